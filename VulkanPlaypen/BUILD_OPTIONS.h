@@ -1,4 +1,6 @@
 #pragma once
 
 #define BUILD_ENABLE_VULKAN_DEBUG          1
-#define BUILD_ENABLE_VUKLAN_RUNTIME_DEBUG  1
\ No newline at end of file
+#define BUILD_ENABLE_VUKLAN_RUNTIME_DEBUG  1
+#define BUILD_ENABLE_HOST_ALLOCATOR        1
+#define BUILD_ENABLE_SIMD                  1
\ No newline at end of file
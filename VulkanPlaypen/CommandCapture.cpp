@@ -0,0 +1,567 @@
+#include "CommandCapture.h"
+#include "Renderer.h"
+#include "RendererUtils.h"
+#include "DeletionQueue.h"
+#include "SubmissionQueue.h"
+
+#include <assert.h>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+static void DeferredDestroyCommandPool( void* user_data, uint64_t handle )
+{
+	static_cast<CommandCapture*>( user_data )->DestroyCommandPool( (VkCommandPool)handle );
+}
+
+static void DeferredDestroyFence( void* user_data, uint64_t handle )
+{
+	static_cast<CommandCapture*>( user_data )->DestroyFence( (VkFence)handle );
+}
+
+static void DeferredDestroySemaphore( void* user_data, uint64_t handle )
+{
+	static_cast<CommandCapture*>( user_data )->DestroySemaphore( (VkSemaphore)handle );
+}
+
+static void DeferredDestroyBuffer( void* user_data, uint64_t handle )
+{
+	static_cast<CommandCapture*>( user_data )->DestroyBuffer( (VkBuffer)handle );
+}
+
+CommandCapture::CommandCapture( Renderer* r )
+{
+	_renderer = r;
+}
+
+
+CommandCapture::~CommandCapture()
+{
+	EndCapture();
+
+	for( auto &i : _buffer_allocations ) {
+		vkDestroyBuffer( _renderer->getDevice(), (VkBuffer)i.first, _renderer->getAllocationCallbacks() );
+		vkFreeMemory( _renderer->getDevice(), i.second.memory, _renderer->getAllocationCallbacks() );
+	}
+	_buffer_allocations.clear();
+}
+
+bool CommandCapture::BeginCapture( const std::string& path )
+{
+	EndCapture();
+
+	if( !_writer.Open( path ) ) {
+		std::cout << "Failed to open capture file " << path << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+void CommandCapture::EndCapture()
+{
+	if( !_writer.IsOpen() ) {
+		return;
+	}
+
+	_writer.Close();
+
+	for( auto &ids : _object_ids ) {
+		ids.clear();
+	}
+}
+
+bool CommandCapture::IsCapturing() const
+{
+	return _writer.IsOpen();
+}
+
+void CommandCapture::EndFrame()
+{
+	if( IsCapturing() ) {
+		_writer.EndFrame();
+	}
+}
+
+VkResult CommandCapture::CreateCommandPool( const VkCommandPoolCreateInfo* create_info, VkCommandPool* command_pool )
+{
+	VkResult result = vkCreateCommandPool( _renderer->getDevice(), create_info, _renderer->getAllocationCallbacks(), command_pool );
+
+	if( IsCapturing() && result == VK_SUCCESS ) {
+		TraceCreateCommandPool* packet = _BeginPacket<TraceCreateCommandPool>( TRACE_PACKET_CREATE_COMMAND_POOL );
+		if( packet != nullptr ) {
+			packet->pool = _AssignId( TRACE_OBJECT_COMMAND_POOL, (uint64_t)*command_pool );
+			packet->flags = create_info->flags;
+		}
+	}
+
+	return result;
+}
+
+void CommandCapture::DestroyCommandPool( VkCommandPool command_pool )
+{
+	if( IsCapturing() ) {
+		TraceDestroyCommandPool* packet = _BeginPacket<TraceDestroyCommandPool>( TRACE_PACKET_DESTROY_COMMAND_POOL );
+		if( packet != nullptr ) {
+			packet->pool = _GetId( TRACE_OBJECT_COMMAND_POOL, (uint64_t)command_pool );
+			_ReleaseId( TRACE_OBJECT_COMMAND_POOL, (uint64_t)command_pool );
+		}
+	}
+
+	vkDestroyCommandPool( _renderer->getDevice(), command_pool, _renderer->getAllocationCallbacks() );
+}
+
+VkResult CommandCapture::ResetCommandPool( VkCommandPool command_pool, VkCommandPoolResetFlags flags )
+{
+	if( IsCapturing() ) {
+		TraceResetCommandPool* packet = _BeginPacket<TraceResetCommandPool>( TRACE_PACKET_RESET_COMMAND_POOL );
+		if( packet != nullptr ) {
+			packet->pool = _GetId( TRACE_OBJECT_COMMAND_POOL, (uint64_t)command_pool );
+			packet->flags = flags;
+		}
+	}
+
+	return vkResetCommandPool( _renderer->getDevice(), command_pool, flags );
+}
+
+VkResult CommandCapture::AllocateCommandBuffers( const VkCommandBufferAllocateInfo* allocate_info, VkCommandBuffer* command_buffers )
+{
+	VkResult result = vkAllocateCommandBuffers( _renderer->getDevice(), allocate_info, command_buffers );
+
+	if( IsCapturing() && result == VK_SUCCESS ) {
+		uint32_t first_id = _writer.AllocateId( TRACE_OBJECT_COMMAND_BUFFER, allocate_info->commandBufferCount );
+		for( uint32_t i = 0; i < allocate_info->commandBufferCount; i++ ) {
+			_object_ids[TRACE_OBJECT_COMMAND_BUFFER][(uint64_t)command_buffers[i]] = first_id + i;
+		}
+
+		TraceAllocateCommandBuffers* packet = _BeginPacket<TraceAllocateCommandBuffers>( TRACE_PACKET_ALLOCATE_COMMAND_BUFFERS );
+		if( packet != nullptr ) {
+			packet->pool = _GetId( TRACE_OBJECT_COMMAND_POOL, (uint64_t)allocate_info->commandPool );
+			packet->level = allocate_info->level;
+			packet->count = allocate_info->commandBufferCount;
+			packet->first_command_buffer = first_id;
+		}
+	}
+
+	return result;
+}
+
+VkResult CommandCapture::BeginCommandBuffer( VkCommandBuffer command_buffer, const VkCommandBufferBeginInfo* begin_info )
+{
+	if( IsCapturing() ) {
+		TraceBeginCommandBuffer* packet = _BeginPacket<TraceBeginCommandBuffer>( TRACE_PACKET_BEGIN_COMMAND_BUFFER );
+		if( packet != nullptr ) {
+			packet->command_buffer = _GetId( TRACE_OBJECT_COMMAND_BUFFER, (uint64_t)command_buffer );
+			packet->flags = begin_info->flags;
+		}
+	}
+
+	return vkBeginCommandBuffer( command_buffer, begin_info );
+}
+
+VkResult CommandCapture::EndCommandBuffer( VkCommandBuffer command_buffer )
+{
+	if( IsCapturing() ) {
+		TraceEndCommandBuffer* packet = _BeginPacket<TraceEndCommandBuffer>( TRACE_PACKET_END_COMMAND_BUFFER );
+		if( packet != nullptr ) {
+			packet->command_buffer = _GetId( TRACE_OBJECT_COMMAND_BUFFER, (uint64_t)command_buffer );
+		}
+	}
+
+	return vkEndCommandBuffer( command_buffer );
+}
+
+VkResult CommandCapture::CreateFence( const VkFenceCreateInfo* create_info, VkFence* fence )
+{
+	VkResult result = vkCreateFence( _renderer->getDevice(), create_info, _renderer->getAllocationCallbacks(), fence );
+
+	if( IsCapturing() && result == VK_SUCCESS ) {
+		TraceCreateFence* packet = _BeginPacket<TraceCreateFence>( TRACE_PACKET_CREATE_FENCE );
+		if( packet != nullptr ) {
+			packet->fence = _AssignId( TRACE_OBJECT_FENCE, (uint64_t)*fence );
+			packet->flags = create_info->flags;
+		}
+	}
+
+	return result;
+}
+
+void CommandCapture::DestroyFence( VkFence fence )
+{
+	if( IsCapturing() ) {
+		TraceDestroyFence* packet = _BeginPacket<TraceDestroyFence>( TRACE_PACKET_DESTROY_FENCE );
+		if( packet != nullptr ) {
+			packet->fence = _GetId( TRACE_OBJECT_FENCE, (uint64_t)fence );
+			_ReleaseId( TRACE_OBJECT_FENCE, (uint64_t)fence );
+		}
+	}
+
+	vkDestroyFence( _renderer->getDevice(), fence, _renderer->getAllocationCallbacks() );
+}
+
+VkResult CommandCapture::ResetFences( uint32_t fence_count, const VkFence* fences )
+{
+	if( IsCapturing() ) {
+		TraceResetFences* packet = _BeginPacket<TraceResetFences>( TRACE_PACKET_RESET_FENCES, uint64_t( fence_count ) * sizeof( uint32_t ) );
+		if( packet != nullptr ) {
+			packet->fence_count = fence_count;
+
+			uint32_t* fence_ids = reinterpret_cast<uint32_t*>( packet + 1 );
+			for( uint32_t i = 0; i < fence_count; i++ ) {
+				fence_ids[i] = _GetId( TRACE_OBJECT_FENCE, (uint64_t)fences[i] );
+			}
+		}
+	}
+
+	return vkResetFences( _renderer->getDevice(), fence_count, fences );
+}
+
+VkResult CommandCapture::WaitForFences( uint32_t fence_count, const VkFence* fences, VkBool32 wait_all, uint64_t timeout )
+{
+	if( IsCapturing() ) {
+		TraceWaitForFences* packet = _BeginPacket<TraceWaitForFences>( TRACE_PACKET_WAIT_FOR_FENCES, uint64_t( fence_count ) * sizeof( uint32_t ) );
+		if( packet != nullptr ) {
+			packet->fence_count = fence_count;
+			packet->wait_all = wait_all;
+			packet->timeout = timeout;
+
+			uint32_t* fence_ids = reinterpret_cast<uint32_t*>( packet + 1 );
+			for( uint32_t i = 0; i < fence_count; i++ ) {
+				fence_ids[i] = _GetId( TRACE_OBJECT_FENCE, (uint64_t)fences[i] );
+			}
+		}
+	}
+
+	return vkWaitForFences( _renderer->getDevice(), fence_count, fences, wait_all, timeout );
+}
+
+VkResult CommandCapture::CreateSemaphore( const VkSemaphoreCreateInfo* create_info, VkSemaphore* semaphore )
+{
+	VkResult result = vkCreateSemaphore( _renderer->getDevice(), create_info, _renderer->getAllocationCallbacks(), semaphore );
+
+	if( IsCapturing() && result == VK_SUCCESS ) {
+		TraceCreateSemaphore* packet = _BeginPacket<TraceCreateSemaphore>( TRACE_PACKET_CREATE_SEMAPHORE );
+		if( packet != nullptr ) {
+			packet->semaphore = _AssignId( TRACE_OBJECT_SEMAPHORE, (uint64_t)*semaphore );
+		}
+	}
+
+	return result;
+}
+
+void CommandCapture::DestroySemaphore( VkSemaphore semaphore )
+{
+	if( IsCapturing() ) {
+		TraceDestroySemaphore* packet = _BeginPacket<TraceDestroySemaphore>( TRACE_PACKET_DESTROY_SEMAPHORE );
+		if( packet != nullptr ) {
+			packet->semaphore = _GetId( TRACE_OBJECT_SEMAPHORE, (uint64_t)semaphore );
+			_ReleaseId( TRACE_OBJECT_SEMAPHORE, (uint64_t)semaphore );
+		}
+	}
+
+	vkDestroySemaphore( _renderer->getDevice(), semaphore, _renderer->getAllocationCallbacks() );
+}
+
+VkResult CommandCapture::CreateBuffer( const VkBufferCreateInfo* create_info, VkMemoryPropertyFlags memory_properties, VkBuffer* buffer )
+{
+	VkResult result = vkCreateBuffer( _renderer->getDevice(), create_info, _renderer->getAllocationCallbacks(), buffer );
+	if( result != VK_SUCCESS ) {
+		return result;
+	}
+
+	BufferAllocation allocation {};
+	allocation.properties = memory_properties;
+
+	result = AllocateBufferMemory( _renderer->getDevice(), _renderer->getAllocationCallbacks(), _renderer->getPhysicalDeviceMemoryProperties(), *buffer, memory_properties, &allocation.memory );
+	if( result != VK_SUCCESS ) {
+		vkDestroyBuffer( _renderer->getDevice(), *buffer, _renderer->getAllocationCallbacks() );
+		*buffer = VK_NULL_HANDLE;
+		return result;
+	}
+
+	_buffer_allocations[(uint64_t)*buffer] = allocation;
+
+	if( IsCapturing() ) {
+		TraceCreateBuffer* packet = _BeginPacket<TraceCreateBuffer>( TRACE_PACKET_CREATE_BUFFER );
+		if( packet != nullptr ) {
+			packet->buffer = _AssignId( TRACE_OBJECT_BUFFER, (uint64_t)*buffer );
+			packet->size = create_info->size;
+			packet->usage = create_info->usage;
+			packet->memory_properties = memory_properties;
+		}
+	}
+
+	return result;
+}
+
+void CommandCapture::DestroyBuffer( VkBuffer buffer )
+{
+	if( IsCapturing() ) {
+		TraceDestroyBuffer* packet = _BeginPacket<TraceDestroyBuffer>( TRACE_PACKET_DESTROY_BUFFER );
+		if( packet != nullptr ) {
+			packet->buffer = _GetId( TRACE_OBJECT_BUFFER, (uint64_t)buffer );
+			_ReleaseId( TRACE_OBJECT_BUFFER, (uint64_t)buffer );
+		}
+	}
+
+	auto allocation = _buffer_allocations.find( (uint64_t)buffer );
+	assert( allocation != _buffer_allocations.end() && "DestroyBuffer called on a buffer not created through CommandCapture" );
+
+	vkDestroyBuffer( _renderer->getDevice(), buffer, _renderer->getAllocationCallbacks() );
+	if( allocation != _buffer_allocations.end() ) {
+		vkFreeMemory( _renderer->getDevice(), allocation->second.memory, _renderer->getAllocationCallbacks() );
+		_buffer_allocations.erase( allocation );
+	}
+}
+
+void CommandCapture::UploadBuffer( VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size, const void* data )
+{
+	auto allocation = _buffer_allocations.find( (uint64_t)buffer );
+	if( allocation == _buffer_allocations.end() || !( allocation->second.properties & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT ) ) {
+		assert( 0 && "UploadBuffer requires a host visible buffer created through CommandCapture" );
+		return;
+	}
+
+	// Flushes of non coherent memory must start on a nonCoherentAtomSize boundary, so map from one
+	VkDeviceSize atom_size = _renderer->getPhysicalDeviceProperties().limits.nonCoherentAtomSize;
+	VkDeviceSize map_offset = offset - offset % atom_size;
+
+	void* mapped = nullptr;
+	vkResultErrorCheck( vkMapMemory( _renderer->getDevice(), allocation->second.memory, map_offset, VK_WHOLE_SIZE, 0, &mapped ) );
+	std::memcpy( static_cast<uint8_t*>( mapped ) + size_t( offset - map_offset ), data, size_t( size ) );
+
+	if( !( allocation->second.properties & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT ) ) {
+		VkMappedMemoryRange range {};
+		range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+		range.memory = allocation->second.memory;
+		range.offset = map_offset;
+		range.size = VK_WHOLE_SIZE;
+		vkFlushMappedMemoryRanges( _renderer->getDevice(), 1, &range );
+	}
+
+	vkUnmapMemory( _renderer->getDevice(), allocation->second.memory );
+
+	if( IsCapturing() ) {
+		TraceUploadBuffer* packet = _BeginPacket<TraceUploadBuffer>( TRACE_PACKET_UPLOAD_BUFFER, size );
+		if( packet != nullptr ) {
+			packet->buffer = _GetId( TRACE_OBJECT_BUFFER, (uint64_t)buffer );
+			packet->offset = offset;
+			packet->size = size;
+			std::memcpy( packet + 1, data, size_t( size ) );
+		}
+	}
+}
+
+void CommandCapture::CmdSetViewport( VkCommandBuffer command_buffer, uint32_t first_viewport, uint32_t viewport_count, const VkViewport* viewports )
+{
+	if( IsCapturing() ) {
+		TraceCmdSetViewport* packet = _BeginPacket<TraceCmdSetViewport>( TRACE_PACKET_CMD_SET_VIEWPORT, uint64_t( viewport_count ) * sizeof( VkViewport ) );
+		if( packet != nullptr ) {
+			packet->command_buffer = _GetId( TRACE_OBJECT_COMMAND_BUFFER, (uint64_t)command_buffer );
+			packet->first_viewport = first_viewport;
+			packet->viewport_count = viewport_count;
+			std::memcpy( packet + 1, viewports, viewport_count * sizeof( VkViewport ) );
+		}
+	}
+
+	vkCmdSetViewport( command_buffer, first_viewport, viewport_count, viewports );
+}
+
+void CommandCapture::CmdPipelineBarrier( VkCommandBuffer command_buffer, VkPipelineStageFlags src_stage, VkPipelineStageFlags dst_stage, VkDependencyFlags dependency_flags,
+	uint32_t memory_barrier_count, const VkMemoryBarrier* memory_barriers,
+	uint32_t buffer_barrier_count, const VkBufferMemoryBarrier* buffer_barriers,
+	uint32_t image_barrier_count, const VkImageMemoryBarrier* image_barriers )
+{
+	if( IsCapturing() ) {
+		// Images aren't part of the trace format yet, so image barriers can't be replayed
+		assert( image_barrier_count == 0 && "Image barriers are not supported by the capture layer" );
+
+		uint64_t extra_size = uint64_t( memory_barrier_count ) * sizeof( TraceMemoryBarrier ) + uint64_t( buffer_barrier_count ) * sizeof( TraceBufferMemoryBarrier );
+		TraceCmdPipelineBarrier* packet = _BeginPacket<TraceCmdPipelineBarrier>( TRACE_PACKET_CMD_PIPELINE_BARRIER, extra_size );
+		if( packet != nullptr ) {
+			packet->command_buffer = _GetId( TRACE_OBJECT_COMMAND_BUFFER, (uint64_t)command_buffer );
+			packet->src_stage = src_stage;
+			packet->dst_stage = dst_stage;
+			packet->dependency_flags = dependency_flags;
+			packet->memory_barrier_count = memory_barrier_count;
+			packet->buffer_barrier_count = buffer_barrier_count;
+
+			TraceMemoryBarrier* trace_memory_barriers = reinterpret_cast<TraceMemoryBarrier*>( packet + 1 );
+			for( uint32_t i = 0; i < memory_barrier_count; i++ ) {
+				trace_memory_barriers[i].src_access = memory_barriers[i].srcAccessMask;
+				trace_memory_barriers[i].dst_access = memory_barriers[i].dstAccessMask;
+			}
+
+			TraceBufferMemoryBarrier* trace_buffer_barriers = reinterpret_cast<TraceBufferMemoryBarrier*>( trace_memory_barriers + memory_barrier_count );
+			for( uint32_t i = 0; i < buffer_barrier_count; i++ ) {
+				trace_buffer_barriers[i].src_access = buffer_barriers[i].srcAccessMask;
+				trace_buffer_barriers[i].dst_access = buffer_barriers[i].dstAccessMask;
+				trace_buffer_barriers[i].src_queue_family = buffer_barriers[i].srcQueueFamilyIndex;
+				trace_buffer_barriers[i].dst_queue_family = buffer_barriers[i].dstQueueFamilyIndex;
+				trace_buffer_barriers[i].buffer = _GetId( TRACE_OBJECT_BUFFER, (uint64_t)buffer_barriers[i].buffer );
+				trace_buffer_barriers[i].offset = buffer_barriers[i].offset;
+				trace_buffer_barriers[i].size = buffer_barriers[i].size;
+			}
+		}
+	}
+
+	vkCmdPipelineBarrier( command_buffer, src_stage, dst_stage, dependency_flags, memory_barrier_count, memory_barriers, buffer_barrier_count, buffer_barriers, image_barrier_count, image_barriers );
+}
+
+void CommandCapture::CmdCopyBuffer( VkCommandBuffer command_buffer, VkBuffer src_buffer, VkBuffer dst_buffer, uint32_t region_count, const VkBufferCopy* regions )
+{
+	if( IsCapturing() ) {
+		TraceCmdCopyBuffer* packet = _BeginPacket<TraceCmdCopyBuffer>( TRACE_PACKET_CMD_COPY_BUFFER, uint64_t( region_count ) * sizeof( VkBufferCopy ) );
+		if( packet != nullptr ) {
+			packet->command_buffer = _GetId( TRACE_OBJECT_COMMAND_BUFFER, (uint64_t)command_buffer );
+			packet->src_buffer = _GetId( TRACE_OBJECT_BUFFER, (uint64_t)src_buffer );
+			packet->dst_buffer = _GetId( TRACE_OBJECT_BUFFER, (uint64_t)dst_buffer );
+			packet->region_count = region_count;
+			std::memcpy( packet + 1, regions, region_count * sizeof( VkBufferCopy ) );
+		}
+	}
+
+	vkCmdCopyBuffer( command_buffer, src_buffer, dst_buffer, region_count, regions );
+}
+
+void CommandCapture::CmdFillBuffer( VkCommandBuffer command_buffer, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size, uint32_t data )
+{
+	if( IsCapturing() ) {
+		TraceCmdFillBuffer* packet = _BeginPacket<TraceCmdFillBuffer>( TRACE_PACKET_CMD_FILL_BUFFER );
+		if( packet != nullptr ) {
+			packet->command_buffer = _GetId( TRACE_OBJECT_COMMAND_BUFFER, (uint64_t)command_buffer );
+			packet->buffer = _GetId( TRACE_OBJECT_BUFFER, (uint64_t)buffer );
+			packet->offset = offset;
+			packet->size = size;
+			packet->data = data;
+		}
+	}
+
+	vkCmdFillBuffer( command_buffer, buffer, offset, size, data );
+}
+
+VkResult CommandCapture::QueueSubmit( uint32_t submit_count, const VkSubmitInfo* submits, VkFence fence )
+{
+	if( IsCapturing() ) {
+		uint64_t extra_size = 0;
+		for( uint32_t i = 0; i < submit_count; i++ ) {
+			extra_size += sizeof( TraceSubmitInfo );
+			extra_size += ( uint64_t( submits[i].waitSemaphoreCount ) * 2 + submits[i].commandBufferCount + submits[i].signalSemaphoreCount ) * sizeof( uint32_t );
+		}
+
+		TraceQueueSubmit* packet = _BeginPacket<TraceQueueSubmit>( TRACE_PACKET_QUEUE_SUBMIT, extra_size );
+		if( packet != nullptr ) {
+			packet->fence = fence != VK_NULL_HANDLE ? _GetId( TRACE_OBJECT_FENCE, (uint64_t)fence ) : TRACE_NULL_ID;
+			packet->submit_count = submit_count;
+
+			uint8_t* write = reinterpret_cast<uint8_t*>( packet + 1 );
+			for( uint32_t i = 0; i < submit_count; i++ ) {
+				TraceSubmitInfo* submit_info = reinterpret_cast<TraceSubmitInfo*>( write );
+				submit_info->wait_semaphore_count = submits[i].waitSemaphoreCount;
+				submit_info->command_buffer_count = submits[i].commandBufferCount;
+				submit_info->signal_semaphore_count = submits[i].signalSemaphoreCount;
+
+				uint32_t* ids = reinterpret_cast<uint32_t*>( submit_info + 1 );
+				for( uint32_t j = 0; j < submits[i].waitSemaphoreCount; j++ ) {
+					*ids++ = _GetId( TRACE_OBJECT_SEMAPHORE, (uint64_t)submits[i].pWaitSemaphores[j] );
+				}
+				for( uint32_t j = 0; j < submits[i].waitSemaphoreCount; j++ ) {
+					*ids++ = submits[i].pWaitDstStageMask[j];
+				}
+				for( uint32_t j = 0; j < submits[i].commandBufferCount; j++ ) {
+					*ids++ = _GetId( TRACE_OBJECT_COMMAND_BUFFER, (uint64_t)submits[i].pCommandBuffers[j] );
+				}
+				for( uint32_t j = 0; j < submits[i].signalSemaphoreCount; j++ ) {
+					*ids++ = _GetId( TRACE_OBJECT_SEMAPHORE, (uint64_t)submits[i].pSignalSemaphores[j] );
+				}
+
+				write = reinterpret_cast<uint8_t*>( ids );
+			}
+		}
+	}
+
+	_renderer->getSubmissionQueue()->Submit( submit_count, submits, fence );
+	return VK_SUCCESS;
+}
+
+VkResult CommandCapture::QueueWaitIdle()
+{
+	if( IsCapturing() ) {
+		_BeginPacket<uint32_t>( TRACE_PACKET_QUEUE_WAIT_IDLE );
+	}
+
+	return _renderer->getSubmissionQueue()->WaitIdle();
+}
+
+VkResult CommandCapture::DeviceWaitIdle()
+{
+	if( IsCapturing() ) {
+		_BeginPacket<uint32_t>( TRACE_PACKET_DEVICE_WAIT_IDLE );
+	}
+
+	// The device has one queue, and vkDeviceWaitIdle() would need it externally synchronized
+	return _renderer->getSubmissionQueue()->WaitIdle();
+}
+
+void CommandCapture::DeferDestroyCommandPool( VkCommandPool command_pool )
+{
+	_renderer->getDeletionQueue()->Defer( DeferredDestroyCommandPool, this, (uint64_t)command_pool );
+}
+
+void CommandCapture::DeferDestroyFence( VkFence fence )
+{
+	_renderer->getDeletionQueue()->Defer( DeferredDestroyFence, this, (uint64_t)fence );
+}
+
+void CommandCapture::DeferDestroySemaphore( VkSemaphore semaphore )
+{
+	_renderer->getDeletionQueue()->Defer( DeferredDestroySemaphore, this, (uint64_t)semaphore );
+}
+
+void CommandCapture::DeferDestroyBuffer( VkBuffer buffer )
+{
+	_renderer->getDeletionQueue()->Defer( DeferredDestroyBuffer, this, (uint64_t)buffer );
+}
+
+uint32_t CommandCapture::_AssignId( TraceObjectType type, uint64_t handle )
+{
+	uint32_t id = _writer.AllocateId( type );
+	_object_ids[type][handle] = id;
+	return id;
+}
+
+uint32_t CommandCapture::_GetId( TraceObjectType type, uint64_t handle ) const
+{
+	auto id = _object_ids[type].find( handle );
+	if( id == _object_ids[type].end() ) {
+		assert( 0 && "Object used in a capture was created before the capture started" );
+		return TRACE_NULL_ID;
+	}
+
+	return id->second;
+}
+
+void CommandCapture::_ReleaseId( TraceObjectType type, uint64_t handle )
+{
+	_object_ids[type].erase( handle );
+}
+
+template<typename T>
+T* CommandCapture::_BeginPacket( TracePacketType type, uint64_t extra_size )
+{
+	// Packet sizes are stored as uint32, leaving room for the payload to be padded to 8 bytes
+	if( extra_size > UINT32_MAX - 7 - sizeof( T ) ) {
+		std::cout << "Call too large for the trace format, capture ended" << std::endl;
+		EndCapture();
+		return nullptr;
+	}
+
+	void* payload = _writer.BeginPacket( type, uint32_t( sizeof( T ) + extra_size ) );
+	if( payload == nullptr ) {
+		std::cout << "Capture file could not grow, capture ended" << std::endl;
+		EndCapture();
+		return nullptr;
+	}
+
+	return reinterpret_cast<T*>( payload );
+}
\ No newline at end of file
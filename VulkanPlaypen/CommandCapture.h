@@ -0,0 +1,91 @@
+#pragma once
+
+#include "Platform.h"
+#include "CommandTrace.h"
+
+#include <string>
+#include <unordered_map>
+
+class Renderer;
+
+// Capture layer around the renderer's submission path. Every call is forwarded to Vulkan on the renderer's
+// device/queue, and while a capture is active it's also serialized into a CommandTraceWriter so the exact same
+// workload can be replayed later with CommandReplay.
+//
+// Objects only get trace ids while capturing, so a capture must be started before the objects it uses are created.
+class CommandCapture
+{
+public:
+	CommandCapture( Renderer* r );
+	~CommandCapture();
+
+	bool BeginCapture( const std::string& path );
+	void EndCapture();
+	bool IsCapturing() const;
+
+	void EndFrame();
+
+	VkResult CreateCommandPool( const VkCommandPoolCreateInfo* create_info, VkCommandPool* command_pool );
+	void DestroyCommandPool( VkCommandPool command_pool );
+	VkResult ResetCommandPool( VkCommandPool command_pool, VkCommandPoolResetFlags flags );
+
+	VkResult AllocateCommandBuffers( const VkCommandBufferAllocateInfo* allocate_info, VkCommandBuffer* command_buffers );
+	VkResult BeginCommandBuffer( VkCommandBuffer command_buffer, const VkCommandBufferBeginInfo* begin_info );
+	VkResult EndCommandBuffer( VkCommandBuffer command_buffer );
+
+	VkResult CreateFence( const VkFenceCreateInfo* create_info, VkFence* fence );
+	void DestroyFence( VkFence fence );
+	VkResult ResetFences( uint32_t fence_count, const VkFence* fences );
+	VkResult WaitForFences( uint32_t fence_count, const VkFence* fences, VkBool32 wait_all, uint64_t timeout );
+
+	VkResult CreateSemaphore( const VkSemaphoreCreateInfo* create_info, VkSemaphore* semaphore );
+	void DestroySemaphore( VkSemaphore semaphore );
+
+	// Buffers own their memory, allocated from a memory type with the given property flags
+	VkResult CreateBuffer( const VkBufferCreateInfo* create_info, VkMemoryPropertyFlags memory_properties, VkBuffer* buffer );
+	void DestroyBuffer( VkBuffer buffer );
+	// The buffer must have been created with VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
+	void UploadBuffer( VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size, const void* data );
+
+	void CmdSetViewport( VkCommandBuffer command_buffer, uint32_t first_viewport, uint32_t viewport_count, const VkViewport* viewports );
+	void CmdPipelineBarrier( VkCommandBuffer command_buffer, VkPipelineStageFlags src_stage, VkPipelineStageFlags dst_stage, VkDependencyFlags dependency_flags,
+		uint32_t memory_barrier_count, const VkMemoryBarrier* memory_barriers,
+		uint32_t buffer_barrier_count, const VkBufferMemoryBarrier* buffer_barriers,
+		uint32_t image_barrier_count, const VkImageMemoryBarrier* image_barriers );
+	void CmdCopyBuffer( VkCommandBuffer command_buffer, VkBuffer src_buffer, VkBuffer dst_buffer, uint32_t region_count, const VkBufferCopy* regions );
+	void CmdFillBuffer( VkCommandBuffer command_buffer, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size, uint32_t data );
+
+	// Through the renderer's submission queue, which treats submit errors as fatal
+	VkResult QueueSubmit( uint32_t submit_count, const VkSubmitInfo* submits, VkFence fence );
+	VkResult QueueWaitIdle();
+	VkResult DeviceWaitIdle();
+
+	// Destruction through the renderer's DeletionQueue, once the GPU is past the current frame. The destroy is
+	// recorded when it actually executes
+	void DeferDestroyCommandPool( VkCommandPool command_pool );
+	void DeferDestroyFence( VkFence fence );
+	void DeferDestroySemaphore( VkSemaphore semaphore );
+	void DeferDestroyBuffer( VkBuffer buffer );
+
+private:
+	struct BufferAllocation
+	{
+		VkDeviceMemory memory;
+		VkMemoryPropertyFlags properties;
+	};
+
+	uint32_t _AssignId( TraceObjectType type, uint64_t handle );
+	uint32_t _GetId( TraceObjectType type, uint64_t handle ) const;
+	void _ReleaseId( TraceObjectType type, uint64_t handle );
+
+	// Ends the capture and returns nullptr if the packet can't be written, callers then skip it
+	template<typename T>
+	T* _BeginPacket( TracePacketType type, uint64_t extra_size = 0 );
+
+	Renderer* _renderer = nullptr;
+
+	CommandTraceWriter _writer;
+
+	std::unordered_map<uint64_t, uint32_t> _object_ids[TRACE_OBJECT_TYPE_COUNT];
+	std::unordered_map<uint64_t, BufferAllocation> _buffer_allocations;
+};
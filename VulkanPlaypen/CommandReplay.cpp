@@ -0,0 +1,769 @@
+#include "CommandReplay.h"
+#include "Renderer.h"
+#include "RendererUtils.h"
+#include "DeletionQueue.h"
+#include "SubmissionQueue.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+CommandReplay::CommandReplay( Renderer* r )
+{
+	_renderer = r;
+}
+
+
+CommandReplay::~CommandReplay()
+{
+	_reader.Close();
+}
+
+bool CommandReplay::Load( const std::string& path )
+{
+	if( !_reader.Open( path ) ) {
+		std::cout << "Failed to open trace " << path << " (missing, corrupt or wrong version)" << std::endl;
+		return false;
+	}
+
+	const TraceFileHeader& header = _reader.getHeader();
+	std::cout << "Loaded trace " << path << ": " << header.frame_count << " frame(s), " << header.packet_count << " packet(s), " << header.stream_size << " bytes" << std::endl;
+
+	return true;
+}
+
+bool CommandReplay::Run( uint32_t loop_count )
+{
+	const TraceFileHeader& header = _reader.getHeader();
+	if( header.magic != TRACE_FILE_MAGIC ) {
+		return false;
+	}
+
+	_InitTiming();
+
+	_frame_timings.clear();
+	_frame_timings.reserve( size_t( header.frame_count ) * loop_count );
+
+	bool success = true;
+
+	for( uint32_t loop = 0; loop < loop_count && success; loop++ ) {
+		_reader.Rewind();
+
+		_command_pools.assign( header.object_count[TRACE_OBJECT_COMMAND_POOL], VK_NULL_HANDLE );
+		_command_buffers.assign( header.object_count[TRACE_OBJECT_COMMAND_BUFFER], VK_NULL_HANDLE );
+		_fences.assign( header.object_count[TRACE_OBJECT_FENCE], VK_NULL_HANDLE );
+		_semaphores.assign( header.object_count[TRACE_OBJECT_SEMAPHORE], VK_NULL_HANDLE );
+		_buffers.assign( header.object_count[TRACE_OBJECT_BUFFER], VK_NULL_HANDLE );
+		_buffer_memory.assign( header.object_count[TRACE_OBJECT_BUFFER], VK_NULL_HANDLE );
+		_buffer_memory_properties.assign( header.object_count[TRACE_OBJECT_BUFFER], 0 );
+
+		TracePacket packet;
+		while( _reader.Next( packet ) ) {
+			if( !_frame_open ) {
+				_BeginFrame();
+			}
+
+			if( packet.type == TRACE_PACKET_END_FRAME ) {
+				_EndFrame();
+				continue;
+			}
+
+			if( !_Execute( packet ) ) {
+				std::cout << "Replay failed on packet type " << packet.type << " in frame " << _frame_index << std::endl;
+				success = false;
+				break;
+			}
+		}
+
+		// Commands left after the last frame marker still count as a (partial) frame
+		if( _frame_open ) {
+			_EndFrame();
+		}
+
+		// Anything the trace didn't clean up itself is released between loops, outside of the timed frames
+		_renderer->getSubmissionQueue()->WaitIdle();
+		_DestroyObjects();
+	}
+
+	for( uint32_t i = 0; i < FRAME_LATENCY; i++ ) {
+		_CollectSlot( _timing_slots[i], i );
+	}
+
+	_DeInitTiming();
+
+	return success;
+}
+
+const std::vector<ReplayFrameTiming>& CommandReplay::getFrameTimings() const
+{
+	return _frame_timings;
+}
+
+void CommandReplay::PrintReport() const
+{
+	std::vector<double> cpu_times;
+	std::vector<double> gpu_times;
+	cpu_times.reserve( _frame_timings.size() );
+	gpu_times.reserve( _frame_timings.size() );
+
+	double cpu_total = 0.0;
+	for( auto &i : _frame_timings ) {
+		cpu_times.push_back( i.cpu_ms );
+		cpu_total += i.cpu_ms;
+		if( i.gpu_ms >= 0.0 ) {
+			gpu_times.push_back( i.gpu_ms );
+		}
+	}
+	std::sort( cpu_times.begin(), cpu_times.end() );
+	std::sort( gpu_times.begin(), gpu_times.end() );
+
+	std::cout << "Replayed " << _frame_timings.size() << " frame(s) in " << std::fixed << std::setprecision( 3 ) << cpu_total << " ms CPU" << std::endl;
+	std::cout << "         " << std::setw( 10 ) << "min" << std::setw( 10 ) << "p50" << std::setw( 10 ) << "p95" << std::setw( 10 ) << "p99" << std::setw( 10 ) << "max" << std::endl;
+	std::cout << " CPU ms  " << std::setw( 10 ) << Percentile( cpu_times, 0.0 ) << std::setw( 10 ) << Percentile( cpu_times, 0.5 ) << std::setw( 10 ) << Percentile( cpu_times, 0.95 )
+		<< std::setw( 10 ) << Percentile( cpu_times, 0.99 ) << std::setw( 10 ) << Percentile( cpu_times, 1.0 ) << std::endl;
+
+	if( !gpu_times.empty() ) {
+		std::cout << " GPU ms  " << std::setw( 10 ) << Percentile( gpu_times, 0.0 ) << std::setw( 10 ) << Percentile( gpu_times, 0.5 ) << std::setw( 10 ) << Percentile( gpu_times, 0.95 )
+			<< std::setw( 10 ) << Percentile( gpu_times, 0.99 ) << std::setw( 10 ) << Percentile( gpu_times, 1.0 ) << std::endl;
+	}
+	else {
+		std::cout << " GPU ms  timestamps not supported on this queue" << std::endl;
+	}
+}
+
+bool CommandReplay::WriteCsv( const std::string& path ) const
+{
+	std::ofstream csv( path );
+	if( !csv ) {
+		return false;
+	}
+
+	csv << "frame,cpu_ms,gpu_ms\n";
+	csv << std::fixed << std::setprecision( 6 );
+	for( auto &i : _frame_timings ) {
+		csv << i.frame << "," << i.cpu_ms << "," << i.gpu_ms << "\n";
+	}
+
+	return bool( csv );
+}
+
+void CommandReplay::_InitTiming()
+{
+	VkDevice device = _renderer->getDevice();
+
+	// Timestamps are only valid if the queue family reports some valid bits
+	{
+		uint32_t family_count = 0;
+		vkGetPhysicalDeviceQueueFamilyProperties( _renderer->getPhysicalDevice(), &family_count, nullptr );
+		std::vector<VkQueueFamilyProperties> family_property_list( family_count );
+		vkGetPhysicalDeviceQueueFamilyProperties( _renderer->getPhysicalDevice(), &family_count, family_property_list.data() );
+
+		_timestamps_supported = family_property_list[_renderer->getGraphicsFamilyIndex()].timestampValidBits > 0;
+	}
+
+	VkCommandPoolCreateInfo pool_info {};
+	pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	pool_info.queueFamilyIndex = _renderer->getGraphicsFamilyIndex();
+	vkResultErrorCheck( vkCreateCommandPool( device, &pool_info, _renderer->getAllocationCallbacks(), &_timing_command_pool ) );
+
+	if( _timestamps_supported ) {
+		VkQueryPoolCreateInfo query_pool_info {};
+		query_pool_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		query_pool_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+		query_pool_info.queryCount = FRAME_LATENCY * 2;
+		vkResultErrorCheck( vkCreateQueryPool( device, &query_pool_info, _renderer->getAllocationCallbacks(), &_timing_query_pool ) );
+	}
+
+	for( uint32_t i = 0; i < FRAME_LATENCY; i++ ) {
+		TimingSlot& slot = _timing_slots[i];
+		slot = TimingSlot();
+
+		VkFenceCreateInfo fence_info {};
+		fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+		vkResultErrorCheck( vkCreateFence( device, &fence_info, _renderer->getAllocationCallbacks(), &slot.fence ) );
+
+		if( !_timestamps_supported ) {
+			continue;
+		}
+
+		VkCommandBuffer command_buffers[2];
+		VkCommandBufferAllocateInfo command_buffer_info {};
+		command_buffer_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		command_buffer_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		command_buffer_info.commandPool = _timing_command_pool;
+		command_buffer_info.commandBufferCount = 2;
+		vkResultErrorCheck( vkAllocateCommandBuffers( device, &command_buffer_info, command_buffers ) );
+
+		slot.begin_command_buffer = command_buffers[0];
+		slot.end_command_buffer = command_buffers[1];
+
+		VkCommandBufferBeginInfo begin_info {};
+		begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+
+		vkBeginCommandBuffer( slot.begin_command_buffer, &begin_info );
+		vkCmdResetQueryPool( slot.begin_command_buffer, _timing_query_pool, i * 2, 2 );
+		vkCmdWriteTimestamp( slot.begin_command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, _timing_query_pool, i * 2 );
+		vkEndCommandBuffer( slot.begin_command_buffer );
+
+		vkBeginCommandBuffer( slot.end_command_buffer, &begin_info );
+		vkCmdWriteTimestamp( slot.end_command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, _timing_query_pool, i * 2 + 1 );
+		vkEndCommandBuffer( slot.end_command_buffer );
+	}
+
+	_frame_open = false;
+	_frame_index = 0;
+}
+
+void CommandReplay::_DeInitTiming()
+{
+	VkDevice device = _renderer->getDevice();
+
+	for( auto &slot : _timing_slots ) {
+		vkDestroyFence( device, slot.fence, _renderer->getAllocationCallbacks() );
+		slot = TimingSlot();
+	}
+
+	vkDestroyCommandPool( device, _timing_command_pool, _renderer->getAllocationCallbacks() );
+	_timing_command_pool = VK_NULL_HANDLE;
+
+	if( _timing_query_pool != VK_NULL_HANDLE ) {
+		vkDestroyQueryPool( device, _timing_query_pool, _renderer->getAllocationCallbacks() );
+		_timing_query_pool = VK_NULL_HANDLE;
+	}
+}
+
+void CommandReplay::_BeginFrame()
+{
+	uint32_t slot_index = _frame_index % FRAME_LATENCY;
+	TimingSlot& slot = _timing_slots[slot_index];
+
+	// Reusing a slot throttles the replay to FRAME_LATENCY frames ahead of the GPU
+	_CollectSlot( slot, slot_index );
+	vkResetFences( _renderer->getDevice(), 1, &slot.fence );
+
+	ReplayFrameTiming timing {};
+	timing.frame = _frame_index;
+	timing.gpu_ms = -1.0;
+	_frame_timings.push_back( timing );
+	slot.timing_index = _frame_timings.size() - 1;
+
+	_frame_cpu_start = std::chrono::high_resolution_clock::now();
+
+	if( _timestamps_supported ) {
+		VkSubmitInfo submit_info {};
+		submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submit_info.commandBufferCount = 1;
+		submit_info.pCommandBuffers = &slot.begin_command_buffer;
+		_renderer->getSubmissionQueue()->Submit( 1, &submit_info );
+	}
+
+	_frame_open = true;
+}
+
+void CommandReplay::_EndFrame()
+{
+	TimingSlot& slot = _timing_slots[_frame_index % FRAME_LATENCY];
+
+	if( _timestamps_supported ) {
+		VkSubmitInfo submit_info {};
+		submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submit_info.commandBufferCount = 1;
+		submit_info.pCommandBuffers = &slot.end_command_buffer;
+		_renderer->getSubmissionQueue()->Submit( 1, &submit_info, slot.fence );
+	}
+	else {
+		_renderer->getSubmissionQueue()->Submit( 0, nullptr, slot.fence );
+	}
+
+	_renderer->getDeletionQueue()->EndFrame();
+
+	auto cpu_end = std::chrono::high_resolution_clock::now();
+	_frame_timings[slot.timing_index].cpu_ms = std::chrono::duration<double, std::milli>( cpu_end - _frame_cpu_start ).count();
+
+	slot.pending = true;
+	_frame_open = false;
+	_frame_index++;
+}
+
+void CommandReplay::_CollectSlot( TimingSlot& slot, uint32_t slot_index )
+{
+	if( !slot.pending ) {
+		return;
+	}
+
+	vkWaitForFences( _renderer->getDevice(), 1, &slot.fence, VK_TRUE, UINT64_MAX );
+	slot.pending = false;
+
+	if( !_timestamps_supported ) {
+		return;
+	}
+
+	uint64_t timestamps[2] {};
+	vkResultErrorCheck( vkGetQueryPoolResults( _renderer->getDevice(), _timing_query_pool, slot_index * 2, 2, sizeof( timestamps ), timestamps, sizeof( uint64_t ), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT ) );
+
+	double period_ns = _renderer->getPhysicalDeviceProperties().limits.timestampPeriod;
+	_frame_timings[slot.timing_index].gpu_ms = double( timestamps[1] - timestamps[0] ) * period_ns / 1000000.0;
+}
+
+// True if the payload holds header_size bytes followed by extra_size more. Written so corrupt counts can't overflow
+static bool PayloadFits( const TracePacket& packet, uint64_t header_size, uint64_t extra_size = 0 )
+{
+	return header_size <= packet.size && extra_size <= packet.size - header_size;
+}
+
+// The payload as T, or nullptr if the packet is too small to hold one
+template<typename T>
+static const T* PayloadAs( const TracePacket& packet )
+{
+	return PayloadFits( packet, sizeof( T ) ) ? reinterpret_cast<const T*>( packet.payload ) : nullptr;
+}
+
+// Ids come from the trace too, so every lookup goes through these instead of indexing or at() throwing
+template<typename T>
+static bool IdInRange( const std::vector<T>& objects, uint32_t id )
+{
+	return id < objects.size();
+}
+
+// True if id names an object that currently exists
+template<typename T>
+static bool IsLive( const std::vector<T>& objects, uint32_t id )
+{
+	return id < objects.size() && objects[id] != VK_NULL_HANDLE;
+}
+
+bool CommandReplay::_Execute( const TracePacket& packet )
+{
+	VkDevice device = _renderer->getDevice();
+
+	switch( packet.type ) {
+		case TRACE_PACKET_CREATE_COMMAND_POOL:
+		{
+			auto p = PayloadAs<TraceCreateCommandPool>( packet );
+			if( p == nullptr || !IdInRange( _command_pools, p->pool ) || IsLive( _command_pools, p->pool ) ) {
+				return false;
+			}
+
+			VkCommandPoolCreateInfo pool_info {};
+			pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+			pool_info.queueFamilyIndex = _renderer->getGraphicsFamilyIndex();
+			pool_info.flags = p->flags;
+			return vkCreateCommandPool( device, &pool_info, _renderer->getAllocationCallbacks(), &_command_pools[p->pool] ) == VK_SUCCESS;
+		}
+		case TRACE_PACKET_DESTROY_COMMAND_POOL:
+		{
+			auto p = PayloadAs<TraceDestroyCommandPool>( packet );
+			if( p == nullptr || !IsLive( _command_pools, p->pool ) ) {
+				return false;
+			}
+			_renderer->getDeletionQueue()->DestroyCommandPool( _command_pools[p->pool] );
+			_command_pools[p->pool] = VK_NULL_HANDLE;
+			return true;
+		}
+		case TRACE_PACKET_RESET_COMMAND_POOL:
+		{
+			auto p = PayloadAs<TraceResetCommandPool>( packet );
+			if( p == nullptr || !IsLive( _command_pools, p->pool ) ) {
+				return false;
+			}
+			return vkResetCommandPool( device, _command_pools[p->pool], p->flags ) == VK_SUCCESS;
+		}
+		case TRACE_PACKET_ALLOCATE_COMMAND_BUFFERS:
+		{
+			auto p = PayloadAs<TraceAllocateCommandBuffers>( packet );
+			if( p == nullptr || !IsLive( _command_pools, p->pool ) ) {
+				return false;
+			}
+			if( size_t( p->first_command_buffer ) + p->count > _command_buffers.size() ) {
+				return false;
+			}
+
+			VkCommandBufferAllocateInfo command_buffer_info {};
+			command_buffer_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+			command_buffer_info.level = VkCommandBufferLevel( p->level );
+			command_buffer_info.commandPool = _command_pools[p->pool];
+			command_buffer_info.commandBufferCount = p->count;
+			return vkAllocateCommandBuffers( device, &command_buffer_info, &_command_buffers[p->first_command_buffer] ) == VK_SUCCESS;
+		}
+		case TRACE_PACKET_BEGIN_COMMAND_BUFFER:
+		{
+			auto p = PayloadAs<TraceBeginCommandBuffer>( packet );
+			if( p == nullptr || !IsLive( _command_buffers, p->command_buffer ) ) {
+				return false;
+			}
+
+			VkCommandBufferBeginInfo begin_info {};
+			begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+			begin_info.flags = p->flags;
+			return vkBeginCommandBuffer( _command_buffers[p->command_buffer], &begin_info ) == VK_SUCCESS;
+		}
+		case TRACE_PACKET_END_COMMAND_BUFFER:
+		{
+			auto p = PayloadAs<TraceEndCommandBuffer>( packet );
+			if( p == nullptr || !IsLive( _command_buffers, p->command_buffer ) ) {
+				return false;
+			}
+			return vkEndCommandBuffer( _command_buffers[p->command_buffer] ) == VK_SUCCESS;
+		}
+		case TRACE_PACKET_CREATE_FENCE:
+		{
+			auto p = PayloadAs<TraceCreateFence>( packet );
+			if( p == nullptr || !IdInRange( _fences, p->fence ) || IsLive( _fences, p->fence ) ) {
+				return false;
+			}
+
+			VkFenceCreateInfo fence_info {};
+			fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+			fence_info.flags = p->flags;
+			return vkCreateFence( device, &fence_info, _renderer->getAllocationCallbacks(), &_fences[p->fence] ) == VK_SUCCESS;
+		}
+		case TRACE_PACKET_DESTROY_FENCE:
+		{
+			auto p = PayloadAs<TraceDestroyFence>( packet );
+			if( p == nullptr || !IsLive( _fences, p->fence ) ) {
+				return false;
+			}
+			_renderer->getDeletionQueue()->DestroyFence( _fences[p->fence] );
+			_fences[p->fence] = VK_NULL_HANDLE;
+			return true;
+		}
+		case TRACE_PACKET_RESET_FENCES:
+		case TRACE_PACKET_WAIT_FOR_FENCES:
+		{
+			uint32_t fence_count = 0;
+			const uint32_t* fence_ids = nullptr;
+			size_t header_size = 0;
+
+			if( packet.type == TRACE_PACKET_RESET_FENCES ) {
+				auto p = PayloadAs<TraceResetFences>( packet );
+				if( p == nullptr ) {
+					return false;
+				}
+				fence_count = p->fence_count;
+				fence_ids = reinterpret_cast<const uint32_t*>( p + 1 );
+				header_size = sizeof( *p );
+			}
+			else {
+				auto p = PayloadAs<TraceWaitForFences>( packet );
+				if( p == nullptr ) {
+					return false;
+				}
+				fence_count = p->fence_count;
+				fence_ids = reinterpret_cast<const uint32_t*>( p + 1 );
+				header_size = sizeof( *p );
+			}
+
+			if( !PayloadFits( packet, header_size, uint64_t( fence_count ) * sizeof( uint32_t ) ) ) {
+				return false;
+			}
+
+			_scratch_fences.resize( fence_count );
+			for( uint32_t i = 0; i < fence_count; i++ ) {
+				if( !IsLive( _fences, fence_ids[i] ) ) {
+					return false;
+				}
+				_scratch_fences[i] = _fences[fence_ids[i]];
+			}
+
+			if( packet.type == TRACE_PACKET_RESET_FENCES ) {
+				return vkResetFences( device, fence_count, _scratch_fences.data() ) == VK_SUCCESS;
+			}
+
+			// Size checked above
+			auto p = reinterpret_cast<const TraceWaitForFences*>( packet.payload );
+			return vkWaitForFences( device, fence_count, _scratch_fences.data(), p->wait_all, p->timeout ) >= 0;
+		}
+		case TRACE_PACKET_CREATE_SEMAPHORE:
+		{
+			auto p = PayloadAs<TraceCreateSemaphore>( packet );
+			if( p == nullptr || !IdInRange( _semaphores, p->semaphore ) || IsLive( _semaphores, p->semaphore ) ) {
+				return false;
+			}
+
+			VkSemaphoreCreateInfo semaphore_info {};
+			semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+			return vkCreateSemaphore( device, &semaphore_info, _renderer->getAllocationCallbacks(), &_semaphores[p->semaphore] ) == VK_SUCCESS;
+		}
+		case TRACE_PACKET_DESTROY_SEMAPHORE:
+		{
+			auto p = PayloadAs<TraceDestroySemaphore>( packet );
+			if( p == nullptr || !IsLive( _semaphores, p->semaphore ) ) {
+				return false;
+			}
+			_renderer->getDeletionQueue()->DestroySemaphore( _semaphores[p->semaphore] );
+			_semaphores[p->semaphore] = VK_NULL_HANDLE;
+			return true;
+		}
+		case TRACE_PACKET_CREATE_BUFFER:
+		{
+			auto p = PayloadAs<TraceCreateBuffer>( packet );
+			if( p == nullptr || !IdInRange( _buffers, p->buffer ) || IsLive( _buffers, p->buffer ) ) {
+				return false;
+			}
+
+			VkBufferCreateInfo buffer_info {};
+			buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+			buffer_info.size = p->size;
+			buffer_info.usage = p->usage;
+			buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+			if( vkCreateBuffer( device, &buffer_info, _renderer->getAllocationCallbacks(), &_buffers[p->buffer] ) != VK_SUCCESS ) {
+				return false;
+			}
+
+			_buffer_memory_properties[p->buffer] = p->memory_properties;
+			return AllocateBufferMemory( device, _renderer->getAllocationCallbacks(), _renderer->getPhysicalDeviceMemoryProperties(), _buffers[p->buffer], p->memory_properties, &_buffer_memory[p->buffer] ) == VK_SUCCESS;
+		}
+		case TRACE_PACKET_DESTROY_BUFFER:
+		{
+			auto p = PayloadAs<TraceDestroyBuffer>( packet );
+			if( p == nullptr || !IsLive( _buffers, p->buffer ) ) {
+				return false;
+			}
+			_renderer->getDeletionQueue()->DestroyBuffer( _buffers[p->buffer] );
+			_renderer->getDeletionQueue()->FreeMemory( _buffer_memory[p->buffer] );
+			_buffers[p->buffer] = VK_NULL_HANDLE;
+			_buffer_memory[p->buffer] = VK_NULL_HANDLE;
+			return true;
+		}
+		case TRACE_PACKET_UPLOAD_BUFFER:
+		{
+			auto p = PayloadAs<TraceUploadBuffer>( packet );
+			if( p == nullptr || !PayloadFits( packet, sizeof( *p ), p->size ) || !IsLive( _buffers, p->buffer ) ) {
+				return false;
+			}
+			VkDeviceMemory memory = _buffer_memory[p->buffer];
+
+			// Flushes of non coherent memory must start on a nonCoherentAtomSize boundary, so map from one
+			VkDeviceSize atom_size = _renderer->getPhysicalDeviceProperties().limits.nonCoherentAtomSize;
+			VkDeviceSize map_offset = p->offset - p->offset % atom_size;
+
+			// The upload source is read straight out of the mapped trace
+			void* mapped = nullptr;
+			if( vkMapMemory( device, memory, map_offset, VK_WHOLE_SIZE, 0, &mapped ) != VK_SUCCESS ) {
+				return false;
+			}
+			std::memcpy( static_cast<uint8_t*>( mapped ) + size_t( p->offset - map_offset ), p + 1, size_t( p->size ) );
+
+			if( !( _buffer_memory_properties[p->buffer] & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT ) ) {
+				VkMappedMemoryRange range {};
+				range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+				range.memory = memory;
+				range.offset = map_offset;
+				range.size = VK_WHOLE_SIZE;
+				vkFlushMappedMemoryRanges( device, 1, &range );
+			}
+
+			vkUnmapMemory( device, memory );
+			return true;
+		}
+		case TRACE_PACKET_CMD_SET_VIEWPORT:
+		{
+			auto p = PayloadAs<TraceCmdSetViewport>( packet );
+			if( p == nullptr || !PayloadFits( packet, sizeof( *p ), uint64_t( p->viewport_count ) * sizeof( VkViewport ) ) || !IsLive( _command_buffers, p->command_buffer ) ) {
+				return false;
+			}
+			vkCmdSetViewport( _command_buffers[p->command_buffer], p->first_viewport, p->viewport_count, reinterpret_cast<const VkViewport*>( p + 1 ) );
+			return true;
+		}
+		case TRACE_PACKET_CMD_PIPELINE_BARRIER:
+		{
+			auto p = PayloadAs<TraceCmdPipelineBarrier>( packet );
+			if( p == nullptr || !PayloadFits( packet, sizeof( *p ),
+				uint64_t( p->memory_barrier_count ) * sizeof( TraceMemoryBarrier ) + uint64_t( p->buffer_barrier_count ) * sizeof( TraceBufferMemoryBarrier ) ) ||
+				!IsLive( _command_buffers, p->command_buffer ) ) {
+				return false;
+			}
+
+			auto trace_memory_barriers = reinterpret_cast<const TraceMemoryBarrier*>( p + 1 );
+			_scratch_memory_barriers.resize( p->memory_barrier_count );
+			for( uint32_t i = 0; i < p->memory_barrier_count; i++ ) {
+				VkMemoryBarrier& barrier = _scratch_memory_barriers[i];
+				barrier = {};
+				barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+				barrier.srcAccessMask = trace_memory_barriers[i].src_access;
+				barrier.dstAccessMask = trace_memory_barriers[i].dst_access;
+			}
+
+			auto trace_buffer_barriers = reinterpret_cast<const TraceBufferMemoryBarrier*>( trace_memory_barriers + p->memory_barrier_count );
+			_scratch_buffer_barriers.resize( p->buffer_barrier_count );
+			for( uint32_t i = 0; i < p->buffer_barrier_count; i++ ) {
+				VkBufferMemoryBarrier& barrier = _scratch_buffer_barriers[i];
+				barrier = {};
+				barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+				barrier.srcAccessMask = trace_buffer_barriers[i].src_access;
+				barrier.dstAccessMask = trace_buffer_barriers[i].dst_access;
+				barrier.srcQueueFamilyIndex = trace_buffer_barriers[i].src_queue_family;
+				barrier.dstQueueFamilyIndex = trace_buffer_barriers[i].dst_queue_family;
+				if( !IsLive( _buffers, trace_buffer_barriers[i].buffer ) ) {
+					return false;
+				}
+				barrier.buffer = _buffers[trace_buffer_barriers[i].buffer];
+				barrier.offset = trace_buffer_barriers[i].offset;
+				barrier.size = trace_buffer_barriers[i].size;
+			}
+
+			vkCmdPipelineBarrier( _command_buffers[p->command_buffer], p->src_stage, p->dst_stage, p->dependency_flags,
+				p->memory_barrier_count, _scratch_memory_barriers.data(),
+				p->buffer_barrier_count, _scratch_buffer_barriers.data(),
+				0, nullptr );
+			return true;
+		}
+		case TRACE_PACKET_CMD_COPY_BUFFER:
+		{
+			auto p = PayloadAs<TraceCmdCopyBuffer>( packet );
+			if( p == nullptr || !PayloadFits( packet, sizeof( *p ), uint64_t( p->region_count ) * sizeof( VkBufferCopy ) ) ||
+				!IsLive( _command_buffers, p->command_buffer ) || !IsLive( _buffers, p->src_buffer ) || !IsLive( _buffers, p->dst_buffer ) ) {
+				return false;
+			}
+			vkCmdCopyBuffer( _command_buffers[p->command_buffer], _buffers[p->src_buffer], _buffers[p->dst_buffer], p->region_count, reinterpret_cast<const VkBufferCopy*>( p + 1 ) );
+			return true;
+		}
+		case TRACE_PACKET_CMD_FILL_BUFFER:
+		{
+			auto p = PayloadAs<TraceCmdFillBuffer>( packet );
+			if( p == nullptr || !IsLive( _command_buffers, p->command_buffer ) || !IsLive( _buffers, p->buffer ) ) {
+				return false;
+			}
+			vkCmdFillBuffer( _command_buffers[p->command_buffer], _buffers[p->buffer], p->offset, p->size, p->data );
+			return true;
+		}
+		case TRACE_PACKET_QUEUE_SUBMIT:
+		{
+			auto p = PayloadAs<TraceQueueSubmit>( packet );
+			if( p == nullptr || ( p->fence != TRACE_NULL_ID && !IsLive( _fences, p->fence ) ) ) {
+				return false;
+			}
+
+			// Size the scratch arrays up front, so the pointers handed to the VkSubmitInfos stay valid. This pass also
+			// checks that every submit info and its id arrays lie within the packet
+			uint64_t semaphore_count = 0;
+			uint64_t command_buffer_count = 0;
+			{
+				uint64_t read_offset = sizeof( TraceQueueSubmit );
+				for( uint32_t i = 0; i < p->submit_count; i++ ) {
+					if( !PayloadFits( packet, read_offset, sizeof( TraceSubmitInfo ) ) ) {
+						return false;
+					}
+					auto submit_info = reinterpret_cast<const TraceSubmitInfo*>( packet.payload + read_offset );
+					read_offset += sizeof( TraceSubmitInfo );
+
+					uint64_t id_count = uint64_t( submit_info->wait_semaphore_count ) * 2 + submit_info->command_buffer_count + submit_info->signal_semaphore_count;
+					if( !PayloadFits( packet, read_offset, id_count * sizeof( uint32_t ) ) ) {
+						return false;
+					}
+					read_offset += id_count * sizeof( uint32_t );
+
+					semaphore_count += uint64_t( submit_info->wait_semaphore_count ) + submit_info->signal_semaphore_count;
+					command_buffer_count += submit_info->command_buffer_count;
+				}
+			}
+
+			_scratch_submits.resize( p->submit_count );
+			_scratch_semaphores.resize( size_t( semaphore_count ) );
+			_scratch_command_buffers.resize( size_t( command_buffer_count ) );
+
+			VkSemaphore* semaphores = _scratch_semaphores.data();
+			VkCommandBuffer* command_buffers = _scratch_command_buffers.data();
+
+			const uint8_t* read = reinterpret_cast<const uint8_t*>( p + 1 );
+			for( uint32_t i = 0; i < p->submit_count; i++ ) {
+				auto submit_info = reinterpret_cast<const TraceSubmitInfo*>( read );
+				const uint32_t* ids = reinterpret_cast<const uint32_t*>( submit_info + 1 );
+
+				VkSubmitInfo& submit = _scratch_submits[i];
+				submit = {};
+				submit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+
+				submit.waitSemaphoreCount = submit_info->wait_semaphore_count;
+				submit.pWaitSemaphores = semaphores;
+				for( uint32_t j = 0; j < submit_info->wait_semaphore_count; j++, ids++ ) {
+					if( !IsLive( _semaphores, *ids ) ) {
+						return false;
+					}
+					*semaphores++ = _semaphores[*ids];
+				}
+
+				// Stage masks are stored as raw flags and can be used in place
+				submit.pWaitDstStageMask = reinterpret_cast<const VkPipelineStageFlags*>( ids );
+				ids += submit_info->wait_semaphore_count;
+
+				submit.commandBufferCount = submit_info->command_buffer_count;
+				submit.pCommandBuffers = command_buffers;
+				for( uint32_t j = 0; j < submit_info->command_buffer_count; j++, ids++ ) {
+					if( !IsLive( _command_buffers, *ids ) ) {
+						return false;
+					}
+					*command_buffers++ = _command_buffers[*ids];
+				}
+
+				submit.signalSemaphoreCount = submit_info->signal_semaphore_count;
+				submit.pSignalSemaphores = semaphores;
+				for( uint32_t j = 0; j < submit_info->signal_semaphore_count; j++, ids++ ) {
+					if( !IsLive( _semaphores, *ids ) ) {
+						return false;
+					}
+					*semaphores++ = _semaphores[*ids];
+				}
+
+				read = reinterpret_cast<const uint8_t*>( ids );
+			}
+
+			VkFence fence = p->fence != TRACE_NULL_ID ? _fences[p->fence] : VK_NULL_HANDLE;
+			_renderer->getSubmissionQueue()->Submit( p->submit_count, _scratch_submits.data(), fence );
+			return true;
+		}
+		case TRACE_PACKET_QUEUE_WAIT_IDLE:
+			return _renderer->getSubmissionQueue()->WaitIdle() == VK_SUCCESS;
+
+		case TRACE_PACKET_DEVICE_WAIT_IDLE:
+			// The device has one queue, and vkDeviceWaitIdle() would need it externally synchronized
+			return _renderer->getSubmissionQueue()->WaitIdle() == VK_SUCCESS;
+
+		default:
+			return false;
+	}
+}
+
+void CommandReplay::_DestroyObjects()
+{
+	VkDevice device = _renderer->getDevice();
+
+	_renderer->getDeletionQueue()->Flush();
+
+	for( size_t i = 0; i < _buffers.size(); i++ ) {
+		if( _buffers[i] != VK_NULL_HANDLE ) {
+			vkDestroyBuffer( device, _buffers[i], _renderer->getAllocationCallbacks() );
+			vkFreeMemory( device, _buffer_memory[i], _renderer->getAllocationCallbacks() );
+		}
+	}
+
+	for( auto i : _semaphores ) {
+		if( i != VK_NULL_HANDLE ) {
+			vkDestroySemaphore( device, i, _renderer->getAllocationCallbacks() );
+		}
+	}
+
+	for( auto i : _fences ) {
+		if( i != VK_NULL_HANDLE ) {
+			vkDestroyFence( device, i, _renderer->getAllocationCallbacks() );
+		}
+	}
+
+	// Command buffers are released with their pools
+	for( auto i : _command_pools ) {
+		if( i != VK_NULL_HANDLE ) {
+			vkDestroyCommandPool( device, i, _renderer->getAllocationCallbacks() );
+		}
+	}
+
+	_buffers.clear();
+	_buffer_memory.clear();
+	_buffer_memory_properties.clear();
+	_semaphores.clear();
+	_fences.clear();
+	_command_buffers.clear();
+	_command_pools.clear();
+}
\ No newline at end of file
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "Platform.h"
+#include "CommandTrace.h"
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+class Renderer;
+
+struct ReplayFrameTiming
+{
+	uint32_t frame;
+	double cpu_ms;
+	double gpu_ms;		// negative if the queue doesn't support timestamps
+};
+
+// Plays a command trace back against a Renderer as fast as possible, without a window. Each trace frame is
+// bracketed by GPU timestamps so that per-frame CPU (replay submission cost) and GPU (queue execution) times can be
+// compared between builds running the exact same workload.
+//
+// Destroy packets go through the renderer's DeletionQueue, so a trace recorded without idling the queue still
+// replays safely at full speed.
+class CommandReplay
+{
+public:
+	CommandReplay( Renderer* r );
+	~CommandReplay();
+
+	bool Load( const std::string& path );
+
+	bool Run( uint32_t loop_count = 1 );
+
+	const std::vector<ReplayFrameTiming>& getFrameTimings() const;
+
+	void PrintReport() const;
+	bool WriteCsv( const std::string& path ) const;
+
+private:
+	// Frames kept in flight before the replay waits for the GPU to read back timestamps
+	static const uint32_t FRAME_LATENCY = 3;
+
+	struct TimingSlot
+	{
+		VkCommandBuffer begin_command_buffer = VK_NULL_HANDLE;
+		VkCommandBuffer end_command_buffer = VK_NULL_HANDLE;
+		VkFence fence = VK_NULL_HANDLE;
+		size_t timing_index = 0;
+		bool pending = false;
+	};
+
+	void _InitTiming();
+	void _DeInitTiming();
+
+	void _BeginFrame();
+	void _EndFrame();
+	void _CollectSlot( TimingSlot& slot, uint32_t slot_index );
+
+	bool _Execute( const TracePacket& packet );
+	void _DestroyObjects();
+
+	Renderer* _renderer = nullptr;
+
+	CommandTraceReader _reader;
+
+	// Replay objects, indexed by trace id
+	std::vector<VkCommandPool> _command_pools;
+	std::vector<VkCommandBuffer> _command_buffers;
+	std::vector<VkFence> _fences;
+	std::vector<VkSemaphore> _semaphores;
+	std::vector<VkBuffer> _buffers;
+	std::vector<VkDeviceMemory> _buffer_memory;
+	std::vector<VkMemoryPropertyFlags> _buffer_memory_properties;
+
+	// Scratch arrays for translating packets back into Vulkan structures
+	std::vector<VkSemaphore> _scratch_semaphores;
+	std::vector<VkCommandBuffer> _scratch_command_buffers;
+	std::vector<VkFence> _scratch_fences;
+	std::vector<VkSubmitInfo> _scratch_submits;
+	std::vector<VkMemoryBarrier> _scratch_memory_barriers;
+	std::vector<VkBufferMemoryBarrier> _scratch_buffer_barriers;
+
+	VkCommandPool _timing_command_pool = VK_NULL_HANDLE;
+	VkQueryPool _timing_query_pool = VK_NULL_HANDLE;
+	TimingSlot _timing_slots[FRAME_LATENCY];
+	bool _timestamps_supported = false;
+
+	bool _frame_open = false;
+	uint32_t _frame_index = 0;
+	std::chrono::high_resolution_clock::time_point _frame_cpu_start;
+
+	std::vector<ReplayFrameTiming> _frame_timings;
+};
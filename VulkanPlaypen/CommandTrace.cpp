@@ -0,0 +1,194 @@
+#include "CommandTrace.h"
+
+#include <cstring>
+
+#define TRACE_INITIAL_FILE_SIZE ( 16ull * 1024 * 1024 )
+
+static uint64_t AlignTracePayload( uint64_t size )
+{
+	return ( size + 7 ) & ~uint64_t( 7 );
+}
+
+CommandTraceWriter::CommandTraceWriter()
+{
+}
+
+
+CommandTraceWriter::~CommandTraceWriter()
+{
+	Close();
+}
+
+bool CommandTraceWriter::Open( const std::string& path )
+{
+	Close();
+
+	if( !_file.OpenWrite( path, TRACE_INITIAL_FILE_SIZE ) ) {
+		return false;
+	}
+
+	_header = {};
+	_header.magic = TRACE_FILE_MAGIC;
+	_header.version = TRACE_FILE_VERSION;
+	_write_offset = sizeof( TraceFileHeader );
+
+	return true;
+}
+
+void CommandTraceWriter::Close()
+{
+	if( !_file.IsOpen() ) {
+		return;
+	}
+
+	_header.stream_size = _write_offset - sizeof( TraceFileHeader );
+	std::memcpy( _file.getData(), &_header, sizeof( TraceFileHeader ) );
+
+	// Trim the slack left over from growing the mapping
+	_file.Resize( _write_offset );
+	_file.Close();
+}
+
+bool CommandTraceWriter::IsOpen() const
+{
+	return _file.IsOpen();
+}
+
+void* CommandTraceWriter::BeginPacket( TracePacketType type, uint32_t payload_size )
+{
+	uint64_t aligned_size = AlignTracePayload( payload_size );
+
+	if( !_Reserve( sizeof( TracePacketHeader ) + aligned_size ) ) {
+		return nullptr;
+	}
+
+	uint8_t* data = _file.getData() + _write_offset;
+
+	TracePacketHeader* packet_header = reinterpret_cast<TracePacketHeader*>( data );
+	packet_header->type = type;
+	packet_header->reserved = 0;
+	packet_header->size = uint32_t( aligned_size );
+
+	uint8_t* payload = data + sizeof( TracePacketHeader );
+	std::memset( payload, 0, size_t( aligned_size ) );
+
+	_write_offset += sizeof( TracePacketHeader ) + aligned_size;
+	_header.packet_count++;
+
+	return payload;
+}
+
+uint32_t CommandTraceWriter::AllocateId( TraceObjectType type, uint32_t count )
+{
+	uint32_t id = _header.object_count[type];
+	_header.object_count[type] += count;
+	return id;
+}
+
+void CommandTraceWriter::EndFrame()
+{
+	TraceEndFrame* packet = reinterpret_cast<TraceEndFrame*>( BeginPacket( TRACE_PACKET_END_FRAME, sizeof( TraceEndFrame ) ) );
+	if( packet != nullptr ) {
+		packet->frame = _header.frame_count;
+	}
+	_header.frame_count++;
+}
+
+uint32_t CommandTraceWriter::getFrameCount() const
+{
+	return _header.frame_count;
+}
+
+bool CommandTraceWriter::_Reserve( uint64_t size )
+{
+	if( !_file.IsOpen() ) {
+		return false;
+	}
+
+	uint64_t required = _write_offset + size;
+	if( required <= _file.getSize() ) {
+		return true;
+	}
+
+	uint64_t new_size = _file.getSize();
+	while( new_size < required ) {
+		new_size *= 2;
+	}
+
+	return _file.Resize( new_size );
+}
+
+CommandTraceReader::CommandTraceReader()
+{
+}
+
+
+CommandTraceReader::~CommandTraceReader()
+{
+	Close();
+}
+
+bool CommandTraceReader::Open( const std::string& path )
+{
+	Close();
+
+	if( !_file.OpenRead( path ) ) {
+		return false;
+	}
+
+	if( _file.getSize() < sizeof( TraceFileHeader ) ) {
+		Close();
+		return false;
+	}
+
+	std::memcpy( &_header, _file.getData(), sizeof( TraceFileHeader ) );
+
+	if( _header.magic != TRACE_FILE_MAGIC || _header.version != TRACE_FILE_VERSION ||
+		sizeof( TraceFileHeader ) + _header.stream_size > _file.getSize() ) {
+		Close();
+		return false;
+	}
+
+	_read_offset = sizeof( TraceFileHeader );
+	return true;
+}
+
+void CommandTraceReader::Close()
+{
+	_file.Close();
+	_header = {};
+	_read_offset = 0;
+}
+
+bool CommandTraceReader::Next( TracePacket& packet )
+{
+	uint64_t stream_end = sizeof( TraceFileHeader ) + _header.stream_size;
+
+	if( _read_offset + sizeof( TracePacketHeader ) > stream_end ) {
+		return false;
+	}
+
+	const TracePacketHeader* packet_header = reinterpret_cast<const TracePacketHeader*>( _file.getData() + _read_offset );
+	uint64_t packet_end = _read_offset + sizeof( TracePacketHeader ) + packet_header->size;
+
+	if( packet_end > stream_end ) {
+		return false;
+	}
+
+	packet.type = TracePacketType( packet_header->type );
+	packet.size = packet_header->size;
+	packet.payload = _file.getData() + _read_offset + sizeof( TracePacketHeader );
+
+	_read_offset = packet_end;
+	return true;
+}
+
+void CommandTraceReader::Rewind()
+{
+	_read_offset = sizeof( TraceFileHeader );
+}
+
+const TraceFileHeader& CommandTraceReader::getHeader() const
+{
+	return _header;
+}
\ No newline at end of file
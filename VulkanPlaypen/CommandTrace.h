@@ -0,0 +1,222 @@
+#pragma once
+
+#include "Platform.h"
+#include "MappedFile.h"
+
+#include <cstdint>
+#include <string>
+
+// Binary command trace format
+//
+// A trace is a TraceFileHeader followed by a stream of packets. Every packet is a TracePacketHeader followed by
+// its payload, with payloads padded to 8 bytes so that they can be read in place from the memory mapped file.
+// Vulkan objects are never stored as handles; each object type gets its own dense id space instead, so replay
+// can keep its objects in flat arrays indexed by id.
+
+#define TRACE_FILE_MAGIC    0x52544B56 // "VKTR"
+#define TRACE_FILE_VERSION  1
+#define TRACE_NULL_ID       0xFFFFFFFF
+
+enum TraceObjectType
+{
+	TRACE_OBJECT_COMMAND_POOL = 0,
+	TRACE_OBJECT_COMMAND_BUFFER,
+	TRACE_OBJECT_FENCE,
+	TRACE_OBJECT_SEMAPHORE,
+	TRACE_OBJECT_BUFFER,
+
+	TRACE_OBJECT_TYPE_COUNT
+};
+
+enum TracePacketType : uint16_t
+{
+	TRACE_PACKET_CREATE_COMMAND_POOL = 1,
+	TRACE_PACKET_DESTROY_COMMAND_POOL,
+	TRACE_PACKET_RESET_COMMAND_POOL,
+	TRACE_PACKET_ALLOCATE_COMMAND_BUFFERS,
+	TRACE_PACKET_BEGIN_COMMAND_BUFFER,
+	TRACE_PACKET_END_COMMAND_BUFFER,
+	TRACE_PACKET_CREATE_FENCE,
+	TRACE_PACKET_DESTROY_FENCE,
+	TRACE_PACKET_RESET_FENCES,
+	TRACE_PACKET_WAIT_FOR_FENCES,
+	TRACE_PACKET_CREATE_SEMAPHORE,
+	TRACE_PACKET_DESTROY_SEMAPHORE,
+	TRACE_PACKET_CREATE_BUFFER,
+	TRACE_PACKET_DESTROY_BUFFER,
+	TRACE_PACKET_UPLOAD_BUFFER,
+	TRACE_PACKET_CMD_SET_VIEWPORT,
+	TRACE_PACKET_CMD_PIPELINE_BARRIER,
+	TRACE_PACKET_CMD_COPY_BUFFER,
+	TRACE_PACKET_CMD_FILL_BUFFER,
+	TRACE_PACKET_QUEUE_SUBMIT,
+	TRACE_PACKET_QUEUE_WAIT_IDLE,
+	TRACE_PACKET_DEVICE_WAIT_IDLE,
+	TRACE_PACKET_END_FRAME,
+};
+
+struct TraceFileHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t frame_count;
+	uint32_t packet_count;
+	uint32_t object_count[TRACE_OBJECT_TYPE_COUNT];
+	uint32_t reserved;
+	uint64_t stream_size;
+};
+
+struct TracePacketHeader
+{
+	uint16_t type;
+	uint16_t reserved;
+	uint32_t size;
+};
+
+// Packet payloads
+
+struct TraceCreateCommandPool   { uint32_t pool; uint32_t flags; };
+struct TraceDestroyCommandPool  { uint32_t pool; };
+struct TraceResetCommandPool    { uint32_t pool; uint32_t flags; };
+struct TraceAllocateCommandBuffers { uint32_t pool; uint32_t level; uint32_t count; uint32_t first_command_buffer; };
+struct TraceBeginCommandBuffer  { uint32_t command_buffer; uint32_t flags; };
+struct TraceEndCommandBuffer    { uint32_t command_buffer; };
+struct TraceCreateFence         { uint32_t fence; uint32_t flags; };
+struct TraceDestroyFence        { uint32_t fence; };
+struct TraceCreateSemaphore     { uint32_t semaphore; };
+struct TraceDestroySemaphore    { uint32_t semaphore; };
+struct TraceDestroyBuffer       { uint32_t buffer; };
+struct TraceEndFrame            { uint32_t frame; };
+
+// Followed by uint32_t fences[fence_count]
+struct TraceResetFences         { uint32_t fence_count; };
+
+// Followed by uint32_t fences[fence_count]
+struct TraceWaitForFences       { uint32_t fence_count; uint32_t wait_all; uint64_t timeout; };
+
+struct TraceCreateBuffer
+{
+	uint64_t size;
+	uint32_t buffer;
+	uint32_t usage;
+	uint32_t memory_properties;
+	uint32_t reserved;
+};
+
+// Followed by the uploaded bytes
+struct TraceUploadBuffer
+{
+	uint64_t offset;
+	uint64_t size;
+	uint32_t buffer;
+	uint32_t reserved;
+};
+
+// Followed by VkViewport viewports[viewport_count]
+struct TraceCmdSetViewport      { uint32_t command_buffer; uint32_t first_viewport; uint32_t viewport_count; };
+
+struct TraceMemoryBarrier       { uint32_t src_access; uint32_t dst_access; };
+
+struct TraceBufferMemoryBarrier
+{
+	uint64_t offset;
+	uint64_t size;
+	uint32_t src_access;
+	uint32_t dst_access;
+	uint32_t src_queue_family;
+	uint32_t dst_queue_family;
+	uint32_t buffer;
+	uint32_t reserved;
+};
+
+// Followed by TraceMemoryBarrier[memory_barrier_count], then TraceBufferMemoryBarrier[buffer_barrier_count]
+struct TraceCmdPipelineBarrier
+{
+	uint32_t command_buffer;
+	uint32_t src_stage;
+	uint32_t dst_stage;
+	uint32_t dependency_flags;
+	uint32_t memory_barrier_count;
+	uint32_t buffer_barrier_count;
+};
+
+// Followed by VkBufferCopy regions[region_count]
+struct TraceCmdCopyBuffer       { uint32_t command_buffer; uint32_t src_buffer; uint32_t dst_buffer; uint32_t region_count; };
+
+struct TraceCmdFillBuffer
+{
+	uint64_t offset;
+	uint64_t size;
+	uint32_t command_buffer;
+	uint32_t buffer;
+	uint32_t data;
+	uint32_t reserved;
+};
+
+// Followed by submit_count TraceSubmitInfo blocks
+struct TraceQueueSubmit         { uint32_t fence; uint32_t submit_count; };
+
+// Followed by uint32_t wait_semaphores[], uint32_t wait_stages[], uint32_t command_buffers[], uint32_t signal_semaphores[]
+struct TraceSubmitInfo
+{
+	uint32_t wait_semaphore_count;
+	uint32_t command_buffer_count;
+	uint32_t signal_semaphore_count;
+};
+
+class CommandTraceWriter
+{
+public:
+	CommandTraceWriter();
+	~CommandTraceWriter();
+
+	bool Open( const std::string& path );
+	void Close();
+
+	bool IsOpen() const;
+
+	// Reserves space for a packet in the mapped file and returns a pointer to its (zeroed) payload
+	void* BeginPacket( TracePacketType type, uint32_t payload_size );
+
+	uint32_t AllocateId( TraceObjectType type, uint32_t count = 1 );
+	void EndFrame();
+
+	uint32_t getFrameCount() const;
+
+private:
+	bool _Reserve( uint64_t size );
+
+	MappedFile _file;
+	uint64_t _write_offset = 0;
+
+	TraceFileHeader _header {};
+};
+
+struct TracePacket
+{
+	TracePacketType type;
+	uint32_t size;
+	const uint8_t* payload;
+};
+
+class CommandTraceReader
+{
+public:
+	CommandTraceReader();
+	~CommandTraceReader();
+
+	bool Open( const std::string& path );
+	void Close();
+
+	// Returns false at the end of the stream or if the stream is corrupt
+	bool Next( TracePacket& packet );
+	void Rewind();
+
+	const TraceFileHeader& getHeader() const;
+
+private:
+	MappedFile _file;
+	uint64_t _read_offset = 0;
+
+	TraceFileHeader _header {};
+};
@@ -0,0 +1,250 @@
+#include "CompletionReactor.h"
+#include "Renderer.h"
+#include "RendererUtils.h"
+#include "SubmissionQueue.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+
+CompletionReactor::CompletionReactor( Renderer* r, const CompletionReactorSettings& settings )
+{
+	_renderer = r;
+	_settings = settings;
+	_settings.wait_timeout_us = std::max<uint32_t>( _settings.wait_timeout_us, 1 );
+
+	_thread_pool = new ThreadPool( _settings.worker_count );
+	_thread = std::thread( &CompletionReactor::_ReactorLoop, this );
+}
+
+
+CompletionReactor::~CompletionReactor()
+{
+	Flush();
+
+	{
+		std::lock_guard<std::mutex> lock( _mutex );
+		_stopping = true;
+	}
+	_watch_available.notify_one();
+	_thread.join();
+
+	delete _thread_pool;
+	_thread_pool = nullptr;
+
+	for( auto fence : _all_fences ) {
+		vkDestroyFence( _renderer->getDevice(), fence, _renderer->getAllocationCallbacks() );
+	}
+	_all_fences.clear();
+	_free_fences.clear();
+}
+
+void CompletionReactor::Watch( VkFence fence, CompletionCallback callback )
+{
+	_AddOutstanding();
+	_Enqueue( fence, false, std::move( callback ), std::chrono::high_resolution_clock::now() );
+}
+
+void CompletionReactor::WatchQueued( VkFence fence, CompletionCallback callback )
+{
+	_WatchQueued( fence, false, std::move( callback ) );
+}
+
+void CompletionReactor::Submit( uint32_t submit_count, const VkSubmitInfo* submits, CompletionCallback callback )
+{
+	VkFence fence = _AcquireFence();
+
+	// Submit errors are fatal on the submit thread
+	_renderer->getSubmissionQueue()->Submit( submit_count, submits, fence );
+	_WatchQueued( fence, true, std::move( callback ) );
+}
+
+void CompletionReactor::Flush()
+{
+	std::unique_lock<std::mutex> lock( _mutex );
+	_idle.wait( lock, [this]() { return _outstanding == 0; } );
+}
+
+uint32_t CompletionReactor::getPendingCount() const
+{
+	std::lock_guard<std::mutex> lock( _mutex );
+	return _outstanding;
+}
+
+CompletionReactorStats CompletionReactor::getStats() const
+{
+	std::lock_guard<std::mutex> lock( _mutex );
+	return _stats;
+}
+
+void CompletionReactor::PrintStats() const
+{
+	CompletionReactorStats stats = getStats();
+	double per_wake = stats.wake_count > 0 ? double( stats.completed_count ) / stats.wake_count : 0.0;
+	double latency_ms_avg = stats.completed_count > 0 ? stats.latency_ms_total / stats.completed_count : 0.0;
+
+	std::cout << std::fixed << std::setprecision( 2 )
+		<< "Completion reactor: " << stats.completed_count << " of " << stats.watched_count << " completed, max " << stats.max_pending << " pending" << std::endl
+		<< "  " << stats.wake_count << " wakes (" << per_wake << " completions each), " << stats.timeout_count << " timeouts" << std::endl
+		<< "  watch to callback avg " << latency_ms_avg << " ms, max " << stats.latency_ms_max << " ms" << std::endl;
+}
+
+void CompletionReactor::_WatchQueued( VkFence fence, bool pooled, CompletionCallback callback )
+{
+	// Counted right away so Flush() waits for it. The fence is externally synchronized while vkQueueSubmit() runs, so
+	// the reactor thread only gets it from the submit thread, once everything queued so far has been submitted
+	_AddOutstanding();
+
+	auto watch_time = std::chrono::high_resolution_clock::now();
+	_renderer->getSubmissionQueue()->Execute( [this, fence, pooled, callback, watch_time]( VkQueue ) {
+		_Enqueue( fence, pooled, callback, watch_time );
+	} );
+}
+
+void CompletionReactor::_AddOutstanding()
+{
+	std::lock_guard<std::mutex> lock( _mutex );
+	_outstanding++;
+	_stats.watched_count++;
+}
+
+void CompletionReactor::_Enqueue( VkFence fence, bool pooled, CompletionCallback callback, std::chrono::high_resolution_clock::time_point watch_time )
+{
+	Entry entry;
+	entry.fence = fence;
+	entry.pooled = pooled;
+	entry.callback = std::move( callback );
+	entry.watch_time = watch_time;
+
+	{
+		std::lock_guard<std::mutex> lock( _mutex );
+		_incoming.push_back( std::move( entry ) );
+	}
+	_watch_available.notify_one();
+}
+
+void CompletionReactor::_ReactorLoop()
+{
+	VkDevice device = _renderer->getDevice();
+	uint64_t timeout_ns = uint64_t( _settings.wait_timeout_us ) * 1000;
+
+	for( ;; ) {
+		{
+			std::unique_lock<std::mutex> lock( _mutex );
+
+			// Nothing to wait for, sleep until something is watched
+			if( _pending.empty() ) {
+				_watch_available.wait( lock, [this]() { return _stopping || !_incoming.empty(); } );
+			}
+			if( _pending.empty() && _incoming.empty() ) {
+				return;
+			}
+
+			for( auto &i : _incoming ) {
+				_pending.push_back( std::move( i ) );
+			}
+			_incoming.clear();
+
+			_stats.max_pending = std::max( _stats.max_pending, uint32_t( _pending.size() ) );
+		}
+
+		_pending_fences.clear();
+		for( auto &i : _pending ) {
+			_pending_fences.push_back( i.fence );
+		}
+
+		VkResult result = vkWaitForFences( device, uint32_t( _pending_fences.size() ), _pending_fences.data(), VK_FALSE, timeout_ns );
+		if( result == VK_TIMEOUT ) {
+			std::lock_guard<std::mutex> lock( _mutex );
+			_stats.timeout_count++;
+			continue;
+		}
+		vkResultErrorCheck( result );
+
+		// The wait only says one has signaled, poll for all of them. Keeps the rest in watch order
+		size_t kept = 0;
+		for( size_t i = 0; i < _pending.size(); i++ ) {
+			VkResult status = vkGetFenceStatus( device, _pending[i].fence );
+			if( status == VK_NOT_READY ) {
+				if( kept != i ) {
+					_pending[kept] = std::move( _pending[i] );
+				}
+				kept++;
+				continue;
+			}
+			vkResultErrorCheck( status );
+
+			_completed.push_back( std::move( _pending[i] ) );
+		}
+		_pending.resize( kept );
+
+		auto now = std::chrono::high_resolution_clock::now();
+		double latency_ms_total = 0.0;
+		double latency_ms_max = 0.0;
+		for( auto &i : _completed ) {
+			double latency_ms = std::chrono::duration<double, std::milli>( now - i.watch_time ).count();
+			latency_ms_total += latency_ms;
+			latency_ms_max = std::max( latency_ms_max, latency_ms );
+		}
+
+		{
+			std::lock_guard<std::mutex> lock( _mutex );
+			_stats.wake_count++;
+			_stats.completed_count += _completed.size();
+			_stats.latency_ms_total += latency_ms_total;
+			_stats.latency_ms_max = std::max( _stats.latency_ms_max, latency_ms_max );
+		}
+
+		for( auto &i : _completed ) {
+			_Complete( i );
+		}
+		_completed.clear();
+	}
+}
+
+void CompletionReactor::_Complete( Entry& entry )
+{
+	// Recycled straight away, the callback never sees a pooled fence
+	if( entry.pooled ) {
+		vkResultErrorCheck( vkResetFences( _renderer->getDevice(), 1, &entry.fence ) );
+
+		std::lock_guard<std::mutex> lock( _fence_pool_mutex );
+		_free_fences.push_back( entry.fence );
+	}
+
+	CompletionCallback callback = std::move( entry.callback );
+	_thread_pool->Enqueue( [this, callback]() {
+		if( callback ) {
+			callback();
+		}
+		_Finished();
+	} );
+}
+
+void CompletionReactor::_Finished()
+{
+	std::lock_guard<std::mutex> lock( _mutex );
+	if( --_outstanding == 0 ) {
+		_idle.notify_all();
+	}
+}
+
+VkFence CompletionReactor::_AcquireFence()
+{
+	std::lock_guard<std::mutex> lock( _fence_pool_mutex );
+
+	if( !_free_fences.empty() ) {
+		VkFence fence = _free_fences.back();
+		_free_fences.pop_back();
+		return fence;
+	}
+
+	VkFence fence;
+	VkFenceCreateInfo fence_info {};
+	fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	vkResultErrorCheck( vkCreateFence( _renderer->getDevice(), &fence_info, _renderer->getAllocationCallbacks(), &fence ) );
+
+	_all_fences.push_back( fence );
+	return fence;
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include "Platform.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class Renderer;
+class ThreadPool;
+
+struct CompletionReactorSettings
+{
+	// Longest the reactor stays in one fence wait. Fences watched during a wait are picked up when it ends, so this
+	// bounds their extra latency. An idle reactor sleeps until something is watched
+	uint32_t wait_timeout_us = 500;
+
+	// Threads running the callbacks, 0 runs them on the reactor thread, where they must be short
+	uint32_t worker_count = 0;
+};
+
+struct CompletionReactorStats
+{
+	uint64_t watched_count = 0;
+	uint64_t completed_count = 0;
+
+	// Fence waits that returned with at least one fence signaled, and those that timed out
+	uint64_t wake_count = 0;
+	uint64_t timeout_count = 0;
+
+	uint32_t max_pending = 0;
+
+	double latency_ms_total = 0.0;
+	double latency_ms_max = 0.0;
+};
+
+typedef std::function<void()> CompletionCallback;
+
+// Waits for GPU work on one thread, so no other thread has to block on a fence.
+//
+// Watched fences are handed to a reactor thread that waits for any of them to signal with a single vkWaitForFences()
+// call, then polls the rest to find all that have, and runs their callbacks. A callback is the continuation of
+// whatever waited for the work: it can queue the next step, hand a readback to its consumer or destroy the objects
+// the work used.
+//
+// Submit() takes the fence from a pool owned by the reactor and recycles it once the callback has run. Fences passed
+// to Watch() stay the caller's and are not touched again once their callback has been called.
+class CompletionReactor
+{
+public:
+	CompletionReactor( Renderer* r, const CompletionReactorSettings& settings = CompletionReactorSettings() );
+	~CompletionReactor();
+
+	// Calls callback once fence has signaled. The fence must already be submitted or signaled, and its vkQueueSubmit()
+	// must have returned
+	void Watch( VkFence fence, CompletionCallback callback );
+
+	// Watch() for a fence queued on the renderer's submission queue, which is watched once the queue has submitted it
+	void WatchQueued( VkFence fence, CompletionCallback callback );
+
+	// Submits through the renderer's submission queue with a pooled fence and watches it
+	void Submit( uint32_t submit_count, const VkSubmitInfo* submits, CompletionCallback callback );
+
+	// Blocks until every fence watched so far has signaled and its callback has returned
+	void Flush();
+
+	uint32_t getPendingCount() const;
+
+	CompletionReactorStats getStats() const;
+	void PrintStats() const;
+
+private:
+	struct Entry
+	{
+		VkFence fence;
+		bool pooled;
+		CompletionCallback callback;
+		std::chrono::high_resolution_clock::time_point watch_time;
+	};
+
+	void _WatchQueued( VkFence fence, bool pooled, CompletionCallback callback );
+	void _AddOutstanding();
+	void _Enqueue( VkFence fence, bool pooled, CompletionCallback callback, std::chrono::high_resolution_clock::time_point watch_time );
+	void _ReactorLoop();
+	void _Complete( Entry& entry );
+	void _Finished();
+
+	VkFence _AcquireFence();
+
+	Renderer* _renderer = nullptr;
+	CompletionReactorSettings _settings;
+
+	ThreadPool* _thread_pool = nullptr;
+	std::thread _thread;
+
+	mutable std::mutex _mutex;
+	std::condition_variable _watch_available;
+	std::condition_variable _idle;
+	std::vector<Entry> _incoming;
+	bool _stopping = false;
+
+	// Watched and not yet finished, including callbacks still running on the workers
+	uint32_t _outstanding = 0;
+
+	// Reactor thread only, in watch order
+	std::vector<Entry> _pending;
+	std::vector<Entry> _completed;
+	std::vector<VkFence> _pending_fences;
+
+	std::mutex _fence_pool_mutex;
+	std::vector<VkFence> _free_fences;
+	std::vector<VkFence> _all_fences;
+
+	CompletionReactorStats _stats;
+};
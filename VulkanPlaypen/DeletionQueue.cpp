@@ -0,0 +1,381 @@
+#include "DeletionQueue.h"
+#include "Renderer.h"
+#include "RendererUtils.h"
+#include "SubmissionQueue.h"
+
+#include <algorithm>
+#include <iostream>
+
+DeletionQueue::DeletionQueue( Renderer* r )
+{
+	_renderer = r;
+}
+
+
+DeletionQueue::~DeletionQueue()
+{
+	Flush();
+
+	for( auto i : _free_fences ) {
+		vkDestroyFence( _renderer->getDevice(), i, _renderer->getAllocationCallbacks() );
+	}
+	_free_fences.clear();
+}
+
+void DeletionQueue::EndFrame( VkFence frame_fence )
+{
+	{
+		std::lock_guard<std::mutex> lock( _mutex );
+
+		// Frames nothing was queued in don't need a fence of their own
+		if( _current_frame_used ) {
+			FrameFence entry {};
+			entry.frame = _current_frame;
+			entry.fence = frame_fence;
+			entry.owned = frame_fence == VK_NULL_HANDLE;
+
+			if( entry.owned ) {
+				if( !_free_fences.empty() ) {
+					entry.fence = _free_fences.back();
+					_free_fences.pop_back();
+				}
+				else {
+					VkFenceCreateInfo fence_info {};
+					fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+					vkResultErrorCheck( vkCreateFence( _renderer->getDevice(), &fence_info, _renderer->getAllocationCallbacks(), &entry.fence ) );
+				}
+
+				// An empty submit signals its fence once all previously submitted work on the queue has completed
+				_renderer->getSubmissionQueue()->Submit( 0, nullptr, entry.fence );
+			}
+
+			_frame_fences.push_back( entry );
+		}
+		else if( _frame_fences.empty() ) {
+			_completed_frame = _current_frame;
+		}
+
+		_current_frame++;
+		_current_frame_used = false;
+
+		_PollFences( false );
+	}
+
+	_DestroyCompleted();
+}
+
+void DeletionQueue::RetireFence( VkFence frame_fence )
+{
+	std::lock_guard<std::mutex> lock( _mutex );
+
+	// Fences signal in submission order, so every frame up to the last one closed with this fence is done
+	auto last = std::find_if( _frame_fences.rbegin(), _frame_fences.rend(), [frame_fence]( const FrameFence& entry ) { return entry.fence == frame_fence; } );
+	if( last == _frame_fences.rend() ) {
+		return;
+	}
+
+	size_t count = size_t( _frame_fences.rend() - last );
+	for( size_t i = 0; i < count; i++ ) {
+		_CompleteFrontFence();
+	}
+}
+
+void DeletionQueue::Collect()
+{
+	{
+		std::lock_guard<std::mutex> lock( _mutex );
+		_PollFences( false );
+	}
+
+	_DestroyCompleted();
+}
+
+void DeletionQueue::Flush()
+{
+	// Custom functions may queue further deletions, keep going until nothing is left
+	for( ;; ) {
+		EndFrame();
+
+		{
+			std::lock_guard<std::mutex> lock( _mutex );
+			_PollFences( true );
+		}
+
+		_DestroyCompleted();
+
+		std::lock_guard<std::mutex> lock( _mutex );
+		if( _pending.empty() ) {
+			return;
+		}
+	}
+}
+
+void DeletionQueue::DestroyBuffer( VkBuffer buffer )
+{
+	_Queue( DEFERRED_DELETION_BUFFER, (uint64_t)buffer );
+}
+
+void DeletionQueue::DestroyImage( VkImage image )
+{
+	_Queue( DEFERRED_DELETION_IMAGE, (uint64_t)image );
+}
+
+void DeletionQueue::DestroyImageView( VkImageView image_view )
+{
+	_Queue( DEFERRED_DELETION_IMAGE_VIEW, (uint64_t)image_view );
+}
+
+void DeletionQueue::FreeMemory( VkDeviceMemory memory )
+{
+	_Queue( DEFERRED_DELETION_MEMORY, (uint64_t)memory );
+}
+
+void DeletionQueue::DestroySampler( VkSampler sampler )
+{
+	_Queue( DEFERRED_DELETION_SAMPLER, (uint64_t)sampler );
+}
+
+void DeletionQueue::DestroyCommandPool( VkCommandPool command_pool )
+{
+	_Queue( DEFERRED_DELETION_COMMAND_POOL, (uint64_t)command_pool );
+}
+
+void DeletionQueue::DestroyFence( VkFence fence )
+{
+	_Queue( DEFERRED_DELETION_FENCE, (uint64_t)fence );
+}
+
+void DeletionQueue::DestroySemaphore( VkSemaphore semaphore )
+{
+	_Queue( DEFERRED_DELETION_SEMAPHORE, (uint64_t)semaphore );
+}
+
+void DeletionQueue::DestroyQueryPool( VkQueryPool query_pool )
+{
+	_Queue( DEFERRED_DELETION_QUERY_POOL, (uint64_t)query_pool );
+}
+
+void DeletionQueue::DestroyFramebuffer( VkFramebuffer framebuffer )
+{
+	_Queue( DEFERRED_DELETION_FRAMEBUFFER, (uint64_t)framebuffer );
+}
+
+void DeletionQueue::DestroyRenderPass( VkRenderPass render_pass )
+{
+	_Queue( DEFERRED_DELETION_RENDER_PASS, (uint64_t)render_pass );
+}
+
+void DeletionQueue::DestroyPipeline( VkPipeline pipeline )
+{
+	_Queue( DEFERRED_DELETION_PIPELINE, (uint64_t)pipeline );
+}
+
+void DeletionQueue::DestroyPipelineLayout( VkPipelineLayout pipeline_layout )
+{
+	_Queue( DEFERRED_DELETION_PIPELINE_LAYOUT, (uint64_t)pipeline_layout );
+}
+
+void DeletionQueue::DestroyDescriptorSetLayout( VkDescriptorSetLayout descriptor_set_layout )
+{
+	_Queue( DEFERRED_DELETION_DESCRIPTOR_SET_LAYOUT, (uint64_t)descriptor_set_layout );
+}
+
+void DeletionQueue::DestroyDescriptorPool( VkDescriptorPool descriptor_pool )
+{
+	_Queue( DEFERRED_DELETION_DESCRIPTOR_POOL, (uint64_t)descriptor_pool );
+}
+
+void DeletionQueue::DestroyShaderModule( VkShaderModule shader_module )
+{
+	_Queue( DEFERRED_DELETION_SHADER_MODULE, (uint64_t)shader_module );
+}
+
+void DeletionQueue::DestroySwapchain( VkSwapchainKHR swapchain )
+{
+	_Queue( DEFERRED_DELETION_SWAPCHAIN, (uint64_t)swapchain );
+}
+
+void DeletionQueue::DestroySurface( VkSurfaceKHR surface )
+{
+	_Queue( DEFERRED_DELETION_SURFACE, (uint64_t)surface );
+}
+
+void DeletionQueue::Defer( DeferredDeletionFunction function, void* user_data, uint64_t handle )
+{
+	_Queue( DEFERRED_DELETION_FUNCTION, handle, function, user_data );
+}
+
+uint64_t DeletionQueue::getCurrentFrame() const
+{
+	std::lock_guard<std::mutex> lock( _mutex );
+	return _current_frame;
+}
+
+uint64_t DeletionQueue::getCompletedFrame() const
+{
+	std::lock_guard<std::mutex> lock( _mutex );
+	return _completed_frame;
+}
+
+DeletionQueueStats DeletionQueue::getStats() const
+{
+	std::lock_guard<std::mutex> lock( _mutex );
+
+	DeletionQueueStats stats;
+	stats.pending_count = _pending.size();
+	stats.peak_pending_count = _peak_pending_count;
+	stats.oldest_pending_age = _pending.empty() ? 0 : _current_frame - _pending.front().frame;
+	stats.frames_in_flight = _frame_fences.size();
+	stats.queued_count = _queued_count;
+	stats.destroyed_count = _destroyed_count;
+	return stats;
+}
+
+void DeletionQueue::PrintStats() const
+{
+	DeletionQueueStats stats = getStats();
+
+	std::cout << "Deferred deletion: " << stats.pending_count << " pending (peak " << stats.peak_pending_count
+		<< ", oldest " << stats.oldest_pending_age << " frames), " << stats.frames_in_flight << " frames in flight, "
+		<< stats.destroyed_count << " of " << stats.queued_count << " destroyed" << std::endl;
+}
+
+void DeletionQueue::_Queue( DeferredDeletionType type, uint64_t handle, DeferredDeletionFunction function, void* user_data )
+{
+	if( handle == 0 ) {
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock( _mutex );
+
+	PendingDeletion deletion {};
+	deletion.frame = _current_frame;
+	deletion.type = type;
+	deletion.handle = handle;
+	deletion.function = function;
+	deletion.user_data = user_data;
+	_pending.push_back( deletion );
+
+	_current_frame_used = true;
+	_queued_count++;
+	_peak_pending_count = std::max<uint64_t>( _peak_pending_count, _pending.size() );
+}
+
+void DeletionQueue::_PollFences( bool wait )
+{
+	VkDevice device = _renderer->getDevice();
+
+	// Fences signal in submission order, so stop at the first one that hasn't
+	while( !_frame_fences.empty() ) {
+		FrameFence& frame_fence = _frame_fences.front();
+
+		if( wait ) {
+			vkWaitForFences( device, 1, &frame_fence.fence, VK_TRUE, UINT64_MAX );
+		}
+		else if( vkGetFenceStatus( device, frame_fence.fence ) != VK_SUCCESS ) {
+			break;
+		}
+
+		_CompleteFrontFence();
+	}
+}
+
+void DeletionQueue::_CompleteFrontFence()
+{
+	FrameFence& frame_fence = _frame_fences.front();
+
+	// Borrowed fences are reset by their owner
+	if( frame_fence.owned ) {
+		vkResetFences( _renderer->getDevice(), 1, &frame_fence.fence );
+		_free_fences.push_back( frame_fence.fence );
+	}
+
+	_completed_frame = frame_fence.frame;
+	_frame_fences.pop_front();
+}
+
+void DeletionQueue::_DestroyCompleted()
+{
+	// Destruction runs outside the lock so custom functions can queue more deletions
+	for( ;; ) {
+		PendingDeletion deletion {};
+		{
+			std::lock_guard<std::mutex> lock( _mutex );
+			if( _pending.empty() || _pending.front().frame > _completed_frame ) {
+				return;
+			}
+
+			deletion = _pending.front();
+			_pending.pop_front();
+			_destroyed_count++;
+		}
+
+		_Destroy( deletion );
+	}
+}
+
+void DeletionQueue::_Destroy( const PendingDeletion& deletion )
+{
+	VkDevice device = _renderer->getDevice();
+	const VkAllocationCallbacks* allocator = _renderer->getAllocationCallbacks();
+
+	switch( deletion.type ) {
+		case DEFERRED_DELETION_BUFFER:
+			vkDestroyBuffer( device, (VkBuffer)deletion.handle, allocator );
+			break;
+		case DEFERRED_DELETION_IMAGE:
+			vkDestroyImage( device, (VkImage)deletion.handle, allocator );
+			break;
+		case DEFERRED_DELETION_IMAGE_VIEW:
+			vkDestroyImageView( device, (VkImageView)deletion.handle, allocator );
+			break;
+		case DEFERRED_DELETION_MEMORY:
+			vkFreeMemory( device, (VkDeviceMemory)deletion.handle, allocator );
+			break;
+		case DEFERRED_DELETION_SAMPLER:
+			vkDestroySampler( device, (VkSampler)deletion.handle, allocator );
+			break;
+		case DEFERRED_DELETION_COMMAND_POOL:
+			vkDestroyCommandPool( device, (VkCommandPool)deletion.handle, allocator );
+			break;
+		case DEFERRED_DELETION_FENCE:
+			vkDestroyFence( device, (VkFence)deletion.handle, allocator );
+			break;
+		case DEFERRED_DELETION_SEMAPHORE:
+			vkDestroySemaphore( device, (VkSemaphore)deletion.handle, allocator );
+			break;
+		case DEFERRED_DELETION_QUERY_POOL:
+			vkDestroyQueryPool( device, (VkQueryPool)deletion.handle, allocator );
+			break;
+		case DEFERRED_DELETION_FRAMEBUFFER:
+			vkDestroyFramebuffer( device, (VkFramebuffer)deletion.handle, allocator );
+			break;
+		case DEFERRED_DELETION_RENDER_PASS:
+			vkDestroyRenderPass( device, (VkRenderPass)deletion.handle, allocator );
+			break;
+		case DEFERRED_DELETION_PIPELINE:
+			vkDestroyPipeline( device, (VkPipeline)deletion.handle, allocator );
+			break;
+		case DEFERRED_DELETION_PIPELINE_LAYOUT:
+			vkDestroyPipelineLayout( device, (VkPipelineLayout)deletion.handle, allocator );
+			break;
+		case DEFERRED_DELETION_DESCRIPTOR_SET_LAYOUT:
+			vkDestroyDescriptorSetLayout( device, (VkDescriptorSetLayout)deletion.handle, allocator );
+			break;
+		case DEFERRED_DELETION_DESCRIPTOR_POOL:
+			vkDestroyDescriptorPool( device, (VkDescriptorPool)deletion.handle, allocator );
+			break;
+		case DEFERRED_DELETION_SHADER_MODULE:
+			vkDestroyShaderModule( device, (VkShaderModule)deletion.handle, allocator );
+			break;
+		case DEFERRED_DELETION_SWAPCHAIN:
+			vkDestroySwapchainKHR( device, (VkSwapchainKHR)deletion.handle, allocator );
+			break;
+		case DEFERRED_DELETION_SURFACE:
+			vkDestroySurfaceKHR( _renderer->getInstance(), (VkSurfaceKHR)deletion.handle, allocator );
+			break;
+		case DEFERRED_DELETION_FUNCTION:
+			deletion.function( deletion.user_data, deletion.handle );
+			break;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,138 @@
+#pragma once
+
+#include "Platform.h"
+
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+class Renderer;
+
+enum DeferredDeletionType
+{
+	DEFERRED_DELETION_BUFFER,
+	DEFERRED_DELETION_IMAGE,
+	DEFERRED_DELETION_IMAGE_VIEW,
+	DEFERRED_DELETION_MEMORY,
+	DEFERRED_DELETION_SAMPLER,
+	DEFERRED_DELETION_COMMAND_POOL,
+	DEFERRED_DELETION_FENCE,
+	DEFERRED_DELETION_SEMAPHORE,
+	DEFERRED_DELETION_QUERY_POOL,
+	DEFERRED_DELETION_FRAMEBUFFER,
+	DEFERRED_DELETION_RENDER_PASS,
+	DEFERRED_DELETION_PIPELINE,
+	DEFERRED_DELETION_PIPELINE_LAYOUT,
+	DEFERRED_DELETION_DESCRIPTOR_SET_LAYOUT,
+	DEFERRED_DELETION_DESCRIPTOR_POOL,
+	DEFERRED_DELETION_SHADER_MODULE,
+	DEFERRED_DELETION_SWAPCHAIN,
+	DEFERRED_DELETION_SURFACE,
+	DEFERRED_DELETION_FUNCTION,
+};
+
+// Custom destruction, called with the handle it was queued with
+typedef void ( *DeferredDeletionFunction )( void* user_data, uint64_t handle );
+
+struct DeletionQueueStats
+{
+	uint64_t pending_count = 0;
+	uint64_t peak_pending_count = 0;
+	uint64_t oldest_pending_age = 0;	// in frames
+	uint64_t frames_in_flight = 0;
+
+	uint64_t queued_count = 0;
+	uint64_t destroyed_count = 0;
+};
+
+// Destroys Vulkan objects once the GPU is done with them, without idling the queue.
+//
+// Destroy requests are tagged with the current frame. EndFrame() closes the frame with a fence that signals only after
+// all earlier work on the queue has completed: the fence the renderer submitted its frame with, or else an empty
+// vkQueueSubmit with a fence of the queue's own. Once a frame's fence has signaled everything tagged with that frame or
+// an earlier one is destroyed. Only work on the renderer's queue is tracked, so objects used on other queues have to be
+// retired by their owners.
+//
+// Requests can come from any thread. Handles are destroyed with the renderer's allocation callbacks.
+class DeletionQueue
+{
+public:
+	DeletionQueue( Renderer* r );
+	~DeletionQueue();
+
+	// Closes the current frame and destroys whatever earlier frames have made safe. Never blocks. frame_fence, if given,
+	// must have been submitted after all of the frame's work and stays the caller's, who calls RetireFence() once it
+	// has signaled and before resetting it. Without one the frame is closed with an empty submit
+	void EndFrame( VkFence frame_fence = VK_NULL_HANDLE );
+	void RetireFence( VkFence frame_fence );
+	// Destroys whatever has become safe, without closing the current frame
+	void Collect();
+	// Waits for every frame and destroys everything queued, for shutdown and teardown of whole subsystems
+	void Flush();
+
+	void DestroyBuffer( VkBuffer buffer );
+	void DestroyImage( VkImage image );
+	void DestroyImageView( VkImageView image_view );
+	void FreeMemory( VkDeviceMemory memory );
+	void DestroySampler( VkSampler sampler );
+	void DestroyCommandPool( VkCommandPool command_pool );
+	void DestroyFence( VkFence fence );
+	void DestroySemaphore( VkSemaphore semaphore );
+	void DestroyQueryPool( VkQueryPool query_pool );
+	void DestroyFramebuffer( VkFramebuffer framebuffer );
+	void DestroyRenderPass( VkRenderPass render_pass );
+	void DestroyPipeline( VkPipeline pipeline );
+	void DestroyPipelineLayout( VkPipelineLayout pipeline_layout );
+	void DestroyDescriptorSetLayout( VkDescriptorSetLayout descriptor_set_layout );
+	void DestroyDescriptorPool( VkDescriptorPool descriptor_pool );
+	void DestroyShaderModule( VkShaderModule shader_module );
+	void DestroySwapchain( VkSwapchainKHR swapchain );
+	void DestroySurface( VkSurfaceKHR surface );
+	void Defer( DeferredDeletionFunction function, void* user_data, uint64_t handle );
+
+	uint64_t getCurrentFrame() const;
+	uint64_t getCompletedFrame() const;
+
+	DeletionQueueStats getStats() const;
+	void PrintStats() const;
+
+private:
+	struct PendingDeletion
+	{
+		uint64_t frame;
+		DeferredDeletionType type;
+		uint64_t handle;
+		DeferredDeletionFunction function;
+		void* user_data;
+	};
+
+	struct FrameFence
+	{
+		uint64_t frame;
+		VkFence fence;
+		bool owned;			// from _free_fences, otherwise borrowed through EndFrame()
+	};
+
+	void _Queue( DeferredDeletionType type, uint64_t handle, DeferredDeletionFunction function = nullptr, void* user_data = nullptr );
+	void _PollFences( bool wait );
+	void _CompleteFrontFence();
+	void _DestroyCompleted();
+	void _Destroy( const PendingDeletion& deletion );
+
+	Renderer* _renderer = nullptr;
+
+	mutable std::mutex _mutex;
+
+	uint64_t _current_frame = 1;
+	uint64_t _completed_frame = 0;
+	bool _current_frame_used = false;
+
+	std::deque<PendingDeletion> _pending;
+	std::deque<FrameFence> _frame_fences;
+	std::vector<VkFence> _free_fences;
+
+	uint64_t _peak_pending_count = 0;
+	uint64_t _queued_count = 0;
+	uint64_t _destroyed_count = 0;
+};
\ No newline at end of file
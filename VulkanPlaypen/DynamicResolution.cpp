@@ -0,0 +1,346 @@
+#include "DynamicResolution.h"
+#include "RendererUtils.h"
+#include "DeletionQueue.h"
+#include "ObjectCache.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+
+DynamicResolution::DynamicResolution( Renderer* r, VkFormat format, uint32_t output_x, uint32_t output_y, const DynamicResolutionSettings& settings )
+{
+	_renderer = r;
+	_settings = settings;
+	_format = format;
+
+	// Crossed limits would make the clamp in OnGpuTime() pick max_scale whatever was measured
+	_settings.max_scale = std::max( _settings.max_scale, 0.01f );
+	_settings.min_scale = std::min( std::max( _settings.min_scale, 0.01f ), _settings.max_scale );
+	_scale = _settings.max_scale;
+
+	VkFormatProperties format_properties {};
+	vkGetPhysicalDeviceFormatProperties( _renderer->getPhysicalDevice(), _format, &format_properties );
+	if( format_properties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT ) {
+		_filter = VK_FILTER_LINEAR;
+	}
+
+	_log.reserve( std::min<size_t>( _settings.max_log_entries, 4096 ) );
+
+	_InitRenderPass();
+	SetOutputSize( output_x, output_y );
+}
+
+
+DynamicResolution::~DynamicResolution()
+{
+	if( !_settings.log_path.empty() ) {
+		WriteLog( _settings.log_path );
+	}
+
+	_DeInitTarget();
+}
+
+bool DynamicResolution::IsSupported( Renderer* r, VkFormat format )
+{
+	VkFormatProperties format_properties {};
+	vkGetPhysicalDeviceFormatProperties( r->getPhysicalDevice(), format, &format_properties );
+
+	VkFormatFeatureFlags required = VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BIT | VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT;
+	return ( format_properties.optimalTilingFeatures & required ) == required;
+}
+
+void DynamicResolution::SetOutputSize( uint32_t output_x, uint32_t output_y )
+{
+	_output_x = std::max( output_x, 1u );
+	_output_y = std::max( output_y, 1u );
+
+	uint32_t needed_x = std::max( uint32_t( std::ceil( _output_x * _settings.max_scale ) ), 1u );
+	uint32_t needed_y = std::max( uint32_t( std::ceil( _output_y * _settings.max_scale ) ), 1u );
+
+	// Never shrinks, a window that is made smaller and then bigger again shouldn't reallocate twice
+	if( needed_x > _target_x || needed_y > _target_y ) {
+		needed_x = std::max( needed_x, _target_x );
+		needed_y = std::max( needed_y, _target_y );
+		_DeInitTarget();
+		_InitTarget( needed_x, needed_y );
+	}
+
+	_UpdateRenderExtent();
+}
+
+void DynamicResolution::RecordFrame( VkCommandBuffer command_buffer, uint32_t frame_slot, uint64_t frame_index, const VkClearColorValue& clear_color, VkImage output_image )
+{
+	_slot_frames[frame_slot].frame_index = frame_index;
+	_slot_frames[frame_slot].width = _render_extent.width;
+	_slot_frames[frame_slot].height = _render_extent.height;
+	_slot_frames[frame_slot].scale = _scale;
+
+	VkClearValue clear_value {};
+	clear_value.color = clear_color;
+
+	VkRenderPassBeginInfo begin_info {};
+	begin_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+	begin_info.renderPass = _render_pass;
+	begin_info.framebuffer = _target_framebuffer;
+	begin_info.renderArea.extent = _render_extent;
+	begin_info.clearValueCount = 1;
+	begin_info.pClearValues = &clear_value;
+	vkCmdBeginRenderPass( command_buffer, &begin_info, VK_SUBPASS_CONTENTS_INLINE );
+
+	if( _settings.fill_passes > 0 ) {
+		VkClearAttachment fill {};
+		fill.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		fill.colorAttachment = 0;
+		fill.clearValue = clear_value;
+
+		VkClearRect fill_rect {};
+		fill_rect.rect.extent = _render_extent;
+		fill_rect.layerCount = 1;
+
+		for( uint32_t i = 0; i < _settings.fill_passes; i++ ) {
+			vkCmdClearAttachments( command_buffer, 1, &fill, 1, &fill_rect );
+		}
+	}
+
+	vkCmdEndRenderPass( command_buffer );
+
+	// The render pass leaves the target in TRANSFER_SRC_OPTIMAL, its outgoing dependency covers the blit
+	VkImageBlit blit {};
+	blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	blit.srcSubresource.layerCount = 1;
+	blit.srcOffsets[1].x = int32_t( _render_extent.width );
+	blit.srcOffsets[1].y = int32_t( _render_extent.height );
+	blit.srcOffsets[1].z = 1;
+	blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	blit.dstSubresource.layerCount = 1;
+	blit.dstOffsets[1].x = int32_t( _output_x );
+	blit.dstOffsets[1].y = int32_t( _output_y );
+	blit.dstOffsets[1].z = 1;
+	vkCmdBlitImage( command_buffer, _target_image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, output_image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, _filter );
+}
+
+void DynamicResolution::OnGpuTime( uint32_t frame_slot, double gpu_ms )
+{
+	const SlotFrame& frame = _slot_frames[frame_slot];
+	uint64_t pixels = uint64_t( frame.width ) * frame.height;
+	if( pixels == 0 ) {
+		return;
+	}
+
+	double cost = gpu_ms / double( pixels );
+	_cost_per_pixel_ms = _cost_per_pixel_ms > 0.0 ? _cost_per_pixel_ms + ( cost - _cost_per_pixel_ms ) * _settings.cost_smoothing : cost;
+
+	// A late frame is acted on right away, the smoothed cost would keep the next few late as well
+	double estimate = gpu_ms > _settings.target_gpu_ms ? std::max( cost, _cost_per_pixel_ms ) : _cost_per_pixel_ms;
+	double budget_pixels = _settings.target_gpu_ms * _settings.headroom / estimate;
+
+	float wanted = float( std::sqrt( budget_pixels / ( double( _output_x ) * _output_y ) ) );
+	wanted = std::min( wanted, _scale + _settings.max_scale_increase );
+	wanted = std::max( _settings.min_scale, std::min( _settings.max_scale, wanted ) );
+
+	// Small changes are let through when they reach a limit, otherwise the scale could stop just short of it
+	bool at_limit = wanted == _settings.min_scale || wanted == _settings.max_scale;
+	if( std::fabs( wanted - _scale ) >= _settings.min_scale_change || ( at_limit && wanted != _scale ) ) {
+		_scale = wanted;
+		_UpdateRenderExtent();
+		_stats.scale_changes++;
+	}
+
+	DynamicResolutionLogEntry entry {};
+	entry.frame_index = frame.frame_index;
+	entry.gpu_ms = gpu_ms;
+	entry.width = frame.width;
+	entry.height = frame.height;
+	entry.scale = frame.scale;
+	entry.next_scale = _scale;
+	if( _log.size() < _settings.max_log_entries ) {
+		_log.push_back( entry );
+	}
+	else {
+		_log_dropped_count++;
+	}
+
+	_stats.scale_min = _stats.samples > 0 ? std::min( _stats.scale_min, frame.scale ) : frame.scale;
+	_stats.scale_max = _stats.samples > 0 ? std::max( _stats.scale_max, frame.scale ) : frame.scale;
+	_stats.scale_total += frame.scale;
+	_stats.samples++;
+	if( gpu_ms > _settings.target_gpu_ms ) {
+		_stats.frames_over_target++;
+	}
+}
+
+float DynamicResolution::getScale() const
+{
+	return _scale;
+}
+
+VkExtent2D DynamicResolution::getRenderExtent() const
+{
+	return _render_extent;
+}
+
+const std::vector<DynamicResolutionLogEntry>& DynamicResolution::getLog() const
+{
+	return _log;
+}
+
+bool DynamicResolution::WriteLog( const std::string& path ) const
+{
+	std::ofstream file( path );
+	if( !file ) {
+		std::cout << "Failed to write the dynamic resolution log to " << path << std::endl;
+		return false;
+	}
+
+	file << "frame,gpu_ms,width,height,scale,next_scale" << std::endl;
+	file << std::fixed;
+	for( auto &i : _log ) {
+		file << i.frame_index << "," << std::setprecision( 3 ) << i.gpu_ms << "," << i.width << "," << i.height << ","
+			<< std::setprecision( 4 ) << i.scale << "," << i.next_scale << "\n";
+	}
+
+	std::cout << "Wrote " << _log.size() << " dynamic resolution log entries to " << path;
+	if( _log_dropped_count > 0 ) {
+		std::cout << ", " << _log_dropped_count << " later frames were not logged";
+	}
+	std::cout << std::endl;
+	return true;
+}
+
+const DynamicResolutionStats& DynamicResolution::getStats() const
+{
+	return _stats;
+}
+
+void DynamicResolution::ResetStats()
+{
+	_stats = DynamicResolutionStats();
+}
+
+void DynamicResolution::PrintStats() const
+{
+	double scale_avg = _stats.samples > 0 ? _stats.scale_total / _stats.samples : 0.0;
+
+	std::cout << std::fixed << std::setprecision( 2 ) << "  dynamic resolution: scale avg " << scale_avg << " (min " << _stats.scale_min
+		<< ", max " << _stats.scale_max << "), now " << _render_extent.width << "x" << _render_extent.height << " of "
+		<< _output_x << "x" << _output_y << ", " << _stats.scale_changes << " changes, " << _stats.frames_over_target << " of "
+		<< _stats.samples << " frames over " << _settings.target_gpu_ms << " ms" << std::endl;
+}
+
+void DynamicResolution::_InitRenderPass()
+{
+	VkAttachmentDescription attachment {};
+	attachment.format = _format;
+	attachment.samples = VK_SAMPLE_COUNT_1_BIT;
+	attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+	attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+	attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	attachment.finalLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+
+	VkAttachmentReference color_reference {};
+	color_reference.attachment = 0;
+	color_reference.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+	VkSubpassDescription subpass {};
+	subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+	subpass.colorAttachmentCount = 1;
+	subpass.pColorAttachments = &color_reference;
+
+	// Frames in flight share the target: a frame's clear waits for the previous frame's blit to have read it, and
+	// the blit waits for the clear and fills
+	VkSubpassDependency dependencies[2] {};
+	dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+	dependencies[0].dstSubpass = 0;
+	dependencies[0].srcStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+	dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	dependencies[0].srcAccessMask = 0;
+	dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	dependencies[1].srcSubpass = 0;
+	dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+	dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	dependencies[1].dstStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+	dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	dependencies[1].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+	VkRenderPassCreateInfo render_pass_info {};
+	render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+	render_pass_info.attachmentCount = 1;
+	render_pass_info.pAttachments = &attachment;
+	render_pass_info.subpassCount = 1;
+	render_pass_info.pSubpasses = &subpass;
+	render_pass_info.dependencyCount = 2;
+	render_pass_info.pDependencies = dependencies;
+	_render_pass = _renderer->getObjectCache()->GetRenderPass( render_pass_info );
+}
+
+void DynamicResolution::_InitTarget( uint32_t size_x, uint32_t size_y )
+{
+	VkDevice device = _renderer->getDevice();
+
+	VkImageCreateInfo image_info {};
+	image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	image_info.imageType = VK_IMAGE_TYPE_2D;
+	image_info.format = _format;
+	image_info.extent.width = size_x;
+	image_info.extent.height = size_y;
+	image_info.extent.depth = 1;
+	image_info.mipLevels = 1;
+	image_info.arrayLayers = 1;
+	image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+	image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+	image_info.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+	image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	vkResultErrorCheck( vkCreateImage( device, &image_info, _renderer->getAllocationCallbacks(), &_target_image ) );
+	vkResultErrorCheck( AllocateImageMemory( device, _renderer->getAllocationCallbacks(), _renderer->getPhysicalDeviceMemoryProperties(), _target_image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &_target_memory ) );
+
+	VkImageViewCreateInfo view_info {};
+	view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	view_info.image = _target_image;
+	view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	view_info.format = _format;
+	view_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	view_info.subresourceRange.levelCount = 1;
+	view_info.subresourceRange.layerCount = 1;
+	vkResultErrorCheck( vkCreateImageView( device, &view_info, _renderer->getAllocationCallbacks(), &_target_view ) );
+
+	VkFramebufferCreateInfo framebuffer_info {};
+	framebuffer_info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+	framebuffer_info.renderPass = _render_pass;
+	framebuffer_info.attachmentCount = 1;
+	framebuffer_info.pAttachments = &_target_view;
+	framebuffer_info.width = size_x;
+	framebuffer_info.height = size_y;
+	framebuffer_info.layers = 1;
+	_target_framebuffer = _renderer->getObjectCache()->GetFramebuffer( framebuffer_info );
+
+	_target_x = size_x;
+	_target_y = size_y;
+}
+
+void DynamicResolution::_DeInitTarget()
+{
+	// Frames still in flight may render into it
+	if( _target_image != VK_NULL_HANDLE ) {
+		_renderer->getObjectCache()->InvalidateImageView( _target_view );
+		_renderer->getDeletionQueue()->DestroyImageView( _target_view );
+		_renderer->getDeletionQueue()->DestroyImage( _target_image );
+		_renderer->getDeletionQueue()->FreeMemory( _target_memory );
+	}
+
+	_target_framebuffer = VK_NULL_HANDLE;
+	_target_view = VK_NULL_HANDLE;
+	_target_image = VK_NULL_HANDLE;
+	_target_memory = VK_NULL_HANDLE;
+	_target_x = 0;
+	_target_y = 0;
+}
+
+void DynamicResolution::_UpdateRenderExtent()
+{
+	_render_extent.width = std::max( 1u, std::min( _target_x, uint32_t( std::lround( _output_x * _scale ) ) ) );
+	_render_extent.height = std::max( 1u, std::min( _target_y, uint32_t( std::lround( _output_y * _scale ) ) ) );
+}
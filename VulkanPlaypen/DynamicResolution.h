@@ -0,0 +1,133 @@
+#pragma once
+
+#include "Platform.h"
+#include "Renderer.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct DynamicResolutionSettings
+{
+	double target_gpu_ms = 16.0;
+	// Aim this far under the target, so noise alone doesn't push frames over it
+	double headroom = 0.9;
+
+	float min_scale = 0.5f;
+	float max_scale = 1.0f;
+
+	// Largest step up per measured frame, steps down are not limited
+	float max_scale_increase = 0.05f;
+	// Smaller changes are ignored so the resolution doesn't wobble
+	float min_scale_change = 0.02f;
+	// Weight of a new measurement in the smoothed cost per pixel
+	double cost_smoothing = 0.2;
+
+	// Full render area fills per frame on top of the clear, standing in for scene work
+	uint32_t fill_passes = 0;
+
+	// CSV of every measured frame and the scale chosen after it, written on destruction. Empty for none
+	std::string log_path;
+	// Frames measured after the log holds this many are not logged
+	uint32_t max_log_entries = 100000;
+};
+
+struct DynamicResolutionLogEntry
+{
+	uint64_t frame_index;
+	double gpu_ms;
+	uint32_t width;
+	uint32_t height;
+	float scale;			// the measured frame's
+	float next_scale;		// chosen from its measurement
+};
+
+struct DynamicResolutionStats
+{
+	uint32_t samples = 0;
+	uint32_t frames_over_target = 0;
+	uint32_t scale_changes = 0;
+	float scale_min = 0.0f;
+	float scale_max = 0.0f;
+	double scale_total = 0.0;
+};
+
+// Renders a window's frames into a sub-rectangle of an offscreen target and scales them up into the swapchain image
+// with a blit. The sub-rectangle's size follows the GPU time measured for earlier frames: a controller keeps a
+// smoothed cost per rendered pixel and picks the scale whose pixel count fits the target frame time. Costs are per
+// pixel so measurements that arrive a few frames late, rendered at an older scale, still apply.
+//
+// The target is allocated at the output size times max_scale, so scale changes only move the render area. It is
+// reallocated only when the output grows past it.
+class DynamicResolution
+{
+public:
+	DynamicResolution( Renderer* r, VkFormat format, uint32_t output_x, uint32_t output_y, const DynamicResolutionSettings& settings );
+	~DynamicResolution();
+
+	// The format has to be renderable and blittable from, the output image's to blit into
+	static bool IsSupported( Renderer* r, VkFormat format );
+
+	void SetOutputSize( uint32_t output_x, uint32_t output_y );
+
+	// Clears the render area to clear_color, runs the fill passes and blits the result over the whole output image,
+	// which must be in TRANSFER_DST_OPTIMAL layout
+	void RecordFrame( VkCommandBuffer command_buffer, uint32_t frame_slot, uint64_t frame_index, const VkClearColorValue& clear_color, VkImage output_image );
+
+	// GPU time of the frame last recorded with frame_slot
+	void OnGpuTime( uint32_t frame_slot, double gpu_ms );
+
+	float getScale() const;
+	VkExtent2D getRenderExtent() const;
+
+	const std::vector<DynamicResolutionLogEntry>& getLog() const;
+	bool WriteLog( const std::string& path ) const;
+
+	const DynamicResolutionStats& getStats() const;
+	void ResetStats();
+	void PrintStats() const;
+
+private:
+	struct SlotFrame
+	{
+		uint64_t frame_index;
+		uint32_t width;
+		uint32_t height;
+		float scale;
+	};
+
+	// The render pass and framebuffer come from the renderer's object cache
+	void _InitRenderPass();
+
+	void _InitTarget( uint32_t size_x, uint32_t size_y );
+	void _DeInitTarget();
+
+	void _UpdateRenderExtent();
+
+	Renderer* _renderer = nullptr;
+	DynamicResolutionSettings _settings;
+	VkFormat _format = VK_FORMAT_UNDEFINED;
+	VkFilter _filter = VK_FILTER_NEAREST;
+
+	uint32_t _output_x = 0;
+	uint32_t _output_y = 0;
+
+	VkRenderPass _render_pass = VK_NULL_HANDLE;
+
+	uint32_t _target_x = 0;
+	uint32_t _target_y = 0;
+	VkImage _target_image = VK_NULL_HANDLE;
+	VkDeviceMemory _target_memory = VK_NULL_HANDLE;
+	VkImageView _target_view = VK_NULL_HANDLE;
+	VkFramebuffer _target_framebuffer = VK_NULL_HANDLE;
+
+	float _scale = 1.0f;
+	VkExtent2D _render_extent {};
+	double _cost_per_pixel_ms = 0.0;
+
+	SlotFrame _slot_frames[Renderer::FRAMES_IN_FLIGHT] {};
+
+	std::vector<DynamicResolutionLogEntry> _log;
+	uint64_t _log_dropped_count = 0;
+	DynamicResolutionStats _stats;
+};
@@ -0,0 +1,137 @@
+#include "FrameUploadBuffer.h"
+#include "Renderer.h"
+#include "RendererUtils.h"
+#include "DeletionQueue.h"
+#include "SubmissionQueue.h"
+
+#include <algorithm>
+
+FrameUploadBuffer::FrameUploadBuffer( Renderer* r, VkDeviceSize frame_size )
+{
+	_renderer = r;
+
+	_fences = new VkFence[Renderer::FRAMES_IN_FLIGHT];
+	_fence_pending = new bool[Renderer::FRAMES_IN_FLIGHT];
+	for( uint32_t i = 0; i < Renderer::FRAMES_IN_FLIGHT; i++ ) {
+		VkFenceCreateInfo fence_info {};
+		fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+		vkResultErrorCheck( vkCreateFence( _renderer->getDevice(), &fence_info, _renderer->getAllocationCallbacks(), &_fences[i] ) );
+		_fence_pending[i] = false;
+	}
+
+	_InitBuffer( frame_size );
+}
+
+
+FrameUploadBuffer::~FrameUploadBuffer()
+{
+	VkDevice device = _renderer->getDevice();
+
+	for( uint32_t i = 0; i < Renderer::FRAMES_IN_FLIGHT; i++ ) {
+		if( _fence_pending[i] ) {
+			vkWaitForFences( device, 1, &_fences[i], VK_TRUE, UINT64_MAX );
+		}
+		vkDestroyFence( device, _fences[i], _renderer->getAllocationCallbacks() );
+	}
+	delete[] _fences;
+	delete[] _fence_pending;
+
+	// Work submitted after the last EndFrame() isn't fenced, leave the buffer to the deletion queue
+	vkUnmapMemory( device, _memory );
+	_renderer->getDeletionQueue()->DestroyBuffer( _buffer );
+	_renderer->getDeletionQueue()->FreeMemory( _memory );
+}
+
+FrameUploadAllocation FrameUploadBuffer::Allocate( VkDeviceSize size, VkDeviceSize alignment )
+{
+	FrameUploadAllocation allocation {};
+	allocation.buffer = _buffer;
+	allocation.frame = _frame;
+	allocation.generation = _generation;
+
+	VkDeviceSize offset = ( _used + alignment - 1 ) / alignment * alignment;
+	if( offset + size > _frame_size ) {
+		return allocation;
+	}
+
+	VkDeviceSize region = _frame_size * ( _frame % Renderer::FRAMES_IN_FLIGHT );
+	allocation.offset = region + offset;
+	allocation.data = _data + region + offset;
+
+	_used = offset + size;
+	return allocation;
+}
+
+void FrameUploadBuffer::EndFrame()
+{
+	VkDevice device = _renderer->getDevice();
+
+	// An empty submit signals once everything submitted before it, including this frame's reads, has completed
+	uint32_t slot = uint32_t( _frame % Renderer::FRAMES_IN_FLIGHT );
+	_renderer->getSubmissionQueue()->Submit( 0, nullptr, _fences[slot] );
+	_fence_pending[slot] = true;
+
+	_frame++;
+	_used = 0;
+
+	slot = uint32_t( _frame % Renderer::FRAMES_IN_FLIGHT );
+	if( _fence_pending[slot] ) {
+		vkResultErrorCheck( vkWaitForFences( device, 1, &_fences[slot], VK_TRUE, UINT64_MAX ) );
+		vkResultErrorCheck( vkResetFences( device, 1, &_fences[slot] ) );
+		_fence_pending[slot] = false;
+	}
+}
+
+void FrameUploadBuffer::Reserve( VkDeviceSize frame_size )
+{
+	if( frame_size <= _frame_size ) {
+		return;
+	}
+
+	vkUnmapMemory( _renderer->getDevice(), _memory );
+	_renderer->getDeletionQueue()->DestroyBuffer( _buffer );
+	_renderer->getDeletionQueue()->FreeMemory( _memory );
+
+	_InitBuffer( frame_size );
+	_used = 0;
+}
+
+uint64_t FrameUploadBuffer::getCurrentFrame() const
+{
+	return _frame;
+}
+
+VkDeviceSize FrameUploadBuffer::getFrameSize() const
+{
+	return _frame_size;
+}
+
+VkDeviceSize FrameUploadBuffer::getUsedSize() const
+{
+	return _used;
+}
+
+void FrameUploadBuffer::_InitBuffer( VkDeviceSize frame_size )
+{
+	VkDevice device = _renderer->getDevice();
+	const VkPhysicalDeviceLimits& limits = _renderer->getPhysicalDeviceProperties().limits;
+
+	// Keep every region start valid for any kind of binding
+	VkDeviceSize region_alignment = std::max<VkDeviceSize>( 256, std::max( limits.minUniformBufferOffsetAlignment, limits.minStorageBufferOffsetAlignment ) );
+	_frame_size = ( frame_size + region_alignment - 1 ) / region_alignment * region_alignment;
+
+	VkBufferCreateInfo buffer_info {};
+	buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	buffer_info.size = _frame_size * Renderer::FRAMES_IN_FLIGHT;
+	buffer_info.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT |
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+	buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	vkResultErrorCheck( vkCreateBuffer( device, &buffer_info, _renderer->getAllocationCallbacks(), &_buffer ) );
+	vkResultErrorCheck( AllocateBufferMemory( device, _renderer->getAllocationCallbacks(), _renderer->getPhysicalDeviceMemoryProperties(), _buffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &_memory ) );
+
+	void* mapped = nullptr;
+	vkResultErrorCheck( vkMapMemory( device, _memory, 0, VK_WHOLE_SIZE, 0, &mapped ) );
+	_data = reinterpret_cast<uint8_t*>( mapped );
+
+	_generation++;
+}
\ No newline at end of file
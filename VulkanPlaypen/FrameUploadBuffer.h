@@ -0,0 +1,61 @@
+#pragma once
+
+#include "Platform.h"
+
+#include <cstdint>
+
+class Renderer;
+
+struct FrameUploadAllocation
+{
+	VkBuffer buffer;
+	VkDeviceSize offset;
+	void* data;				// nullptr when the frame's region is full
+
+	uint64_t frame;
+	uint32_t generation;	// changes whenever Reserve() replaces the buffer
+};
+
+// Host visible memory for data written by the CPU every frame: instance transforms, uniforms, dynamic geometry.
+//
+// One persistently mapped buffer is split into a region per frame in flight. Allocations are linear within the
+// current frame's region and EndFrame() moves on to the next one, waiting only if the GPU is still using it from
+// FRAMES_IN_FLIGHT frames ago. Regions are fenced with an empty vkQueueSubmit, so everything that reads the frame's
+// data has to be submitted to the renderer's queue before EndFrame().
+//
+// Region contents survive until the region comes around again, so a caller that gets the same offset
+// FRAMES_IN_FLIGHT frames later may update only what changed since then.
+class FrameUploadBuffer
+{
+public:
+	FrameUploadBuffer( Renderer* r, VkDeviceSize frame_size );
+	~FrameUploadBuffer();
+
+	FrameUploadAllocation Allocate( VkDeviceSize size, VkDeviceSize alignment = 16 );
+
+	void EndFrame();
+
+	// Grows every region to at least frame_size. The old buffer is retired through the deletion queue
+	void Reserve( VkDeviceSize frame_size );
+
+	uint64_t getCurrentFrame() const;
+	VkDeviceSize getFrameSize() const;
+	VkDeviceSize getUsedSize() const;
+
+private:
+	void _InitBuffer( VkDeviceSize frame_size );
+
+	Renderer* _renderer = nullptr;
+
+	VkBuffer _buffer = VK_NULL_HANDLE;
+	VkDeviceMemory _memory = VK_NULL_HANDLE;
+	uint8_t* _data = nullptr;
+	VkDeviceSize _frame_size = 0;
+	uint32_t _generation = 0;
+
+	VkFence* _fences = nullptr;
+	bool* _fence_pending = nullptr;
+
+	uint64_t _frame = 0;
+	VkDeviceSize _used = 0;
+};
\ No newline at end of file
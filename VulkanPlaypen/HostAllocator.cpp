@@ -0,0 +1,515 @@
+#include "HostAllocator.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <new>
+
+#define HOST_ALLOCATOR_MIN_BLOCK_SIZE    64
+#define HOST_ALLOCATOR_MIN_ALIGNMENT     16
+#define HOST_ALLOCATOR_SIZE_CLASS_LARGE  0xFF
+#define HOST_ALLOCATOR_SIZE_CLASS_ARENA  0xFE
+
+// Sits right in front of every pointer handed to the driver
+struct HostBlockHeader
+{
+	size_t size;				// requested size
+	uint32_t offset;			// from the start of the block to the user pointer
+	uint8_t size_class;
+	uint8_t scope;
+	void* owner;				// HostCommandArena of arena blocks, HostThreadCache of slab blocks
+};
+
+struct HostCommandArena
+{
+	std::atomic<uint32_t> live;
+	size_t offset;
+};
+
+// Arena data starts after the arena header, rounded up to the minimum alignment
+#define HOST_COMMAND_ARENA_HEADER_SIZE  ( ( sizeof( HostCommandArena ) + HOST_ALLOCATOR_MIN_ALIGNMENT - 1 ) & ~size_t( HOST_ALLOCATOR_MIN_ALIGNMENT - 1 ) )
+
+// One per thread and allocator, owned by the allocator so other threads can still free into it
+struct HostThreadCache
+{
+	HostThreadCache()
+	{
+		for( auto &i : remote_frees ) {
+			i = nullptr;
+		}
+	}
+
+	void* free_lists[HOST_ALLOCATOR_SIZE_CLASS_COUNT] = {};
+
+	// Blocks of this cache freed on other threads. Any thread pushes, the owning thread takes the whole list at once
+	std::atomic<void*> remote_frees[HOST_ALLOCATOR_SIZE_CLASS_COUNT];
+
+	HostCommandArena* arena = nullptr;
+};
+
+struct HostThreadCacheEntry
+{
+	uint64_t allocator_id;
+	HostThreadCache* cache;
+};
+
+// Caches of every allocator this thread has used. Ids aren't reused, so entries of destroyed allocators are never
+// looked up again
+static thread_local std::vector<HostThreadCacheEntry> host_thread_caches;
+static std::atomic<uint64_t> host_allocator_next_id( 1 );
+
+static const char* HOST_ALLOCATION_SCOPE_NAMES[HOST_ALLOCATOR_SCOPE_COUNT] = { "command", "object", "cache", "device", "instance" };
+
+static uintptr_t AlignHostAddress( uintptr_t address, size_t alignment )
+{
+	return ( address + alignment - 1 ) & ~uintptr_t( alignment - 1 );
+}
+
+static uint8_t GetHostSizeClass( size_t required )
+{
+	size_t block_size = HOST_ALLOCATOR_MIN_BLOCK_SIZE;
+	for( uint8_t size_class = 0; size_class < HOST_ALLOCATOR_SIZE_CLASS_COUNT; size_class++ ) {
+		if( required <= block_size ) {
+			return size_class;
+		}
+		block_size *= 2;
+	}
+
+	return HOST_ALLOCATOR_SIZE_CLASS_LARGE;
+}
+
+static HostBlockHeader* GetHostBlockHeader( void* memory )
+{
+	return reinterpret_cast<HostBlockHeader*>( reinterpret_cast<uint8_t*>( memory ) - sizeof( HostBlockHeader ) );
+}
+
+static void* VKAPI_CALL HostAllocationCallback( void* user_data, size_t size, size_t alignment, VkSystemAllocationScope scope )
+{
+	return static_cast<HostAllocator*>( user_data )->Allocate( size, alignment, scope );
+}
+
+static void* VKAPI_CALL HostReallocationCallback( void* user_data, void* original, size_t size, size_t alignment, VkSystemAllocationScope scope )
+{
+	return static_cast<HostAllocator*>( user_data )->Reallocate( original, size, alignment, scope );
+}
+
+static void VKAPI_CALL HostFreeCallback( void* user_data, void* memory )
+{
+	static_cast<HostAllocator*>( user_data )->Free( memory );
+}
+
+static void VKAPI_CALL HostInternalAllocationCallback( void* user_data, size_t size, VkInternalAllocationType type, VkSystemAllocationScope scope )
+{
+	static_cast<HostAllocator*>( user_data )->NotifyInternalAllocation( size, scope );
+}
+
+static void VKAPI_CALL HostInternalFreeCallback( void* user_data, size_t size, VkInternalAllocationType type, VkSystemAllocationScope scope )
+{
+	static_cast<HostAllocator*>( user_data )->NotifyInternalFree( size, scope );
+}
+
+HostAllocator::HostAllocator()
+{
+	_id = host_allocator_next_id.fetch_add( 1 );
+
+	for( auto &i : _scopes ) {
+		i.allocations = 0;
+		i.reallocations = 0;
+		i.frees = 0;
+		i.allocated_bytes = 0;
+		i.live_bytes = 0;
+		i.peak_bytes = 0;
+		i.internal_allocations = 0;
+		i.internal_live_bytes = 0;
+	}
+	_system_allocations = 0;
+	_arena_allocations = 0;
+	_arena_overflows = 0;
+	_remote_frees = 0;
+
+	_callbacks.pUserData = this;
+	_callbacks.pfnAllocation = HostAllocationCallback;
+	_callbacks.pfnReallocation = HostReallocationCallback;
+	_callbacks.pfnFree = HostFreeCallback;
+	_callbacks.pfnInternalAllocation = HostInternalAllocationCallback;
+	_callbacks.pfnInternalFree = HostInternalFreeCallback;
+}
+
+
+HostAllocator::~HostAllocator()
+{
+	for( auto i : _system_blocks ) {
+		std::free( i );
+	}
+	_system_blocks.clear();
+
+	for( auto i : _thread_caches ) {
+		delete i;
+	}
+	_thread_caches.clear();
+}
+
+const VkAllocationCallbacks* HostAllocator::getCallbacks() const
+{
+	return &_callbacks;
+}
+
+void* HostAllocator::Allocate( size_t size, size_t alignment, VkSystemAllocationScope scope )
+{
+	if( size == 0 ) {
+		return nullptr;
+	}
+
+	alignment = std::max<size_t>( alignment, HOST_ALLOCATOR_MIN_ALIGNMENT );
+
+	void* memory = nullptr;
+	if( scope == VK_SYSTEM_ALLOCATION_SCOPE_COMMAND ) {
+		memory = _AllocateFromArena( size, alignment, scope );
+		if( memory != nullptr ) {
+			_arena_allocations.fetch_add( 1, std::memory_order_relaxed );
+		}
+		else {
+			_arena_overflows.fetch_add( 1, std::memory_order_relaxed );
+		}
+	}
+
+	if( memory == nullptr ) {
+		memory = _AllocateBlock( size, alignment, scope );
+		if( memory == nullptr ) {
+			return nullptr;
+		}
+	}
+
+	ScopeCounters& counters = _scopes[scope];
+	counters.allocations.fetch_add( 1, std::memory_order_relaxed );
+	counters.allocated_bytes.fetch_add( size, std::memory_order_relaxed );
+	_AddLiveBytes( scope, size );
+
+	return memory;
+}
+
+void* HostAllocator::Reallocate( void* original, size_t size, size_t alignment, VkSystemAllocationScope scope )
+{
+	if( original == nullptr ) {
+		return Allocate( size, alignment, scope );
+	}
+
+	if( size == 0 ) {
+		Free( original );
+		return nullptr;
+	}
+
+	alignment = std::max<size_t>( alignment, HOST_ALLOCATOR_MIN_ALIGNMENT );
+
+	HostBlockHeader* header = GetHostBlockHeader( original );
+	size_t original_size = header->size;
+	VkSystemAllocationScope original_scope = VkSystemAllocationScope( header->scope );
+
+	size_t capacity = header->size;
+	if( header->size_class < HOST_ALLOCATOR_SIZE_CLASS_COUNT ) {
+		capacity = ( size_t( HOST_ALLOCATOR_MIN_BLOCK_SIZE ) << header->size_class ) - header->offset;
+	}
+
+	void* memory = original;
+	if( size <= capacity && ( reinterpret_cast<uintptr_t>( original ) & ( alignment - 1 ) ) == 0 ) {
+		// Still fits the block it's in
+		header->size = size;
+		header->scope = uint8_t( scope );
+	}
+	else {
+		memory = _AllocateBlock( size, alignment, scope );
+		if( memory == nullptr ) {
+			return nullptr;
+		}
+
+		std::memcpy( memory, original, std::min( size, original_size ) );
+		_FreeBlock( original );
+	}
+
+	_scopes[original_scope].live_bytes.fetch_sub( original_size, std::memory_order_relaxed );
+
+	ScopeCounters& counters = _scopes[scope];
+	counters.reallocations.fetch_add( 1, std::memory_order_relaxed );
+	counters.allocated_bytes.fetch_add( size, std::memory_order_relaxed );
+	_AddLiveBytes( scope, size );
+
+	return memory;
+}
+
+void HostAllocator::Free( void* memory )
+{
+	if( memory == nullptr ) {
+		return;
+	}
+
+	HostBlockHeader* header = GetHostBlockHeader( memory );
+
+	ScopeCounters& counters = _scopes[header->scope];
+	counters.frees.fetch_add( 1, std::memory_order_relaxed );
+	counters.live_bytes.fetch_sub( header->size, std::memory_order_relaxed );
+
+	_FreeBlock( memory );
+}
+
+void HostAllocator::NotifyInternalAllocation( size_t size, VkSystemAllocationScope scope )
+{
+	_scopes[scope].internal_allocations.fetch_add( 1, std::memory_order_relaxed );
+	_scopes[scope].internal_live_bytes.fetch_add( size, std::memory_order_relaxed );
+}
+
+void HostAllocator::NotifyInternalFree( size_t size, VkSystemAllocationScope scope )
+{
+	_scopes[scope].internal_live_bytes.fetch_sub( size, std::memory_order_relaxed );
+}
+
+HostAllocatorStats HostAllocator::getStats() const
+{
+	HostAllocatorStats stats;
+
+	for( uint32_t i = 0; i < HOST_ALLOCATOR_SCOPE_COUNT; i++ ) {
+		stats.scopes[i].allocations = _scopes[i].allocations.load( std::memory_order_relaxed );
+		stats.scopes[i].reallocations = _scopes[i].reallocations.load( std::memory_order_relaxed );
+		stats.scopes[i].frees = _scopes[i].frees.load( std::memory_order_relaxed );
+		stats.scopes[i].allocated_bytes = _scopes[i].allocated_bytes.load( std::memory_order_relaxed );
+		stats.scopes[i].live_bytes = _scopes[i].live_bytes.load( std::memory_order_relaxed );
+		stats.scopes[i].peak_bytes = _scopes[i].peak_bytes.load( std::memory_order_relaxed );
+		stats.scopes[i].internal_allocations = _scopes[i].internal_allocations.load( std::memory_order_relaxed );
+		stats.scopes[i].internal_live_bytes = _scopes[i].internal_live_bytes.load( std::memory_order_relaxed );
+	}
+
+	stats.system_allocations = _system_allocations.load( std::memory_order_relaxed );
+	stats.arena_allocations = _arena_allocations.load( std::memory_order_relaxed );
+	stats.arena_overflows = _arena_overflows.load( std::memory_order_relaxed );
+	stats.remote_frees = _remote_frees.load( std::memory_order_relaxed );
+
+	return stats;
+}
+
+uint64_t HostAllocator::EndFrame()
+{
+	HostAllocatorStats current = getStats();
+	uint64_t allocation_count = 0;
+
+	_frame_stats = current;
+	for( uint32_t i = 0; i < HOST_ALLOCATOR_SCOPE_COUNT; i++ ) {
+		HostAllocationScopeStats& frame = _frame_stats.scopes[i];
+		const HostAllocationScopeStats& begin = _frame_begin.scopes[i];
+
+		frame.allocations -= begin.allocations;
+		frame.reallocations -= begin.reallocations;
+		frame.frees -= begin.frees;
+		frame.allocated_bytes -= begin.allocated_bytes;
+		frame.internal_allocations -= begin.internal_allocations;
+
+		allocation_count += frame.allocations + frame.reallocations;
+	}
+	_frame_stats.system_allocations -= _frame_begin.system_allocations;
+	_frame_stats.arena_allocations -= _frame_begin.arena_allocations;
+	_frame_stats.arena_overflows -= _frame_begin.arena_overflows;
+	_frame_stats.remote_frees -= _frame_begin.remote_frees;
+
+	_frame_begin = current;
+	return allocation_count;
+}
+
+const HostAllocatorStats& HostAllocator::getFrameStats() const
+{
+	return _frame_stats;
+}
+
+void HostAllocator::PrintStats() const
+{
+	PrintStats( getStats() );
+}
+
+void HostAllocator::PrintStats( const HostAllocatorStats& stats )
+{
+	std::cout << "Host allocations   allocs  reallocs     frees   live KB   peak KB  total KB  internal" << std::endl;
+
+	for( uint32_t i = 0; i < HOST_ALLOCATOR_SCOPE_COUNT; i++ ) {
+		const HostAllocationScopeStats& scope = stats.scopes[i];
+		std::cout << "  " << std::left << std::setw( 10 ) << HOST_ALLOCATION_SCOPE_NAMES[i] << std::right
+			<< std::setw( 12 ) << scope.allocations
+			<< std::setw( 10 ) << scope.reallocations
+			<< std::setw( 10 ) << scope.frees
+			<< std::setw( 10 ) << scope.live_bytes / 1024
+			<< std::setw( 10 ) << scope.peak_bytes / 1024
+			<< std::setw( 10 ) << scope.allocated_bytes / 1024
+			<< std::setw( 10 ) << scope.internal_allocations << std::endl;
+	}
+
+	std::cout << "  system allocations " << stats.system_allocations << ", command arena " << stats.arena_allocations
+		<< " (" << stats.arena_overflows << " overflowed), " << stats.remote_frees << " frees from other threads" << std::endl;
+}
+
+void* HostAllocator::_AllocateBlock( size_t size, size_t alignment, VkSystemAllocationScope scope )
+{
+	size_t required = size + sizeof( HostBlockHeader ) + alignment - 1;
+	uint8_t size_class = GetHostSizeClass( required );
+
+	uint8_t* block = nullptr;
+	HostThreadCache* cache = nullptr;
+	if( size_class == HOST_ALLOCATOR_SIZE_CLASS_LARGE ) {
+		block = static_cast<uint8_t*>( std::malloc( required ) );
+		if( block == nullptr ) {
+			return nullptr;
+		}
+		_system_allocations.fetch_add( 1, std::memory_order_relaxed );
+	}
+	else {
+		cache = _GetThreadCache();
+
+		// Blocks other threads freed come back before a new slab is taken
+		if( cache->free_lists[size_class] == nullptr ) {
+			cache->free_lists[size_class] = cache->remote_frees[size_class].exchange( nullptr, std::memory_order_acquire );
+		}
+
+		if( cache->free_lists[size_class] == nullptr ) {
+			// Refill the class with a whole slab
+			size_t block_size = size_t( HOST_ALLOCATOR_MIN_BLOCK_SIZE ) << size_class;
+			uint8_t* slab = static_cast<uint8_t*>( _AllocateSystem( HOST_ALLOCATOR_SLAB_SIZE ) );
+			if( slab == nullptr ) {
+				return nullptr;
+			}
+
+			for( size_t offset = 0; offset + block_size <= HOST_ALLOCATOR_SLAB_SIZE; offset += block_size ) {
+				*reinterpret_cast<void**>( slab + offset ) = cache->free_lists[size_class];
+				cache->free_lists[size_class] = slab + offset;
+			}
+		}
+
+		block = static_cast<uint8_t*>( cache->free_lists[size_class] );
+		cache->free_lists[size_class] = *reinterpret_cast<void**>( block );
+	}
+
+	uintptr_t memory = AlignHostAddress( reinterpret_cast<uintptr_t>( block ) + sizeof( HostBlockHeader ), alignment );
+
+	HostBlockHeader* header = GetHostBlockHeader( reinterpret_cast<void*>( memory ) );
+	header->size = size;
+	header->offset = uint32_t( memory - reinterpret_cast<uintptr_t>( block ) );
+	header->size_class = size_class;
+	header->scope = uint8_t( scope );
+	header->owner = cache;
+
+	return reinterpret_cast<void*>( memory );
+}
+
+void HostAllocator::_FreeBlock( void* memory )
+{
+	HostBlockHeader* header = GetHostBlockHeader( memory );
+	uint8_t* block = static_cast<uint8_t*>( memory ) - header->offset;
+
+	if( header->size_class == HOST_ALLOCATOR_SIZE_CLASS_ARENA ) {
+		// The owning thread rewinds the arena once nothing in it is live
+		static_cast<HostCommandArena*>( header->owner )->live.fetch_sub( 1, std::memory_order_release );
+	}
+	else if( header->size_class == HOST_ALLOCATOR_SIZE_CLASS_LARGE ) {
+		std::free( block );
+	}
+	else {
+		// Blocks go back to the cache they were allocated from, so a thread that only frees doesn't hoard them while the
+		// allocating thread keeps taking new slabs
+		HostThreadCache* owner = static_cast<HostThreadCache*>( header->owner );
+		uint8_t size_class = header->size_class;
+
+		if( owner == _GetThreadCache() ) {
+			*reinterpret_cast<void**>( block ) = owner->free_lists[size_class];
+			owner->free_lists[size_class] = block;
+		}
+		else {
+			void* head = owner->remote_frees[size_class].load( std::memory_order_relaxed );
+			do {
+				*reinterpret_cast<void**>( block ) = head;
+			} while( !owner->remote_frees[size_class].compare_exchange_weak( head, block, std::memory_order_release, std::memory_order_relaxed ) );
+
+			_remote_frees.fetch_add( 1, std::memory_order_relaxed );
+		}
+	}
+}
+
+HostThreadCache* HostAllocator::_GetThreadCache()
+{
+	for( auto &i : host_thread_caches ) {
+		if( i.allocator_id == _id ) {
+			return i.cache;
+		}
+	}
+
+	HostThreadCache* cache = new HostThreadCache();
+	{
+		std::lock_guard<std::mutex> lock( _system_mutex );
+		_thread_caches.push_back( cache );
+	}
+
+	HostThreadCacheEntry entry {};
+	entry.allocator_id = _id;
+	entry.cache = cache;
+	host_thread_caches.push_back( entry );
+
+	return cache;
+}
+
+void* HostAllocator::_AllocateFromArena( size_t size, size_t alignment, VkSystemAllocationScope scope )
+{
+	HostThreadCache& cache = *_GetThreadCache();
+
+	if( cache.arena == nullptr ) {
+		void* arena_memory = _AllocateSystem( HOST_COMMAND_ARENA_HEADER_SIZE + HOST_ALLOCATOR_COMMAND_ARENA_SIZE );
+		if( arena_memory == nullptr ) {
+			return nullptr;
+		}
+
+		cache.arena = new( arena_memory ) HostCommandArena;
+		cache.arena->live = 0;
+		cache.arena->offset = 0;
+	}
+
+	HostCommandArena* arena = cache.arena;
+	if( arena->live.load( std::memory_order_acquire ) == 0 ) {
+		arena->offset = 0;
+	}
+
+	uintptr_t base = reinterpret_cast<uintptr_t>( arena ) + HOST_COMMAND_ARENA_HEADER_SIZE;
+	uintptr_t memory = AlignHostAddress( base + arena->offset + sizeof( HostBlockHeader ), alignment );
+	if( memory + size > base + HOST_ALLOCATOR_COMMAND_ARENA_SIZE ) {
+		return nullptr;
+	}
+
+	arena->offset = memory + size - base;
+	arena->live.fetch_add( 1, std::memory_order_relaxed );
+
+	HostBlockHeader* header = GetHostBlockHeader( reinterpret_cast<void*>( memory ) );
+	header->size = size;
+	header->offset = 0;
+	header->size_class = HOST_ALLOCATOR_SIZE_CLASS_ARENA;
+	header->scope = uint8_t( scope );
+	header->owner = arena;
+
+	return reinterpret_cast<void*>( memory );
+}
+
+void* HostAllocator::_AllocateSystem( size_t size )
+{
+	void* memory = std::malloc( size );
+	if( memory == nullptr ) {
+		return nullptr;
+	}
+
+	std::lock_guard<std::mutex> lock( _system_mutex );
+	_system_blocks.push_back( memory );
+	_system_allocations.fetch_add( 1, std::memory_order_relaxed );
+
+	return memory;
+}
+
+void HostAllocator::_AddLiveBytes( VkSystemAllocationScope scope, uint64_t size )
+{
+	ScopeCounters& counters = _scopes[scope];
+	uint64_t live = counters.live_bytes.fetch_add( size, std::memory_order_relaxed ) + size;
+
+	uint64_t peak = counters.peak_bytes.load( std::memory_order_relaxed );
+	while( live > peak && !counters.peak_bytes.compare_exchange_weak( peak, live, std::memory_order_relaxed ) ) {
+	}
+}
\ No newline at end of file
@@ -0,0 +1,116 @@
+#pragma once
+
+#include "Platform.h"
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// Size classes run from 64 bytes to 8 KB in powers of two, bigger blocks go straight to malloc
+#define HOST_ALLOCATOR_SIZE_CLASS_COUNT    8
+#define HOST_ALLOCATOR_SLAB_SIZE           ( 64 * 1024 )
+#define HOST_ALLOCATOR_COMMAND_ARENA_SIZE  ( 64 * 1024 )
+#define HOST_ALLOCATOR_SCOPE_COUNT         ( VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE + 1 )
+
+struct HostAllocationScopeStats
+{
+	uint64_t allocations = 0;
+	uint64_t reallocations = 0;
+	uint64_t frees = 0;
+	uint64_t allocated_bytes = 0;
+	uint64_t live_bytes = 0;
+	uint64_t peak_bytes = 0;
+
+	// Driver allocations that bypass the callbacks, reported through pfnInternalAllocation
+	uint64_t internal_allocations = 0;
+	uint64_t internal_live_bytes = 0;
+};
+
+struct HostAllocatorStats
+{
+	HostAllocationScopeStats scopes[HOST_ALLOCATOR_SCOPE_COUNT];
+
+	uint64_t system_allocations = 0;	// trips to malloc: slab refills, command arenas and oversized blocks
+	uint64_t arena_allocations = 0;
+	uint64_t arena_overflows = 0;
+	uint64_t remote_frees = 0;			// blocks freed on another thread than the one they were allocated on
+};
+
+struct HostThreadCache;
+
+// VkAllocationCallbacks implementation for driver host memory.
+//
+// Allocations are served from thread local free lists per size class, refilled a slab at a time, so the steady
+// state never touches malloc or takes a lock. A block freed on another thread goes back to the thread that allocated
+// it through a lock-free list, which that thread takes over before it refills from a new slab. Objects created on one
+// thread and destroyed on another therefore cycle through the same blocks too. VK_SYSTEM_ALLOCATION_SCOPE_COMMAND
+// allocations only live for the duration of a single Vulkan call, so they are bumped out of a thread local arena that
+// rewinds once everything in it has been freed. Counts and bytes are tracked per VkSystemAllocationScope.
+//
+// Slabs and thread caches are only returned to the system when the allocator is destroyed, which has to happen after
+// every object created with its callbacks is gone. Blocks cached for a thread that has exited stay unused until then.
+class HostAllocator
+{
+public:
+	HostAllocator();
+	~HostAllocator();
+
+	const VkAllocationCallbacks* getCallbacks() const;
+
+	void* Allocate( size_t size, size_t alignment, VkSystemAllocationScope scope );
+	void* Reallocate( void* original, size_t size, size_t alignment, VkSystemAllocationScope scope );
+	void Free( void* memory );
+
+	void NotifyInternalAllocation( size_t size, VkSystemAllocationScope scope );
+	void NotifyInternalFree( size_t size, VkSystemAllocationScope scope );
+
+	HostAllocatorStats getStats() const;
+
+	// Closes a frame of telemetry and returns how many allocations and reallocations it made
+	uint64_t EndFrame();
+	// Counters of the frame closed by the last EndFrame(), live and peak bytes are absolute
+	const HostAllocatorStats& getFrameStats() const;
+
+	void PrintStats() const;
+	static void PrintStats( const HostAllocatorStats& stats );
+
+private:
+	struct ScopeCounters
+	{
+		std::atomic<uint64_t> allocations;
+		std::atomic<uint64_t> reallocations;
+		std::atomic<uint64_t> frees;
+		std::atomic<uint64_t> allocated_bytes;
+		std::atomic<uint64_t> live_bytes;
+		std::atomic<uint64_t> peak_bytes;
+		std::atomic<uint64_t> internal_allocations;
+		std::atomic<uint64_t> internal_live_bytes;
+	};
+
+	void* _AllocateBlock( size_t size, size_t alignment, VkSystemAllocationScope scope );
+	void _FreeBlock( void* memory );
+	void* _AllocateFromArena( size_t size, size_t alignment, VkSystemAllocationScope scope );
+	void* _AllocateSystem( size_t size );
+	HostThreadCache* _GetThreadCache();
+
+	void _AddLiveBytes( VkSystemAllocationScope scope, uint64_t size );
+
+	VkAllocationCallbacks _callbacks {};
+
+	// Identifies this allocator to the thread local caches, which outlive it
+	uint64_t _id = 0;
+
+	std::mutex _system_mutex;
+	std::vector<void*> _system_blocks;
+	std::vector<HostThreadCache*> _thread_caches;
+
+	ScopeCounters _scopes[HOST_ALLOCATOR_SCOPE_COUNT];
+	std::atomic<uint64_t> _system_allocations;
+	std::atomic<uint64_t> _arena_allocations;
+	std::atomic<uint64_t> _arena_overflows;
+	std::atomic<uint64_t> _remote_frees;
+
+	HostAllocatorStats _frame_begin;
+	HostAllocatorStats _frame_stats;
+};
\ No newline at end of file
@@ -0,0 +1,156 @@
+#include "ImageEncoding.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+struct PngCrcTable
+{
+	uint32_t entries[256];
+
+	PngCrcTable()
+	{
+		for( uint32_t n = 0; n < 256; n++ ) {
+			uint32_t c = n;
+			for( uint32_t k = 0; k < 8; k++ ) {
+				c = ( c & 1 ) ? 0xEDB88320u ^ ( c >> 1 ) : c >> 1;
+			}
+			entries[n] = c;
+		}
+	}
+};
+
+static uint32_t UpdatePngCrc( uint32_t crc, const uint8_t* data, size_t size )
+{
+	// Built on first use, function local statics are initialized once even with several writer threads
+	static const PngCrcTable table;
+
+	for( size_t i = 0; i < size; i++ ) {
+		crc = table.entries[( crc ^ data[i] ) & 0xFF] ^ ( crc >> 8 );
+	}
+	return crc;
+}
+
+static void PutBigEndian32( std::vector<uint8_t>& out, uint32_t value )
+{
+	out.push_back( uint8_t( value >> 24 ) );
+	out.push_back( uint8_t( value >> 16 ) );
+	out.push_back( uint8_t( value >> 8 ) );
+	out.push_back( uint8_t( value ) );
+}
+
+static void PutPngChunk( std::vector<uint8_t>& out, const char* type, const uint8_t* data, size_t size )
+{
+	PutBigEndian32( out, uint32_t( size ) );
+
+	size_t type_offset = out.size();
+	out.insert( out.end(), type, type + 4 );
+	out.insert( out.end(), data, data + size );
+
+	uint32_t crc = UpdatePngCrc( 0xFFFFFFFFu, out.data() + type_offset, size + 4 );
+	PutBigEndian32( out, crc ^ 0xFFFFFFFFu );
+}
+
+bool WriteRawFile( const std::string& path, const void* data, size_t size )
+{
+	FILE* file = std::fopen( path.c_str(), "wb" );
+	if( file == nullptr ) {
+		return false;
+	}
+
+	bool success = std::fwrite( data, 1, size, file ) == size;
+	return std::fclose( file ) == 0 && success;
+}
+
+bool WritePng( const std::string& path, uint32_t width, uint32_t height, VkFormat format, const void* pixels )
+{
+	bool bgra = format == VK_FORMAT_B8G8R8A8_UNORM || format == VK_FORMAT_B8G8R8A8_SRGB;
+	bool rgba = format == VK_FORMAT_R8G8B8A8_UNORM || format == VK_FORMAT_R8G8B8A8_SRGB;
+	if( !bgra && !rgba ) {
+		return false;
+	}
+
+	// Filter type 0 per row, followed by the RGBA row
+	size_t row_size = size_t( width ) * 4 + 1;
+	std::vector<uint8_t> scanlines( row_size * height );
+	const uint8_t* src = static_cast<const uint8_t*>( pixels );
+
+	for( uint32_t y = 0; y < height; y++ ) {
+		uint8_t* row = &scanlines[y * row_size];
+		row[0] = 0;
+		std::memcpy( row + 1, src + size_t( y ) * width * 4, size_t( width ) * 4 );
+
+		if( bgra ) {
+			for( uint32_t x = 0; x < width; x++ ) {
+				uint8_t* texel = row + 1 + x * 4;
+				uint8_t b = texel[0];
+				texel[0] = texel[2];
+				texel[2] = b;
+			}
+		}
+	}
+
+	// zlib stream made of stored deflate blocks
+	std::vector<uint8_t> zlib;
+	zlib.reserve( scanlines.size() + scanlines.size() / 65535 * 5 + 16 );
+	zlib.push_back( 0x78 );
+	zlib.push_back( 0x01 );
+
+	size_t offset = 0;
+	do {
+		size_t block_size = std::min<size_t>( scanlines.size() - offset, 65535 );
+		bool last = offset + block_size == scanlines.size();
+
+		zlib.push_back( last ? 1 : 0 );
+		zlib.push_back( uint8_t( block_size ) );
+		zlib.push_back( uint8_t( block_size >> 8 ) );
+		zlib.push_back( uint8_t( ~block_size ) );
+		zlib.push_back( uint8_t( ~block_size >> 8 ) );
+		zlib.insert( zlib.end(), scanlines.begin() + offset, scanlines.begin() + offset + block_size );
+
+		offset += block_size;
+	} while( offset < scanlines.size() );
+
+	uint32_t adler_a = 1;
+	uint32_t adler_b = 0;
+	for( auto i : scanlines ) {
+		adler_a = ( adler_a + i ) % 65521;
+		adler_b = ( adler_b + adler_a ) % 65521;
+	}
+	PutBigEndian32( zlib, ( adler_b << 16 ) | adler_a );
+
+	std::vector<uint8_t> png;
+	png.reserve( zlib.size() + 64 );
+
+	const uint8_t signature[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+	png.insert( png.end(), signature, signature + sizeof( signature ) );
+
+	std::vector<uint8_t> header;
+	PutBigEndian32( header, width );
+	PutBigEndian32( header, height );
+	header.push_back( 8 );		// bit depth
+	header.push_back( 6 );		// RGBA
+	header.push_back( 0 );		// deflate
+	header.push_back( 0 );		// adaptive filtering
+	header.push_back( 0 );		// no interlace
+
+	PutPngChunk( png, "IHDR", header.data(), header.size() );
+	PutPngChunk( png, "IDAT", zlib.data(), zlib.size() );
+	PutPngChunk( png, "IEND", nullptr, 0 );
+
+	return WriteRawFile( path, png.data(), png.size() );
+}
+
+uint64_t HashBytes( const void* data, size_t size )
+{
+	const uint8_t* bytes = static_cast<const uint8_t*>( data );
+	uint64_t hash = 0xCBF29CE484222325ull;
+
+	for( size_t i = 0; i < size; i++ ) {
+		hash ^= bytes[i];
+		hash *= 0x100000001B3ull;
+	}
+
+	return hash;
+}
\ No newline at end of file
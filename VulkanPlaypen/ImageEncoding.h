@@ -0,0 +1,17 @@
+#pragma once
+
+#include "Platform.h"
+
+#include <cstdint>
+#include <string>
+
+// Encoders for data read back from the GPU. All of them are safe to call from worker threads
+
+bool WriteRawFile( const std::string& path, const void* data, size_t size );
+
+// Writes an 8 bit RGBA PNG. Accepts VK_FORMAT_R8G8B8A8_* and VK_FORMAT_B8G8R8A8_* pixels, tightly packed. The
+// image data is stored uncompressed, which keeps encoding cheap enough to run on every captured frame
+bool WritePng( const std::string& path, uint32_t width, uint32_t height, VkFormat format, const void* pixels );
+
+// 64 bit FNV-1a
+uint64_t HashBytes( const void* data, size_t size );
\ No newline at end of file
@@ -0,0 +1,249 @@
+#include "MappedFile.h"
+
+#if !defined( _WIN32 )
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile()
+{
+}
+
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+bool MappedFile::IsOpen() const
+{
+	return _data != nullptr;
+}
+
+bool MappedFile::IsWritable() const
+{
+	return _writable;
+}
+
+uint8_t* MappedFile::getData() const
+{
+	return _data;
+}
+
+uint64_t MappedFile::getSize() const
+{
+	return _size;
+}
+
+#if defined( _WIN32 )
+
+bool MappedFile::OpenRead( const std::string& path )
+{
+	Close();
+
+	_file = CreateFile( path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL );
+	if( _file == INVALID_HANDLE_VALUE ) {
+		return false;
+	}
+
+	LARGE_INTEGER file_size {};
+	GetFileSizeEx( _file, &file_size );
+
+	_size = uint64_t( file_size.QuadPart );
+	_writable = false;
+
+	if( !_Map() ) {
+		Close();
+		return false;
+	}
+	return true;
+}
+
+bool MappedFile::OpenWrite( const std::string& path, uint64_t size )
+{
+	Close();
+
+	_file = CreateFile( path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL );
+	if( _file == INVALID_HANDLE_VALUE ) {
+		return false;
+	}
+
+	_writable = true;
+	_size = size;
+
+	if( !_Map() ) {
+		Close();
+		return false;
+	}
+	return true;
+}
+
+bool MappedFile::Resize( uint64_t size )
+{
+	if( !_writable || _file == INVALID_HANDLE_VALUE ) {
+		return false;
+	}
+
+	_Unmap();
+
+	// The file mapping keeps the file at its mapped size, so explicitly truncate when shrinking
+	LARGE_INTEGER new_size {};
+	new_size.QuadPart = LONGLONG( size );
+	SetFilePointerEx( _file, new_size, NULL, FILE_BEGIN );
+	SetEndOfFile( _file );
+
+	_size = size;
+	return _Map();
+}
+
+void MappedFile::Close()
+{
+	_Unmap();
+
+	if( _file != INVALID_HANDLE_VALUE ) {
+		CloseHandle( _file );
+		_file = INVALID_HANDLE_VALUE;
+	}
+
+	_size = 0;
+	_writable = false;
+}
+
+bool MappedFile::_Map()
+{
+	if( _size == 0 ) {
+		return false;
+	}
+
+	DWORD protect = _writable ? PAGE_READWRITE : PAGE_READONLY;
+	DWORD access = _writable ? FILE_MAP_WRITE : FILE_MAP_READ;
+
+	_mapping = CreateFileMapping( _file, NULL, protect, DWORD( _size >> 32 ), DWORD( _size & 0xFFFFFFFF ), NULL );
+	if( _mapping == NULL ) {
+		return false;
+	}
+
+	_data = reinterpret_cast<uint8_t*>( MapViewOfFile( _mapping, access, 0, 0, SIZE_T( _size ) ) );
+	return _data != nullptr;
+}
+
+void MappedFile::_Unmap()
+{
+	if( _data != nullptr ) {
+		if( _writable ) {
+			FlushViewOfFile( _data, 0 );
+		}
+		UnmapViewOfFile( _data );
+		_data = nullptr;
+	}
+
+	if( _mapping != NULL ) {
+		CloseHandle( _mapping );
+		_mapping = NULL;
+	}
+}
+
+#else
+
+bool MappedFile::OpenRead( const std::string& path )
+{
+	Close();
+
+	_file = open( path.c_str(), O_RDONLY );
+	if( _file < 0 ) {
+		return false;
+	}
+
+	struct stat file_stat {};
+	fstat( _file, &file_stat );
+
+	_size = uint64_t( file_stat.st_size );
+	_writable = false;
+
+	if( !_Map() ) {
+		Close();
+		return false;
+	}
+	return true;
+}
+
+bool MappedFile::OpenWrite( const std::string& path, uint64_t size )
+{
+	Close();
+
+	_file = open( path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644 );
+	if( _file < 0 ) {
+		return false;
+	}
+
+	_writable = true;
+	_size = size;
+
+	if( ftruncate( _file, off_t( _size ) ) != 0 || !_Map() ) {
+		Close();
+		return false;
+	}
+	return true;
+}
+
+bool MappedFile::Resize( uint64_t size )
+{
+	if( !_writable || _file < 0 ) {
+		return false;
+	}
+
+	_Unmap();
+
+	if( ftruncate( _file, off_t( size ) ) != 0 ) {
+		return false;
+	}
+
+	_size = size;
+	return _Map();
+}
+
+void MappedFile::Close()
+{
+	_Unmap();
+
+	if( _file >= 0 ) {
+		close( _file );
+		_file = -1;
+	}
+
+	_size = 0;
+	_writable = false;
+}
+
+bool MappedFile::_Map()
+{
+	if( _size == 0 ) {
+		return false;
+	}
+
+	int protect = _writable ? ( PROT_READ | PROT_WRITE ) : PROT_READ;
+
+	void* data = mmap( nullptr, size_t( _size ), protect, MAP_SHARED, _file, 0 );
+	if( data == MAP_FAILED ) {
+		return false;
+	}
+
+	if( !_writable ) {
+		madvise( data, size_t( _size ), MADV_SEQUENTIAL );
+	}
+
+	_data = reinterpret_cast<uint8_t*>( data );
+	return true;
+}
+
+void MappedFile::_Unmap()
+{
+	if( _data != nullptr ) {
+		munmap( _data, size_t( _size ) );
+		_data = nullptr;
+	}
+}
+
+#endif
\ No newline at end of file
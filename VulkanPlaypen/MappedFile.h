@@ -0,0 +1,47 @@
+#pragma once
+
+#include "Platform.h"
+
+#include <cstdint>
+#include <string>
+
+// Thin wrapper around an OS file mapping. Read mappings are used for loading packed data (traces, assets) without
+// copying it into heap memory first, write mappings let us stream data straight into the file via the page cache.
+class MappedFile
+{
+public:
+	MappedFile();
+	~MappedFile();
+
+	MappedFile( const MappedFile& ) = delete;
+	MappedFile& operator=( const MappedFile& ) = delete;
+
+	bool OpenRead( const std::string& path );
+	bool OpenWrite( const std::string& path, uint64_t size );
+
+	// Grow (or shrink) a writable mapping. Any pointers into the previous mapping are invalidated
+	bool Resize( uint64_t size );
+
+	void Close();
+
+	bool IsOpen() const;
+	bool IsWritable() const;
+
+	uint8_t* getData() const;
+	uint64_t getSize() const;
+
+private:
+	bool _Map();
+	void _Unmap();
+
+	uint8_t* _data = nullptr;
+	uint64_t _size = 0;
+	bool _writable = false;
+
+#if defined( _WIN32 )
+	HANDLE _file = INVALID_HANDLE_VALUE;
+	HANDLE _mapping = NULL;
+#else
+	int _file = -1;
+#endif
+};
@@ -0,0 +1,211 @@
+#include "MeshBuffers.h"
+#include "MeshPack.h"
+#include "Renderer.h"
+#include "RendererUtils.h"
+#include "DeletionQueue.h"
+#include "SubmissionQueue.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+MeshBuffers::MeshBuffers( Renderer* r, VkDeviceSize staging_size )
+{
+	_renderer = r;
+	_staging_size = std::max<VkDeviceSize>( staging_size, STAGING_CHUNKS * MESH_PACK_DATA_ALIGNMENT );
+
+	_InitStaging();
+}
+
+
+MeshBuffers::~MeshBuffers()
+{
+	Unload();
+	_DeInitStaging();
+}
+
+bool MeshBuffers::Load( const MeshPack& pack )
+{
+	Unload();
+
+	VkDeviceSize size = pack.getDataSize();
+	if( size == 0 ) {
+		return false;
+	}
+
+	VkDevice device = _renderer->getDevice();
+	auto start = std::chrono::high_resolution_clock::now();
+
+	VkBufferCreateInfo buffer_info {};
+	buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	buffer_info.size = size;
+	buffer_info.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+	buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	vkResultErrorCheck( vkCreateBuffer( device, &buffer_info, _renderer->getAllocationCallbacks(), &_buffer ) );
+	vkResultErrorCheck( AllocateBufferMemory( device, _renderer->getAllocationCallbacks(), _renderer->getPhysicalDeviceMemoryProperties(), _buffer, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &_memory ) );
+	_size = size;
+
+	VkDeviceSize chunk_size = _staging_size / STAGING_CHUNKS;
+	bool in_flight[STAGING_CHUNKS] = {};
+	double staging_copy_ms = 0.0;
+	uint32_t chunk_count = 0;
+
+	for( VkDeviceSize offset = 0; offset < size; offset += chunk_size, chunk_count++ ) {
+		uint32_t chunk = chunk_count % STAGING_CHUNKS;
+		VkDeviceSize copy_size = std::min( chunk_size, size - offset );
+
+		if( in_flight[chunk] ) {
+			vkResultErrorCheck( vkWaitForFences( device, 1, &_fences[chunk], VK_TRUE, UINT64_MAX ) );
+			vkResultErrorCheck( vkResetFences( device, 1, &_fences[chunk] ) );
+		}
+
+		auto copy_start = std::chrono::high_resolution_clock::now();
+		std::memcpy( _staging_data + chunk * chunk_size, pack.getData() + offset, size_t( copy_size ) );
+		staging_copy_ms += std::chrono::duration<double, std::milli>( std::chrono::high_resolution_clock::now() - copy_start ).count();
+
+		VkCommandBuffer command_buffer = _command_buffers[chunk];
+		VkCommandBufferBeginInfo begin_info {};
+		begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		vkResultErrorCheck( vkResetCommandBuffer( command_buffer, 0 ) );
+		vkResultErrorCheck( vkBeginCommandBuffer( command_buffer, &begin_info ) );
+
+		VkBufferCopy region {};
+		region.srcOffset = chunk * chunk_size;
+		region.dstOffset = offset;
+		region.size = copy_size;
+		vkCmdCopyBuffer( command_buffer, _staging_buffer, _buffer, 1, &region );
+
+		// The last chunk makes every copy before it visible to whatever reads the meshes next
+		if( offset + copy_size >= size ) {
+			VkBufferMemoryBarrier barrier {};
+			barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+			barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+			barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barrier.buffer = _buffer;
+			barrier.offset = 0;
+			barrier.size = VK_WHOLE_SIZE;
+			vkCmdPipelineBarrier( command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+				0, 0, nullptr, 1, &barrier, 0, nullptr );
+		}
+
+		vkResultErrorCheck( vkEndCommandBuffer( command_buffer ) );
+
+		VkSubmitInfo submit_info {};
+		submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submit_info.commandBufferCount = 1;
+		submit_info.pCommandBuffers = &command_buffer;
+		_renderer->getSubmissionQueue()->Submit( 1, &submit_info, _fences[chunk] );
+		in_flight[chunk] = true;
+	}
+
+	for( uint32_t i = 0; i < STAGING_CHUNKS; i++ ) {
+		if( in_flight[i] ) {
+			vkResultErrorCheck( vkWaitForFences( device, 1, &_fences[i], VK_TRUE, UINT64_MAX ) );
+			vkResultErrorCheck( vkResetFences( device, 1, &_fences[i] ) );
+		}
+	}
+
+	_stats.uploaded_bytes = size;
+	_stats.chunk_count = chunk_count;
+	_stats.staging_copy_ms = staging_copy_ms;
+	_stats.upload_ms = std::chrono::duration<double, std::milli>( std::chrono::high_resolution_clock::now() - start ).count();
+
+	return true;
+}
+
+void MeshBuffers::Unload()
+{
+	// Frames still in flight may draw from it
+	if( _buffer != VK_NULL_HANDLE ) {
+		_renderer->getDeletionQueue()->DestroyBuffer( _buffer );
+		_renderer->getDeletionQueue()->FreeMemory( _memory );
+	}
+
+	_buffer = VK_NULL_HANDLE;
+	_memory = VK_NULL_HANDLE;
+	_size = 0;
+	_stats = MeshBufferStats();
+}
+
+uint32_t MeshBuffers::BindLod( VkCommandBuffer command_buffer, const MeshPack& pack, uint32_t mesh, uint32_t lod ) const
+{
+	const MeshPackMesh& m = pack.getMesh( mesh );
+	const MeshPackLod& l = pack.getLod( mesh, lod );
+
+	VkDeviceSize vertex_offset = m.vertex_offset;
+	vkCmdBindVertexBuffers( command_buffer, 0, 1, &_buffer, &vertex_offset );
+	vkCmdBindIndexBuffer( command_buffer, _buffer, l.index_offset, VkIndexType( m.index_type ) );
+
+	return l.index_count;
+}
+
+VkBuffer MeshBuffers::getBuffer() const
+{
+	return _buffer;
+}
+
+VkDeviceSize MeshBuffers::getSize() const
+{
+	return _size;
+}
+
+const MeshBufferStats& MeshBuffers::getStats() const
+{
+	return _stats;
+}
+
+void MeshBuffers::_InitStaging()
+{
+	VkDevice device = _renderer->getDevice();
+
+	VkBufferCreateInfo buffer_info {};
+	buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	buffer_info.size = _staging_size;
+	buffer_info.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+	buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	vkResultErrorCheck( vkCreateBuffer( device, &buffer_info, _renderer->getAllocationCallbacks(), &_staging_buffer ) );
+	vkResultErrorCheck( AllocateBufferMemory( device, _renderer->getAllocationCallbacks(), _renderer->getPhysicalDeviceMemoryProperties(), _staging_buffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &_staging_memory ) );
+	vkResultErrorCheck( vkMapMemory( device, _staging_memory, 0, VK_WHOLE_SIZE, 0, reinterpret_cast<void**>( &_staging_data ) ) );
+
+	VkCommandPoolCreateInfo pool_info {};
+	pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	pool_info.queueFamilyIndex = _renderer->getGraphicsFamilyIndex();
+	pool_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT | VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+	vkResultErrorCheck( vkCreateCommandPool( device, &pool_info, _renderer->getAllocationCallbacks(), &_command_pool ) );
+
+	VkCommandBufferAllocateInfo command_buffer_info {};
+	command_buffer_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	command_buffer_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	command_buffer_info.commandPool = _command_pool;
+	command_buffer_info.commandBufferCount = STAGING_CHUNKS;
+	vkResultErrorCheck( vkAllocateCommandBuffers( device, &command_buffer_info, _command_buffers ) );
+
+	for( auto &i : _fences ) {
+		VkFenceCreateInfo fence_info {};
+		fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+		vkResultErrorCheck( vkCreateFence( device, &fence_info, _renderer->getAllocationCallbacks(), &i ) );
+	}
+}
+
+void MeshBuffers::_DeInitStaging()
+{
+	VkDevice device = _renderer->getDevice();
+
+	for( auto &i : _fences ) {
+		vkDestroyFence( device, i, _renderer->getAllocationCallbacks() );
+		i = VK_NULL_HANDLE;
+	}
+	vkDestroyCommandPool( device, _command_pool, _renderer->getAllocationCallbacks() );
+
+	vkUnmapMemory( device, _staging_memory );
+	vkDestroyBuffer( device, _staging_buffer, _renderer->getAllocationCallbacks() );
+	vkFreeMemory( device, _staging_memory, _renderer->getAllocationCallbacks() );
+
+	_command_pool = VK_NULL_HANDLE;
+	_staging_buffer = VK_NULL_HANDLE;
+	_staging_memory = VK_NULL_HANDLE;
+	_staging_data = nullptr;
+}
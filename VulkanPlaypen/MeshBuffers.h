@@ -0,0 +1,66 @@
+#pragma once
+
+#include "Platform.h"
+
+#include <cstdint>
+
+class MeshPack;
+class Renderer;
+
+struct MeshBufferStats
+{
+	VkDeviceSize uploaded_bytes = 0;
+	uint32_t chunk_count = 0;
+
+	// Copying out of the mapped pack, which is where its pages are read in, and the whole upload
+	double staging_copy_ms = 0.0;
+	double upload_ms = 0.0;
+};
+
+// Device local copy of a MeshPack's data section.
+//
+// The data section goes into one buffer usable as vertex, index and storage buffer, so the offsets in the pack's
+// tables bind straight into it. It is copied out of the mapped file into host visible staging memory and on to the
+// GPU in chunks, with two chunks in flight so filling one overlaps the GPU copying the other. Nothing is parsed or
+// converted on the way.
+class MeshBuffers
+{
+public:
+	MeshBuffers( Renderer* r, VkDeviceSize staging_size = 16 * 1024 * 1024 );
+	~MeshBuffers();
+
+	// Uploads the whole data section (blocking), replacing anything loaded before
+	bool Load( const MeshPack& pack );
+	void Unload();
+
+	// Binds a LOD's vertices to binding 0 and its indices, returns its index count
+	uint32_t BindLod( VkCommandBuffer command_buffer, const MeshPack& pack, uint32_t mesh, uint32_t lod ) const;
+
+	VkBuffer getBuffer() const;
+	VkDeviceSize getSize() const;
+
+	const MeshBufferStats& getStats() const;
+
+private:
+	static const uint32_t STAGING_CHUNKS = 2;
+
+	void _InitStaging();
+	void _DeInitStaging();
+
+	Renderer* _renderer = nullptr;
+
+	VkBuffer _buffer = VK_NULL_HANDLE;
+	VkDeviceMemory _memory = VK_NULL_HANDLE;
+	VkDeviceSize _size = 0;
+
+	VkDeviceSize _staging_size = 0;
+	VkBuffer _staging_buffer = VK_NULL_HANDLE;
+	VkDeviceMemory _staging_memory = VK_NULL_HANDLE;
+	uint8_t* _staging_data = nullptr;
+
+	VkCommandPool _command_pool = VK_NULL_HANDLE;
+	VkCommandBuffer _command_buffers[STAGING_CHUNKS] = {};
+	VkFence _fences[STAGING_CHUNKS] = {};
+
+	MeshBufferStats _stats;
+};
@@ -0,0 +1,270 @@
+#include "MeshPack.h"
+
+#include <algorithm>
+#include <cstring>
+
+static uint64_t AlignMeshPackOffset( uint64_t offset )
+{
+	return ( offset + MESH_PACK_DATA_ALIGNMENT - 1 ) & ~uint64_t( MESH_PACK_DATA_ALIGNMENT - 1 );
+}
+
+// True if size bytes at offset lie within a block of block_size bytes, without overflowing on corrupt values
+static bool RangeFits( uint64_t offset, uint64_t size, uint64_t block_size )
+{
+	return size <= block_size && offset <= block_size - size;
+}
+
+MeshPack::MeshPack()
+{
+}
+
+
+MeshPack::~MeshPack()
+{
+	Close();
+}
+
+bool MeshPack::Open( const std::string& path )
+{
+	Close();
+
+	if( !_file.OpenRead( path ) || _file.getSize() < sizeof( MeshPackHeader ) ) {
+		Close();
+		return false;
+	}
+
+	const uint8_t* base = _file.getData();
+	_header = reinterpret_cast<const MeshPackHeader*>( base );
+
+	// 64 bit math, so the sizes can't wrap on Win32 where size_t is 32 bit
+	uint64_t tables_size = sizeof( MeshPackHeader ) + uint64_t( _header->mesh_count ) * sizeof( MeshPackMesh ) + uint64_t( _header->lod_count ) * sizeof( MeshPackLod );
+
+	if( _header->magic != MESH_PACK_MAGIC || _header->version != MESH_PACK_VERSION ||
+		tables_size > _header->data_offset || !RangeFits( _header->data_offset, _header->data_size, _file.getSize() ) ) {
+		Close();
+		return false;
+	}
+
+	_meshes = reinterpret_cast<const MeshPackMesh*>( base + sizeof( MeshPackHeader ) );
+	_lods = reinterpret_cast<const MeshPackLod*>( _meshes + _header->mesh_count );
+	_data = base + _header->data_offset;
+
+	// Users index LODs and read mesh data without further checks
+	uint64_t data_size = _header->data_size;
+	for( uint32_t i = 0; i < _header->mesh_count; i++ ) {
+		const MeshPackMesh& mesh = _meshes[i];
+		bool valid = mesh.lod_count != 0 && uint64_t( mesh.first_lod ) + mesh.lod_count <= _header->lod_count &&
+			( mesh.index_type == VK_INDEX_TYPE_UINT16 || mesh.index_type == VK_INDEX_TYPE_UINT32 ) &&
+			RangeFits( mesh.vertex_offset, uint64_t( mesh.vertex_count ) * sizeof( MeshPackVertex ), data_size );
+
+		uint64_t index_size = mesh.index_type == VK_INDEX_TYPE_UINT16 ? sizeof( uint16_t ) : sizeof( uint32_t );
+		for( uint32_t lod = 0; valid && lod < mesh.lod_count; lod++ ) {
+			const MeshPackLod& l = _lods[mesh.first_lod + lod];
+			valid = RangeFits( l.index_offset, uint64_t( l.index_count ) * index_size, data_size ) &&
+				RangeFits( l.meshlet_offset, uint64_t( l.meshlet_count ) * sizeof( MeshPackMeshlet ), data_size );
+
+			// Meshlets address their vertex and triangle arrays with their own offsets
+			const MeshPackMeshlet* meshlets = valid ? reinterpret_cast<const MeshPackMeshlet*>( _data + l.meshlet_offset ) : nullptr;
+			for( uint32_t m = 0; valid && m < l.meshlet_count; m++ ) {
+				valid = RangeFits( l.meshlet_vertex_offset, ( uint64_t( meshlets[m].vertex_offset ) + meshlets[m].vertex_count ) * sizeof( uint32_t ), data_size ) &&
+					RangeFits( l.meshlet_triangle_offset, uint64_t( meshlets[m].triangle_offset ) + uint64_t( meshlets[m].triangle_count ) * 3, data_size );
+			}
+		}
+
+		if( !valid ) {
+			Close();
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void MeshPack::Close()
+{
+	_file.Close();
+	_header = nullptr;
+	_meshes = nullptr;
+	_lods = nullptr;
+	_data = nullptr;
+}
+
+uint32_t MeshPack::getMeshCount() const
+{
+	return _header != nullptr ? _header->mesh_count : 0;
+}
+
+const MeshPackMesh& MeshPack::getMesh( uint32_t mesh ) const
+{
+	return _meshes[mesh];
+}
+
+const MeshPackLod& MeshPack::getLod( uint32_t mesh, uint32_t lod ) const
+{
+	return _lods[_meshes[mesh].first_lod + lod];
+}
+
+const MeshPackVertex* MeshPack::getVertices( uint32_t mesh ) const
+{
+	return reinterpret_cast<const MeshPackVertex*>( _data + _meshes[mesh].vertex_offset );
+}
+
+const void* MeshPack::getIndices( uint32_t mesh, uint32_t lod ) const
+{
+	return _data + getLod( mesh, lod ).index_offset;
+}
+
+const MeshPackMeshlet* MeshPack::getMeshlets( uint32_t mesh, uint32_t lod ) const
+{
+	return reinterpret_cast<const MeshPackMeshlet*>( _data + getLod( mesh, lod ).meshlet_offset );
+}
+
+const uint32_t* MeshPack::getMeshletVertices( uint32_t mesh, uint32_t lod ) const
+{
+	return reinterpret_cast<const uint32_t*>( _data + getLod( mesh, lod ).meshlet_vertex_offset );
+}
+
+const uint8_t* MeshPack::getMeshletTriangles( uint32_t mesh, uint32_t lod ) const
+{
+	return _data + getLod( mesh, lod ).meshlet_triangle_offset;
+}
+
+const uint8_t* MeshPack::getData() const
+{
+	return _data;
+}
+
+uint64_t MeshPack::getDataSize() const
+{
+	return _header != nullptr ? _header->data_size : 0;
+}
+
+uint32_t MeshPack::FindMesh( const std::string& name ) const
+{
+	for( uint32_t i = 0; i < getMeshCount(); i++ ) {
+		if( std::strncmp( _meshes[i].name, name.c_str(), MESH_PACK_NAME_LENGTH ) == 0 ) {
+			return i;
+		}
+	}
+
+	return UINT32_MAX;
+}
+
+uint32_t MeshPack::SelectLod( uint32_t mesh, float distance, float pixels_per_unit, float max_pixels ) const
+{
+	const MeshPackMesh& m = _meshes[mesh];
+	float scale = pixels_per_unit / std::max( distance, 1e-6f );
+
+	// Errors grow with the LOD index
+	uint32_t selected = 0;
+	for( uint32_t lod = 1; lod < m.lod_count; lod++ ) {
+		if( _lods[m.first_lod + lod].error * scale > max_pixels ) {
+			break;
+		}
+		selected = lod;
+	}
+
+	return selected;
+}
+
+void MeshPackWriter::AddMesh( const std::string& name, const float bounds_min[3], const float bounds_scale[3], const std::vector<MeshPackVertex>& vertices, const std::vector<MeshPackLodData>& lods )
+{
+	PendingMesh pending {};
+	std::strncpy( pending.mesh.name, name.c_str(), MESH_PACK_NAME_LENGTH - 1 );
+	for( uint32_t i = 0; i < 3; i++ ) {
+		pending.mesh.bounds_min[i] = bounds_min[i];
+		pending.mesh.bounds_scale[i] = bounds_scale[i];
+	}
+	pending.mesh.vertex_count = uint32_t( vertices.size() );
+	pending.mesh.index_type = vertices.size() <= 0xFFFF ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+	pending.mesh.lod_count = uint32_t( lods.size() );
+	pending.vertices = vertices;
+	pending.lods = lods;
+
+	_meshes.push_back( pending );
+}
+
+bool MeshPackWriter::Write( const std::string& path ) const
+{
+	MeshPackHeader header {};
+	header.magic = MESH_PACK_MAGIC;
+	header.version = MESH_PACK_VERSION;
+	header.mesh_count = uint32_t( _meshes.size() );
+
+	std::vector<MeshPackMesh> meshes;
+	std::vector<MeshPackLod> lods;
+
+	uint64_t data_size = 0;
+	for( auto &i : _meshes ) {
+		MeshPackMesh mesh = i.mesh;
+		mesh.first_lod = uint32_t( lods.size() );
+		mesh.vertex_offset = data_size;
+		data_size = AlignMeshPackOffset( data_size + i.vertices.size() * sizeof( MeshPackVertex ) );
+
+		uint64_t index_size = mesh.index_type == VK_INDEX_TYPE_UINT16 ? sizeof( uint16_t ) : sizeof( uint32_t );
+
+		for( auto &l : i.lods ) {
+			MeshPackLod lod {};
+			lod.index_count = uint32_t( l.indices.size() );
+			lod.meshlet_count = uint32_t( l.meshlets.size() );
+			lod.error = l.error;
+
+			lod.index_offset = data_size;
+			data_size = AlignMeshPackOffset( data_size + l.indices.size() * index_size );
+			lod.meshlet_offset = data_size;
+			data_size = AlignMeshPackOffset( data_size + l.meshlets.size() * sizeof( MeshPackMeshlet ) );
+			lod.meshlet_vertex_offset = data_size;
+			data_size = AlignMeshPackOffset( data_size + l.meshlet_vertices.size() * sizeof( uint32_t ) );
+			lod.meshlet_triangle_offset = data_size;
+			data_size = AlignMeshPackOffset( data_size + l.meshlet_triangles.size() );
+
+			lods.push_back( lod );
+		}
+
+		meshes.push_back( mesh );
+	}
+
+	header.lod_count = uint32_t( lods.size() );
+	header.data_offset = AlignMeshPackOffset( sizeof( MeshPackHeader ) + meshes.size() * sizeof( MeshPackMesh ) + lods.size() * sizeof( MeshPackLod ) );
+	header.data_size = data_size;
+
+	MappedFile file;
+	if( !file.OpenWrite( path, header.data_offset + header.data_size ) ) {
+		return false;
+	}
+
+	// Padding between blocks is zeroed too, so packs are reproducible
+	uint8_t* base = file.getData();
+	std::memset( base, 0, size_t( header.data_offset + header.data_size ) );
+	std::memcpy( base, &header, sizeof( header ) );
+	std::memcpy( base + sizeof( header ), meshes.data(), meshes.size() * sizeof( MeshPackMesh ) );
+	std::memcpy( base + sizeof( header ) + meshes.size() * sizeof( MeshPackMesh ), lods.data(), lods.size() * sizeof( MeshPackLod ) );
+
+	uint8_t* data = base + header.data_offset;
+	for( size_t m = 0; m < _meshes.size(); m++ ) {
+		const PendingMesh& pending = _meshes[m];
+		std::memcpy( data + meshes[m].vertex_offset, pending.vertices.data(), pending.vertices.size() * sizeof( MeshPackVertex ) );
+
+		for( uint32_t l = 0; l < meshes[m].lod_count; l++ ) {
+			const MeshPackLodData& source = pending.lods[l];
+			const MeshPackLod& lod = lods[meshes[m].first_lod + l];
+
+			if( meshes[m].index_type == VK_INDEX_TYPE_UINT16 ) {
+				uint16_t* indices = reinterpret_cast<uint16_t*>( data + lod.index_offset );
+				for( size_t i = 0; i < source.indices.size(); i++ ) {
+					indices[i] = uint16_t( source.indices[i] );
+				}
+			}
+			else {
+				std::memcpy( data + lod.index_offset, source.indices.data(), source.indices.size() * sizeof( uint32_t ) );
+			}
+
+			std::memcpy( data + lod.meshlet_offset, source.meshlets.data(), source.meshlets.size() * sizeof( MeshPackMeshlet ) );
+			std::memcpy( data + lod.meshlet_vertex_offset, source.meshlet_vertices.data(), source.meshlet_vertices.size() * sizeof( uint32_t ) );
+			std::memcpy( data + lod.meshlet_triangle_offset, source.meshlet_triangles.data(), source.meshlet_triangles.size() );
+		}
+	}
+
+	file.Close();
+	return true;
+}
@@ -0,0 +1,153 @@
+#pragma once
+
+#include "Platform.h"
+#include "MappedFile.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Packed, quantized mesh format
+//
+// A pack is a MeshPackHeader, followed by mesh_count MeshPackMesh entries, followed by the MeshPackLod table,
+// followed by the data section. The data section holds everything the GPU reads: per mesh the vertices, and per LOD
+// the indices, meshlets, meshlet vertex indices and meshlet triangles, each starting on a MESH_PACK_DATA_ALIGNMENT
+// boundary. It is uploaded as is into one buffer, and every offset in the tables is an offset into that buffer.
+//
+// Vertices are 16 bytes: positions are unorm16 within the mesh bounds (position = bounds_min + value * bounds_scale),
+// normals are octahedral snorm16 and UVs are half floats. All LODs of a mesh index the same vertices, LOD 0 is
+// ordered for the post-transform vertex cache and for overdraw, and vertices are in the order LOD 0 first uses them.
+
+#define MESH_PACK_MAGIC           0x4B504D4D // "MMPK"
+#define MESH_PACK_VERSION         1
+#define MESH_PACK_NAME_LENGTH     64
+#define MESH_PACK_DATA_ALIGNMENT  256
+
+#define MESH_PACK_MESHLET_MAX_VERTICES   64
+#define MESH_PACK_MESHLET_MAX_TRIANGLES  124
+
+struct MeshPackHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t mesh_count;
+	uint32_t lod_count;
+	uint64_t data_offset;
+	uint64_t data_size;
+};
+
+// VK_FORMAT_R16G16B16A16_UNORM, VK_FORMAT_R16G16_SNORM and VK_FORMAT_R16G16_SFLOAT attributes
+struct MeshPackVertex
+{
+	uint16_t position[4];		// w is unused
+	int16_t normal[2];
+	uint16_t uv[2];
+};
+
+struct MeshPackMesh
+{
+	char name[MESH_PACK_NAME_LENGTH];
+	float bounds_min[3];
+	float bounds_scale[3];
+	uint32_t vertex_count;
+	uint32_t index_type;		// VkIndexType, 16 bit whenever the vertex count allows it
+	uint32_t lod_count;
+	uint32_t first_lod;			// index into the LOD table
+	uint64_t vertex_offset;		// relative to data_offset
+};
+
+struct MeshPackLod
+{
+	uint32_t index_count;
+	uint32_t meshlet_count;
+	float error;				// largest distance a vertex moved from LOD 0, in object space
+	uint32_t reserved;
+
+	// Relative to data_offset
+	uint64_t index_offset;
+	uint64_t meshlet_offset;
+	uint64_t meshlet_vertex_offset;
+	uint64_t meshlet_triangle_offset;
+};
+
+// Up to MESH_PACK_MESHLET_MAX_TRIANGLES triangles over up to MESH_PACK_MESHLET_MAX_VERTICES vertices
+struct MeshPackMeshlet
+{
+	uint32_t vertex_offset;		// first entry in the LOD's meshlet vertex indices (uint32)
+	uint32_t triangle_offset;	// first byte in the LOD's meshlet triangles, three local vertex indices per triangle
+	uint32_t vertex_count;
+	uint32_t triangle_count;
+
+	// Bounding sphere in object space, for culling
+	float center[3];
+	float radius;
+};
+
+class MeshPack
+{
+public:
+	MeshPack();
+	~MeshPack();
+
+	bool Open( const std::string& path );
+	void Close();
+
+	uint32_t getMeshCount() const;
+	const MeshPackMesh& getMesh( uint32_t mesh ) const;
+	const MeshPackLod& getLod( uint32_t mesh, uint32_t lod ) const;
+
+	const MeshPackVertex* getVertices( uint32_t mesh ) const;
+	// uint16_t or uint32_t, per the mesh's index_type
+	const void* getIndices( uint32_t mesh, uint32_t lod ) const;
+	const MeshPackMeshlet* getMeshlets( uint32_t mesh, uint32_t lod ) const;
+	const uint32_t* getMeshletVertices( uint32_t mesh, uint32_t lod ) const;
+	const uint8_t* getMeshletTriangles( uint32_t mesh, uint32_t lod ) const;
+
+	// The whole data section, as uploaded
+	const uint8_t* getData() const;
+	uint64_t getDataSize() const;
+
+	// Returns UINT32_MAX if there's no mesh with that name
+	uint32_t FindMesh( const std::string& name ) const;
+
+	// Coarsest LOD whose error, seen from distance with the given pixels per unit at distance 1, stays below
+	// max_pixels
+	uint32_t SelectLod( uint32_t mesh, float distance, float pixels_per_unit, float max_pixels = 1.0f ) const;
+
+private:
+	MappedFile _file;
+
+	const MeshPackHeader* _header = nullptr;
+	const MeshPackMesh* _meshes = nullptr;
+	const MeshPackLod* _lods = nullptr;
+	const uint8_t* _data = nullptr;
+};
+
+// One LOD ready to be written, indices are always 32 bit here
+struct MeshPackLodData
+{
+	float error = 0.0f;
+	std::vector<uint32_t> indices;
+	std::vector<MeshPackMeshlet> meshlets;
+	std::vector<uint32_t> meshlet_vertices;
+	std::vector<uint8_t> meshlet_triangles;
+};
+
+// Offline side of the format, used by tools to assemble packs
+class MeshPackWriter
+{
+public:
+	void AddMesh( const std::string& name, const float bounds_min[3], const float bounds_scale[3], const std::vector<MeshPackVertex>& vertices, const std::vector<MeshPackLodData>& lods );
+
+	bool Write( const std::string& path ) const;
+
+private:
+	struct PendingMesh
+	{
+		MeshPackMesh mesh;
+		std::vector<MeshPackVertex> vertices;
+		std::vector<MeshPackLodData> lods;
+	};
+
+	std::vector<PendingMesh> _meshes;
+};
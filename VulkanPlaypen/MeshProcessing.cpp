@@ -0,0 +1,1095 @@
+#include "MeshProcessing.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <unordered_map>
+
+static const float MESH_PI = 3.14159265358979f;
+
+uint32_t SourceMesh::getVertexCount() const
+{
+	return uint32_t( positions.size() / 3 );
+}
+
+static void GenerateNormals( SourceMesh& mesh )
+{
+	mesh.normals.assign( mesh.positions.size(), 0.0f );
+
+	// Unnormalized face normals weight by area
+	for( size_t t = 0; t + 2 < mesh.indices.size(); t += 3 ) {
+		const float* a = &mesh.positions[mesh.indices[t + 0] * 3];
+		const float* b = &mesh.positions[mesh.indices[t + 1] * 3];
+		const float* c = &mesh.positions[mesh.indices[t + 2] * 3];
+
+		float e0[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+		float e1[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+		float n[3] = { e0[1] * e1[2] - e0[2] * e1[1], e0[2] * e1[0] - e0[0] * e1[2], e0[0] * e1[1] - e0[1] * e1[0] };
+
+		for( uint32_t k = 0; k < 3; k++ ) {
+			float* out = &mesh.normals[mesh.indices[t + k] * 3];
+			out[0] += n[0];
+			out[1] += n[1];
+			out[2] += n[2];
+		}
+	}
+
+	for( size_t v = 0; v < mesh.normals.size(); v += 3 ) {
+		float* n = &mesh.normals[v];
+		float length = std::sqrt( n[0] * n[0] + n[1] * n[1] + n[2] * n[2] );
+		if( length > 0.0f ) {
+			n[0] /= length;
+			n[1] /= length;
+			n[2] /= length;
+		}
+		else {
+			n[2] = 1.0f;
+		}
+	}
+}
+
+struct ObjVertexKey
+{
+	int32_t position;
+	int32_t uv;
+	int32_t normal;
+
+	bool operator==( const ObjVertexKey& other ) const
+	{
+		return position == other.position && uv == other.uv && normal == other.normal;
+	}
+};
+
+struct ObjVertexKeyHash
+{
+	size_t operator()( const ObjVertexKey& key ) const
+	{
+		return size_t( uint32_t( key.position ) * 73856093u ^ uint32_t( key.uv ) * 19349663u ^ uint32_t( key.normal ) * 83492791u );
+	}
+};
+
+// Resolves a 1 based, possibly negative OBJ index to a 0 based one, -1 if absent
+static int32_t ResolveObjIndex( long index, size_t count )
+{
+	if( index > 0 ) {
+		return int32_t( index - 1 );
+	}
+	if( index < 0 ) {
+		return int32_t( long( count ) + index );
+	}
+	return -1;
+}
+
+bool LoadObjMesh( const std::string& path, SourceMesh* mesh )
+{
+	std::ifstream file( path, std::ios::binary );
+	if( !file ) {
+		return false;
+	}
+	std::string text( ( std::istreambuf_iterator<char>( file ) ), std::istreambuf_iterator<char>() );
+
+	std::vector<float> positions;
+	std::vector<float> uvs;
+	std::vector<float> normals;
+
+	std::unordered_map<ObjVertexKey, uint32_t, ObjVertexKeyHash> vertex_map;
+	std::vector<ObjVertexKey> vertices;
+	std::vector<uint32_t> indices;
+	std::vector<uint32_t> face;
+
+	const char* p = text.c_str();
+	while( *p ) {
+		// One record per line
+		while( *p == ' ' || *p == '\t' ) {
+			p++;
+		}
+
+		if( p[0] == 'v' && ( p[1] == ' ' || p[1] == '\t' ) ) {
+			char* end;
+			for( uint32_t i = 0; i < 3; i++ ) {
+				positions.push_back( std::strtof( p + ( i == 0 ? 1 : 0 ), &end ) );
+				p = end;
+			}
+		}
+		else if( p[0] == 'v' && p[1] == 't' ) {
+			char* end;
+			uvs.push_back( std::strtof( p + 2, &end ) );
+			uvs.push_back( std::strtof( end, &end ) );
+			p = end;
+		}
+		else if( p[0] == 'v' && p[1] == 'n' ) {
+			char* end;
+			for( uint32_t i = 0; i < 3; i++ ) {
+				normals.push_back( std::strtof( p + ( i == 0 ? 2 : 0 ), &end ) );
+				p = end;
+			}
+		}
+		else if( p[0] == 'f' && ( p[1] == ' ' || p[1] == '\t' ) ) {
+			p++;
+			face.clear();
+
+			for( ;; ) {
+				while( *p == ' ' || *p == '\t' ) {
+					p++;
+				}
+				if( *p == '\0' || *p == '\r' || *p == '\n' ) {
+					break;
+				}
+
+				char* end;
+				ObjVertexKey key;
+				key.position = ResolveObjIndex( std::strtol( p, &end, 10 ), positions.size() / 3 );
+				key.uv = -1;
+				key.normal = -1;
+				p = end;
+
+				if( *p == '/' ) {
+					p++;
+					if( *p != '/' ) {
+						key.uv = ResolveObjIndex( std::strtol( p, &end, 10 ), uvs.size() / 2 );
+						p = end;
+					}
+					if( *p == '/' ) {
+						p++;
+						key.normal = ResolveObjIndex( std::strtol( p, &end, 10 ), normals.size() / 3 );
+						p = end;
+					}
+				}
+
+				if( key.position < 0 || size_t( key.position ) >= positions.size() / 3 ) {
+					return false;
+				}
+
+				auto found = vertex_map.find( key );
+				if( found == vertex_map.end() ) {
+					found = vertex_map.insert( std::make_pair( key, uint32_t( vertices.size() ) ) ).first;
+					vertices.push_back( key );
+				}
+				face.push_back( found->second );
+
+				// Skip anything unparsed in this corner
+				while( *p != '\0' && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n' ) {
+					p++;
+				}
+			}
+
+			for( size_t i = 2; i < face.size(); i++ ) {
+				indices.push_back( face[0] );
+				indices.push_back( face[i - 1] );
+				indices.push_back( face[i] );
+			}
+		}
+
+		while( *p != '\0' && *p != '\n' ) {
+			p++;
+		}
+		if( *p == '\n' ) {
+			p++;
+		}
+	}
+
+	bool has_normals = true;
+	mesh->positions.resize( vertices.size() * 3 );
+	mesh->normals.resize( vertices.size() * 3 );
+	mesh->uvs.resize( vertices.size() * 2 );
+	mesh->indices = std::move( indices );
+
+	for( size_t v = 0; v < vertices.size(); v++ ) {
+		const ObjVertexKey& key = vertices[v];
+		std::memcpy( &mesh->positions[v * 3], &positions[key.position * 3], sizeof( float ) * 3 );
+
+		if( key.uv >= 0 && size_t( key.uv ) * 2 + 1 < uvs.size() ) {
+			mesh->uvs[v * 2 + 0] = uvs[key.uv * 2 + 0];
+			mesh->uvs[v * 2 + 1] = uvs[key.uv * 2 + 1];
+		}
+		else {
+			mesh->uvs[v * 2 + 0] = 0.0f;
+			mesh->uvs[v * 2 + 1] = 0.0f;
+		}
+
+		if( key.normal >= 0 && size_t( key.normal ) * 3 + 2 < normals.size() ) {
+			std::memcpy( &mesh->normals[v * 3], &normals[key.normal * 3], sizeof( float ) * 3 );
+		}
+		else {
+			has_normals = false;
+		}
+	}
+
+	if( !has_normals ) {
+		GenerateNormals( *mesh );
+	}
+
+	return !mesh->indices.empty();
+}
+
+bool WriteObjMesh( const std::string& path, const SourceMesh& mesh )
+{
+	FILE* file = std::fopen( path.c_str(), "wb" );
+	if( file == nullptr ) {
+		return false;
+	}
+
+	uint32_t vertex_count = mesh.getVertexCount();
+	for( uint32_t v = 0; v < vertex_count; v++ ) {
+		std::fprintf( file, "v %.6f %.6f %.6f\n", mesh.positions[v * 3 + 0], mesh.positions[v * 3 + 1], mesh.positions[v * 3 + 2] );
+	}
+	for( uint32_t v = 0; v < vertex_count; v++ ) {
+		std::fprintf( file, "vt %.6f %.6f\n", mesh.uvs[v * 2 + 0], mesh.uvs[v * 2 + 1] );
+	}
+	for( uint32_t v = 0; v < vertex_count; v++ ) {
+		std::fprintf( file, "vn %.6f %.6f %.6f\n", mesh.normals[v * 3 + 0], mesh.normals[v * 3 + 1], mesh.normals[v * 3 + 2] );
+	}
+	for( size_t t = 0; t + 2 < mesh.indices.size(); t += 3 ) {
+		uint32_t a = mesh.indices[t + 0] + 1;
+		uint32_t b = mesh.indices[t + 1] + 1;
+		uint32_t c = mesh.indices[t + 2] + 1;
+		std::fprintf( file, "f %u/%u/%u %u/%u/%u %u/%u/%u\n", a, a, a, b, b, b, c, c, c );
+	}
+
+	bool ok = std::ferror( file ) == 0;
+	std::fclose( file );
+	return ok;
+}
+
+SourceMesh GenerateTorusMesh( uint32_t rings, uint32_t sides )
+{
+	const float major_radius = 1.0f;
+	const float minor_radius = 0.35f;
+
+	rings = std::max( rings, 3u );
+	sides = std::max( sides, 3u );
+
+	SourceMesh mesh;
+	for( uint32_t r = 0; r <= rings; r++ ) {
+		float u = float( r ) / rings;
+		float theta = u * 2.0f * MESH_PI;
+
+		for( uint32_t s = 0; s <= sides; s++ ) {
+			float v = float( s ) / sides;
+			float phi = v * 2.0f * MESH_PI;
+
+			float nx = std::cos( phi ) * std::cos( theta );
+			float ny = std::cos( phi ) * std::sin( theta );
+			float nz = std::sin( phi );
+
+			mesh.positions.push_back( major_radius * std::cos( theta ) + minor_radius * nx );
+			mesh.positions.push_back( major_radius * std::sin( theta ) + minor_radius * ny );
+			mesh.positions.push_back( minor_radius * nz );
+			mesh.normals.push_back( nx );
+			mesh.normals.push_back( ny );
+			mesh.normals.push_back( nz );
+			mesh.uvs.push_back( u );
+			mesh.uvs.push_back( v );
+		}
+	}
+
+	// Row by row, the order a naive exporter would produce
+	for( uint32_t r = 0; r < rings; r++ ) {
+		for( uint32_t s = 0; s < sides; s++ ) {
+			uint32_t a = r * ( sides + 1 ) + s;
+			uint32_t b = a + sides + 1;
+
+			mesh.indices.push_back( a );
+			mesh.indices.push_back( b );
+			mesh.indices.push_back( a + 1 );
+			mesh.indices.push_back( a + 1 );
+			mesh.indices.push_back( b );
+			mesh.indices.push_back( b + 1 );
+		}
+	}
+
+	return mesh;
+}
+
+VertexCacheStats AnalyzeVertexCache( const std::vector<uint32_t>& indices, uint32_t vertex_count, uint32_t cache_size )
+{
+	// A vertex is cached while fewer than cache_size misses came after its own
+	std::vector<uint32_t> miss_stamp( vertex_count, 0 );
+	uint32_t misses = 0;
+
+	for( auto i : indices ) {
+		if( miss_stamp[i] == 0 || misses + 1 - miss_stamp[i] > cache_size ) {
+			misses++;
+			miss_stamp[i] = misses;
+		}
+	}
+
+	uint32_t used_vertices = 0;
+	for( auto i : miss_stamp ) {
+		used_vertices += i != 0 ? 1 : 0;
+	}
+
+	VertexCacheStats stats {};
+	stats.acmr = indices.empty() ? 0.0f : float( misses ) / ( indices.size() / 3 );
+	stats.atvr = used_vertices == 0 ? 0.0f : float( misses ) / used_vertices;
+	return stats;
+}
+
+static const uint32_t VERTEX_CACHE_SIZE = 32;
+static const uint32_t VERTEX_VALENCE_TABLE_SIZE = 64;
+
+void OptimizeVertexCache( std::vector<uint32_t>& indices, uint32_t vertex_count )
+{
+	size_t triangle_count = indices.size() / 3;
+	if( triangle_count == 0 ) {
+		return;
+	}
+
+	float cache_scores[VERTEX_CACHE_SIZE];
+	for( uint32_t i = 0; i < VERTEX_CACHE_SIZE; i++ ) {
+		// The last triangle's vertices score the same, so it is not favoured over its neighbours
+		cache_scores[i] = i < 3 ? 0.75f : std::pow( 1.0f - float( i - 3 ) / ( VERTEX_CACHE_SIZE - 3 ), 1.5f );
+	}
+	float valence_scores[VERTEX_VALENCE_TABLE_SIZE];
+	for( uint32_t i = 1; i < VERTEX_VALENCE_TABLE_SIZE; i++ ) {
+		valence_scores[i] = 2.0f / std::sqrt( float( i ) );
+	}
+	valence_scores[0] = 0.0f;
+
+	auto vertex_score = [&]( int32_t cache_position, uint32_t live_triangles ) {
+		if( live_triangles == 0 ) {
+			return -1.0f;
+		}
+		float score = cache_position >= 0 ? cache_scores[cache_position] : 0.0f;
+		return score + ( live_triangles < VERTEX_VALENCE_TABLE_SIZE ? valence_scores[live_triangles] : 2.0f / std::sqrt( float( live_triangles ) ) );
+	};
+
+	// Triangles using each vertex, the live ones first
+	std::vector<uint32_t> adjacency_offsets( vertex_count + 1, 0 );
+	for( auto i : indices ) {
+		adjacency_offsets[i + 1]++;
+	}
+	for( uint32_t v = 0; v < vertex_count; v++ ) {
+		adjacency_offsets[v + 1] += adjacency_offsets[v];
+	}
+
+	std::vector<uint32_t> live_triangles( vertex_count, 0 );
+	std::vector<uint32_t> adjacency( indices.size() );
+	for( size_t t = 0; t < triangle_count; t++ ) {
+		for( uint32_t k = 0; k < 3; k++ ) {
+			uint32_t v = indices[t * 3 + k];
+			adjacency[adjacency_offsets[v] + live_triangles[v]++] = uint32_t( t );
+		}
+	}
+
+	std::vector<int32_t> cache_position( vertex_count, -1 );
+	std::vector<float> vertex_scores( vertex_count );
+	for( uint32_t v = 0; v < vertex_count; v++ ) {
+		vertex_scores[v] = vertex_score( -1, live_triangles[v] );
+	}
+
+	std::vector<float> triangle_scores( triangle_count );
+	std::vector<uint8_t> emitted( triangle_count, 0 );
+	for( size_t t = 0; t < triangle_count; t++ ) {
+		triangle_scores[t] = vertex_scores[indices[t * 3 + 0]] + vertex_scores[indices[t * 3 + 1]] + vertex_scores[indices[t * 3 + 2]];
+	}
+
+	std::vector<uint32_t> output;
+	output.reserve( indices.size() );
+
+	uint32_t cache[VERTEX_CACHE_SIZE + 3];
+	uint32_t cache_count = 0;
+	uint32_t new_cache[VERTEX_CACHE_SIZE + 3];
+
+	size_t next_unemitted = 0;
+	size_t best_triangle = 0;
+	for( size_t t = 1; t < triangle_count; t++ ) {
+		if( triangle_scores[t] > triangle_scores[best_triangle] ) {
+			best_triangle = t;
+		}
+	}
+
+	for( size_t emitted_count = 0; emitted_count < triangle_count; emitted_count++ ) {
+		// Nothing in the cache scored, continue with the next triangle in input order
+		if( best_triangle == SIZE_MAX ) {
+			while( emitted[next_unemitted] ) {
+				next_unemitted++;
+			}
+			best_triangle = next_unemitted;
+		}
+
+		const uint32_t* triangle = &indices[best_triangle * 3];
+		output.push_back( triangle[0] );
+		output.push_back( triangle[1] );
+		output.push_back( triangle[2] );
+		emitted[best_triangle] = 1;
+
+		for( uint32_t k = 0; k < 3; k++ ) {
+			uint32_t v = triangle[k];
+			uint32_t* begin = &adjacency[adjacency_offsets[v]];
+			uint32_t* end = begin + live_triangles[v];
+			uint32_t* found = std::find( begin, end, uint32_t( best_triangle ) );
+			if( found != end ) {
+				*found = *( end - 1 );
+				live_triangles[v]--;
+			}
+		}
+
+		// The triangle's vertices move to the front, the rest shift back
+		uint32_t new_count = 0;
+		for( uint32_t k = 0; k < 3; k++ ) {
+			new_cache[new_count++] = triangle[k];
+		}
+		for( uint32_t i = 0; i < cache_count; i++ ) {
+			uint32_t v = cache[i];
+			if( v != triangle[0] && v != triangle[1] && v != triangle[2] ) {
+				new_cache[new_count++] = v;
+			}
+		}
+
+		for( uint32_t i = VERTEX_CACHE_SIZE; i < new_count; i++ ) {
+			cache_position[new_cache[i]] = -1;
+			vertex_scores[new_cache[i]] = vertex_score( -1, live_triangles[new_cache[i]] );
+		}
+		cache_count = std::min( new_count, VERTEX_CACHE_SIZE );
+		std::memcpy( cache, new_cache, cache_count * sizeof( uint32_t ) );
+
+		for( uint32_t i = 0; i < cache_count; i++ ) {
+			cache_position[cache[i]] = int32_t( i );
+			vertex_scores[cache[i]] = vertex_score( int32_t( i ), live_triangles[cache[i]] );
+		}
+
+		// Only triangles around cached or just evicted vertices changed score
+		best_triangle = SIZE_MAX;
+		float best_score = 0.0f;
+		for( uint32_t i = 0; i < new_count; i++ ) {
+			uint32_t v = new_cache[i];
+			const uint32_t* begin = &adjacency[adjacency_offsets[v]];
+
+			for( uint32_t a = 0; a < live_triangles[v]; a++ ) {
+				uint32_t t = begin[a];
+				float score = vertex_scores[indices[t * 3 + 0]] + vertex_scores[indices[t * 3 + 1]] + vertex_scores[indices[t * 3 + 2]];
+				triangle_scores[t] = score;
+
+				if( score > best_score ) {
+					best_score = score;
+					best_triangle = t;
+				}
+			}
+		}
+	}
+
+	indices.swap( output );
+}
+
+uint32_t OptimizeOverdraw( std::vector<uint32_t>& indices, const SourceMesh& mesh, float threshold )
+{
+	const uint32_t cache_size = 16;
+
+	size_t triangle_count = indices.size() / 3;
+	uint32_t vertex_count = mesh.getVertexCount();
+	if( triangle_count == 0 ) {
+		return 0;
+	}
+
+	// Simulated FIFO cache, bumping misses by more than the cache size empties it
+	std::vector<uint32_t> miss_stamp( vertex_count, 0 );
+	uint32_t misses = 0;
+	auto triangle_misses = [&]( size_t t ) {
+		uint32_t result = 0;
+		for( uint32_t k = 0; k < 3; k++ ) {
+			uint32_t v = indices[t * 3 + k];
+			if( miss_stamp[v] == 0 || misses + 1 - miss_stamp[v] > cache_size ) {
+				misses++;
+				miss_stamp[v] = misses;
+				result++;
+			}
+		}
+		return result;
+	};
+
+	// Hard boundaries are triangles that miss the cache on all three vertices
+	std::vector<uint32_t> hard_starts;
+	for( size_t t = 0; t < triangle_count; t++ ) {
+		if( triangle_misses( t ) == 3 || t == 0 ) {
+			hard_starts.push_back( uint32_t( t ) );
+		}
+	}
+	hard_starts.push_back( uint32_t( triangle_count ) );
+
+	// Soft boundaries split hard clusters wherever the ACMR since the last split, from a cold cache, is within
+	// threshold of the hard cluster's. Starting the next cluster there costs no more than that
+	std::vector<uint32_t> cluster_starts;
+	for( size_t h = 0; h + 1 < hard_starts.size(); h++ ) {
+		uint32_t begin = hard_starts[h];
+		uint32_t end = hard_starts[h + 1];
+
+		misses += cache_size + 1;
+		uint32_t hard_misses = 0;
+		for( uint32_t t = begin; t < end; t++ ) {
+			hard_misses += triangle_misses( t );
+		}
+		float cluster_threshold = threshold * float( hard_misses ) / float( end - begin );
+
+		misses += cache_size + 1;
+		cluster_starts.push_back( begin );
+		uint32_t start = begin;
+		uint32_t running_misses = 0;
+
+		for( uint32_t t = begin; t < end; t++ ) {
+			running_misses += triangle_misses( t );
+
+			if( t + 1 < end && running_misses <= cluster_threshold * float( t + 1 - start ) ) {
+				cluster_starts.push_back( t + 1 );
+				start = t + 1;
+				running_misses = 0;
+				misses += cache_size + 1;
+			}
+		}
+	}
+
+	uint32_t cluster_count = uint32_t( cluster_starts.size() );
+	if( cluster_count < 2 ) {
+		return 0;
+	}
+	cluster_starts.push_back( uint32_t( triangle_count ) );
+
+	struct Cluster
+	{
+		uint32_t begin;
+		uint32_t end;
+		float sort_key;
+	};
+
+	std::vector<Cluster> clusters( cluster_count );
+	std::vector<float> centroids( cluster_count * 3 );
+	std::vector<float> normals( cluster_count * 3 );
+	float mesh_centroid[3] = {};
+	float mesh_area = 0.0f;
+
+	for( uint32_t c = 0; c < cluster_count; c++ ) {
+		float centroid[3] = {};
+		float normal[3] = {};
+		float area = 0.0f;
+
+		for( uint32_t t = cluster_starts[c]; t < cluster_starts[c + 1]; t++ ) {
+			const float* a = &mesh.positions[indices[t * 3 + 0] * 3];
+			const float* b = &mesh.positions[indices[t * 3 + 1] * 3];
+			const float* d = &mesh.positions[indices[t * 3 + 2] * 3];
+
+			float e0[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+			float e1[3] = { d[0] - a[0], d[1] - a[1], d[2] - a[2] };
+			float n[3] = { e0[1] * e1[2] - e0[2] * e1[1], e0[2] * e1[0] - e0[0] * e1[2], e0[0] * e1[1] - e0[1] * e1[0] };
+			float triangle_area = std::sqrt( n[0] * n[0] + n[1] * n[1] + n[2] * n[2] );
+
+			for( uint32_t k = 0; k < 3; k++ ) {
+				centroid[k] += ( a[k] + b[k] + d[k] ) * ( triangle_area / 3.0f );
+				normal[k] += n[k];
+			}
+			area += triangle_area;
+		}
+
+		for( uint32_t k = 0; k < 3; k++ ) {
+			mesh_centroid[k] += centroid[k];
+			centroids[c * 3 + k] = area > 0.0f ? centroid[k] / area : 0.0f;
+			normals[c * 3 + k] = normal[k];
+		}
+		mesh_area += area;
+
+		clusters[c].begin = cluster_starts[c];
+		clusters[c].end = cluster_starts[c + 1];
+	}
+
+	for( uint32_t k = 0; k < 3; k++ ) {
+		mesh_centroid[k] = mesh_area > 0.0f ? mesh_centroid[k] / mesh_area : 0.0f;
+	}
+
+	for( uint32_t c = 0; c < cluster_count; c++ ) {
+		const float* n = &normals[c * 3];
+		float length = std::sqrt( n[0] * n[0] + n[1] * n[1] + n[2] * n[2] );
+		float key = 0.0f;
+		for( uint32_t k = 0; k < 3; k++ ) {
+			key += ( centroids[c * 3 + k] - mesh_centroid[k] ) * ( length > 0.0f ? n[k] / length : 0.0f );
+		}
+		clusters[c].sort_key = key;
+	}
+
+	std::stable_sort( clusters.begin(), clusters.end(), []( const Cluster& a, const Cluster& b ) { return a.sort_key > b.sort_key; } );
+
+	std::vector<uint32_t> sorted;
+	sorted.reserve( indices.size() );
+	for( auto &c : clusters ) {
+		sorted.insert( sorted.end(), indices.begin() + c.begin * 3, indices.begin() + c.end * 3 );
+	}
+
+	VertexCacheStats before = AnalyzeVertexCache( indices, vertex_count, cache_size );
+	VertexCacheStats after = AnalyzeVertexCache( sorted, vertex_count, cache_size );
+	if( after.acmr > before.acmr * threshold ) {
+		return 0;
+	}
+
+	indices.swap( sorted );
+	return cluster_count;
+}
+
+void OptimizeVertexFetch( SourceMesh& mesh )
+{
+	uint32_t vertex_count = mesh.getVertexCount();
+	std::vector<uint32_t> remap( vertex_count, UINT32_MAX );
+
+	uint32_t next = 0;
+	for( auto &i : mesh.indices ) {
+		if( remap[i] == UINT32_MAX ) {
+			remap[i] = next++;
+		}
+		i = remap[i];
+	}
+
+	std::vector<float> positions( next * 3 );
+	std::vector<float> normals( next * 3 );
+	std::vector<float> uvs( next * 2 );
+	for( uint32_t v = 0; v < vertex_count; v++ ) {
+		uint32_t r = remap[v];
+		if( r == UINT32_MAX ) {
+			continue;
+		}
+		std::memcpy( &positions[r * 3], &mesh.positions[v * 3], sizeof( float ) * 3 );
+		std::memcpy( &normals[r * 3], &mesh.normals[v * 3], sizeof( float ) * 3 );
+		std::memcpy( &uvs[r * 2], &mesh.uvs[v * 2], sizeof( float ) * 2 );
+	}
+
+	mesh.positions.swap( positions );
+	mesh.normals.swap( normals );
+	mesh.uvs.swap( uvs );
+}
+
+static void ComputeBounds( const SourceMesh& mesh, float bounds_min[3], float bounds_max[3] )
+{
+	for( uint32_t k = 0; k < 3; k++ ) {
+		bounds_min[k] = mesh.positions.empty() ? 0.0f : mesh.positions[k];
+		bounds_max[k] = bounds_min[k];
+	}
+	for( size_t v = 0; v < mesh.positions.size(); v += 3 ) {
+		for( uint32_t k = 0; k < 3; k++ ) {
+			bounds_min[k] = std::min( bounds_min[k], mesh.positions[v + k] );
+			bounds_max[k] = std::max( bounds_max[k], mesh.positions[v + k] );
+		}
+	}
+}
+
+std::vector<uint32_t> SimplifyMeshClustered( const SourceMesh& mesh, float cell_size, float* error )
+{
+	uint32_t vertex_count = mesh.getVertexCount();
+
+	float bounds_min[3];
+	float bounds_max[3];
+	ComputeBounds( mesh, bounds_min, bounds_max );
+
+	// 21 bits of cell coordinate per axis
+	std::unordered_map<uint64_t, uint32_t> cell_map;
+	std::vector<uint32_t> vertex_cells( vertex_count );
+	std::vector<float> cell_sums;
+
+	for( uint32_t v = 0; v < vertex_count; v++ ) {
+		const float* p = &mesh.positions[v * 3];
+		uint64_t key = 0;
+		for( uint32_t k = 0; k < 3; k++ ) {
+			uint64_t cell = uint64_t( std::min( ( p[k] - bounds_min[k] ) / cell_size, float( ( 1 << 21 ) - 1 ) ) );
+			key |= cell << ( k * 21 );
+		}
+
+		auto found = cell_map.find( key );
+		if( found == cell_map.end() ) {
+			found = cell_map.insert( std::make_pair( key, uint32_t( cell_map.size() ) ) ).first;
+			cell_sums.insert( cell_sums.end(), 4, 0.0f );
+		}
+
+		uint32_t cell = found->second;
+		vertex_cells[v] = cell;
+		cell_sums[cell * 4 + 0] += p[0];
+		cell_sums[cell * 4 + 1] += p[1];
+		cell_sums[cell * 4 + 2] += p[2];
+		cell_sums[cell * 4 + 3] += 1.0f;
+	}
+
+	// Each cell collapses onto its vertex nearest the cell's mean position
+	uint32_t cell_count = uint32_t( cell_map.size() );
+	std::vector<uint32_t> representatives( cell_count, UINT32_MAX );
+	std::vector<float> representative_distances( cell_count, 0.0f );
+
+	for( uint32_t v = 0; v < vertex_count; v++ ) {
+		uint32_t cell = vertex_cells[v];
+		const float* p = &mesh.positions[v * 3];
+		const float* sum = &cell_sums[cell * 4];
+
+		float d[3] = { p[0] - sum[0] / sum[3], p[1] - sum[1] / sum[3], p[2] - sum[2] / sum[3] };
+		float distance = d[0] * d[0] + d[1] * d[1] + d[2] * d[2];
+
+		if( representatives[cell] == UINT32_MAX || distance < representative_distances[cell] ) {
+			representatives[cell] = v;
+			representative_distances[cell] = distance;
+		}
+	}
+
+	float max_error = 0.0f;
+	for( uint32_t v = 0; v < vertex_count; v++ ) {
+		const float* p = &mesh.positions[v * 3];
+		const float* r = &mesh.positions[representatives[vertex_cells[v]] * 3];
+		float d[3] = { p[0] - r[0], p[1] - r[1], p[2] - r[2] };
+		max_error = std::max( max_error, d[0] * d[0] + d[1] * d[1] + d[2] * d[2] );
+	}
+	*error = std::sqrt( max_error );
+
+	// Collapsed and duplicate triangles are dropped, the first of a set of duplicates stays
+	struct Triangle
+	{
+		uint32_t sorted[3];
+		uint32_t index;
+	};
+
+	std::vector<uint32_t> collapsed;
+	std::vector<Triangle> triangles;
+	for( size_t t = 0; t + 2 < mesh.indices.size(); t += 3 ) {
+		uint32_t a = representatives[vertex_cells[mesh.indices[t + 0]]];
+		uint32_t b = representatives[vertex_cells[mesh.indices[t + 1]]];
+		uint32_t c = representatives[vertex_cells[mesh.indices[t + 2]]];
+		if( a == b || b == c || a == c ) {
+			continue;
+		}
+
+		Triangle triangle;
+		triangle.sorted[0] = std::min( a, std::min( b, c ) );
+		triangle.sorted[2] = std::max( a, std::max( b, c ) );
+		triangle.sorted[1] = a + b + c - triangle.sorted[0] - triangle.sorted[2];
+		triangle.index = uint32_t( collapsed.size() / 3 );
+		triangles.push_back( triangle );
+
+		collapsed.push_back( a );
+		collapsed.push_back( b );
+		collapsed.push_back( c );
+	}
+
+	std::sort( triangles.begin(), triangles.end(), []( const Triangle& x, const Triangle& y ) {
+		if( x.sorted[0] != y.sorted[0] ) return x.sorted[0] < y.sorted[0];
+		if( x.sorted[1] != y.sorted[1] ) return x.sorted[1] < y.sorted[1];
+		if( x.sorted[2] != y.sorted[2] ) return x.sorted[2] < y.sorted[2];
+		return x.index < y.index;
+	} );
+
+	std::vector<uint8_t> keep( collapsed.size() / 3, 0 );
+	for( size_t i = 0; i < triangles.size(); i++ ) {
+		if( i == 0 || std::memcmp( triangles[i].sorted, triangles[i - 1].sorted, sizeof( triangles[i].sorted ) ) != 0 ) {
+			keep[triangles[i].index] = 1;
+		}
+	}
+
+	std::vector<uint32_t> indices;
+	for( size_t t = 0; t < keep.size(); t++ ) {
+		if( keep[t] ) {
+			indices.insert( indices.end(), collapsed.begin() + t * 3, collapsed.begin() + t * 3 + 3 );
+		}
+	}
+
+	return indices;
+}
+
+void BuildMeshlets( const SourceMesh& mesh, const std::vector<uint32_t>& indices, MeshPackLodData* lod )
+{
+	std::vector<uint32_t> local_index( mesh.getVertexCount(), UINT32_MAX );
+
+	MeshPackMeshlet meshlet {};
+
+	auto finish_meshlet = [&]() {
+		if( meshlet.triangle_count == 0 ) {
+			return;
+		}
+
+		const uint32_t* vertices = &lod->meshlet_vertices[meshlet.vertex_offset];
+		float bounds_min[3];
+		float bounds_max[3];
+		for( uint32_t k = 0; k < 3; k++ ) {
+			bounds_min[k] = mesh.positions[vertices[0] * 3 + k];
+			bounds_max[k] = bounds_min[k];
+		}
+		for( uint32_t i = 1; i < meshlet.vertex_count; i++ ) {
+			for( uint32_t k = 0; k < 3; k++ ) {
+				bounds_min[k] = std::min( bounds_min[k], mesh.positions[vertices[i] * 3 + k] );
+				bounds_max[k] = std::max( bounds_max[k], mesh.positions[vertices[i] * 3 + k] );
+			}
+		}
+
+		float radius = 0.0f;
+		for( uint32_t k = 0; k < 3; k++ ) {
+			meshlet.center[k] = ( bounds_min[k] + bounds_max[k] ) * 0.5f;
+		}
+		for( uint32_t i = 0; i < meshlet.vertex_count; i++ ) {
+			const float* p = &mesh.positions[vertices[i] * 3];
+			float d[3] = { p[0] - meshlet.center[0], p[1] - meshlet.center[1], p[2] - meshlet.center[2] };
+			radius = std::max( radius, d[0] * d[0] + d[1] * d[1] + d[2] * d[2] );
+			local_index[vertices[i]] = UINT32_MAX;
+		}
+		meshlet.radius = std::sqrt( radius );
+
+		lod->meshlets.push_back( meshlet );
+
+		meshlet = MeshPackMeshlet {};
+		meshlet.vertex_offset = uint32_t( lod->meshlet_vertices.size() );
+		meshlet.triangle_offset = uint32_t( lod->meshlet_triangles.size() );
+	};
+
+	for( size_t t = 0; t + 2 < indices.size(); t += 3 ) {
+		const uint32_t* triangle = &indices[t];
+
+		uint32_t new_vertices = 0;
+		for( uint32_t k = 0; k < 3; k++ ) {
+			bool repeated = ( k > 0 && triangle[k] == triangle[0] ) || ( k > 1 && triangle[k] == triangle[1] );
+			new_vertices += local_index[triangle[k]] == UINT32_MAX && !repeated ? 1 : 0;
+		}
+
+		if( meshlet.vertex_count + new_vertices > MESH_PACK_MESHLET_MAX_VERTICES || meshlet.triangle_count + 1 > MESH_PACK_MESHLET_MAX_TRIANGLES ) {
+			finish_meshlet();
+		}
+
+		for( uint32_t k = 0; k < 3; k++ ) {
+			uint32_t v = triangle[k];
+			if( local_index[v] == UINT32_MAX ) {
+				local_index[v] = meshlet.vertex_count++;
+				lod->meshlet_vertices.push_back( v );
+			}
+			lod->meshlet_triangles.push_back( uint8_t( local_index[v] ) );
+		}
+		meshlet.triangle_count++;
+	}
+
+	finish_meshlet();
+}
+
+uint16_t FloatToHalf( float value )
+{
+	uint32_t bits;
+	std::memcpy( &bits, &value, sizeof( bits ) );
+
+	uint32_t sign = ( bits >> 16 ) & 0x8000;
+	uint32_t float_exponent = ( bits >> 23 ) & 0xFF;
+	uint32_t mantissa = bits & 0x7FFFFF;
+	int32_t exponent = int32_t( float_exponent ) - 127 + 15;
+
+	if( float_exponent == 0xFF ) {
+		return uint16_t( sign | 0x7C00 | ( mantissa != 0 ? 0x200 : 0 ) );
+	}
+	if( exponent >= 31 ) {
+		return uint16_t( sign | 0x7C00 );
+	}
+
+	// Round to nearest even in both cases, a carry into the exponent is still correct
+	if( exponent <= 0 ) {
+		if( exponent < -10 ) {
+			return uint16_t( sign );
+		}
+		mantissa |= 0x800000;
+		uint32_t shift = uint32_t( 14 - exponent );
+		uint32_t half = mantissa >> shift;
+		uint32_t remainder = mantissa & ( ( 1u << shift ) - 1 );
+		uint32_t midpoint = 1u << ( shift - 1 );
+		if( remainder > midpoint || ( remainder == midpoint && ( half & 1 ) ) ) {
+			half++;
+		}
+		return uint16_t( sign | half );
+	}
+
+	uint32_t half = sign | ( uint32_t( exponent ) << 10 ) | ( mantissa >> 13 );
+	uint32_t remainder = mantissa & 0x1FFF;
+	if( remainder > 0x1000 || ( remainder == 0x1000 && ( half & 1 ) ) ) {
+		half++;
+	}
+	return uint16_t( half );
+}
+
+float HalfToFloat( uint16_t value )
+{
+	uint32_t sign = uint32_t( value & 0x8000 ) << 16;
+	uint32_t exponent = ( value >> 10 ) & 0x1F;
+	uint32_t mantissa = value & 0x3FF;
+	uint32_t bits;
+
+	if( exponent == 0 ) {
+		// Zero or denormal
+		float magnitude = std::ldexp( float( mantissa ), -24 );
+		return sign ? -magnitude : magnitude;
+	}
+	else if( exponent == 31 ) {
+		bits = sign | 0x7F800000 | ( mantissa << 13 );
+	}
+	else {
+		bits = sign | ( ( exponent + 127 - 15 ) << 23 ) | ( mantissa << 13 );
+	}
+
+	float result;
+	std::memcpy( &result, &bits, sizeof( result ) );
+	return result;
+}
+
+static int16_t QuantizeSnorm16( float value )
+{
+	return int16_t( std::lround( std::max( -1.0f, std::min( 1.0f, value ) ) * 32767.0f ) );
+}
+
+void EncodeOctahedral( const float normal[3], int16_t encoded[2] )
+{
+	float sum = std::fabs( normal[0] ) + std::fabs( normal[1] ) + std::fabs( normal[2] );
+	if( sum == 0.0f ) {
+		encoded[0] = 0;
+		encoded[1] = 0;
+		return;
+	}
+
+	float x = normal[0] / sum;
+	float y = normal[1] / sum;
+
+	// The lower hemisphere folds over the diagonals
+	if( normal[2] < 0.0f ) {
+		float folded_x = ( 1.0f - std::fabs( y ) ) * ( x >= 0.0f ? 1.0f : -1.0f );
+		float folded_y = ( 1.0f - std::fabs( x ) ) * ( y >= 0.0f ? 1.0f : -1.0f );
+		x = folded_x;
+		y = folded_y;
+	}
+
+	encoded[0] = QuantizeSnorm16( x );
+	encoded[1] = QuantizeSnorm16( y );
+}
+
+void DecodeOctahedral( const int16_t encoded[2], float normal[3] )
+{
+	float x = std::max( -1.0f, encoded[0] / 32767.0f );
+	float y = std::max( -1.0f, encoded[1] / 32767.0f );
+	float z = 1.0f - std::fabs( x ) - std::fabs( y );
+
+	if( z < 0.0f ) {
+		float unfolded_x = ( 1.0f - std::fabs( y ) ) * ( x >= 0.0f ? 1.0f : -1.0f );
+		float unfolded_y = ( 1.0f - std::fabs( x ) ) * ( y >= 0.0f ? 1.0f : -1.0f );
+		x = unfolded_x;
+		y = unfolded_y;
+	}
+
+	float length = std::sqrt( x * x + y * y + z * z );
+	normal[0] = x / length;
+	normal[1] = y / length;
+	normal[2] = z / length;
+}
+
+void QuantizeMesh( const SourceMesh& mesh, std::vector<MeshPackVertex>* vertices, float bounds_min[3], float bounds_scale[3] )
+{
+	float bounds_max[3];
+	ComputeBounds( mesh, bounds_min, bounds_max );
+
+	float inverse_scale[3];
+	for( uint32_t k = 0; k < 3; k++ ) {
+		bounds_scale[k] = ( bounds_max[k] - bounds_min[k] ) / 65535.0f;
+		inverse_scale[k] = bounds_scale[k] > 0.0f ? 1.0f / bounds_scale[k] : 0.0f;
+	}
+
+	uint32_t vertex_count = mesh.getVertexCount();
+	vertices->resize( vertex_count );
+
+	for( uint32_t v = 0; v < vertex_count; v++ ) {
+		MeshPackVertex& out = ( *vertices )[v];
+
+		for( uint32_t k = 0; k < 3; k++ ) {
+			float value = ( mesh.positions[v * 3 + k] - bounds_min[k] ) * inverse_scale[k] + 0.5f;
+			out.position[k] = uint16_t( std::max( 0.0f, std::min( 65535.0f, value ) ) );
+		}
+		out.position[3] = 0;
+
+		EncodeOctahedral( &mesh.normals[v * 3], out.normal );
+
+		out.uv[0] = FloatToHalf( mesh.uvs[v * 2 + 0] );
+		out.uv[1] = FloatToHalf( mesh.uvs[v * 2 + 1] );
+	}
+}
+
+MeshQuantizationError MeasureQuantizationError( const SourceMesh& mesh, const std::vector<MeshPackVertex>& vertices, const float bounds_min[3], const float bounds_scale[3] )
+{
+	MeshQuantizationError error {};
+	float min_cosine = 1.0f;
+
+	for( uint32_t v = 0; v < mesh.getVertexCount(); v++ ) {
+		const MeshPackVertex& q = vertices[v];
+
+		float distance = 0.0f;
+		for( uint32_t k = 0; k < 3; k++ ) {
+			float d = bounds_min[k] + q.position[k] * bounds_scale[k] - mesh.positions[v * 3 + k];
+			distance += d * d;
+		}
+		error.position = std::max( error.position, std::sqrt( distance ) );
+
+		const float* n = &mesh.normals[v * 3];
+		float length = std::sqrt( n[0] * n[0] + n[1] * n[1] + n[2] * n[2] );
+		if( length > 0.0f ) {
+			float decoded[3];
+			DecodeOctahedral( q.normal, decoded );
+			min_cosine = std::min( min_cosine, ( decoded[0] * n[0] + decoded[1] * n[1] + decoded[2] * n[2] ) / length );
+		}
+
+		for( uint32_t k = 0; k < 2; k++ ) {
+			error.uv = std::max( error.uv, std::fabs( HalfToFloat( q.uv[k] ) - mesh.uvs[v * 2 + k] ) );
+		}
+	}
+
+	error.normal_degrees = std::acos( std::max( -1.0f, std::min( 1.0f, min_cosine ) ) ) * 180.0f / MESH_PI;
+	return error;
+}
+
+void ConvertMesh( const std::string& name, SourceMesh mesh, MeshPackWriter& writer, const MeshConvertSettings& settings, MeshConvertStats* stats )
+{
+	MeshConvertStats local_stats;
+	if( stats == nullptr ) {
+		stats = &local_stats;
+	}
+
+	stats->vertex_count = mesh.getVertexCount();
+	stats->triangle_count = uint32_t( mesh.indices.size() / 3 );
+	stats->cache_before = AnalyzeVertexCache( mesh.indices, mesh.getVertexCount() );
+
+	OptimizeVertexCache( mesh.indices, mesh.getVertexCount() );
+	stats->overdraw_clusters = OptimizeOverdraw( mesh.indices, mesh, settings.overdraw_threshold );
+	OptimizeVertexFetch( mesh );
+
+	stats->cache_after = AnalyzeVertexCache( mesh.indices, mesh.getVertexCount() );
+
+	std::vector<MeshPackLodData> lods( 1 );
+	lods[0].indices = mesh.indices;
+	BuildMeshlets( mesh, lods[0].indices, &lods[0] );
+
+	// Coarser LODs cluster LOD 0 with a growing cell size until each reaches its triangle target
+	float bounds_min[3];
+	float bounds_max[3];
+	ComputeBounds( mesh, bounds_min, bounds_max );
+	float diagonal = std::sqrt( ( bounds_max[0] - bounds_min[0] ) * ( bounds_max[0] - bounds_min[0] ) +
+		( bounds_max[1] - bounds_min[1] ) * ( bounds_max[1] - bounds_min[1] ) + ( bounds_max[2] - bounds_min[2] ) * ( bounds_max[2] - bounds_min[2] ) );
+	float cell_size = diagonal / 1024.0f;
+
+	while( lods.size() < settings.max_lod_count && diagonal > 0.0f ) {
+		size_t previous_triangles = lods.back().indices.size() / 3;
+		if( previous_triangles <= settings.min_lod_triangles ) {
+			break;
+		}
+		size_t target_triangles = size_t( previous_triangles * settings.lod_triangle_ratio );
+
+		MeshPackLodData lod;
+		for( ; cell_size < diagonal; cell_size *= 1.25f ) {
+			lod.indices = SimplifyMeshClustered( mesh, cell_size, &lod.error );
+			if( lod.indices.size() / 3 <= target_triangles ) {
+				break;
+			}
+		}
+
+		if( lod.indices.empty() || lod.indices.size() / 3 >= previous_triangles ) {
+			break;
+		}
+
+		OptimizeVertexCache( lod.indices, mesh.getVertexCount() );
+		BuildMeshlets( mesh, lod.indices, &lod );
+		lods.push_back( std::move( lod ) );
+	}
+
+	std::vector<MeshPackVertex> vertices;
+	float bounds_scale[3];
+	QuantizeMesh( mesh, &vertices, bounds_min, bounds_scale );
+	stats->quantization = MeasureQuantizationError( mesh, vertices, bounds_min, bounds_scale );
+
+	writer.AddMesh( name, bounds_min, bounds_scale, vertices, lods );
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include "MeshPack.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Offline mesh processing behind the MeshPack format: importing, index and vertex reordering, LODs, meshlets and
+// quantization. None of this runs at load time.
+
+// Unquantized mesh with unique vertices, three floats per position and normal and two per UV
+struct SourceMesh
+{
+	std::vector<float> positions;
+	std::vector<float> normals;
+	std::vector<float> uvs;
+	std::vector<uint32_t> indices;
+
+	uint32_t getVertexCount() const;
+};
+
+// Wavefront OBJ with v, vt, vn and polygonal f records. Faces are triangulated as fans and missing normals are
+// generated
+bool LoadObjMesh( const std::string& path, SourceMesh* mesh );
+bool WriteObjMesh( const std::string& path, const SourceMesh& mesh );
+
+// Test geometry, (rings + 1) * (sides + 1) vertices
+SourceMesh GenerateTorusMesh( uint32_t rings, uint32_t sides );
+
+struct VertexCacheStats
+{
+	float acmr;		// vertex shader invocations per triangle
+	float atvr;		// vertex shader invocations per vertex
+};
+
+// Simulated FIFO post-transform cache
+VertexCacheStats AnalyzeVertexCache( const std::vector<uint32_t>& indices, uint32_t vertex_count, uint32_t cache_size = 16 );
+
+// Reorders triangles for the post-transform cache (Forsyth, linear speed vertex cache optimisation)
+void OptimizeVertexCache( std::vector<uint32_t>& indices, uint32_t vertex_count );
+
+// Splits cache-ordered triangles into clusters that cost little to start with a cold cache and sorts them so outward
+// facing ones are drawn first, which lets them occlude the rest. Keeps the cache order if the ACMR would get worse than
+// threshold times the current one. Returns the number of clusters, 0 if nothing changed
+uint32_t OptimizeOverdraw( std::vector<uint32_t>& indices, const SourceMesh& mesh, float threshold );
+
+// Renumbers vertices in the order the indices first use them and drops unused ones
+void OptimizeVertexFetch( SourceMesh& mesh );
+
+// Vertex clustering: vertices in the same grid cell collapse onto the one nearest the cell's mean, indexing the
+// original vertices. error receives the furthest any vertex moved
+std::vector<uint32_t> SimplifyMeshClustered( const SourceMesh& mesh, float cell_size, float* error );
+
+// Greedy meshlets in index order
+void BuildMeshlets( const SourceMesh& mesh, const std::vector<uint32_t>& indices, MeshPackLodData* lod );
+
+void QuantizeMesh( const SourceMesh& mesh, std::vector<MeshPackVertex>* vertices, float bounds_min[3], float bounds_scale[3] );
+
+uint16_t FloatToHalf( float value );
+float HalfToFloat( uint16_t value );
+void EncodeOctahedral( const float normal[3], int16_t encoded[2] );
+void DecodeOctahedral( const int16_t encoded[2], float normal[3] );
+
+struct MeshQuantizationError
+{
+	float position;			// largest distance, object space
+	float normal_degrees;
+	float uv;
+};
+
+MeshQuantizationError MeasureQuantizationError( const SourceMesh& mesh, const std::vector<MeshPackVertex>& vertices, const float bounds_min[3], const float bounds_scale[3] );
+
+struct MeshConvertSettings
+{
+	float overdraw_threshold = 1.05f;
+
+	// LODs aim for this share of the previous LOD's triangles, and stop below min_lod_triangles
+	uint32_t max_lod_count = 6;
+	float lod_triangle_ratio = 0.5f;
+	uint32_t min_lod_triangles = 128;
+};
+
+struct MeshConvertStats
+{
+	uint32_t vertex_count = 0;
+	uint32_t triangle_count = 0;
+
+	VertexCacheStats cache_before {};
+	VertexCacheStats cache_after {};
+	uint32_t overdraw_clusters = 0;
+
+	MeshQuantizationError quantization {};
+};
+
+// The whole pipeline for one mesh, adding the result to writer
+void ConvertMesh( const std::string& name, SourceMesh mesh, MeshPackWriter& writer, const MeshConvertSettings& settings = MeshConvertSettings(), MeshConvertStats* stats = nullptr );
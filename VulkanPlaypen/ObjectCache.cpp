@@ -0,0 +1,517 @@
+#include "ObjectCache.h"
+#include "Renderer.h"
+#include "RendererUtils.h"
+#include "DeletionQueue.h"
+#include "ImageEncoding.h"
+
+#include <cstring>
+#include <iomanip>
+#include <type_traits>
+
+// Keys are built field by field, copying whole structs would hash their padding
+template<typename T>
+static void AppendKey( std::vector<uint8_t>& key, T value )
+{
+	static_assert( std::is_scalar<T>::value, "Keys are built from scalars only" );
+
+	size_t offset = key.size();
+	key.resize( offset + sizeof( T ) );
+	std::memcpy( key.data() + offset, &value, sizeof( T ) );
+}
+
+template<typename T>
+static void AppendKeyHandle( std::vector<uint8_t>& key, T handle )
+{
+	AppendKey( key, (uint64_t)handle );
+}
+
+static void AppendKeyAttachmentReference( std::vector<uint8_t>& key, const VkAttachmentReference& reference )
+{
+	AppendKey( key, reference.attachment );
+	AppendKey( key, reference.layout );
+}
+
+// Per thread, so building a key for a lookup doesn't allocate once the buffers have grown
+static std::vector<uint8_t>& KeyScratch()
+{
+	static thread_local std::vector<uint8_t> key;
+	key.clear();
+	return key;
+}
+
+static std::vector<uint64_t>& ReferenceScratch()
+{
+	static thread_local std::vector<uint64_t> references;
+	references.clear();
+	return references;
+}
+
+ObjectCacheTable::ObjectCacheTable()
+	: _slots( nullptr ), _hits( 0 ), _misses( 0 )
+{
+	_Rebuild( 16 );
+}
+
+
+ObjectCacheTable::~ObjectCacheTable()
+{
+}
+
+uint64_t ObjectCacheTable::Find( uint64_t hash, const std::vector<uint8_t>& key )
+{
+	uint64_t handle = _Probe( _slots.load( std::memory_order_acquire ), hash, key );
+	if( handle != 0 ) {
+		_hits.fetch_add( 1, std::memory_order_relaxed );
+	}
+
+	return handle;
+}
+
+uint64_t ObjectCacheTable::Insert( uint64_t hash, const std::vector<uint8_t>& key, const std::vector<uint64_t>& references, const std::function<uint64_t()>& create )
+{
+	std::lock_guard<std::mutex> lock( _mutex );
+
+	// Another thread may have created it since the lock free lookup
+	uint64_t handle = _Probe( _slots.load( std::memory_order_relaxed ), hash, key );
+	if( handle != 0 ) {
+		_hits.fetch_add( 1, std::memory_order_relaxed );
+		return handle;
+	}
+
+	std::unique_ptr<Entry> entry( new Entry() );
+	entry->hash = hash;
+	entry->key = key;
+	entry->references = references;
+	entry->handle = create();
+
+	_Insert( entry.get() );
+	_all_entries.push_back( std::move( entry ) );
+	_misses.fetch_add( 1, std::memory_order_relaxed );
+
+	return _all_entries.back()->handle;
+}
+
+void ObjectCacheTable::Invalidate( uint64_t reference, const std::function<void( uint64_t )>& retire )
+{
+	std::lock_guard<std::mutex> lock( _mutex );
+	Slots* slots = _slots.load( std::memory_order_relaxed );
+
+	for( uint32_t i = 0; i <= slots->mask; i++ ) {
+		Entry* entry = slots->entries[i].load( std::memory_order_relaxed );
+		if( entry == nullptr || entry == _Tombstone() ) {
+			continue;
+		}
+
+		for( auto r : entry->references ) {
+			if( r == reference ) {
+				slots->entries[i].store( _Tombstone(), std::memory_order_release );
+				retire( entry->handle );
+				_live_count--;
+				_invalidated_count++;
+				break;
+			}
+		}
+	}
+}
+
+void ObjectCacheTable::Clear( const std::function<void( uint64_t )>& retire )
+{
+	std::lock_guard<std::mutex> lock( _mutex );
+	Slots* slots = _slots.load( std::memory_order_relaxed );
+
+	for( uint32_t i = 0; i <= slots->mask; i++ ) {
+		Entry* entry = slots->entries[i].load( std::memory_order_relaxed );
+		if( entry != nullptr && entry != _Tombstone() ) {
+			retire( entry->handle );
+		}
+		slots->entries[i].store( nullptr, std::memory_order_relaxed );
+	}
+
+	_used_count = 0;
+	_live_count = 0;
+}
+
+ObjectCacheTypeStats ObjectCacheTable::getStats() const
+{
+	std::lock_guard<std::mutex> lock( _mutex );
+
+	ObjectCacheTypeStats stats;
+	stats.hits = _hits.load( std::memory_order_relaxed );
+	stats.misses = _misses.load( std::memory_order_relaxed );
+	stats.live_count = _live_count;
+	stats.invalidated_count = _invalidated_count;
+	return stats;
+}
+
+ObjectCacheTable::Entry* ObjectCacheTable::_Tombstone()
+{
+	static Entry tombstone { 0, {}, {}, 0 };
+	return &tombstone;
+}
+
+uint64_t ObjectCacheTable::_Probe( const Slots* slots, uint64_t hash, const std::vector<uint8_t>& key ) const
+{
+	// Tables are at most half full, so probing always ends at an empty slot
+	for( uint32_t i = uint32_t( hash ) & slots->mask; ; i = ( i + 1 ) & slots->mask ) {
+		const Entry* entry = slots->entries[i].load( std::memory_order_acquire );
+		if( entry == nullptr ) {
+			return 0;
+		}
+
+		if( entry->hash == hash && entry != _Tombstone() && entry->key == key ) {
+			return entry->handle;
+		}
+	}
+}
+
+void ObjectCacheTable::_Insert( Entry* entry )
+{
+	Slots* slots = _slots.load( std::memory_order_relaxed );
+
+	if( ( _used_count + 1 ) * 2 > slots->mask + 1 ) {
+		// Sized from the live entries, so a table full of tombstones is rebuilt at the same size
+		uint32_t capacity = 16;
+		while( capacity < ( _live_count + 1 ) * 4 ) {
+			capacity *= 2;
+		}
+		_Rebuild( capacity );
+		slots = _slots.load( std::memory_order_relaxed );
+	}
+
+	for( uint32_t i = uint32_t( entry->hash ) & slots->mask; ; i = ( i + 1 ) & slots->mask ) {
+		Entry* current = slots->entries[i].load( std::memory_order_relaxed );
+		if( current == nullptr || current == _Tombstone() ) {
+			if( current == nullptr ) {
+				_used_count++;
+			}
+			slots->entries[i].store( entry, std::memory_order_release );
+			break;
+		}
+	}
+
+	_live_count++;
+}
+
+void ObjectCacheTable::_Rebuild( uint32_t capacity )
+{
+	std::unique_ptr<Slots> slots( new Slots() );
+	slots->mask = capacity - 1;
+	slots->entries.reset( new std::atomic<Entry*>[capacity] );
+	for( uint32_t i = 0; i < capacity; i++ ) {
+		slots->entries[i].store( nullptr, std::memory_order_relaxed );
+	}
+
+	Slots* old_slots = _slots.load( std::memory_order_relaxed );
+	if( old_slots != nullptr ) {
+		for( uint32_t i = 0; i <= old_slots->mask; i++ ) {
+			Entry* entry = old_slots->entries[i].load( std::memory_order_relaxed );
+			if( entry == nullptr || entry == _Tombstone() ) {
+				continue;
+			}
+
+			uint32_t s = uint32_t( entry->hash ) & slots->mask;
+			while( slots->entries[s].load( std::memory_order_relaxed ) != nullptr ) {
+				s = ( s + 1 ) & slots->mask;
+			}
+			slots->entries[s].store( entry, std::memory_order_relaxed );
+		}
+	}
+	_used_count = _live_count;
+
+	// Readers still probing the old array find the same entries there
+	_slots.store( slots.get(), std::memory_order_release );
+	_all_slots.push_back( std::move( slots ) );
+}
+
+ObjectCache::ObjectCache( Renderer* r )
+{
+	_renderer = r;
+}
+
+
+ObjectCache::~ObjectCache()
+{
+	DeletionQueue* deletion_queue = _renderer->getDeletionQueue();
+
+	// Users first: framebuffers use render passes, pipeline layouts use set layouts, set layouts may use samplers
+	_framebuffers.Clear( [deletion_queue]( uint64_t handle ) { deletion_queue->DestroyFramebuffer( (VkFramebuffer)handle ); } );
+	_render_passes.Clear( [deletion_queue]( uint64_t handle ) { deletion_queue->DestroyRenderPass( (VkRenderPass)handle ); } );
+	_pipeline_layouts.Clear( [deletion_queue]( uint64_t handle ) { deletion_queue->DestroyPipelineLayout( (VkPipelineLayout)handle ); } );
+	_descriptor_set_layouts.Clear( [deletion_queue]( uint64_t handle ) { deletion_queue->DestroyDescriptorSetLayout( (VkDescriptorSetLayout)handle ); } );
+	_samplers.Clear( [deletion_queue]( uint64_t handle ) { deletion_queue->DestroySampler( (VkSampler)handle ); } );
+}
+
+VkRenderPass ObjectCache::GetRenderPass( const VkRenderPassCreateInfo& info )
+{
+	assert( info.pNext == nullptr && "pNext chains are not part of the cache key" );
+
+	std::vector<uint8_t>& key = KeyScratch();
+	AppendKey( key, info.flags );
+
+	AppendKey( key, info.attachmentCount );
+	for( uint32_t i = 0; i < info.attachmentCount; i++ ) {
+		const VkAttachmentDescription& a = info.pAttachments[i];
+		AppendKey( key, a.flags );
+		AppendKey( key, a.format );
+		AppendKey( key, a.samples );
+		AppendKey( key, a.loadOp );
+		AppendKey( key, a.storeOp );
+		AppendKey( key, a.stencilLoadOp );
+		AppendKey( key, a.stencilStoreOp );
+		AppendKey( key, a.initialLayout );
+		AppendKey( key, a.finalLayout );
+	}
+
+	AppendKey( key, info.subpassCount );
+	for( uint32_t i = 0; i < info.subpassCount; i++ ) {
+		const VkSubpassDescription& s = info.pSubpasses[i];
+		AppendKey( key, s.flags );
+		AppendKey( key, s.pipelineBindPoint );
+
+		AppendKey( key, s.inputAttachmentCount );
+		for( uint32_t a = 0; a < s.inputAttachmentCount; a++ ) {
+			AppendKeyAttachmentReference( key, s.pInputAttachments[a] );
+		}
+
+		AppendKey( key, s.colorAttachmentCount );
+		for( uint32_t a = 0; a < s.colorAttachmentCount; a++ ) {
+			AppendKeyAttachmentReference( key, s.pColorAttachments[a] );
+		}
+
+		AppendKey( key, s.pResolveAttachments != nullptr );
+		for( uint32_t a = 0; s.pResolveAttachments != nullptr && a < s.colorAttachmentCount; a++ ) {
+			AppendKeyAttachmentReference( key, s.pResolveAttachments[a] );
+		}
+
+		AppendKey( key, s.pDepthStencilAttachment != nullptr );
+		if( s.pDepthStencilAttachment != nullptr ) {
+			AppendKeyAttachmentReference( key, *s.pDepthStencilAttachment );
+		}
+
+		AppendKey( key, s.preserveAttachmentCount );
+		for( uint32_t a = 0; a < s.preserveAttachmentCount; a++ ) {
+			AppendKey( key, s.pPreserveAttachments[a] );
+		}
+	}
+
+	AppendKey( key, info.dependencyCount );
+	for( uint32_t i = 0; i < info.dependencyCount; i++ ) {
+		const VkSubpassDependency& d = info.pDependencies[i];
+		AppendKey( key, d.srcSubpass );
+		AppendKey( key, d.dstSubpass );
+		AppendKey( key, d.srcStageMask );
+		AppendKey( key, d.dstStageMask );
+		AppendKey( key, d.srcAccessMask );
+		AppendKey( key, d.dstAccessMask );
+		AppendKey( key, d.dependencyFlags );
+	}
+
+	uint64_t hash = HashBytes( key.data(), key.size() );
+	uint64_t handle = _render_passes.Find( hash, key );
+	if( handle == 0 ) {
+		handle = _render_passes.Insert( hash, key, ReferenceScratch(), [this, &info]() {
+			VkRenderPass render_pass = VK_NULL_HANDLE;
+			vkResultErrorCheck( vkCreateRenderPass( _renderer->getDevice(), &info, _renderer->getAllocationCallbacks(), &render_pass ) );
+			return (uint64_t)render_pass;
+		} );
+	}
+
+	return (VkRenderPass)handle;
+}
+
+VkFramebuffer ObjectCache::GetFramebuffer( const VkFramebufferCreateInfo& info )
+{
+	assert( info.pNext == nullptr && "pNext chains are not part of the cache key" );
+
+	std::vector<uint8_t>& key = KeyScratch();
+	std::vector<uint64_t>& references = ReferenceScratch();
+
+	AppendKey( key, info.flags );
+	AppendKeyHandle( key, info.renderPass );
+	references.push_back( (uint64_t)info.renderPass );
+	AppendKey( key, info.attachmentCount );
+	for( uint32_t i = 0; i < info.attachmentCount; i++ ) {
+		AppendKeyHandle( key, info.pAttachments[i] );
+		references.push_back( (uint64_t)info.pAttachments[i] );
+	}
+	AppendKey( key, info.width );
+	AppendKey( key, info.height );
+	AppendKey( key, info.layers );
+
+	uint64_t hash = HashBytes( key.data(), key.size() );
+	uint64_t handle = _framebuffers.Find( hash, key );
+	if( handle == 0 ) {
+		handle = _framebuffers.Insert( hash, key, references, [this, &info]() {
+			VkFramebuffer framebuffer = VK_NULL_HANDLE;
+			vkResultErrorCheck( vkCreateFramebuffer( _renderer->getDevice(), &info, _renderer->getAllocationCallbacks(), &framebuffer ) );
+			return (uint64_t)framebuffer;
+		} );
+	}
+
+	return (VkFramebuffer)handle;
+}
+
+VkSampler ObjectCache::GetSampler( const VkSamplerCreateInfo& info )
+{
+	assert( info.pNext == nullptr && "pNext chains are not part of the cache key" );
+
+	std::vector<uint8_t>& key = KeyScratch();
+	AppendKey( key, info.flags );
+	AppendKey( key, info.magFilter );
+	AppendKey( key, info.minFilter );
+	AppendKey( key, info.mipmapMode );
+	AppendKey( key, info.addressModeU );
+	AppendKey( key, info.addressModeV );
+	AppendKey( key, info.addressModeW );
+	AppendKey( key, info.mipLodBias );
+	AppendKey( key, info.anisotropyEnable );
+	AppendKey( key, info.maxAnisotropy );
+	AppendKey( key, info.compareEnable );
+	AppendKey( key, info.compareOp );
+	AppendKey( key, info.minLod );
+	AppendKey( key, info.maxLod );
+	AppendKey( key, info.borderColor );
+	AppendKey( key, info.unnormalizedCoordinates );
+
+	uint64_t hash = HashBytes( key.data(), key.size() );
+	uint64_t handle = _samplers.Find( hash, key );
+	if( handle == 0 ) {
+		handle = _samplers.Insert( hash, key, ReferenceScratch(), [this, &info]() {
+			VkSampler sampler = VK_NULL_HANDLE;
+			vkResultErrorCheck( vkCreateSampler( _renderer->getDevice(), &info, _renderer->getAllocationCallbacks(), &sampler ) );
+			return (uint64_t)sampler;
+		} );
+	}
+
+	return (VkSampler)handle;
+}
+
+VkDescriptorSetLayout ObjectCache::GetDescriptorSetLayout( const VkDescriptorSetLayoutCreateInfo& info )
+{
+	assert( info.pNext == nullptr && "pNext chains are not part of the cache key" );
+
+	std::vector<uint8_t>& key = KeyScratch();
+	std::vector<uint64_t>& references = ReferenceScratch();
+
+	AppendKey( key, info.flags );
+	AppendKey( key, info.bindingCount );
+	for( uint32_t i = 0; i < info.bindingCount; i++ ) {
+		const VkDescriptorSetLayoutBinding& b = info.pBindings[i];
+		AppendKey( key, b.binding );
+		AppendKey( key, b.descriptorType );
+		AppendKey( key, b.descriptorCount );
+		AppendKey( key, b.stageFlags );
+
+		AppendKey( key, b.pImmutableSamplers != nullptr );
+		for( uint32_t s = 0; b.pImmutableSamplers != nullptr && s < b.descriptorCount; s++ ) {
+			AppendKeyHandle( key, b.pImmutableSamplers[s] );
+			references.push_back( (uint64_t)b.pImmutableSamplers[s] );
+		}
+	}
+
+	uint64_t hash = HashBytes( key.data(), key.size() );
+	uint64_t handle = _descriptor_set_layouts.Find( hash, key );
+	if( handle == 0 ) {
+		handle = _descriptor_set_layouts.Insert( hash, key, references, [this, &info]() {
+			VkDescriptorSetLayout layout = VK_NULL_HANDLE;
+			vkResultErrorCheck( vkCreateDescriptorSetLayout( _renderer->getDevice(), &info, _renderer->getAllocationCallbacks(), &layout ) );
+			return (uint64_t)layout;
+		} );
+	}
+
+	return (VkDescriptorSetLayout)handle;
+}
+
+VkPipelineLayout ObjectCache::GetPipelineLayout( const VkPipelineLayoutCreateInfo& info )
+{
+	assert( info.pNext == nullptr && "pNext chains are not part of the cache key" );
+
+	std::vector<uint8_t>& key = KeyScratch();
+	std::vector<uint64_t>& references = ReferenceScratch();
+
+	AppendKey( key, info.flags );
+	AppendKey( key, info.setLayoutCount );
+	for( uint32_t i = 0; i < info.setLayoutCount; i++ ) {
+		AppendKeyHandle( key, info.pSetLayouts[i] );
+		references.push_back( (uint64_t)info.pSetLayouts[i] );
+	}
+	AppendKey( key, info.pushConstantRangeCount );
+	for( uint32_t i = 0; i < info.pushConstantRangeCount; i++ ) {
+		AppendKey( key, info.pPushConstantRanges[i].stageFlags );
+		AppendKey( key, info.pPushConstantRanges[i].offset );
+		AppendKey( key, info.pPushConstantRanges[i].size );
+	}
+
+	uint64_t hash = HashBytes( key.data(), key.size() );
+	uint64_t handle = _pipeline_layouts.Find( hash, key );
+	if( handle == 0 ) {
+		handle = _pipeline_layouts.Insert( hash, key, references, [this, &info]() {
+			VkPipelineLayout layout = VK_NULL_HANDLE;
+			vkResultErrorCheck( vkCreatePipelineLayout( _renderer->getDevice(), &info, _renderer->getAllocationCallbacks(), &layout ) );
+			return (uint64_t)layout;
+		} );
+	}
+
+	return (VkPipelineLayout)handle;
+}
+
+void ObjectCache::InvalidateImageView( VkImageView image_view )
+{
+	DeletionQueue* deletion_queue = _renderer->getDeletionQueue();
+	_framebuffers.Invalidate( (uint64_t)image_view, [deletion_queue]( uint64_t handle ) { deletion_queue->DestroyFramebuffer( (VkFramebuffer)handle ); } );
+}
+
+void ObjectCache::InvalidateRenderPass( VkRenderPass render_pass )
+{
+	DeletionQueue* deletion_queue = _renderer->getDeletionQueue();
+	_framebuffers.Invalidate( (uint64_t)render_pass, [deletion_queue]( uint64_t handle ) { deletion_queue->DestroyFramebuffer( (VkFramebuffer)handle ); } );
+}
+
+void ObjectCache::InvalidateSampler( VkSampler sampler )
+{
+	DeletionQueue* deletion_queue = _renderer->getDeletionQueue();
+
+	std::vector<uint64_t> set_layouts;
+	_descriptor_set_layouts.Invalidate( (uint64_t)sampler, [deletion_queue, &set_layouts]( uint64_t handle ) {
+		deletion_queue->DestroyDescriptorSetLayout( (VkDescriptorSetLayout)handle );
+		set_layouts.push_back( handle );
+	} );
+
+	// Pipeline layouts built from a retired set layout would hand out its handle after it is reused
+	for( auto i : set_layouts ) {
+		_pipeline_layouts.Invalidate( i, [deletion_queue]( uint64_t handle ) { deletion_queue->DestroyPipelineLayout( (VkPipelineLayout)handle ); } );
+	}
+}
+
+ObjectCacheStats ObjectCache::getStats() const
+{
+	ObjectCacheStats stats;
+	stats.render_passes = _render_passes.getStats();
+	stats.framebuffers = _framebuffers.getStats();
+	stats.samplers = _samplers.getStats();
+	stats.descriptor_set_layouts = _descriptor_set_layouts.getStats();
+	stats.pipeline_layouts = _pipeline_layouts.getStats();
+	return stats;
+}
+
+static void PrintObjectCacheTypeStats( const char* name, const ObjectCacheTypeStats& stats )
+{
+	uint64_t lookups = stats.hits + stats.misses;
+	double hit_rate = lookups > 0 ? 100.0 * stats.hits / lookups : 0.0;
+
+	std::cout << std::fixed << std::setprecision( 2 ) << "  " << name << ": " << stats.live_count << " live, " << hit_rate << "% of "
+		<< lookups << " lookups hit, " << stats.invalidated_count << " invalidated" << std::endl;
+}
+
+void ObjectCache::PrintStats() const
+{
+	ObjectCacheStats stats = getStats();
+
+	std::cout << "Object cache:" << std::endl;
+	PrintObjectCacheTypeStats( "render passes", stats.render_passes );
+	PrintObjectCacheTypeStats( "framebuffers", stats.framebuffers );
+	PrintObjectCacheTypeStats( "samplers", stats.samplers );
+	PrintObjectCacheTypeStats( "descriptor set layouts", stats.descriptor_set_layouts );
+	PrintObjectCacheTypeStats( "pipeline layouts", stats.pipeline_layouts );
+	std::cout << "  sampler limit " << _renderer->getPhysicalDeviceProperties().limits.maxSamplerAllocationCount << std::endl;
+}
@@ -0,0 +1,134 @@
+#pragma once
+
+#include "Platform.h"
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+class Renderer;
+
+struct ObjectCacheTypeStats
+{
+	uint64_t hits = 0;
+	uint64_t misses = 0;		// each one created an object
+	uint32_t live_count = 0;
+	uint32_t invalidated_count = 0;
+};
+
+struct ObjectCacheStats
+{
+	ObjectCacheTypeStats render_passes;
+	ObjectCacheTypeStats framebuffers;
+	ObjectCacheTypeStats samplers;
+	ObjectCacheTypeStats descriptor_set_layouts;
+	ObjectCacheTypeStats pipeline_layouts;
+};
+
+// One object type's hash table. Open addressing over an array of entry pointers that readers probe without a lock:
+// entries are immutable once published, and a table that outgrows its array publishes a new one. Replaced arrays
+// and removed entries are kept until the cache is destroyed, as a reader may still be looking at them.
+class ObjectCacheTable
+{
+public:
+	struct Entry
+	{
+		uint64_t hash;
+		std::vector<uint8_t> key;
+		std::vector<uint64_t> references;		// handles the object was created from, for invalidation
+		uint64_t handle;
+	};
+
+	ObjectCacheTable();
+	~ObjectCacheTable();
+
+	// Lock free, returns 0 if the key isn't cached
+	uint64_t Find( uint64_t hash, const std::vector<uint8_t>& key );
+
+	// Calls create under the table's lock if the key is still missing, returns the cached handle
+	uint64_t Insert( uint64_t hash, const std::vector<uint8_t>& key, const std::vector<uint64_t>& references, const std::function<uint64_t()>& create );
+
+	// Removes every entry created from reference, passing each handle to retire
+	void Invalidate( uint64_t reference, const std::function<void( uint64_t )>& retire );
+
+	// Passes every handle to retire and empties the table, not safe against concurrent lookups
+	void Clear( const std::function<void( uint64_t )>& retire );
+
+	ObjectCacheTypeStats getStats() const;
+
+private:
+	struct Slots
+	{
+		uint32_t mask;
+		std::unique_ptr<std::atomic<Entry*>[]> entries;
+	};
+
+	// Removed entries are replaced with this, probing steps over it
+	static Entry* _Tombstone();
+
+	uint64_t _Probe( const Slots* slots, uint64_t hash, const std::vector<uint8_t>& key ) const;
+	void _Insert( Entry* entry );
+	void _Rebuild( uint32_t capacity );
+
+	std::atomic<Slots*> _slots;
+	mutable std::mutex _mutex;
+	uint32_t _used_count = 0;		// live entries and tombstones, what probing has to step over
+	uint32_t _live_count = 0;
+	uint32_t _invalidated_count = 0;
+
+	std::vector<std::unique_ptr<Slots>> _all_slots;
+	std::vector<std::unique_ptr<Entry>> _all_entries;
+
+	std::atomic<uint64_t> _hits;
+	std::atomic<uint64_t> _misses;
+};
+
+// Deduplicates render passes, framebuffers, samplers, descriptor set layouts and pipeline layouts.
+//
+// Objects are keyed by their create info, flattened into bytes with everything it points to, so equal create infos
+// share one object no matter where their arrays live. Lookups hash the key and probe without locking, with the key
+// built in a per-thread buffer, so a hit doesn't allocate or lock. A miss creates the object under the type's
+// lock. pNext chains are not part of the key and must be nullptr.
+//
+// Cached objects belong to the cache: don't destroy them. Handles from outside the cache that a key holds have to be
+// invalidated before they are destroyed, or a reused handle would find the stale object: InvalidateImageView() and
+// InvalidateRenderPass() for framebuffer attachments and render passes, InvalidateSampler() for immutable samplers.
+// Window does that for its swapchain images. Set layouts in pipeline layout infos must come from the cache. Everything
+// is retired through the deletion queue when the cache is destroyed. Safe to use from any thread.
+class ObjectCache
+{
+public:
+	ObjectCache( Renderer* r );
+	~ObjectCache();
+
+	VkRenderPass GetRenderPass( const VkRenderPassCreateInfo& info );
+	VkFramebuffer GetFramebuffer( const VkFramebufferCreateInfo& info );
+	VkSampler GetSampler( const VkSamplerCreateInfo& info );
+	VkDescriptorSetLayout GetDescriptorSetLayout( const VkDescriptorSetLayoutCreateInfo& info );
+	VkPipelineLayout GetPipelineLayout( const VkPipelineLayoutCreateInfo& info );
+
+	// Retires every framebuffer that uses image_view. Call before destroying the view
+	void InvalidateImageView( VkImageView image_view );
+
+	// Retires every framebuffer that uses render_pass. Call before destroying a render pass not owned by the cache
+	void InvalidateRenderPass( VkRenderPass render_pass );
+
+	// Retires every descriptor set layout with sampler as an immutable sampler, and the pipeline layouts using them.
+	// Call before destroying a sampler not owned by the cache
+	void InvalidateSampler( VkSampler sampler );
+
+	ObjectCacheStats getStats() const;
+	void PrintStats() const;
+
+private:
+	Renderer* _renderer = nullptr;
+
+	ObjectCacheTable _render_passes;
+	ObjectCacheTable _framebuffers;
+	ObjectCacheTable _samplers;
+	ObjectCacheTable _descriptor_set_layouts;
+	ObjectCacheTable _pipeline_layouts;
+};
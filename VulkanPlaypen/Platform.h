@@ -4,8 +4,12 @@
 
 #define VK_USE_PLATFORM_WIN32_KHR 1
 #define PLATFORM_SURFACE_EXTENSION_NAME VK_KHR_WIN32_SURFACE_EXTENSION_NAME
+#define NOMINMAX
 #include <Windows.h>
 
+// Windows.h maps CreateSemaphore onto CreateSemaphoreA/W, which collides with our Vulkan-style wrapper names
+#undef CreateSemaphore
+
 #elif defined( __linux )
 
 #define VK_USE_PLATFORM_XCB_KHR 1
@@ -16,4 +20,8 @@
 #error Platform not yet supported!
 #endif
 
-#include <vulkan/vulkan.h>
\ No newline at end of file
+// Entry points are loaded at runtime, see VulkanDispatch.h
+#define VK_NO_PROTOTYPES 1
+#include <vulkan/vulkan.h>
+
+#include "VulkanDispatch.h"
\ No newline at end of file
@@ -0,0 +1,457 @@
+#include "ReadbackQueue.h"
+#include "Renderer.h"
+#include "RendererUtils.h"
+#include "SubmissionQueue.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+
+// Covers bufferOffset alignment for every texel size getTexelSize() knows
+static const VkDeviceSize READBACK_ALIGNMENT = 16;
+
+static VkDeviceSize AlignReadbackOffset( VkDeviceSize offset )
+{
+	return ( offset + READBACK_ALIGNMENT - 1 ) & ~( READBACK_ALIGNMENT - 1 );
+}
+
+ReadbackQueue::ReadbackQueue( Renderer* r, const ReadbackSettings& settings )
+{
+	_renderer = r;
+	_settings = settings;
+	_settings.slot_count = std::max<uint32_t>( _settings.slot_count, 1 );
+
+	_thread_pool = new ThreadPool( _settings.worker_count );
+
+	VkDevice device = _renderer->getDevice();
+
+	VkCommandPoolCreateInfo pool_info {};
+	pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	pool_info.queueFamilyIndex = _renderer->getGraphicsFamilyIndex();
+	pool_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT | VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+	vkResultErrorCheck( vkCreateCommandPool( device, &pool_info, _renderer->getAllocationCallbacks(), &_command_pool ) );
+
+	_slots = new Slot[_settings.slot_count];
+	for( uint32_t i = 0; i < _settings.slot_count; i++ ) {
+		Slot& slot = _slots[i];
+
+		_InitSlotBuffer( slot, _settings.initial_slot_size );
+
+		VkCommandBufferAllocateInfo command_buffer_info {};
+		command_buffer_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		command_buffer_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		command_buffer_info.commandPool = _command_pool;
+		command_buffer_info.commandBufferCount = 1;
+		vkResultErrorCheck( vkAllocateCommandBuffers( device, &command_buffer_info, &slot.command_buffer ) );
+
+		VkFenceCreateInfo fence_info {};
+		fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+		vkResultErrorCheck( vkCreateFence( device, &fence_info, _renderer->getAllocationCallbacks(), &slot.fence ) );
+	}
+}
+
+
+ReadbackQueue::~ReadbackQueue()
+{
+	Flush();
+
+	delete _thread_pool;
+	_thread_pool = nullptr;
+
+	VkDevice device = _renderer->getDevice();
+
+	for( uint32_t i = 0; i < _settings.slot_count; i++ ) {
+		_DeInitSlotBuffer( _slots[i] );
+		vkDestroyFence( device, _slots[i].fence, _renderer->getAllocationCallbacks() );
+	}
+	delete[] _slots;
+	_slots = nullptr;
+
+	vkDestroyCommandPool( device, _command_pool, _renderer->getAllocationCallbacks() );
+	_command_pool = VK_NULL_HANDLE;
+}
+
+void ReadbackQueue::ReadBuffer( VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size, ReadbackCallback callback )
+{
+	Request request {};
+	request.buffer = buffer;
+	request.buffer_offset = offset;
+	request.size = size;
+	request.callback = std::move( callback );
+
+	_Request( request );
+}
+
+void ReadbackQueue::ReadImage( VkImage image, VkImageLayout layout, VkFormat format, uint32_t width, uint32_t height, ReadbackCallback callback )
+{
+	uint32_t texel_size = getTexelSize( format );
+	if( texel_size == 0 ) {
+		assert( 0 && "Readback: unsupported image format." );
+		std::exit( -1 );
+	}
+	if( layout == VK_IMAGE_LAYOUT_UNDEFINED || layout == VK_IMAGE_LAYOUT_PREINITIALIZED ) {
+		assert( 0 && "Readback: image has no defined contents to read." );
+		std::exit( -1 );
+	}
+
+	Request request {};
+	request.image = image;
+	request.layout = layout;
+	request.format = format;
+	request.width = width;
+	request.height = height;
+	request.size = VkDeviceSize( width ) * height * texel_size;
+	request.callback = std::move( callback );
+
+	_Request( request );
+}
+
+void ReadbackQueue::EndFrame()
+{
+	_frame++;
+
+	_CollectSlots( false );
+
+	std::lock_guard<std::mutex> lock( _mutex );
+	if( _requests.empty() ) {
+		return;
+	}
+
+	// Slots are used in ring order, so a busy next slot means the ring is full
+	if( _SubmitSlot( _slots[_next_slot] ) ) {
+		_next_slot = ( _next_slot + 1 ) % _settings.slot_count;
+	}
+	else {
+		_stats.postponed_frames++;
+	}
+}
+
+void ReadbackQueue::Flush()
+{
+	for( ;; ) {
+		{
+			std::lock_guard<std::mutex> lock( _mutex );
+			if( !_requests.empty() && _SubmitSlot( _slots[_next_slot] ) ) {
+				_next_slot = ( _next_slot + 1 ) % _settings.slot_count;
+			}
+		}
+
+		_CollectSlots( true );
+		_thread_pool->WaitIdle();
+		_CollectSlots( false );
+
+		bool idle = true;
+		for( uint32_t i = 0; i < _settings.slot_count; i++ ) {
+			idle = idle && _slots[i].state == SLOT_FREE;
+		}
+
+		std::lock_guard<std::mutex> lock( _mutex );
+		if( idle && _requests.empty() ) {
+			return;
+		}
+	}
+}
+
+uint64_t ReadbackQueue::getCurrentFrame() const
+{
+	return _frame;
+}
+
+const ReadbackStats& ReadbackQueue::getStats() const
+{
+	return _stats;
+}
+
+void ReadbackQueue::PrintStats() const
+{
+	const double mb = 1024.0 * 1024.0;
+	double latency_frames_avg = _stats.completed_count > 0 ? double( _stats.latency_frames_total ) / _stats.completed_count : 0.0;
+	double latency_ms_avg = _stats.completed_count > 0 ? _stats.latency_ms_total / _stats.completed_count : 0.0;
+
+	std::cout << std::fixed << std::setprecision( 2 )
+		<< "Readback: " << _stats.completed_count << " of " << _stats.requested_count << " completed (" << _stats.completed_bytes / mb << " MB)"
+		<< ", " << _stats.postponed_frames << " postponed frames, " << _stats.slot_resizes << " slot resizes" << std::endl
+		<< "  latency avg " << latency_frames_avg << " frames / " << latency_ms_avg << " ms, max " << _stats.latency_frames_max << " frames / " << _stats.latency_ms_max << " ms" << std::endl;
+}
+
+uint32_t ReadbackQueue::getTexelSize( VkFormat format )
+{
+	switch( format ) {
+	case VK_FORMAT_R8G8B8A8_UNORM:
+	case VK_FORMAT_R8G8B8A8_SRGB:
+	case VK_FORMAT_B8G8R8A8_UNORM:
+	case VK_FORMAT_B8G8R8A8_SRGB:
+	case VK_FORMAT_R32_UINT:
+	case VK_FORMAT_R32_SFLOAT:
+		return 4;
+	case VK_FORMAT_R16G16B16A16_SFLOAT:
+		return 8;
+	case VK_FORMAT_R32G32B32A32_SFLOAT:
+		return 16;
+	default:
+		return 0;
+	}
+}
+
+void ReadbackQueue::_InitSlotBuffer( Slot& slot, VkDeviceSize size )
+{
+	VkDevice device = _renderer->getDevice();
+	const VkPhysicalDeviceMemoryProperties& memory_properties = _renderer->getPhysicalDeviceMemoryProperties();
+
+	VkBufferCreateInfo buffer_info {};
+	buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	buffer_info.size = size;
+	buffer_info.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+	buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	vkResultErrorCheck( vkCreateBuffer( device, &buffer_info, _renderer->getAllocationCallbacks(), &slot.buffer ) );
+
+	// Cached memory makes the CPU side reads fast, plain host visible memory is the fallback
+	VkMemoryPropertyFlags cached = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+	if( AllocateBufferMemory( device, _renderer->getAllocationCallbacks(), memory_properties, slot.buffer, cached, &slot.memory ) != VK_SUCCESS ) {
+		vkResultErrorCheck( AllocateBufferMemory( device, _renderer->getAllocationCallbacks(), memory_properties, slot.buffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, &slot.memory ) );
+	}
+
+	VkMemoryRequirements memory_requirements {};
+	vkGetBufferMemoryRequirements( device, slot.buffer, &memory_requirements );
+	uint32_t type_index = FindMemoryTypeIndex( memory_properties, memory_requirements.memoryTypeBits, cached );
+	if( type_index == UINT32_MAX ) {
+		type_index = FindMemoryTypeIndex( memory_properties, memory_requirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT );
+	}
+	slot.coherent = ( memory_properties.memoryTypes[type_index].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT ) != 0;
+
+	void* mapped = nullptr;
+	vkResultErrorCheck( vkMapMemory( device, slot.memory, 0, VK_WHOLE_SIZE, 0, &mapped ) );
+	slot.data = reinterpret_cast<uint8_t*>( mapped );
+	slot.size = size;
+}
+
+void ReadbackQueue::_DeInitSlotBuffer( Slot& slot )
+{
+	VkDevice device = _renderer->getDevice();
+
+	vkUnmapMemory( device, slot.memory );
+	vkDestroyBuffer( device, slot.buffer, _renderer->getAllocationCallbacks() );
+	vkFreeMemory( device, slot.memory, _renderer->getAllocationCallbacks() );
+
+	slot.buffer = VK_NULL_HANDLE;
+	slot.memory = VK_NULL_HANDLE;
+	slot.data = nullptr;
+	slot.size = 0;
+}
+
+void ReadbackQueue::_Request( Request& request )
+{
+	std::lock_guard<std::mutex> lock( _mutex );
+
+	request.request_frame = _frame;
+	request.request_time = std::chrono::high_resolution_clock::now();
+	_requests.push_back( std::move( request ) );
+
+	_stats.requested_count++;
+}
+
+bool ReadbackQueue::_SubmitSlot( Slot& slot )
+{
+	if( slot.state != SLOT_FREE ) {
+		return false;
+	}
+
+	VkDeviceSize slot_size = 0;
+	for( auto &i : _requests ) {
+		i.slot_offset = slot_size;
+		slot_size = AlignReadbackOffset( slot_size + i.size );
+	}
+
+	// Free slots have no GPU work or callbacks left, so the old buffer can go right away
+	if( slot_size > slot.size ) {
+		VkDeviceSize new_size = std::max<VkDeviceSize>( slot.size, READBACK_ALIGNMENT );
+		while( new_size < slot_size ) {
+			new_size *= 2;
+		}
+
+		_DeInitSlotBuffer( slot );
+		_InitSlotBuffer( slot, new_size );
+		_stats.slot_resizes++;
+	}
+
+	slot.requests.swap( _requests );
+	_requests.clear();
+
+	VkCommandBuffer command_buffer = slot.command_buffer;
+
+	VkCommandBufferBeginInfo begin_info {};
+	begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	vkResultErrorCheck( vkBeginCommandBuffer( command_buffer, &begin_info ) );
+
+	// Make every earlier write visible to the copies and move each image, once, into TRANSFER_SRC_OPTIMAL
+	std::vector<VkImageMemoryBarrier> to_transfer;
+	std::vector<VkImageMemoryBarrier> to_original;
+	for( auto &i : slot.requests ) {
+		if( i.image == VK_NULL_HANDLE || i.layout == VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL ) {
+			continue;
+		}
+
+		bool seen = false;
+		for( auto &b : to_transfer ) {
+			seen = seen || b.image == i.image;
+		}
+		if( seen ) {
+			continue;
+		}
+
+		VkImageMemoryBarrier barrier {};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+		barrier.oldLayout = i.layout;
+		barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = i.image;
+		barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		barrier.subresourceRange.baseMipLevel = 0;
+		barrier.subresourceRange.levelCount = 1;
+		barrier.subresourceRange.baseArrayLayer = 0;
+		barrier.subresourceRange.layerCount = 1;
+		to_transfer.push_back( barrier );
+
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		barrier.newLayout = i.layout;
+		to_original.push_back( barrier );
+	}
+
+	VkMemoryBarrier memory_barrier {};
+	memory_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	memory_barrier.srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT;
+	memory_barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+	vkCmdPipelineBarrier( command_buffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+		1, &memory_barrier, 0, nullptr, uint32_t( to_transfer.size() ), to_transfer.data() );
+
+	for( auto &i : slot.requests ) {
+		if( i.image != VK_NULL_HANDLE ) {
+			VkBufferImageCopy region {};
+			region.bufferOffset = i.slot_offset;
+			region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			region.imageSubresource.mipLevel = 0;
+			region.imageSubresource.baseArrayLayer = 0;
+			region.imageSubresource.layerCount = 1;
+			region.imageExtent.width = i.width;
+			region.imageExtent.height = i.height;
+			region.imageExtent.depth = 1;
+			vkCmdCopyImageToBuffer( command_buffer, i.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, slot.buffer, 1, &region );
+		}
+		else if( i.size > 0 ) {
+			VkBufferCopy region {};
+			region.srcOffset = i.buffer_offset;
+			region.dstOffset = i.slot_offset;
+			region.size = i.size;
+			vkCmdCopyBuffer( command_buffer, i.buffer, slot.buffer, 1, &region );
+		}
+	}
+
+	if( !to_original.empty() ) {
+		vkCmdPipelineBarrier( command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0,
+			0, nullptr, 0, nullptr, uint32_t( to_original.size() ), to_original.data() );
+	}
+
+	memory_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	memory_barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+	vkCmdPipelineBarrier( command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0,
+		1, &memory_barrier, 0, nullptr, 0, nullptr );
+
+	vkResultErrorCheck( vkEndCommandBuffer( command_buffer ) );
+
+	VkSubmitInfo submit_info {};
+	submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submit_info.commandBufferCount = 1;
+	submit_info.pCommandBuffers = &command_buffer;
+	_renderer->getSubmissionQueue()->Submit( 1, &submit_info, slot.fence );
+
+	slot.state = SLOT_IN_FLIGHT;
+	return true;
+}
+
+void ReadbackQueue::_CollectSlots( bool wait )
+{
+	VkDevice device = _renderer->getDevice();
+
+	// Walk the ring from the oldest submission so callbacks are dispatched in request order
+	for( uint32_t n = 0; n < _settings.slot_count; n++ ) {
+		Slot& slot = _slots[( _next_slot + n ) % _settings.slot_count];
+
+		if( slot.state == SLOT_IN_FLIGHT ) {
+			if( wait ) {
+				vkResultErrorCheck( vkWaitForFences( device, 1, &slot.fence, VK_TRUE, UINT64_MAX ) );
+			}
+			else if( vkGetFenceStatus( device, slot.fence ) != VK_SUCCESS ) {
+				continue;
+			}
+
+			_DispatchSlot( slot );
+		}
+
+		if( slot.state == SLOT_PROCESSING && slot.pending_jobs.load( std::memory_order_acquire ) == 0 ) {
+			vkResultErrorCheck( vkResetFences( device, 1, &slot.fence ) );
+			slot.requests.clear();
+			slot.state = SLOT_FREE;
+		}
+	}
+}
+
+void ReadbackQueue::_DispatchSlot( Slot& slot )
+{
+	if( !slot.coherent ) {
+		VkMappedMemoryRange range {};
+		range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+		range.memory = slot.memory;
+		range.offset = 0;
+		range.size = VK_WHOLE_SIZE;
+		vkResultErrorCheck( vkInvalidateMappedMemoryRanges( _renderer->getDevice(), 1, &range ) );
+	}
+
+	auto now = std::chrono::high_resolution_clock::now();
+
+	slot.complete_frame = _frame;
+	slot.state = SLOT_PROCESSING;
+	slot.pending_jobs.store( uint32_t( slot.requests.size() ), std::memory_order_relaxed );
+
+	for( size_t i = 0; i < slot.requests.size(); i++ ) {
+		const Request& request = slot.requests[i];
+
+		uint64_t latency_frames = slot.complete_frame - request.request_frame;
+		double latency_ms = std::chrono::duration<double, std::milli>( now - request.request_time ).count();
+
+		_stats.completed_count++;
+		_stats.completed_bytes += request.size;
+		_stats.latency_frames_total += latency_frames;
+		_stats.latency_frames_max = std::max( _stats.latency_frames_max, latency_frames );
+		_stats.latency_ms_total += latency_ms;
+		_stats.latency_ms_max = std::max( _stats.latency_ms_max, latency_ms );
+
+		// Requests stay untouched until pending_jobs drops to 0, so the jobs can refer to them directly
+		Slot* slot_ptr = &slot;
+		_thread_pool->Enqueue( [slot_ptr, i]() {
+			const Request& request = slot_ptr->requests[i];
+
+			ReadbackData data {};
+			data.data = slot_ptr->data + request.slot_offset;
+			data.size = request.size;
+			data.width = request.width;
+			data.height = request.height;
+			data.format = request.format;
+			data.request_frame = request.request_frame;
+			data.complete_frame = slot_ptr->complete_frame;
+
+			if( request.callback ) {
+				request.callback( data );
+			}
+
+			slot_ptr->pending_jobs.fetch_sub( 1, std::memory_order_release );
+		} );
+	}
+}
\ No newline at end of file
@@ -0,0 +1,160 @@
+#pragma once
+
+#include "Platform.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+class Renderer;
+class ThreadPool;
+
+struct ReadbackSettings
+{
+	// Readback buffers in the ring. Results arrive at most slot_count frames after they were requested
+	uint32_t slot_count = 4;
+
+	// Slots grow on demand, this is only the starting size
+	VkDeviceSize initial_slot_size = 8 * 1024 * 1024;
+
+	// Threads running the completion callbacks, 0 runs them on the thread calling EndFrame()
+	uint32_t worker_count = 2;
+};
+
+struct ReadbackStats
+{
+	uint64_t requested_count = 0;
+	uint64_t completed_count = 0;
+	uint64_t completed_bytes = 0;
+
+	// Frames that had requests waiting but found the next slot still busy
+	uint64_t postponed_frames = 0;
+	uint32_t slot_resizes = 0;
+
+	uint64_t latency_frames_total = 0;
+	uint64_t latency_frames_max = 0;
+	double latency_ms_total = 0.0;
+	double latency_ms_max = 0.0;
+};
+
+// Mapped readback memory handed to a callback. Only valid for the duration of the callback
+struct ReadbackData
+{
+	const void* data;
+	VkDeviceSize size;
+
+	// Images only, pixels are tightly packed rows of mip 0
+	uint32_t width;
+	uint32_t height;
+	VkFormat format;
+
+	uint64_t request_frame;
+	uint64_t complete_frame;
+};
+
+typedef std::function<void( const ReadbackData& data )> ReadbackCallback;
+
+// Copies buffers and images into a ring of persistently mapped, host cached readback buffers without stalling.
+//
+// Requests made during a frame are recorded into one command buffer at EndFrame(), which is submitted after
+// everything the caller has submitted so far, so the copies see the frame's results. The slot's fence is polled on
+// later EndFrame() calls and once it has signaled the callbacks run on the worker threads, reading straight from the
+// mapped slot. A slot is reused only after all of its callbacks have returned. If the ring is full, requests wait for
+// the next frame instead of blocking.
+//
+// Images are read from mip 0, array layer 0 of the color aspect. They are moved to TRANSFER_SRC_OPTIMAL for the copy
+// and back to the given layout afterwards, which is the layout the image must be in when the caller's work finishes.
+class ReadbackQueue
+{
+public:
+	ReadbackQueue( Renderer* r, const ReadbackSettings& settings = ReadbackSettings() );
+	~ReadbackQueue();
+
+	void ReadBuffer( VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size, ReadbackCallback callback );
+	void ReadImage( VkImage image, VkImageLayout layout, VkFormat format, uint32_t width, uint32_t height, ReadbackCallback callback );
+
+	// Dispatches finished readbacks and submits the copies requested this frame. Never blocks
+	void EndFrame();
+	// Waits until every request so far has been copied and its callback has returned
+	void Flush();
+
+	uint64_t getCurrentFrame() const;
+
+	const ReadbackStats& getStats() const;
+	void PrintStats() const;
+
+	// Bytes per texel of the formats ReadImage() accepts, 0 for anything else
+	static uint32_t getTexelSize( VkFormat format );
+
+private:
+	enum SlotState
+	{
+		SLOT_FREE,
+		SLOT_IN_FLIGHT,
+		SLOT_PROCESSING,
+	};
+
+	struct Request
+	{
+		VkBuffer buffer;
+		VkDeviceSize buffer_offset;
+
+		VkImage image;
+		VkImageLayout layout;
+		VkFormat format;
+		uint32_t width;
+		uint32_t height;
+
+		VkDeviceSize size;
+		VkDeviceSize slot_offset;
+		ReadbackCallback callback;
+
+		uint64_t request_frame;
+		std::chrono::high_resolution_clock::time_point request_time;
+	};
+
+	struct Slot
+	{
+		VkBuffer buffer = VK_NULL_HANDLE;
+		VkDeviceMemory memory = VK_NULL_HANDLE;
+		uint8_t* data = nullptr;
+		VkDeviceSize size = 0;
+		bool coherent = false;
+
+		VkCommandBuffer command_buffer = VK_NULL_HANDLE;
+		VkFence fence = VK_NULL_HANDLE;
+
+		SlotState state = SLOT_FREE;
+		std::vector<Request> requests;
+		uint64_t complete_frame = 0;
+
+		// Callbacks of this slot still running on the workers
+		std::atomic<uint32_t> pending_jobs { 0 };
+	};
+
+	void _InitSlotBuffer( Slot& slot, VkDeviceSize size );
+	void _DeInitSlotBuffer( Slot& slot );
+
+	void _Request( Request& request );
+	bool _SubmitSlot( Slot& slot );
+	void _CollectSlots( bool wait );
+	void _DispatchSlot( Slot& slot );
+
+	Renderer* _renderer = nullptr;
+	ReadbackSettings _settings;
+
+	ThreadPool* _thread_pool = nullptr;
+
+	VkCommandPool _command_pool = VK_NULL_HANDLE;
+	Slot* _slots = nullptr;
+	uint32_t _next_slot = 0;
+
+	std::mutex _mutex;
+	std::vector<Request> _requests;
+
+	uint64_t _frame = 0;
+	ReadbackStats _stats;
+};
\ No newline at end of file
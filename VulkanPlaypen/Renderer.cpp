@@ -4,55 +4,157 @@
 
 #include "Renderer.h"
 #include "RendererUtils.h"
+#include "CommandCapture.h"
+#include "DeletionQueue.h"
+#include "DynamicResolution.h"
+#include "FrameUploadBuffer.h"
+#include "HostAllocator.h"
+#include "ObjectCache.h"
+#include "SubmissionQueue.h"
 
 
 #include <assert.h>
 #include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <iomanip>
 #include <vector>
 
 Renderer::Renderer()
 {
+	_host_allocator = new HostAllocator();
+
+	if( !LoadVulkanLibrary() ) {
+		assert( 0 && "Could not load the Vulkan loader library" );
+		std::exit( -1 );
+	}
+
 	_SetupLayersAndExtensions();
 	_SetupDebug();
 	_InitInstance();
 	_InitDebug();
 	_InitDevice();
 	_InitQueue();
+	_submission_queue = new SubmissionQueue( _queue );
+	_InitFrameResources();
+
+	_deletion_queue = new DeletionQueue( this );
+	_object_cache = new ObjectCache( this );
+	_capture = new CommandCapture( this );
+	_frame_upload = new FrameUploadBuffer( this, FRAME_UPLOAD_SIZE );
 }
 
 
 Renderer::~Renderer()
 {
-	delete _window;
+	for( auto w : _windows ) {
+		delete w;
+	}
+	_windows.clear();
+
+	_DeInitFrameResources();
+
+	delete _frame_upload;
+
+	// Queues its objects on the deletion queue
+	delete _object_cache;
+
+	// Deferred deletions can call back into the capture, so they go first
+	_deletion_queue->Flush();
+	delete _capture;
+	delete _deletion_queue;
+
+	// Everything that submits is gone, this drains what is still queued
+	delete _submission_queue;
 
 	_DeInitDevice();
 	_DeInitDebug();
 	_DeInitInstance();
+
+	UnloadVulkanLibrary();
+
+	delete _host_allocator;
 }
 
 Window* Renderer::OpenWindow( uint32_t size_x, uint32_t size_y, std::string windowName )
 {
-	_window = new Window(this, size_x, size_y, windowName);
-	return _window;
+	Window* window = new Window(this, size_x, size_y, windowName);
+	_windows.push_back( window );
+	_window_opened = true;
+	return window;
+}
+
+const std::vector<Window*>& Renderer::getWindows() const
+{
+	return _windows;
 }
 
 bool Renderer::Run()
 {
-	if( _window != nullptr ) {
-		return _window->Update();
+	// Closed windows are dropped right away, their Vulkan objects retire through the deletion queue
+	for( size_t i = 0; i < _windows.size(); ) {
+		if( !_windows[i]->Update() ) {
+			delete _windows[i];
+			_windows.erase( _windows.begin() + i );
+		}
+		else {
+			i++;
+		}
 	}
 
+	// Until a window has been opened there is nothing whose closing ends the loop
+	if( _windows.empty() ) {
+		return !_window_opened;
+	}
+
+	_RenderFrame();
 	return true;
 }
 
+void Renderer::PrintWindowTimings()
+{
+	for( auto w : _windows ) {
+		const WindowFrameTiming& timing = w->getFrameTiming();
+
+		double interval_avg = timing.presented_frames > 1 ? timing.present_interval_total_ms / ( timing.presented_frames - 1 ) : 0.0;
+		double acquire_avg = timing.presented_frames > 0 ? timing.acquire_total_ms / timing.presented_frames : 0.0;
+		double gpu_avg = timing.gpu_samples > 0 ? timing.gpu_total_ms / timing.gpu_samples : 0.0;
+
+		std::cout << std::fixed << std::setprecision( 2 ) << w->getName() << ": " << timing.presented_frames << " presented, "
+			<< timing.skipped_frames << " skipped, interval avg " << interval_avg << " ms (max " << timing.present_interval_max_ms
+			<< "), acquire avg " << acquire_avg << " ms (max " << timing.acquire_max_ms << "), gpu avg " << gpu_avg
+			<< " ms (max " << timing.gpu_max_ms << ")" << std::endl;
+
+		if( w->getDynamicResolution() != nullptr ) {
+			w->getDynamicResolution()->PrintStats();
+			w->getDynamicResolution()->ResetStats();
+		}
+
+		w->ResetFrameTiming();
+	}
+}
+
 void Renderer::_SetupLayersAndExtensions()
 {
 	_instance_extensions.push_back( VK_KHR_SURFACE_EXTENSION_NAME );
 	_instance_extensions.push_back( PLATFORM_SURFACE_EXTENSION_NAME );
 	
 	_device_extensions.push_back( VK_KHR_SWAPCHAIN_EXTENSION_NAME );
+
+	// Optional instance extensions
+	{
+		uint32_t extension_count = 0;
+		vkEnumerateInstanceExtensionProperties( nullptr, &extension_count, nullptr );
+		std::vector<VkExtensionProperties> extension_list( extension_count );
+		vkEnumerateInstanceExtensionProperties( nullptr, &extension_count, extension_list.data() );
+
+		for( auto &i : extension_list ) {
+			if( std::strcmp( i.extensionName, VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME ) == 0 ) {
+				_physical_device_properties2_supported = true;
+				_instance_extensions.push_back( VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME );
+			}
+		}
+	}
 }
 
 void Renderer::_InitInstance()
@@ -72,12 +174,19 @@ void Renderer::_InitInstance()
 	instance_info.ppEnabledExtensionNames = _instance_extensions.data();
 	instance_info.pNext = &debug_callback_create_info;
 
-	vkResultErrorCheck( vkCreateInstance( &instance_info, nullptr, &_instance ) );
+	vkResultErrorCheck( vkCreateInstance( &instance_info, getAllocationCallbacks(), &_instance ) );
+
+	LoadVulkanInstanceDispatch( _instance, &_instance_dispatch );
+	SetVulkanInstanceDispatch( _instance_dispatch );
+
+	if( _physical_device_properties2_supported ) {
+		fvkGetPhysicalDeviceMemoryProperties2KHR = (PFN_vkGetPhysicalDeviceMemoryProperties2KHR)vkGetInstanceProcAddr( _instance, "vkGetPhysicalDeviceMemoryProperties2KHR" );
+	}
 }
 
 void Renderer::_DeInitInstance()
 {
-	vkDestroyInstance( _instance, nullptr );
+	vkDestroyInstance( _instance, getAllocationCallbacks() );
 	_instance = VK_NULL_HANDLE;
 }
 
@@ -85,6 +194,7 @@ void Renderer::_InitDevice()
 {
 	_InitPhysicalDevice();
 	_InitGraphicsFamilyIndex();
+	_InitDeviceExtensions();
 	_ListValidationLayers();
 
 
@@ -105,7 +215,26 @@ void Renderer::_InitDevice()
 	device_info.enabledExtensionCount = _device_extensions.size();
 	device_info.ppEnabledExtensionNames = _device_extensions.data();
 
-	vkResultErrorCheck( vkCreateDevice( _gpu, &device_info, nullptr, &_device ) );
+	vkResultErrorCheck( vkCreateDevice( _gpu, &device_info, getAllocationCallbacks(), &_device ) );
+
+	// From here on device calls skip the loader's trampolines
+	LoadVulkanDeviceDispatch( _instance, _device, &_device_dispatch );
+	SetVulkanDeviceDispatch( _device_dispatch );
+}
+
+void Renderer::_InitDeviceExtensions()
+{
+	uint32_t extension_count = 0;
+	vkEnumerateDeviceExtensionProperties( _gpu, nullptr, &extension_count, nullptr );
+	std::vector<VkExtensionProperties> extension_list( extension_count );
+	vkEnumerateDeviceExtensionProperties( _gpu, nullptr, &extension_count, extension_list.data() );
+
+	for( auto &i : extension_list ) {
+		if( std::strcmp( i.extensionName, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME ) == 0 && fvkGetPhysicalDeviceMemoryProperties2KHR != nullptr ) {
+			_memory_budget_supported = true;
+			_device_extensions.push_back( VK_EXT_MEMORY_BUDGET_EXTENSION_NAME );
+		}
+	}
 }
 
 void Renderer::_InitQueue()
@@ -113,9 +242,145 @@ void Renderer::_InitQueue()
 	vkGetDeviceQueue( _device, _graphics_family_index, 0, &_queue );
 }
 
+void Renderer::_InitFrameResources()
+{
+	VkCommandPoolCreateInfo pool_info {};
+	pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	pool_info.queueFamilyIndex = _graphics_family_index;
+	pool_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+	vkResultErrorCheck( vkCreateCommandPool( _device, &pool_info, getAllocationCallbacks(), &_frame_command_pool ) );
+
+	VkCommandBufferAllocateInfo command_buffer_info {};
+	command_buffer_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	command_buffer_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	command_buffer_info.commandPool = _frame_command_pool;
+	command_buffer_info.commandBufferCount = FRAMES_IN_FLIGHT;
+	vkResultErrorCheck( vkAllocateCommandBuffers( _device, &command_buffer_info, _frame_command_buffers ) );
+
+	for( uint32_t i = 0; i < FRAMES_IN_FLIGHT; i++ ) {
+		VkFenceCreateInfo fence_info {};
+		fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+		vkResultErrorCheck( vkCreateFence( _device, &fence_info, getAllocationCallbacks(), &_frame_fences[i] ) );
+
+		VkSemaphoreCreateInfo semaphore_info {};
+		semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+		vkResultErrorCheck( vkCreateSemaphore( _device, &semaphore_info, getAllocationCallbacks(), &_render_finished[i] ) );
+	}
+}
+
+void Renderer::_DeInitFrameResources()
+{
+	for( uint32_t i = 0; i < FRAMES_IN_FLIGHT; i++ ) {
+		if( _frame_submitted[i] ) {
+			vkWaitForFences( _device, 1, &_frame_fences[i], VK_TRUE, UINT64_MAX );
+			_deletion_queue->RetireFence( _frame_fences[i] );
+			_frame_submitted[i] = false;
+		}
+
+		vkDestroyFence( _device, _frame_fences[i], getAllocationCallbacks() );
+		vkDestroySemaphore( _device, _render_finished[i], getAllocationCallbacks() );
+		_frame_fences[i] = VK_NULL_HANDLE;
+		_render_finished[i] = VK_NULL_HANDLE;
+	}
+
+	// Command buffers are released with the pool
+	vkDestroyCommandPool( _device, _frame_command_pool, getAllocationCallbacks() );
+	_frame_command_pool = VK_NULL_HANDLE;
+}
+
+void Renderer::_RenderFrame()
+{
+	uint32_t slot = uint32_t( _frame_index % FRAMES_IN_FLIGHT );
+
+	// Wait until the GPU is done with this slot's previous frame before reusing its resources
+	if( _frame_submitted[slot] ) {
+		vkWaitForFences( _device, 1, &_frame_fences[slot], VK_TRUE, UINT64_MAX );
+		_deletion_queue->RetireFence( _frame_fences[slot] );
+		vkResetFences( _device, 1, &_frame_fences[slot] );
+		_frame_submitted[slot] = false;
+
+		for( auto w : _windows ) {
+			w->CollectTiming( slot );
+		}
+	}
+
+	_present_windows.clear();
+	_present_wait_semaphores.clear();
+	_present_wait_stages.clear();
+	_present_swapchains.clear();
+	_present_image_indices.clear();
+
+	for( auto w : _windows ) {
+		if( w->AcquireImage( slot ) ) {
+			_present_windows.push_back( w );
+			_present_wait_semaphores.push_back( w->getImageAvailableSemaphore( slot ) );
+			_present_wait_stages.push_back( VK_PIPELINE_STAGE_TRANSFER_BIT );
+		}
+	}
+
+	if( _present_windows.empty() ) {
+		_deletion_queue->EndFrame();
+		_submission_queue->EndFrame();
+		_frame_index++;
+		return;
+	}
+
+	// Record every window's frame in one pass
+	VkCommandBuffer command_buffer = _frame_command_buffers[slot];
+
+	VkCommandBufferBeginInfo begin_info {};
+	begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	vkBeginCommandBuffer( command_buffer, &begin_info );
+
+	for( auto w : _present_windows ) {
+		w->RecordFrame( command_buffer, slot, _frame_index );
+		_present_swapchains.push_back( w->getSwapchain() );
+		_present_image_indices.push_back( w->getImageIndex() );
+	}
+
+	vkEndCommandBuffer( command_buffer );
+
+	VkSubmitInfo submit_info {};
+	submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submit_info.waitSemaphoreCount = uint32_t( _present_wait_semaphores.size() );
+	submit_info.pWaitSemaphores = _present_wait_semaphores.data();
+	submit_info.pWaitDstStageMask = _present_wait_stages.data();
+	submit_info.commandBufferCount = 1;
+	submit_info.pCommandBuffers = &command_buffer;
+	submit_info.signalSemaphoreCount = 1;
+	submit_info.pSignalSemaphores = &_render_finished[slot];
+	_submission_queue->Submit( 1, &submit_info, _frame_fences[slot] );
+	_frame_submitted[slot] = true;
+
+	// The frame fence closes the deletion queue's frame too, saving it an empty submit of its own
+	_deletion_queue->EndFrame( _frame_fences[slot] );
+
+	// One present for all swapchains, per-swapchain results tell which windows need attention. It runs on the submit
+	// thread after the frame's submit, waiting for it keeps the present arrays and results valid
+	_present_results.assign( _present_swapchains.size(), VK_SUCCESS );
+
+	VkPresentInfoKHR present_info {};
+	present_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+	present_info.waitSemaphoreCount = 1;
+	present_info.pWaitSemaphores = &_render_finished[slot];
+	present_info.swapchainCount = uint32_t( _present_swapchains.size() );
+	present_info.pSwapchains = _present_swapchains.data();
+	present_info.pImageIndices = _present_image_indices.data();
+	present_info.pResults = _present_results.data();
+	_submission_queue->ExecuteAndWait( [&present_info]( VkQueue queue ) { vkQueuePresentKHR( queue, &present_info ); } );
+
+	for( size_t i = 0; i < _present_windows.size(); i++ ) {
+		_present_windows[i]->OnPresented( _present_results[i] );
+	}
+
+	_submission_queue->EndFrame();
+	_frame_index++;
+}
+
 void Renderer::_DeInitDevice()
 {
-	vkDestroyDevice( _device, nullptr );
+	vkDestroyDevice( _device, getAllocationCallbacks() );
 	_device = VK_NULL_HANDLE;
 }
 
@@ -134,6 +399,7 @@ void Renderer::_InitPhysicalDevice()
 void Renderer::_InitGpuProperties()
 {
 	vkGetPhysicalDeviceProperties( _gpu, &_gpu_properties );
+	vkGetPhysicalDeviceMemoryProperties( _gpu, &_gpu_memory_properties );
 }
 
 void Renderer::_InitGraphicsFamilyIndex()
@@ -221,12 +487,12 @@ void Renderer::_InitDebug()
 		std::exit( -1 );
 	}
 
-	fvkCreateDebugReportCallbackEXT( _instance, &debug_callback_create_info, nullptr, &_debug_report );
+	fvkCreateDebugReportCallbackEXT( _instance, &debug_callback_create_info, getAllocationCallbacks(), &_debug_report );
 }
 
 void Renderer::_DeInitDebug()
 {
-	fvkDestroyDebugReportCallbackEXT( _instance, _debug_report, nullptr );
+	fvkDestroyDebugReportCallbackEXT( _instance, _debug_report, getAllocationCallbacks() );
 	_debug_report = VK_NULL_HANDLE;
 }
 
@@ -289,9 +555,9 @@ const VkDevice Renderer::getDevice() const
 	return _device;
 }
 
-const VkQueue Renderer::getQueue() const
+SubmissionQueue* Renderer::getSubmissionQueue() const
 {
-	return _queue;
+	return _submission_queue;
 }
 
 const uint32_t Renderer::getGraphicsFamilyIndex() const
@@ -302,4 +568,81 @@ const uint32_t Renderer::getGraphicsFamilyIndex() const
 const VkPhysicalDeviceProperties& Renderer::getPhysicalDeviceProperties() const
 {
 	return _gpu_properties;
+}
+
+const VkPhysicalDeviceMemoryProperties& Renderer::getPhysicalDeviceMemoryProperties() const
+{
+	return _gpu_memory_properties;
+}
+
+CommandCapture* Renderer::getCapture() const
+{
+	return _capture;
+}
+
+DeletionQueue* Renderer::getDeletionQueue() const
+{
+	return _deletion_queue;
+}
+
+ObjectCache* Renderer::getObjectCache() const
+{
+	return _object_cache;
+}
+
+const VkAllocationCallbacks* Renderer::getAllocationCallbacks() const
+{
+#if BUILD_ENABLE_HOST_ALLOCATOR
+	return _host_allocator->getCallbacks();
+#else
+	return nullptr;
+#endif
+}
+
+const VulkanInstanceDispatch& Renderer::getInstanceDispatch() const
+{
+	return _instance_dispatch;
+}
+
+const VulkanDeviceDispatch& Renderer::getDeviceDispatch() const
+{
+	return _device_dispatch;
+}
+
+FrameUploadBuffer* Renderer::getFrameUpload() const
+{
+	return _frame_upload;
+}
+
+HostAllocator* Renderer::getHostAllocator() const
+{
+	return _host_allocator;
+}
+
+bool Renderer::QueryMemoryBudget( VkDeviceSize* heap_budgets, VkDeviceSize* heap_usages ) const
+{
+	for( uint32_t i = 0; i < VK_MAX_MEMORY_HEAPS; i++ ) {
+		heap_budgets[i] = i < _gpu_memory_properties.memoryHeapCount ? _gpu_memory_properties.memoryHeaps[i].size : 0;
+		heap_usages[i] = 0;
+	}
+
+	if( !_memory_budget_supported ) {
+		return false;
+	}
+
+	VkPhysicalDeviceMemoryBudgetPropertiesEXT budget_properties {};
+	budget_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+
+	VkPhysicalDeviceMemoryProperties2KHR memory_properties {};
+	memory_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2_KHR;
+	memory_properties.pNext = &budget_properties;
+
+	fvkGetPhysicalDeviceMemoryProperties2KHR( _gpu, &memory_properties );
+
+	for( uint32_t i = 0; i < memory_properties.memoryProperties.memoryHeapCount; i++ ) {
+		heap_budgets[i] = budget_properties.heapBudget[i];
+		heap_usages[i] = budget_properties.heapUsage[i];
+	}
+
+	return true;
 }
\ No newline at end of file
@@ -3,6 +3,13 @@
 #include "Platform.h"
 #include "Window.h"
 
+class CommandCapture;
+class DeletionQueue;
+class FrameUploadBuffer;
+class HostAllocator;
+class ObjectCache;
+class SubmissionQueue;
+
 #include <cstdlib>
 #include <vector>
 
@@ -12,16 +19,55 @@ public:
 	Renderer();
 	~Renderer();
 
+	// Frames the CPU may record ahead of the GPU
+	static const uint32_t FRAMES_IN_FLIGHT = 2;
+
+	// Starting size of each frame's region in the frame upload buffer, it grows through FrameUploadBuffer::Reserve()
+	static const VkDeviceSize FRAME_UPLOAD_SIZE = 4 * 1024 * 1024;
+
+	// Any number of windows can be open, the renderer owns them
 	Window* OpenWindow( uint32_t size_x, uint32_t size_y, std::string windowName );
+	const std::vector<Window*>& getWindows() const;
 
+	// Updates every window, drops the ones that were closed and renders a frame into the rest. All windows are recorded
+	// into one command buffer and presented with a single vkQueuePresentKHR, and closes the deletion queue's frame.
+	// Returns false once the last window has been closed, true if no window was ever opened
 	bool Run();
 
+	// Prints the frame timing of every window since the last call
+	void PrintWindowTimings();
+
 	const VkInstance getInstance() const;
 	const VkPhysicalDevice getPhysicalDevice() const;
 	const VkDevice getDevice() const;
-	const VkQueue getQueue() const;
 	const uint32_t getGraphicsFamilyIndex() const;
 	const VkPhysicalDeviceProperties& getPhysicalDeviceProperties() const;
+	const VkPhysicalDeviceMemoryProperties& getPhysicalDeviceMemoryProperties() const;
+
+	// Tables the global vk* entry points were loaded from
+	const VulkanInstanceDispatch& getInstanceDispatch() const;
+	const VulkanDeviceDispatch& getDeviceDispatch() const;
+
+	// Owns the graphics queue: every submit, present and queue wait goes through it
+	SubmissionQueue* getSubmissionQueue() const;
+
+	CommandCapture* getCapture() const;
+	// Run() closes its frames, loops that don't render through Run() call its EndFrame() themselves
+	DeletionQueue* getDeletionQueue() const;
+
+	// Shared render passes, framebuffers, samplers and layouts
+	ObjectCache* getObjectCache() const;
+
+	// Per-frame CPU to GPU upload memory. Call its EndFrame() once per frame, after submitting the frame's work
+	FrameUploadBuffer* getFrameUpload() const;
+
+	// Pass to every vkCreate*, vkAllocate*, vkDestroy* and vkFree* call. nullptr when BUILD_ENABLE_HOST_ALLOCATOR is off
+	const VkAllocationCallbacks* getAllocationCallbacks() const;
+	HostAllocator* getHostAllocator() const;
+
+	// Fills per-heap budget and usage arrays (VK_MAX_MEMORY_HEAPS entries). Without VK_EXT_memory_budget the budget
+	// falls back to the heap sizes, usage reads as 0, and this returns false
+	bool QueryMemoryBudget( VkDeviceSize* heap_budgets, VkDeviceSize* heap_usages ) const;
 
 private:
 	void _SetupLayersAndExtensions();
@@ -32,8 +78,14 @@ private:
 	void _InitDevice();
 	void _DeInitDevice();
 
+	void _InitDeviceExtensions();
+
 	void _InitQueue();
 
+	void _InitFrameResources();
+	void _DeInitFrameResources();
+	void _RenderFrame();
+
 	void _InitPhysicalDevice();
 
 	void _InitGpuProperties();
@@ -47,17 +99,47 @@ private:
 	void _ListValidationLayers();
 
 	VkInstance _instance = VK_NULL_HANDLE;
+	VulkanInstanceDispatch _instance_dispatch;
 
 	VkPhysicalDevice _gpu = VK_NULL_HANDLE;
 	VkPhysicalDeviceProperties _gpu_properties {};
+	VkPhysicalDeviceMemoryProperties _gpu_memory_properties {};
 
 	VkDevice _device = VK_NULL_HANDLE;
+	VulkanDeviceDispatch _device_dispatch;
 
 	VkQueue _queue = VK_NULL_HANDLE;
+	SubmissionQueue* _submission_queue = nullptr;
 
 	uint32_t _graphics_family_index = 0;
 
-	Window* _window = nullptr;
+	std::vector<Window*> _windows;
+	bool _window_opened = false;
+
+	uint64_t _frame_index = 0;
+	VkCommandPool _frame_command_pool = VK_NULL_HANDLE;
+	VkCommandBuffer _frame_command_buffers[FRAMES_IN_FLIGHT] {};
+	VkFence _frame_fences[FRAMES_IN_FLIGHT] {};
+	VkSemaphore _render_finished[FRAMES_IN_FLIGHT] {};
+	bool _frame_submitted[FRAMES_IN_FLIGHT] {};
+
+	// Per-frame scratch for the batched present, kept around so frames don't allocate
+	std::vector<Window*> _present_windows;
+	std::vector<VkSemaphore> _present_wait_semaphores;
+	std::vector<VkPipelineStageFlags> _present_wait_stages;
+	std::vector<VkSwapchainKHR> _present_swapchains;
+	std::vector<uint32_t> _present_image_indices;
+	std::vector<VkResult> _present_results;
+
+	CommandCapture* _capture = nullptr;
+
+	DeletionQueue* _deletion_queue = nullptr;
+
+	ObjectCache* _object_cache = nullptr;
+
+	FrameUploadBuffer* _frame_upload = nullptr;
+
+	HostAllocator* _host_allocator = nullptr;
 
 	std::vector<const char*> _instance_layers;
 	std::vector<const char*> _instance_extensions;
@@ -65,6 +147,11 @@ private:
 	std::vector<const char*> _device_layers;
 	std::vector<const char*> _device_extensions;
 
+	bool _physical_device_properties2_supported = false;
+	bool _memory_budget_supported = false;
+
+	PFN_vkGetPhysicalDeviceMemoryProperties2KHR fvkGetPhysicalDeviceMemoryProperties2KHR = nullptr;
+
 	PFN_vkCreateDebugReportCallbackEXT fvkCreateDebugReportCallbackEXT = nullptr;
 	PFN_vkDestroyDebugReportCallbackEXT fvkDestroyDebugReportCallbackEXT = nullptr;
 
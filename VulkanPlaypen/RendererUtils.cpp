@@ -1,6 +1,90 @@
 #include "RendererUtils.h"
 #include "BUILD_OPTIONS.h"
 
+#include <algorithm>
+
+double Percentile( const std::vector<double>& sorted_values, double percentile )
+{
+	if( sorted_values.empty() ) {
+		return 0.0;
+	}
+
+	size_t index = size_t( percentile * ( sorted_values.size() - 1 ) + 0.5 );
+	return sorted_values[std::min( index, sorted_values.size() - 1 )];
+}
+
+uint32_t FindMemoryTypeIndex( const VkPhysicalDeviceMemoryProperties& memory_properties, uint32_t memory_type_bits, VkMemoryPropertyFlags required_properties )
+{
+	for( uint32_t i = 0; i < memory_properties.memoryTypeCount; i++ ) {
+		if( ( memory_type_bits & ( 1u << i ) ) && ( memory_properties.memoryTypes[i].propertyFlags & required_properties ) == required_properties ) {
+			return i;
+		}
+	}
+
+	return UINT32_MAX;
+}
+
+VkResult AllocateBufferMemory( VkDevice device, const VkAllocationCallbacks* allocator, const VkPhysicalDeviceMemoryProperties& memory_properties, VkBuffer buffer, VkMemoryPropertyFlags required_properties, VkDeviceMemory* memory )
+{
+	VkMemoryRequirements requirements {};
+	vkGetBufferMemoryRequirements( device, buffer, &requirements );
+
+	uint32_t memory_type_index = FindMemoryTypeIndex( memory_properties, requirements.memoryTypeBits, required_properties );
+	if( memory_type_index == UINT32_MAX ) {
+		return VK_ERROR_FEATURE_NOT_PRESENT;
+	}
+
+	VkMemoryAllocateInfo allocate_info {};
+	allocate_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	allocate_info.allocationSize = requirements.size;
+	allocate_info.memoryTypeIndex = memory_type_index;
+
+	VkResult result = vkAllocateMemory( device, &allocate_info, allocator, memory );
+	if( result != VK_SUCCESS ) {
+		return result;
+	}
+
+	result = vkBindBufferMemory( device, buffer, *memory, 0 );
+	if( result != VK_SUCCESS ) {
+		vkFreeMemory( device, *memory, allocator );
+		*memory = VK_NULL_HANDLE;
+	}
+	return result;
+}
+
+VkResult AllocateImageMemory( VkDevice device, const VkAllocationCallbacks* allocator, const VkPhysicalDeviceMemoryProperties& memory_properties, VkImage image, VkMemoryPropertyFlags required_properties, VkDeviceMemory* memory, VkDeviceSize* size )
+{
+	VkMemoryRequirements requirements {};
+	vkGetImageMemoryRequirements( device, image, &requirements );
+
+	uint32_t memory_type_index = FindMemoryTypeIndex( memory_properties, requirements.memoryTypeBits, required_properties );
+	if( memory_type_index == UINT32_MAX ) {
+		return VK_ERROR_FEATURE_NOT_PRESENT;
+	}
+
+	VkMemoryAllocateInfo allocate_info {};
+	allocate_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	allocate_info.allocationSize = requirements.size;
+	allocate_info.memoryTypeIndex = memory_type_index;
+
+	VkResult result = vkAllocateMemory( device, &allocate_info, allocator, memory );
+	if( result != VK_SUCCESS ) {
+		return result;
+	}
+
+	result = vkBindImageMemory( device, image, *memory, 0 );
+	if( result != VK_SUCCESS ) {
+		vkFreeMemory( device, *memory, allocator );
+		*memory = VK_NULL_HANDLE;
+		return result;
+	}
+
+	if( size != nullptr ) {
+		*size = requirements.size;
+	}
+	return result;
+}
+
 #if BUILD_ENABLE_VUKLAN_RUNTIME_DEBUG
 
 void vkResultErrorCheck( VkResult result )
@@ -4,5 +4,15 @@
 
 #include <assert.h>
 #include <iostream>
+#include <vector>
 
-void vkResultErrorCheck( VkResult result );
\ No newline at end of file
+void vkResultErrorCheck( VkResult result );
+
+// Returns UINT32_MAX if no memory type allowed by memory_type_bits has all of the required property flags
+uint32_t FindMemoryTypeIndex( const VkPhysicalDeviceMemoryProperties& memory_properties, uint32_t memory_type_bits, VkMemoryPropertyFlags required_properties );
+
+VkResult AllocateBufferMemory( VkDevice device, const VkAllocationCallbacks* allocator, const VkPhysicalDeviceMemoryProperties& memory_properties, VkBuffer buffer, VkMemoryPropertyFlags required_properties, VkDeviceMemory* memory );
+VkResult AllocateImageMemory( VkDevice device, const VkAllocationCallbacks* allocator, const VkPhysicalDeviceMemoryProperties& memory_properties, VkImage image, VkMemoryPropertyFlags required_properties, VkDeviceMemory* memory, VkDeviceSize* size = nullptr );
+
+// Nearest rank percentile, percentile in [0, 1], of values sorted in ascending order. 0 if there are none
+double Percentile( const std::vector<double>& sorted_values, double percentile );
\ No newline at end of file
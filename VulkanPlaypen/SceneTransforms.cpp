@@ -0,0 +1,388 @@
+#include "BUILD_OPTIONS.h"
+#include "SceneTransforms.h"
+#include "Renderer.h"
+
+#include <assert.h>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+
+#if defined( _M_IX86 ) || defined( _M_X64 ) || defined( __i386__ ) || defined( __x86_64__ )
+#define SCENE_TRANSFORMS_X86 1
+#include <xmmintrin.h>
+#if defined( _MSC_VER )
+#include <intrin.h>
+#endif
+#else
+#define SCENE_TRANSFORMS_X86 0
+#endif
+
+#if SCENE_TRANSFORMS_X86
+
+struct SceneSseOps
+{
+	typedef __m128 Type;
+	static const uint32_t WIDTH = 4;
+
+	static inline Type Load( const float* p ) { return _mm_loadu_ps( p ); }
+	static inline void Store( float* p, Type v ) { _mm_storeu_ps( p, v ); }
+	static inline Type Set( float v ) { return _mm_set1_ps( v ); }
+	static inline Type Gather( const float* base, const uint32_t* indices ) { return _mm_setr_ps( base[indices[0]], base[indices[1]], base[indices[2]], base[indices[3]] ); }
+	static inline Type Add( Type a, Type b ) { return _mm_add_ps( a, b ); }
+	static inline Type Sub( Type a, Type b ) { return _mm_sub_ps( a, b ); }
+	static inline Type Mul( Type a, Type b ) { return _mm_mul_ps( a, b ); }
+};
+
+static bool CpuSupportsAvx()
+{
+#if defined( _MSC_VER )
+	int info[4];
+	__cpuid( info, 1 );
+
+	// AVX itself, and the OS saving the YMM registers on context switches
+	bool avx = ( info[2] & ( 1 << 28 ) ) != 0;
+	bool osxsave = ( info[2] & ( 1 << 27 ) ) != 0;
+	return avx && osxsave && ( _xgetbv( 0 ) & 6 ) == 6;
+#else
+	return __builtin_cpu_supports( "avx" );
+#endif
+}
+
+#endif
+
+static const float IDENTITY_3X4[SCENE_WORLD_ELEMENT_COUNT] = {
+	1.0f, 0.0f, 0.0f, 0.0f,
+	0.0f, 1.0f, 0.0f, 0.0f,
+	0.0f, 0.0f, 1.0f, 0.0f,
+};
+
+SceneTransforms::SceneTransforms()
+{
+	_upload_slots.resize( Renderer::FRAMES_IN_FLIGHT );
+	_simd_level = getSupportedSimdLevel();
+
+	// Sentinel identity for roots
+	for( uint32_t e = 0; e < SCENE_WORLD_ELEMENT_COUNT; e++ ) {
+		_world[e].push_back( IDENTITY_3X4[e] );
+	}
+	_world_dirty.push_back( 0 );
+	_level_offsets.push_back( 0 );
+}
+
+SceneNode SceneTransforms::CreateNode( SceneNode parent )
+{
+	assert( parent == SCENE_NODE_NONE || parent < _node_parent.size() );
+
+	SceneNode node = SceneNode( _node_parent.size() );
+
+	// Appended out of depth order, _SortByDepth() puts it in place on the next Update()
+	const float identity_local[SCENE_LOCAL_ELEMENT_COUNT] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f, 1.0f };
+	for( uint32_t e = 0; e < SCENE_LOCAL_ELEMENT_COUNT; e++ ) {
+		_local[e].push_back( identity_local[e] );
+	}
+	_local_dirty.push_back( 1 );
+	_index_to_node.push_back( node );
+
+	_node_parent.push_back( parent );
+	_node_to_index.push_back( uint32_t( _index_to_node.size() - 1 ) );
+
+	_sorted = false;
+	return node;
+}
+
+void SceneTransforms::Reserve( uint32_t node_count )
+{
+	for( auto &i : _local ) {
+		i.reserve( node_count );
+	}
+	for( auto &i : _world ) {
+		i.reserve( node_count + 1 );
+	}
+	_parent.reserve( node_count );
+	_local_dirty.reserve( node_count );
+	_world_dirty.reserve( node_count + 1 );
+	_changed_update.reserve( node_count );
+	_index_to_node.reserve( node_count );
+	_node_parent.reserve( node_count );
+	_node_to_index.reserve( node_count );
+}
+
+void SceneTransforms::SetLocalTransform( SceneNode node, const float translation[3], const float rotation[4], const float scale[3] )
+{
+	uint32_t index = _node_to_index[node];
+
+	_local[SCENE_LOCAL_TX][index] = translation[0];
+	_local[SCENE_LOCAL_TY][index] = translation[1];
+	_local[SCENE_LOCAL_TZ][index] = translation[2];
+	_local[SCENE_LOCAL_QX][index] = rotation[0];
+	_local[SCENE_LOCAL_QY][index] = rotation[1];
+	_local[SCENE_LOCAL_QZ][index] = rotation[2];
+	_local[SCENE_LOCAL_QW][index] = rotation[3];
+	_local[SCENE_LOCAL_SX][index] = scale[0];
+	_local[SCENE_LOCAL_SY][index] = scale[1];
+	_local[SCENE_LOCAL_SZ][index] = scale[2];
+	_local_dirty[index] = 1;
+}
+
+void SceneTransforms::SetTranslation( SceneNode node, const float translation[3] )
+{
+	uint32_t index = _node_to_index[node];
+
+	_local[SCENE_LOCAL_TX][index] = translation[0];
+	_local[SCENE_LOCAL_TY][index] = translation[1];
+	_local[SCENE_LOCAL_TZ][index] = translation[2];
+	_local_dirty[index] = 1;
+}
+
+void SceneTransforms::SetRotation( SceneNode node, const float rotation[4] )
+{
+	uint32_t index = _node_to_index[node];
+
+	_local[SCENE_LOCAL_QX][index] = rotation[0];
+	_local[SCENE_LOCAL_QY][index] = rotation[1];
+	_local[SCENE_LOCAL_QZ][index] = rotation[2];
+	_local[SCENE_LOCAL_QW][index] = rotation[3];
+	_local_dirty[index] = 1;
+}
+
+void SceneTransforms::SetScale( SceneNode node, const float scale[3] )
+{
+	uint32_t index = _node_to_index[node];
+
+	_local[SCENE_LOCAL_SX][index] = scale[0];
+	_local[SCENE_LOCAL_SY][index] = scale[1];
+	_local[SCENE_LOCAL_SZ][index] = scale[2];
+	_local_dirty[index] = 1;
+}
+
+void SceneTransforms::Invalidate()
+{
+	std::fill( _local_dirty.begin(), _local_dirty.end(), uint8_t( 1 ) );
+}
+
+void SceneTransforms::Update()
+{
+	auto start = std::chrono::high_resolution_clock::now();
+
+	if( !_sorted ) {
+		_SortByDepth();
+	}
+
+	_update_count++;
+
+	uint32_t count = uint32_t( _parent.size() );
+
+	SceneTransformArrays arrays {};
+	for( uint32_t e = 0; e < SCENE_LOCAL_ELEMENT_COUNT; e++ ) {
+		arrays.local[e] = _local[e].data();
+	}
+	for( uint32_t e = 0; e < SCENE_WORLD_ELEMENT_COUNT; e++ ) {
+		arrays.world[e] = _world[e].data();
+	}
+	arrays.parent = _parent.data();
+	arrays.local_dirty = _local_dirty.data();
+	arrays.world_dirty = _world_dirty.data();
+
+	// Levels in order, every parent is final before its children read it
+	uint32_t computed = 0;
+	for( size_t level = 0; level + 1 < _level_offsets.size(); level++ ) {
+		computed += _UpdateRange( arrays, _level_offsets[level], _level_offsets[level + 1] );
+	}
+
+	uint32_t dirty = 0;
+	for( uint32_t i = 0; i < count; i++ ) {
+		if( _world_dirty[i] ) {
+			_changed_update[i] = _update_count;
+			dirty++;
+		}
+	}
+	std::memset( _local_dirty.data(), 0, _local_dirty.size() );
+
+	_stats.node_count = count;
+	_stats.level_count = uint32_t( _level_offsets.size() - 1 );
+	_stats.dirty_nodes = dirty;
+	_stats.computed_nodes = computed;
+	_stats.update_ms = std::chrono::duration<double, std::milli>( std::chrono::high_resolution_clock::now() - start ).count();
+}
+
+FrameUploadAllocation SceneTransforms::WriteWorldMatrices( FrameUploadBuffer* upload )
+{
+	auto start = std::chrono::high_resolution_clock::now();
+
+	uint32_t count = uint32_t( _parent.size() );
+
+	FrameUploadAllocation allocation = upload->Allocate( VkDeviceSize( count ) * SCENE_WORLD_ELEMENT_COUNT * sizeof( float ) );
+	if( allocation.data == nullptr ) {
+		return allocation;
+	}
+
+	// Regions are reused every FRAMES_IN_FLIGHT frames, whatever we wrote there last time is still in place
+	UploadSlot& slot = _upload_slots[allocation.frame % _upload_slots.size()];
+	bool incremental = slot.generation == allocation.generation && slot.offset == allocation.offset && slot.node_count == count &&
+		slot.frame + _upload_slots.size() == allocation.frame;
+
+	float* destination = static_cast<float*>( allocation.data );
+	uint32_t written = 0;
+
+	for( uint32_t i = 0; i < count; i++ ) {
+		if( incremental && _changed_update[i] <= slot.update ) {
+			continue;
+		}
+
+		float* matrix = destination + size_t( _index_to_node[i] ) * SCENE_WORLD_ELEMENT_COUNT;
+		for( uint32_t e = 0; e < SCENE_WORLD_ELEMENT_COUNT; e++ ) {
+			matrix[e] = _world[e][i];
+		}
+		written++;
+	}
+
+	slot.generation = allocation.generation;
+	slot.offset = allocation.offset;
+	slot.frame = allocation.frame;
+	slot.node_count = count;
+	slot.update = _update_count;
+
+	_stats.written_nodes = written;
+	_stats.full_write = !incremental;
+	_stats.write_ms = std::chrono::duration<double, std::milli>( std::chrono::high_resolution_clock::now() - start ).count();
+
+	return allocation;
+}
+
+void SceneTransforms::getWorldMatrix( SceneNode node, float matrix[12] ) const
+{
+	uint32_t index = _node_to_index[node];
+	for( uint32_t e = 0; e < SCENE_WORLD_ELEMENT_COUNT; e++ ) {
+		matrix[e] = _world[e][index];
+	}
+}
+
+uint32_t SceneTransforms::getNodeCount() const
+{
+	return uint32_t( _node_parent.size() );
+}
+
+SceneNode SceneTransforms::getParent( SceneNode node ) const
+{
+	return _node_parent[node];
+}
+
+void SceneTransforms::setSimdLevel( SceneSimdLevel level )
+{
+	_simd_level = std::min( level, getSupportedSimdLevel() );
+}
+
+SceneSimdLevel SceneTransforms::getSimdLevel() const
+{
+	return _simd_level;
+}
+
+SceneSimdLevel SceneTransforms::getSupportedSimdLevel()
+{
+#if BUILD_ENABLE_SIMD && SCENE_TRANSFORMS_X86
+	static const SceneSimdLevel supported = CpuSupportsAvx() ? SCENE_SIMD_AVX : SCENE_SIMD_SSE;
+	return supported;
+#else
+	return SCENE_SIMD_SCALAR;
+#endif
+}
+
+const char* SceneTransforms::getSimdLevelName( SceneSimdLevel level )
+{
+	switch( level ) {
+	case SCENE_SIMD_AVX:
+		return "AVX";
+	case SCENE_SIMD_SSE:
+		return "SSE";
+	default:
+		return "scalar";
+	}
+}
+
+const SceneTransformStats& SceneTransforms::getStats() const
+{
+	return _stats;
+}
+
+void SceneTransforms::PrintStats() const
+{
+	std::cout << std::fixed << std::setprecision( 3 )
+		<< "Scene transforms (" << getSimdLevelName( _simd_level ) << "): " << _stats.node_count << " nodes in " << _stats.level_count << " levels" << std::endl
+		<< "  update " << _stats.update_ms << " ms, " << _stats.dirty_nodes << " dirty, " << _stats.computed_nodes << " computed" << std::endl
+		<< "  write  " << _stats.write_ms << " ms, " << _stats.written_nodes << " written" << ( _stats.full_write ? " (full)" : " (incremental)" ) << std::endl;
+}
+
+void SceneTransforms::_SortByDepth()
+{
+	uint32_t count = uint32_t( _node_parent.size() );
+
+	// Parents are created before their children, so depths resolve in node order
+	std::vector<uint32_t> depth( count );
+	uint32_t level_count = 0;
+	for( uint32_t n = 0; n < count; n++ ) {
+		depth[n] = _node_parent[n] == SCENE_NODE_NONE ? 0 : depth[_node_parent[n]] + 1;
+		level_count = std::max( level_count, depth[n] + 1 );
+	}
+
+	// Counting sort, stable so nodes keep their creation order within a level
+	_level_offsets.assign( level_count + 1, 0 );
+	for( uint32_t n = 0; n < count; n++ ) {
+		_level_offsets[depth[n] + 1]++;
+	}
+	for( uint32_t l = 0; l < level_count; l++ ) {
+		_level_offsets[l + 1] += _level_offsets[l];
+	}
+
+	std::vector<uint32_t> next( _level_offsets.begin(), _level_offsets.end() - 1 );
+	std::vector<SceneNode> index_to_node( count );
+	for( uint32_t n = 0; n < count; n++ ) {
+		index_to_node[next[depth[n]]++] = n;
+	}
+
+	std::vector<float> sorted( count );
+	for( auto &local : _local ) {
+		for( uint32_t i = 0; i < count; i++ ) {
+			sorted[i] = local[_node_to_index[index_to_node[i]]];
+		}
+		local.swap( sorted );
+	}
+
+	_index_to_node.swap( index_to_node );
+	for( uint32_t i = 0; i < count; i++ ) {
+		_node_to_index[_index_to_node[i]] = i;
+	}
+
+	_parent.resize( count );
+	for( uint32_t i = 0; i < count; i++ ) {
+		SceneNode parent = _node_parent[_index_to_node[i]];
+		_parent[i] = parent == SCENE_NODE_NONE ? count : _node_to_index[parent];
+	}
+
+	for( uint32_t e = 0; e < SCENE_WORLD_ELEMENT_COUNT; e++ ) {
+		_world[e].assign( count + 1, 0.0f );
+		_world[e][count] = IDENTITY_3X4[e];
+	}
+
+	// Everything moved, so every world transform and upload slot is rebuilt
+	_local_dirty.assign( count, 1 );
+	_world_dirty.assign( count + 1, 0 );
+	_changed_update.assign( count, 0 );
+
+	_sorted = true;
+}
+
+uint32_t SceneTransforms::_UpdateRange( const SceneTransformArrays& arrays, uint32_t begin, uint32_t end ) const
+{
+	switch( _simd_level ) {
+#if BUILD_ENABLE_SIMD && SCENE_TRANSFORMS_X86
+	case SCENE_SIMD_AVX:
+		return UpdateTransformRangeAvx( arrays, begin, end );
+	case SCENE_SIMD_SSE:
+		return UpdateTransformRange<SceneSseOps>( arrays, begin, end );
+#endif
+	default:
+		return UpdateTransformRange<SceneScalarOps>( arrays, begin, end );
+	}
+}
\ No newline at end of file
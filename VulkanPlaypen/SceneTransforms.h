@@ -0,0 +1,119 @@
+#pragma once
+
+#include "Platform.h"
+#include "FrameUploadBuffer.h"
+#include "SceneTransformsKernel.h"
+
+#include <cstdint>
+#include <vector>
+
+typedef uint32_t SceneNode;
+static const SceneNode SCENE_NODE_NONE = UINT32_MAX;
+
+enum SceneSimdLevel
+{
+	SCENE_SIMD_SCALAR,
+	SCENE_SIMD_SSE,
+	SCENE_SIMD_AVX,
+};
+
+struct SceneTransformStats
+{
+	uint32_t node_count = 0;
+	uint32_t level_count = 0;
+
+	// Last Update(): nodes whose world transform changed, and nodes recomputed including clean ones in dirty batches
+	uint32_t dirty_nodes = 0;
+	uint32_t computed_nodes = 0;
+	double update_ms = 0.0;
+
+	// Last WriteWorldMatrices()
+	uint32_t written_nodes = 0;
+	bool full_write = false;
+	double write_ms = 0.0;
+};
+
+// Transform hierarchy stored as structure-of-arrays in depth order.
+//
+// Parents always come before their children, so one pass over the depth levels propagates every change. Only nodes
+// whose local transform changed, or whose parent's world transform did, are recomputed, and batches of clean nodes
+// are skipped. The kernel runs 8 (AVX), 4 (SSE) or 1 node at a time, picked from what the CPU supports.
+//
+// Nodes are identified by the SceneNode returned from CreateNode(), which is also their index in the world matrix
+// array written to upload memory. A parent has to exist before its children and the hierarchy only grows.
+class SceneTransforms
+{
+public:
+	SceneTransforms();
+
+	// New nodes start at the identity. Adding nodes re-sorts the hierarchy on the next Update()
+	SceneNode CreateNode( SceneNode parent = SCENE_NODE_NONE );
+	void Reserve( uint32_t node_count );
+
+	void SetLocalTransform( SceneNode node, const float translation[3], const float rotation[4], const float scale[3] );
+	void SetTranslation( SceneNode node, const float translation[3] );
+	// Unit quaternion, x y z w
+	void SetRotation( SceneNode node, const float rotation[4] );
+	void SetScale( SceneNode node, const float scale[3] );
+
+	// Marks every node dirty
+	void Invalidate();
+
+	// Propagates local transform changes to world transforms
+	void Update();
+
+	// Writes a row-major 3x4 world matrix per node, indexed by SceneNode, into the frame's upload memory. When the
+	// allocation lands where this scene's matrices were FRAMES_IN_FLIGHT frames ago, only the matrices that changed
+	// since then are written. Returns an allocation with null data if upload memory ran out
+	FrameUploadAllocation WriteWorldMatrices( FrameUploadBuffer* upload );
+
+	// Valid after Update()
+	void getWorldMatrix( SceneNode node, float matrix[12] ) const;
+
+	uint32_t getNodeCount() const;
+	SceneNode getParent( SceneNode node ) const;
+
+	// Clamped to what the CPU and BUILD_ENABLE_SIMD allow
+	void setSimdLevel( SceneSimdLevel level );
+	SceneSimdLevel getSimdLevel() const;
+	static SceneSimdLevel getSupportedSimdLevel();
+	static const char* getSimdLevelName( SceneSimdLevel level );
+
+	const SceneTransformStats& getStats() const;
+	void PrintStats() const;
+
+private:
+	struct UploadSlot
+	{
+		uint32_t generation = 0;
+		VkDeviceSize offset = 0;
+		uint64_t frame = 0;
+		uint32_t node_count = 0;
+		uint32_t update = 0;		// _update_count when the slot was written
+	};
+
+	void _SortByDepth();
+	uint32_t _UpdateRange( const SceneTransformArrays& arrays, uint32_t begin, uint32_t end ) const;
+
+	// Depth ordered. World arrays have one extra element, the identity roots use as their parent
+	std::vector<float> _local[SCENE_LOCAL_ELEMENT_COUNT];
+	std::vector<float> _world[SCENE_WORLD_ELEMENT_COUNT];
+	std::vector<uint32_t> _parent;
+	std::vector<uint8_t> _local_dirty;
+	std::vector<uint8_t> _world_dirty;
+	std::vector<uint32_t> _changed_update;		// last Update() that changed the world transform
+	std::vector<uint32_t> _level_offsets;
+	std::vector<SceneNode> _index_to_node;
+
+	// By SceneNode
+	std::vector<SceneNode> _node_parent;
+	std::vector<uint32_t> _node_to_index;
+
+	bool _sorted = true;
+	uint32_t _update_count = 0;
+
+	std::vector<UploadSlot> _upload_slots;
+
+	SceneSimdLevel _simd_level = SCENE_SIMD_SCALAR;
+	SceneTransformStats _stats;
+};
\ No newline at end of file
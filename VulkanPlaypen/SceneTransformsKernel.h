@@ -0,0 +1,155 @@
+#pragma once
+
+// Transform propagation kernel shared by the per-instruction-set translation units of SceneTransforms. Each unit
+// instantiates UpdateTransformRange() with its own vector type so it can be compiled with matching code generation.
+//
+// The kernel has internal linkage. Inline functions with external linkage are merged across units at link time, and
+// the linker could keep the copy compiled with AVX for the scalar and SSE paths, which run on CPUs without it.
+
+#include <cstdint>
+
+enum SceneLocalElement
+{
+	SCENE_LOCAL_TX, SCENE_LOCAL_TY, SCENE_LOCAL_TZ,
+	SCENE_LOCAL_QX, SCENE_LOCAL_QY, SCENE_LOCAL_QZ, SCENE_LOCAL_QW,
+	SCENE_LOCAL_SX, SCENE_LOCAL_SY, SCENE_LOCAL_SZ,
+	SCENE_LOCAL_ELEMENT_COUNT
+};
+
+// World transforms are the rows of a 3x4 affine matrix
+static const uint32_t SCENE_WORLD_ELEMENT_COUNT = 12;
+
+struct SceneTransformArrays
+{
+	const float* local[SCENE_LOCAL_ELEMENT_COUNT];
+	float* world[SCENE_WORLD_ELEMENT_COUNT];
+
+	// Parents come earlier in depth order. Roots point at an identity transform past the last node
+	const uint32_t* parent;
+
+	const uint8_t* local_dirty;
+	uint8_t* world_dirty;
+};
+
+namespace {
+
+struct SceneScalarOps
+{
+	typedef float Type;
+	static const uint32_t WIDTH = 1;
+
+	static inline Type Load( const float* p ) { return *p; }
+	static inline void Store( float* p, Type v ) { *p = v; }
+	static inline Type Set( float v ) { return v; }
+	static inline Type Gather( const float* base, const uint32_t* indices ) { return base[indices[0]]; }
+	static inline Type Add( Type a, Type b ) { return a + b; }
+	static inline Type Sub( Type a, Type b ) { return a - b; }
+	static inline Type Mul( Type a, Type b ) { return a * b; }
+};
+
+// World transforms of WIDTH nodes starting at index, from their local transforms and their parents' world transforms
+template<class V>
+inline void ComposeTransforms( const SceneTransformArrays& a, uint32_t index )
+{
+	typedef typename V::Type T;
+
+	T tx = V::Load( a.local[SCENE_LOCAL_TX] + index );
+	T ty = V::Load( a.local[SCENE_LOCAL_TY] + index );
+	T tz = V::Load( a.local[SCENE_LOCAL_TZ] + index );
+	T qx = V::Load( a.local[SCENE_LOCAL_QX] + index );
+	T qy = V::Load( a.local[SCENE_LOCAL_QY] + index );
+	T qz = V::Load( a.local[SCENE_LOCAL_QZ] + index );
+	T qw = V::Load( a.local[SCENE_LOCAL_QW] + index );
+	T sx = V::Load( a.local[SCENE_LOCAL_SX] + index );
+	T sy = V::Load( a.local[SCENE_LOCAL_SY] + index );
+	T sz = V::Load( a.local[SCENE_LOCAL_SZ] + index );
+
+	// Rotation from a unit quaternion, columns scaled
+	T x2 = V::Add( qx, qx );
+	T y2 = V::Add( qy, qy );
+	T z2 = V::Add( qz, qz );
+	T xx = V::Mul( qx, x2 );
+	T yy = V::Mul( qy, y2 );
+	T zz = V::Mul( qz, z2 );
+	T xy = V::Mul( qx, y2 );
+	T xz = V::Mul( qx, z2 );
+	T yz = V::Mul( qy, z2 );
+	T wx = V::Mul( qw, x2 );
+	T wy = V::Mul( qw, y2 );
+	T wz = V::Mul( qw, z2 );
+	T one = V::Set( 1.0f );
+
+	T l00 = V::Mul( V::Sub( one, V::Add( yy, zz ) ), sx );
+	T l01 = V::Mul( V::Sub( xy, wz ), sy );
+	T l02 = V::Mul( V::Add( xz, wy ), sz );
+	T l10 = V::Mul( V::Add( xy, wz ), sx );
+	T l11 = V::Mul( V::Sub( one, V::Add( xx, zz ) ), sy );
+	T l12 = V::Mul( V::Sub( yz, wx ), sz );
+	T l20 = V::Mul( V::Sub( xz, wy ), sx );
+	T l21 = V::Mul( V::Add( yz, wx ), sy );
+	T l22 = V::Mul( V::Sub( one, V::Add( xx, yy ) ), sz );
+
+	const uint32_t* parents = a.parent + index;
+
+	for( uint32_t row = 0; row < 3; row++ ) {
+		T p0 = V::Gather( a.world[row * 4 + 0], parents );
+		T p1 = V::Gather( a.world[row * 4 + 1], parents );
+		T p2 = V::Gather( a.world[row * 4 + 2], parents );
+		T p3 = V::Gather( a.world[row * 4 + 3], parents );
+
+		V::Store( a.world[row * 4 + 0] + index, V::Add( V::Add( V::Mul( p0, l00 ), V::Mul( p1, l10 ) ), V::Mul( p2, l20 ) ) );
+		V::Store( a.world[row * 4 + 1] + index, V::Add( V::Add( V::Mul( p0, l01 ), V::Mul( p1, l11 ) ), V::Mul( p2, l21 ) ) );
+		V::Store( a.world[row * 4 + 2] + index, V::Add( V::Add( V::Mul( p0, l02 ), V::Mul( p1, l12 ) ), V::Mul( p2, l22 ) ) );
+		V::Store( a.world[row * 4 + 3] + index, V::Add( V::Add( V::Add( V::Mul( p0, tx ), V::Mul( p1, ty ) ), V::Mul( p2, tz ) ), p3 ) );
+	}
+}
+
+// Updates [begin, end), which must not contain a node together with its parent (one depth level does not). A node is
+// dirty when its local transform or its parent's world transform changed. Batches with few dirty nodes only compute
+// those, the rest also recompute their clean nodes, to the same value. Returns the number of computed nodes
+template<class V>
+inline uint32_t UpdateTransformRange( const SceneTransformArrays& a, uint32_t begin, uint32_t end )
+{
+	uint32_t updated = 0;
+	uint32_t index = begin;
+
+	for( ; index + V::WIDTH <= end; index += V::WIDTH ) {
+		uint32_t dirty_count = 0;
+		for( uint32_t k = 0; k < V::WIDTH; k++ ) {
+			uint8_t dirty = a.local_dirty[index + k] | a.world_dirty[a.parent[index + k]];
+			a.world_dirty[index + k] = dirty;
+			dirty_count += dirty;
+		}
+
+		// Mostly clean batches are cheaper one node at a time
+		if( dirty_count * 4 <= V::WIDTH ) {
+			for( uint32_t k = 0; dirty_count > 0 && k < V::WIDTH; k++ ) {
+				if( a.world_dirty[index + k] ) {
+					ComposeTransforms<SceneScalarOps>( a, index + k );
+					updated++;
+				}
+			}
+		}
+		else {
+			ComposeTransforms<V>( a, index );
+			updated += V::WIDTH;
+		}
+	}
+
+	for( ; index < end; index++ ) {
+		uint8_t dirty = a.local_dirty[index] | a.world_dirty[a.parent[index]];
+		a.world_dirty[index] = dirty;
+
+		if( dirty ) {
+			ComposeTransforms<SceneScalarOps>( a, index );
+			updated++;
+		}
+	}
+
+	return updated;
+}
+
+}
+
+// Implemented in SceneTransforms_AVX.cpp, which is compiled with AVX code generation
+uint32_t UpdateTransformRangeAvx( const SceneTransformArrays& a, uint32_t begin, uint32_t end );
\ No newline at end of file
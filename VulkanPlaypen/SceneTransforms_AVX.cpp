@@ -0,0 +1,45 @@
+// AVX build of the scene transform kernel. Only called after SceneTransforms has checked the CPU supports AVX, the
+// project compiles this file alone with /arch:AVX
+
+#include "BUILD_OPTIONS.h"
+
+#include <cstdint>
+
+#if BUILD_ENABLE_SIMD && ( defined( _M_IX86 ) || defined( _M_X64 ) || defined( __i386__ ) || defined( __x86_64__ ) )
+
+#if defined( __GNUC__ ) && !defined( __AVX__ )
+#pragma GCC target( "avx" )
+#endif
+
+#include <immintrin.h>
+
+#include "SceneTransformsKernel.h"
+
+struct SceneAvxOps
+{
+	typedef __m256 Type;
+	static const uint32_t WIDTH = 8;
+
+	static inline Type Load( const float* p ) { return _mm256_loadu_ps( p ); }
+	static inline void Store( float* p, Type v ) { _mm256_storeu_ps( p, v ); }
+	static inline Type Set( float v ) { return _mm256_set1_ps( v ); }
+	static inline Type Gather( const float* base, const uint32_t* indices )
+	{
+		return _mm256_setr_ps( base[indices[0]], base[indices[1]], base[indices[2]], base[indices[3]],
+			base[indices[4]], base[indices[5]], base[indices[6]], base[indices[7]] );
+	}
+	static inline Type Add( Type a, Type b ) { return _mm256_add_ps( a, b ); }
+	static inline Type Sub( Type a, Type b ) { return _mm256_sub_ps( a, b ); }
+	static inline Type Mul( Type a, Type b ) { return _mm256_mul_ps( a, b ); }
+};
+
+uint32_t UpdateTransformRangeAvx( const SceneTransformArrays& a, uint32_t begin, uint32_t end )
+{
+	uint32_t updated = UpdateTransformRange<SceneAvxOps>( a, begin, end );
+
+	// Avoid AVX-SSE transition penalties in the caller
+	_mm256_zeroupper();
+	return updated;
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,373 @@
+#include "SubmissionQueue.h"
+#include "RendererUtils.h"
+
+#include <assert.h>
+#include <algorithm>
+#include <future>
+#include <iomanip>
+#include <iostream>
+
+SubmissionQueue::SubmissionQueue( VkQueue queue, const SubmissionQueueSettings& settings )
+{
+	_queue = queue;
+	_settings = settings;
+	_settings.max_batch_count = std::max<uint32_t>( _settings.max_batch_count, 1 );
+
+	_head.store( &_stub );
+	_tail = &_stub;
+
+	_thread = std::thread( &SubmissionQueue::_SubmitLoop, this );
+}
+
+
+SubmissionQueue::~SubmissionQueue()
+{
+	// The submit thread drains the queue before it stops
+	_stopping.store( true );
+	if( _sleeping.exchange( false ) ) {
+		std::lock_guard<std::mutex> lock( _mutex );
+		_wake.notify_one();
+	}
+	_thread.join();
+
+	for( auto i : _free_packets ) {
+		delete i;
+	}
+	_free_packets.clear();
+}
+
+void SubmissionQueue::Submit( uint32_t submit_count, const VkSubmitInfo* submits, VkFence fence )
+{
+	Packet* packet = _AllocatePacket();
+	packet->submits.assign( submits, submits + submit_count );
+	packet->fence = fence;
+
+	for( auto &i : packet->submits ) {
+		packet->wait_semaphores.insert( packet->wait_semaphores.end(), i.pWaitSemaphores, i.pWaitSemaphores + i.waitSemaphoreCount );
+		packet->wait_stages.insert( packet->wait_stages.end(), i.pWaitDstStageMask, i.pWaitDstStageMask + i.waitSemaphoreCount );
+		packet->command_buffers.insert( packet->command_buffers.end(), i.pCommandBuffers, i.pCommandBuffers + i.commandBufferCount );
+		packet->signal_semaphores.insert( packet->signal_semaphores.end(), i.pSignalSemaphores, i.pSignalSemaphores + i.signalSemaphoreCount );
+
+		i.pNext = nullptr;
+		i.pWaitSemaphores = nullptr;
+		i.pWaitDstStageMask = nullptr;
+		i.pCommandBuffers = nullptr;
+		i.pSignalSemaphores = nullptr;
+	}
+
+	packet->push_time = std::chrono::high_resolution_clock::now();
+	_Push( packet );
+}
+
+void SubmissionQueue::Execute( std::function<void( VkQueue queue )> job )
+{
+	Packet* packet = _AllocatePacket();
+	packet->job = std::move( job );
+	packet->push_time = std::chrono::high_resolution_clock::now();
+	_Push( packet );
+}
+
+void SubmissionQueue::ExecuteAndWait( std::function<void( VkQueue queue )> job )
+{
+	std::promise<void> done;
+	std::future<void> wait = done.get_future();
+
+	Execute( [&job, &done]( VkQueue queue ) {
+		job( queue );
+		done.set_value();
+	} );
+	wait.wait();
+}
+
+void SubmissionQueue::Flush()
+{
+	ExecuteAndWait( []( VkQueue ) {} );
+}
+
+VkResult SubmissionQueue::WaitIdle()
+{
+	VkResult result = VK_SUCCESS;
+	ExecuteAndWait( [&result]( VkQueue queue ) { result = vkQueueWaitIdle( queue ); } );
+	return result;
+}
+
+VkQueue SubmissionQueue::AcquireQueue()
+{
+	{
+		std::lock_guard<std::mutex> lock( _acquire_mutex );
+		assert( !_acquired && "SubmissionQueue::AcquireQueue() called while the queue is already acquired" );
+		_acquired = true;
+	}
+
+	std::promise<void> parked;
+	std::future<void> wait = parked.get_future();
+
+	Execute( [this, &parked]( VkQueue ) {
+		parked.set_value();
+
+		std::unique_lock<std::mutex> lock( _acquire_mutex );
+		_released.wait( lock, [this]() { return !_acquired; } );
+	} );
+	wait.wait();
+
+	return _queue;
+}
+
+void SubmissionQueue::ReleaseQueue()
+{
+	{
+		std::lock_guard<std::mutex> lock( _acquire_mutex );
+		_acquired = false;
+	}
+	_released.notify_one();
+}
+
+void SubmissionQueue::EndFrame()
+{
+	std::lock_guard<std::mutex> lock( _stats_mutex );
+
+	_stats.frame_submit_count = _stats.submit_count - _frame_submit_start;
+	_stats.frame_submit_max = std::max( _stats.frame_submit_max, _stats.frame_submit_count );
+	_stats.frame_count++;
+	_frame_submit_start = _stats.submit_count;
+}
+
+VkQueue SubmissionQueue::getQueue() const
+{
+	return _queue;
+}
+
+SubmissionQueueStats SubmissionQueue::getStats() const
+{
+	std::lock_guard<std::mutex> lock( _stats_mutex );
+	return _stats;
+}
+
+void SubmissionQueue::ResetStats()
+{
+	std::lock_guard<std::mutex> lock( _stats_mutex );
+	_stats = SubmissionQueueStats();
+	_frame_submit_start = 0;
+}
+
+void SubmissionQueue::PrintStats() const
+{
+	SubmissionQueueStats stats = getStats();
+	double batches_per_submit = stats.submit_count > 0 ? double( stats.batch_count ) / stats.submit_count : 0.0;
+	double submits_per_frame = stats.frame_count > 0 ? double( stats.submit_count ) / stats.frame_count : 0.0;
+	double latency_us_avg = stats.packet_count > 0 ? stats.latency_us_total / stats.packet_count : 0.0;
+
+	std::cout << std::fixed << std::setprecision( 2 )
+		<< "Submission queue: " << stats.packet_count << " packets, " << stats.batch_count << " submit infos in " << stats.submit_count << " vkQueueSubmit calls ("
+		<< batches_per_submit << " each), " << stats.execute_count << " executes, " << stats.packet_allocation_count << " packets allocated" << std::endl
+		<< "  submits per frame avg " << submits_per_frame << ", last " << stats.frame_submit_count << ", max " << stats.frame_submit_max << std::endl
+		<< "  queued to submitted avg " << latency_us_avg << " us, max " << stats.latency_us_max << " us" << std::endl;
+}
+
+SubmissionQueue::Packet* SubmissionQueue::_AllocatePacket()
+{
+	{
+		std::lock_guard<std::mutex> lock( _free_mutex );
+		if( !_free_packets.empty() ) {
+			Packet* packet = _free_packets.back();
+			_free_packets.pop_back();
+			return packet;
+		}
+	}
+
+	{
+		std::lock_guard<std::mutex> lock( _stats_mutex );
+		_stats.packet_allocation_count++;
+	}
+	return new Packet;
+}
+
+void SubmissionQueue::_RecyclePackets( Packet* const* packets, size_t count )
+{
+	// Cleared outside the lock, the arrays keep their capacity for the next submit
+	for( size_t i = 0; i < count; i++ ) {
+		Packet* packet = packets[i];
+		packet->submits.clear();
+		packet->wait_semaphores.clear();
+		packet->wait_stages.clear();
+		packet->command_buffers.clear();
+		packet->signal_semaphores.clear();
+		packet->fence = VK_NULL_HANDLE;
+		packet->job = nullptr;
+	}
+
+	std::lock_guard<std::mutex> lock( _free_mutex );
+	for( size_t i = 0; i < count; i++ ) {
+		if( _free_packets.size() < _settings.max_free_packets ) {
+			_free_packets.push_back( packets[i] );
+		}
+		else {
+			delete packets[i];
+		}
+	}
+}
+
+void SubmissionQueue::_Push( Packet* packet )
+{
+	// Counted before it is linked, so the submit thread can tell a push is under way
+	_queued_count.fetch_add( 1 );
+	_Link( packet );
+
+	if( _sleeping.exchange( false ) ) {
+		std::lock_guard<std::mutex> lock( _mutex );
+		_wake.notify_one();
+	}
+}
+
+void SubmissionQueue::_Link( Packet* packet )
+{
+	packet->next.store( nullptr, std::memory_order_relaxed );
+	Packet* previous = _head.exchange( packet, std::memory_order_acq_rel );
+	previous->next.store( packet, std::memory_order_release );
+}
+
+SubmissionQueue::Packet* SubmissionQueue::_Pop()
+{
+	Packet* tail = _tail;
+	Packet* next = tail->next.load( std::memory_order_acquire );
+
+	if( tail == &_stub ) {
+		if( next == nullptr ) {
+			return nullptr;
+		}
+		_tail = next;
+		tail = next;
+		next = next->next.load( std::memory_order_acquire );
+	}
+
+	if( next != nullptr ) {
+		_tail = next;
+		return tail;
+	}
+
+	// The last packet can only be taken with the stub behind it. Another push may still be linking
+	if( tail != _head.load( std::memory_order_acquire ) ) {
+		return nullptr;
+	}
+
+	_Link( &_stub );
+
+	next = tail->next.load( std::memory_order_acquire );
+	if( next != nullptr ) {
+		_tail = next;
+		return tail;
+	}
+	return nullptr;
+}
+
+void SubmissionQueue::_SubmitLoop()
+{
+	uint32_t spins = 0;
+
+	for( ;; ) {
+		Packet* packet = _Pop();
+
+		if( packet == nullptr ) {
+			// Drained, submit what has been gathered before waiting for more
+			_SubmitBatch( VK_NULL_HANDLE );
+
+			if( _queued_count.load() > 0 ) {
+				std::this_thread::yield();
+				continue;
+			}
+			if( _stopping.load() ) {
+				return;
+			}
+			if( spins < _settings.spin_count ) {
+				spins++;
+				std::this_thread::yield();
+				continue;
+			}
+
+			std::unique_lock<std::mutex> lock( _mutex );
+			_sleeping.store( true );
+			if( _queued_count.load() > 0 || _stopping.load() ) {
+				_sleeping.store( false );
+				continue;
+			}
+			_wake.wait( lock, [this]() { return !_sleeping.load(); } );
+			continue;
+		}
+
+		spins = 0;
+		_queued_count.fetch_sub( 1 );
+
+		if( packet->job ) {
+			_SubmitBatch( VK_NULL_HANDLE );
+			packet->job( _queue );
+			_RecyclePackets( &packet, 1 );
+
+			std::lock_guard<std::mutex> lock( _stats_mutex );
+			_stats.execute_count++;
+			continue;
+		}
+
+		_Append( packet );
+
+		if( packet->fence != VK_NULL_HANDLE || _batch_submits.size() >= _settings.max_batch_count ) {
+			_SubmitBatch( packet->fence );
+		}
+	}
+}
+
+void SubmissionQueue::_Append( Packet* packet )
+{
+	const VkSemaphore* wait_semaphores = packet->wait_semaphores.data();
+	const VkPipelineStageFlags* wait_stages = packet->wait_stages.data();
+	const VkCommandBuffer* command_buffers = packet->command_buffers.data();
+	const VkSemaphore* signal_semaphores = packet->signal_semaphores.data();
+
+	for( auto i : packet->submits ) {
+		i.pWaitSemaphores = wait_semaphores;
+		i.pWaitDstStageMask = wait_stages;
+		i.pCommandBuffers = command_buffers;
+		i.pSignalSemaphores = signal_semaphores;
+
+		wait_semaphores += i.waitSemaphoreCount;
+		wait_stages += i.waitSemaphoreCount;
+		command_buffers += i.commandBufferCount;
+		signal_semaphores += i.signalSemaphoreCount;
+
+		_batch_submits.push_back( i );
+	}
+
+	_batch_packets.push_back( packet );
+}
+
+void SubmissionQueue::_SubmitBatch( VkFence fence )
+{
+	if( _batch_submits.empty() && fence == VK_NULL_HANDLE ) {
+		_RecyclePackets( _batch_packets.data(), _batch_packets.size() );
+		_batch_packets.clear();
+		return;
+	}
+
+	vkResultErrorCheck( vkQueueSubmit( _queue, uint32_t( _batch_submits.size() ), _batch_submits.data(), fence ) );
+
+	auto now = std::chrono::high_resolution_clock::now();
+	double latency_us_total = 0.0;
+	double latency_us_max = 0.0;
+	for( auto i : _batch_packets ) {
+		double latency_us = std::chrono::duration<double, std::micro>( now - i->push_time ).count();
+		latency_us_total += latency_us;
+		latency_us_max = std::max( latency_us_max, latency_us );
+	}
+	_RecyclePackets( _batch_packets.data(), _batch_packets.size() );
+
+	{
+		std::lock_guard<std::mutex> lock( _stats_mutex );
+		_stats.packet_count += _batch_packets.size();
+		_stats.batch_count += _batch_submits.size();
+		_stats.submit_count++;
+		_stats.latency_us_total += latency_us_total;
+		_stats.latency_us_max = std::max( _stats.latency_us_max, latency_us_max );
+	}
+
+	_batch_packets.clear();
+	_batch_submits.clear();
+}
@@ -0,0 +1,152 @@
+#pragma once
+
+#include "Platform.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct SubmissionQueueSettings
+{
+	// Polls the empty queue this many times before the submit thread goes to sleep
+	uint32_t spin_count = 256;
+
+	// Most VkSubmitInfos passed to one vkQueueSubmit() call
+	uint32_t max_batch_count = 64;
+
+	// Submitted packets are kept for reuse, with their arrays, up to this many
+	uint32_t max_free_packets = 256;
+};
+
+struct SubmissionQueueStats
+{
+	uint64_t packet_count = 0;
+	uint64_t batch_count = 0;
+	uint64_t submit_count = 0;
+	uint64_t execute_count = 0;
+	uint64_t packet_allocation_count = 0;		// packets that didn't come from the free list
+
+	// Submit calls in the last frame and the most in any frame
+	uint64_t frame_submit_count = 0;
+	uint64_t frame_submit_max = 0;
+	uint64_t frame_count = 0;
+
+	// From Submit() returning to vkQueueSubmit() returning
+	double latency_us_total = 0.0;
+	double latency_us_max = 0.0;
+};
+
+// Owns a VkQueue and submits to it from a dedicated thread.
+//
+// Any thread can Submit(), which copies the submit infos into a packet and pushes it onto a lock-free multiple
+// producer, single consumer queue. The submit thread drains everything queued and passes it to as few vkQueueSubmit()
+// calls as it can, in push order, so a semaphore signaled by one packet is always submitted before a later packet
+// waits on it. A call ends at each packet with a fence, which then signals no later than if it had been submitted on
+// its own.
+//
+// While the queue is owned, nothing else may use it directly. Other queue operations such as presents and idle waits
+// go through Execute() to stay ordered with the submits, code that has to call vkQueueSubmit() itself takes the
+// queue with AcquireQueue(). Extension structures in pNext are not copied.
+//
+// Packets are recycled through a free list once submitted, so steady state submits don't allocate.
+class SubmissionQueue
+{
+public:
+	SubmissionQueue( VkQueue queue, const SubmissionQueueSettings& settings = SubmissionQueueSettings() );
+	~SubmissionQueue();
+
+	// Returns once the packet is queued, errors from vkQueueSubmit() are fatal on the submit thread
+	void Submit( uint32_t submit_count, const VkSubmitInfo* submits, VkFence fence = VK_NULL_HANDLE );
+
+	// Runs job on the submit thread once everything queued before it has been submitted
+	void Execute( std::function<void( VkQueue queue )> job );
+
+	// Like Execute(), but returns once job has run
+	void ExecuteAndWait( std::function<void( VkQueue queue )> job );
+
+	// Blocks until everything queued so far has been submitted
+	void Flush();
+
+	// vkQueueWaitIdle() after everything queued so far
+	VkResult WaitIdle();
+
+	// Parks the submit thread once everything queued so far is submitted and returns the queue for direct use until
+	// ReleaseQueue(). Packets queued in between wait, so don't Flush() or WaitIdle() while holding it
+	VkQueue AcquireQueue();
+	void ReleaseQueue();
+
+	// Closes the frame for the submits per frame stats. Renderer::Run() closes the frames it renders
+	void EndFrame();
+
+	VkQueue getQueue() const;
+
+	SubmissionQueueStats getStats() const;
+	void ResetStats();
+	void PrintStats() const;
+
+private:
+	struct Packet
+	{
+		std::atomic<Packet*> next { nullptr };
+
+		// Array pointers are cleared, the arrays are stored below back to back
+		std::vector<VkSubmitInfo> submits;
+		std::vector<VkSemaphore> wait_semaphores;
+		std::vector<VkPipelineStageFlags> wait_stages;
+		std::vector<VkCommandBuffer> command_buffers;
+		std::vector<VkSemaphore> signal_semaphores;
+		VkFence fence = VK_NULL_HANDLE;
+
+		std::function<void( VkQueue queue )> job;
+
+		std::chrono::high_resolution_clock::time_point push_time;
+	};
+
+	Packet* _AllocatePacket();
+	// Clears the packets and returns them to the free list
+	void _RecyclePackets( Packet* const* packets, size_t count );
+
+	void _Push( Packet* packet );
+	void _Link( Packet* packet );
+	Packet* _Pop();
+
+	void _SubmitLoop();
+	void _Append( Packet* packet );
+	void _SubmitBatch( VkFence fence );
+
+	VkQueue _queue = VK_NULL_HANDLE;
+	SubmissionQueueSettings _settings;
+
+	// Intrusive queue with a stub node, producers swap the head, the submit thread owns the tail
+	std::atomic<Packet*> _head;
+	Packet* _tail = nullptr;
+	Packet _stub;
+	std::atomic<uint32_t> _queued_count { 0 };
+
+	std::thread _thread;
+	std::mutex _mutex;
+	std::condition_variable _wake;
+	std::atomic<bool> _sleeping { false };
+	std::atomic<bool> _stopping { false };
+
+	std::mutex _free_mutex;
+	std::vector<Packet*> _free_packets;
+
+	// Set while the queue is acquired, the submit thread waits for it to clear
+	std::mutex _acquire_mutex;
+	std::condition_variable _released;
+	bool _acquired = false;
+
+	// Submit thread only, packets in the current batch and their arrays with the pointers filled in
+	std::vector<Packet*> _batch_packets;
+	std::vector<VkSubmitInfo> _batch_submits;
+
+	mutable std::mutex _stats_mutex;
+	SubmissionQueueStats _stats;
+	uint64_t _frame_submit_start = 0;
+};
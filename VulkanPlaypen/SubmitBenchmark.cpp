@@ -0,0 +1,549 @@
+#include "SubmitBenchmark.h"
+#include "Renderer.h"
+#include "RendererUtils.h"
+#include "SubmissionQueue.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <sstream>
+#include <thread>
+
+typedef std::chrono::steady_clock BenchmarkClock;
+
+static double ElapsedNs( BenchmarkClock::time_point start, BenchmarkClock::time_point end )
+{
+	return std::chrono::duration<double, std::nano>( end - start ).count();
+}
+
+SubmitBenchmark::SubmitBenchmark( Renderer* r, const SubmitBenchmarkSettings& settings )
+{
+	_renderer = r;
+	_settings = settings;
+	_settings.samples = std::max( _settings.samples, 1u );
+	_settings.max_batch = std::max( _settings.max_batch, 1u );
+	_settings.max_chain = std::max( _settings.max_chain, 1u );
+	_settings.barriers_per_buffer = std::max( _settings.barriers_per_buffer, 1u );
+
+	VkDevice device = _renderer->getDevice();
+
+	VkCommandPoolCreateInfo pool_info {};
+	pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	pool_info.queueFamilyIndex = _renderer->getGraphicsFamilyIndex();
+	pool_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+	vkResultErrorCheck( vkCreateCommandPool( device, &pool_info, _renderer->getAllocationCallbacks(), &_command_pool ) );
+
+	_command_buffers.resize( std::max( _settings.max_batch, _settings.max_chain ) );
+	VkCommandBufferAllocateInfo command_buffer_info {};
+	command_buffer_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	command_buffer_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	command_buffer_info.commandPool = _command_pool;
+	command_buffer_info.commandBufferCount = uint32_t( _command_buffers.size() );
+	vkResultErrorCheck( vkAllocateCommandBuffers( device, &command_buffer_info, _command_buffers.data() ) );
+
+	for( auto command_buffer : _command_buffers ) {
+		_RecordMinimal( command_buffer );
+	}
+
+	_semaphores.resize( _settings.max_chain );
+	for( auto &i : _semaphores ) {
+		VkSemaphoreCreateInfo semaphore_info {};
+		semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+		vkResultErrorCheck( vkCreateSemaphore( device, &semaphore_info, _renderer->getAllocationCallbacks(), &i ) );
+	}
+
+	VkFenceCreateInfo fence_info {};
+	fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	vkResultErrorCheck( vkCreateFence( device, &fence_info, _renderer->getAllocationCallbacks(), &_fence ) );
+}
+
+
+SubmitBenchmark::~SubmitBenchmark()
+{
+	VkDevice device = _renderer->getDevice();
+	_renderer->getSubmissionQueue()->WaitIdle();
+
+	vkDestroyFence( device, _fence, _renderer->getAllocationCallbacks() );
+	for( auto i : _semaphores ) {
+		vkDestroySemaphore( device, i, _renderer->getAllocationCallbacks() );
+	}
+	vkDestroyCommandPool( device, _command_pool, _renderer->getAllocationCallbacks() );
+}
+
+void SubmitBenchmark::Run()
+{
+	_results.clear();
+
+	// Measures the driver, so the submission queue is bypassed while it runs
+	_queue = _renderer->getSubmissionQueue()->AcquireQueue();
+
+	_MeasureCommandPools();
+	_MeasureRecording();
+	_MeasureSubmits();
+	_MeasureFenceWake();
+	_MeasureSemaphoreChains();
+	_MeasureBarriers();
+
+	_renderer->getSubmissionQueue()->ReleaseQueue();
+	_queue = VK_NULL_HANDLE;
+}
+
+const std::vector<SubmitBenchmarkResult>& SubmitBenchmark::getResults() const
+{
+	return _results;
+}
+
+void SubmitBenchmark::PrintResults() const
+{
+	std::cout << std::fixed << std::setprecision( 0 ) << std::left << std::setw( 24 ) << "ns" << std::right << std::setw( 10 ) << "min" << std::setw( 10 ) << "p50"
+		<< std::setw( 10 ) << "p90" << std::setw( 10 ) << "p99" << std::setw( 10 ) << "max" << std::setw( 10 ) << "mean" << std::endl;
+
+	for( auto &i : _results ) {
+		std::cout << std::left << std::setw( 24 ) << i.name << std::right << std::setw( 10 ) << i.min << std::setw( 10 ) << i.p50 << std::setw( 10 ) << i.p90
+			<< std::setw( 10 ) << i.p99 << std::setw( 10 ) << i.max << std::setw( 10 ) << i.mean << std::endl;
+	}
+
+	// Throughput in submit infos, from the median call
+	for( auto &i : _results ) {
+		if( i.name.compare( 0, 14, "queue_submit_x" ) == 0 && i.p50 > 0.0 ) {
+			uint32_t batch = uint32_t( std::strtoul( i.name.c_str() + 14, nullptr, 10 ) );
+			std::cout << std::setprecision( 2 ) << "  " << batch << " submit infos per call: " << batch * 1000.0 / i.p50 << " M submit infos/s" << std::endl;
+		}
+	}
+}
+
+bool SubmitBenchmark::WriteCsv( const std::string& path ) const
+{
+	std::ofstream file( path );
+	if( !file ) {
+		return false;
+	}
+
+	file << "name,samples,min_ns,p50_ns,p90_ns,p99_ns,max_ns,mean_ns" << std::endl;
+	file << std::fixed << std::setprecision( 1 );
+	for( auto &i : _results ) {
+		file << i.name << "," << i.samples << "," << i.min << "," << i.p50 << "," << i.p90 << "," << i.p99 << "," << i.max << "," << i.mean << "\n";
+	}
+
+	return true;
+}
+
+int SubmitBenchmark::CompareWithBaseline( const std::string& path, double tolerance ) const
+{
+	std::ifstream file( path );
+	if( !file ) {
+		return -1;
+	}
+
+	std::map<std::string, double> baseline_p50s;
+	std::string line;
+	std::getline( file, line );
+	while( std::getline( file, line ) ) {
+		std::stringstream fields( line );
+		std::string name, samples, min, p50;
+		if( std::getline( fields, name, ',' ) && std::getline( fields, samples, ',' ) && std::getline( fields, min, ',' ) && std::getline( fields, p50, ',' ) ) {
+			baseline_p50s[name] = std::strtod( p50.c_str(), nullptr );
+		}
+	}
+
+	int regressions = 0;
+	for( auto &i : _results ) {
+		auto baseline = baseline_p50s.find( i.name );
+		if( baseline == baseline_p50s.end() || baseline->second <= 0.0 ) {
+			continue;
+		}
+
+		if( i.p50 > baseline->second * tolerance ) {
+			std::cout << std::fixed << std::setprecision( 0 ) << "Regression: " << i.name << " p50 " << i.p50 << " ns, baseline " << baseline->second
+				<< " ns (" << std::setprecision( 1 ) << ( i.p50 / baseline->second - 1.0 ) * 100.0 << "% slower)" << std::endl;
+			regressions++;
+		}
+	}
+
+	return regressions;
+}
+
+void SubmitBenchmark::_MeasureCommandPools()
+{
+	VkDevice device = _renderer->getDevice();
+	const VkAllocationCallbacks* allocator = _renderer->getAllocationCallbacks();
+
+	VkCommandPoolCreateInfo pool_info {};
+	pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	pool_info.queueFamilyIndex = _renderer->getGraphicsFamilyIndex();
+
+	std::vector<double> create_samples;
+	std::vector<double> destroy_samples;
+	std::vector<double> reset_samples;
+
+	for( uint32_t i = 0; i < _settings.warm_up + _settings.samples; i++ ) {
+		VkCommandPool command_pool = VK_NULL_HANDLE;
+		auto start = BenchmarkClock::now();
+		vkResultErrorCheck( vkCreateCommandPool( device, &pool_info, allocator, &command_pool ) );
+		auto created = BenchmarkClock::now();
+
+		VkCommandBuffer command_buffer = VK_NULL_HANDLE;
+		VkCommandBufferAllocateInfo command_buffer_info {};
+		command_buffer_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		command_buffer_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		command_buffer_info.commandPool = command_pool;
+		command_buffer_info.commandBufferCount = 1;
+		vkResultErrorCheck( vkAllocateCommandBuffers( device, &command_buffer_info, &command_buffer ) );
+		_RecordMinimal( command_buffer );
+
+		auto reset_start = BenchmarkClock::now();
+		vkResultErrorCheck( vkResetCommandPool( device, command_pool, 0 ) );
+		auto reset_end = BenchmarkClock::now();
+
+		vkDestroyCommandPool( device, command_pool, allocator );
+		auto destroyed = BenchmarkClock::now();
+
+		if( i >= _settings.warm_up ) {
+			create_samples.push_back( ElapsedNs( start, created ) );
+			reset_samples.push_back( ElapsedNs( reset_start, reset_end ) );
+			destroy_samples.push_back( ElapsedNs( reset_end, destroyed ) );
+		}
+	}
+
+	_AddResult( "command_pool_create", create_samples );
+	_AddResult( "command_pool_destroy", destroy_samples );
+	_AddResult( "command_pool_reset", reset_samples );
+}
+
+void SubmitBenchmark::_MeasureRecording()
+{
+	VkCommandBuffer command_buffer = _command_buffers[0];
+
+	VkCommandBufferBeginInfo begin_info {};
+	begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+	VkViewport viewport {};
+	viewport.width = 512;
+	viewport.height = 512;
+	viewport.maxDepth = 1.0f;
+
+	std::vector<double> begin_samples;
+	std::vector<double> command_samples;
+	std::vector<double> end_samples;
+
+	for( uint32_t i = 0; i < _settings.warm_up + _settings.samples; i++ ) {
+		vkResultErrorCheck( vkResetCommandBuffer( command_buffer, 0 ) );
+
+		auto start = BenchmarkClock::now();
+		vkResultErrorCheck( vkBeginCommandBuffer( command_buffer, &begin_info ) );
+		auto begun = BenchmarkClock::now();
+		vkCmdSetViewport( command_buffer, 0, 1, &viewport );
+		auto recorded = BenchmarkClock::now();
+		vkResultErrorCheck( vkEndCommandBuffer( command_buffer ) );
+		auto ended = BenchmarkClock::now();
+
+		if( i >= _settings.warm_up ) {
+			begin_samples.push_back( ElapsedNs( start, begun ) );
+			command_samples.push_back( ElapsedNs( begun, recorded ) );
+			end_samples.push_back( ElapsedNs( recorded, ended ) );
+		}
+	}
+
+	// Back to what the other measurements submit
+	_RecordMinimal( command_buffer );
+
+	_AddResult( "command_buffer_begin", begin_samples );
+	_AddResult( "cmd_set_viewport", command_samples );
+	_AddResult( "command_buffer_end", end_samples );
+}
+
+void SubmitBenchmark::_MeasureSubmits()
+{
+	std::vector<VkSubmitInfo> submit_infos( _settings.max_batch );
+	for( uint32_t i = 0; i < _settings.max_batch; i++ ) {
+		submit_infos[i] = {};
+		submit_infos[i].sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submit_infos[i].commandBufferCount = 1;
+		submit_infos[i].pCommandBuffers = &_command_buffers[i];
+	}
+
+	std::vector<double> samples;
+	for( uint32_t batch = 1; batch <= _settings.max_batch; batch *= 2 ) {
+		samples.clear();
+
+		// Drained after every call, so each one finds the queue in the same state
+		for( uint32_t i = 0; i < _settings.warm_up + _settings.samples; i++ ) {
+			auto start = BenchmarkClock::now();
+			_Submit( batch, submit_infos.data(), VK_NULL_HANDLE );
+			auto end = BenchmarkClock::now();
+			vkResultErrorCheck( vkQueueWaitIdle( _queue ) );
+
+			if( i >= _settings.warm_up ) {
+				samples.push_back( ElapsedNs( start, end ) );
+			}
+		}
+
+		_AddResult( "queue_submit_x" + std::to_string( batch ), samples );
+	}
+}
+
+void SubmitBenchmark::_MeasureFenceWake()
+{
+	VkDevice device = _renderer->getDevice();
+
+	VkSubmitInfo submit_info {};
+	submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submit_info.commandBufferCount = 1;
+	submit_info.pCommandBuffers = &_command_buffers[0];
+
+	// The observer polls the fence while the main thread blocks on it. Polling sees the signal about as soon as the
+	// driver makes it visible, the difference to the waiter waking up is the wake latency
+	std::atomic<uint32_t> armed( 0 );
+	std::atomic<uint32_t> observed( 0 );
+	std::atomic<int64_t> observed_time( 0 );
+	std::atomic<bool> stop( false );
+
+	std::thread observer( [&]() {
+		uint32_t last = 0;
+		while( !stop.load( std::memory_order_acquire ) ) {
+			uint32_t sample = armed.load( std::memory_order_acquire );
+			if( sample == last ) {
+				std::this_thread::yield();
+				continue;
+			}
+
+			// Anything but VK_NOT_READY ends the poll, a lost device would never signal
+			while( vkGetFenceStatus( device, _fence ) == VK_NOT_READY ) {
+			}
+			observed_time.store( BenchmarkClock::now().time_since_epoch().count(), std::memory_order_relaxed );
+			observed.store( sample, std::memory_order_release );
+			last = sample;
+		}
+	} );
+
+	std::vector<double> round_trip_samples;
+	std::vector<double> wake_samples;
+
+	for( uint32_t i = 0; i < _settings.warm_up + _settings.samples; i++ ) {
+		uint32_t sample = i + 1;
+
+		auto start = BenchmarkClock::now();
+		_Submit( 1, &submit_info, _fence );
+
+		// The fence is externally synchronized for vkQueueSubmit, the observer may only touch it once that returned
+		armed.store( sample, std::memory_order_release );
+		vkResultErrorCheck( vkWaitForFences( device, 1, &_fence, VK_TRUE, UINT64_MAX ) );
+		auto woken = BenchmarkClock::now();
+
+		while( observed.load( std::memory_order_acquire ) != sample ) {
+			std::this_thread::yield();
+		}
+		BenchmarkClock::time_point signaled( BenchmarkClock::duration( observed_time.load( std::memory_order_relaxed ) ) );
+
+		// Only reset once the observer is done with the fence
+		vkResultErrorCheck( vkResetFences( device, 1, &_fence ) );
+
+		if( i >= _settings.warm_up ) {
+			round_trip_samples.push_back( ElapsedNs( start, woken ) );
+			wake_samples.push_back( std::max( ElapsedNs( signaled, woken ), 0.0 ) );
+		}
+	}
+
+	stop.store( true, std::memory_order_release );
+	observer.join();
+
+	_AddResult( "fence_submit_to_wake", round_trip_samples );
+	_AddResult( "fence_signal_to_wake", wake_samples );
+}
+
+void SubmitBenchmark::_MeasureSemaphoreChains()
+{
+	VkPipelineStageFlags wait_stage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+	std::vector<VkSubmitInfo> submit_infos( _settings.max_chain );
+	std::vector<double> samples;
+
+	for( uint32_t length = 1; length <= _settings.max_chain; length *= 2 ) {
+		// Like the semaphore test: each submit info waits on the one before, the last signals the fence
+		for( uint32_t i = 0; i < length; i++ ) {
+			submit_infos[i] = {};
+			submit_infos[i].sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+			submit_infos[i].commandBufferCount = 1;
+			submit_infos[i].pCommandBuffers = &_command_buffers[i];
+			if( i > 0 ) {
+				submit_infos[i].waitSemaphoreCount = 1;
+				submit_infos[i].pWaitSemaphores = &_semaphores[i - 1];
+				submit_infos[i].pWaitDstStageMask = &wait_stage;
+			}
+			if( i + 1 < length ) {
+				submit_infos[i].signalSemaphoreCount = 1;
+				submit_infos[i].pSignalSemaphores = &_semaphores[i];
+			}
+		}
+
+		samples.clear();
+		for( uint32_t i = 0; i < _settings.warm_up + _settings.samples; i++ ) {
+			auto start = BenchmarkClock::now();
+			_Submit( length, submit_infos.data(), _fence );
+			_WaitAndResetFence();
+			auto end = BenchmarkClock::now();
+
+			if( i >= _settings.warm_up ) {
+				samples.push_back( ElapsedNs( start, end ) );
+			}
+		}
+
+		_AddResult( "semaphore_chain_" + std::to_string( length ), samples );
+	}
+}
+
+void SubmitBenchmark::_MeasureBarriers()
+{
+	VkDevice device = _renderer->getDevice();
+	uint32_t barrier_count = _settings.barriers_per_buffer;
+
+	VkMemoryBarrier memory_barrier {};
+	memory_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	memory_barrier.srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT;
+	memory_barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+
+	VkCommandBufferBeginInfo begin_info {};
+	begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+
+	// GPU cost needs timestamps on the graphics queue
+	uint32_t family_count = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties( _renderer->getPhysicalDevice(), &family_count, nullptr );
+	std::vector<VkQueueFamilyProperties> family_properties( family_count );
+	vkGetPhysicalDeviceQueueFamilyProperties( _renderer->getPhysicalDevice(), &family_count, family_properties.data() );
+	bool timestamps_supported = family_properties[_renderer->getGraphicsFamilyIndex()].timestampValidBits > 0;
+
+	VkQueryPool query_pool = VK_NULL_HANDLE;
+	if( timestamps_supported ) {
+		VkQueryPoolCreateInfo query_pool_info {};
+		query_pool_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		query_pool_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+		query_pool_info.queryCount = 4;
+		vkResultErrorCheck( vkCreateQueryPool( device, &query_pool_info, _renderer->getAllocationCallbacks(), &query_pool ) );
+	}
+
+	// Buffer 0 brackets nothing with timestamps, buffer 1 the barriers
+	std::vector<double> record_samples;
+	std::vector<double> gpu_samples;
+	double timestamp_period = _renderer->getPhysicalDeviceProperties().limits.timestampPeriod;
+
+	for( uint32_t i = 0; i < _settings.warm_up + _settings.samples; i++ ) {
+		for( uint32_t b = 0; b < 2; b++ ) {
+			VkCommandBuffer command_buffer = _command_buffers[b];
+			vkResultErrorCheck( vkResetCommandBuffer( command_buffer, 0 ) );
+			vkResultErrorCheck( vkBeginCommandBuffer( command_buffer, &begin_info ) );
+
+			if( timestamps_supported ) {
+				vkCmdResetQueryPool( command_buffer, query_pool, b * 2, 2 );
+				vkCmdWriteTimestamp( command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, query_pool, b * 2 );
+			}
+
+			if( b == 1 ) {
+				auto start = BenchmarkClock::now();
+				for( uint32_t n = 0; n < barrier_count; n++ ) {
+					vkCmdPipelineBarrier( command_buffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 1, &memory_barrier, 0, nullptr, 0, nullptr );
+				}
+				auto end = BenchmarkClock::now();
+
+				if( i >= _settings.warm_up ) {
+					record_samples.push_back( ElapsedNs( start, end ) / barrier_count );
+				}
+			}
+
+			if( timestamps_supported ) {
+				vkCmdWriteTimestamp( command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, query_pool, b * 2 + 1 );
+			}
+			vkResultErrorCheck( vkEndCommandBuffer( command_buffer ) );
+		}
+
+		if( timestamps_supported ) {
+			VkSubmitInfo submit_info {};
+			submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+			submit_info.commandBufferCount = 2;
+			submit_info.pCommandBuffers = _command_buffers.data();
+			_Submit( 1, &submit_info, _fence );
+			_WaitAndResetFence();
+
+			uint64_t timestamps[4] {};
+			vkResultErrorCheck( vkGetQueryPoolResults( device, query_pool, 0, 4, sizeof( timestamps ), timestamps, sizeof( uint64_t ), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT ) );
+
+			// Signed, timestamp noise can make a cheap barrier come out below the empty bracket
+			double empty_ns = double( int64_t( timestamps[1] - timestamps[0] ) ) * timestamp_period;
+			double barriers_ns = double( int64_t( timestamps[3] - timestamps[2] ) ) * timestamp_period;
+			if( i >= _settings.warm_up ) {
+				gpu_samples.push_back( ( barriers_ns - empty_ns ) / barrier_count );
+			}
+		}
+	}
+
+	if( query_pool != VK_NULL_HANDLE ) {
+		vkDestroyQueryPool( device, query_pool, _renderer->getAllocationCallbacks() );
+	}
+
+	_RecordMinimal( _command_buffers[0] );
+	_RecordMinimal( _command_buffers[1] );
+
+	_AddResult( "barrier_record", record_samples );
+	if( timestamps_supported ) {
+		_AddResult( "barrier_gpu", gpu_samples );
+	}
+	else {
+		std::cout << "No timestamps on the graphics queue, barrier_gpu skipped" << std::endl;
+	}
+}
+
+void SubmitBenchmark::_RecordMinimal( VkCommandBuffer command_buffer )
+{
+	vkResultErrorCheck( vkResetCommandBuffer( command_buffer, 0 ) );
+
+	VkCommandBufferBeginInfo begin_info {};
+	begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	vkResultErrorCheck( vkBeginCommandBuffer( command_buffer, &begin_info ) );
+
+	VkViewport viewport {};
+	viewport.width = 512;
+	viewport.height = 512;
+	viewport.maxDepth = 1.0f;
+	vkCmdSetViewport( command_buffer, 0, 1, &viewport );
+
+	vkResultErrorCheck( vkEndCommandBuffer( command_buffer ) );
+}
+
+void SubmitBenchmark::_Submit( uint32_t count, const VkSubmitInfo* submit_infos, VkFence fence )
+{
+	vkResultErrorCheck( vkQueueSubmit( _queue, count, submit_infos, fence ) );
+}
+
+void SubmitBenchmark::_WaitAndResetFence()
+{
+	vkResultErrorCheck( vkWaitForFences( _renderer->getDevice(), 1, &_fence, VK_TRUE, UINT64_MAX ) );
+	vkResultErrorCheck( vkResetFences( _renderer->getDevice(), 1, &_fence ) );
+}
+
+void SubmitBenchmark::_AddResult( const std::string& name, std::vector<double>& samples )
+{
+	SubmitBenchmarkResult result {};
+	result.name = name;
+	result.samples = uint32_t( samples.size() );
+
+	if( !samples.empty() ) {
+		std::sort( samples.begin(), samples.end() );
+
+		double total = 0.0;
+		for( auto i : samples ) {
+			total += i;
+		}
+
+		result.min = samples.front();
+		result.p50 = Percentile( samples, 0.5 );
+		result.p90 = Percentile( samples, 0.9 );
+		result.p99 = Percentile( samples, 0.99 );
+		result.max = samples.back();
+		result.mean = total / samples.size();
+	}
+
+	_results.push_back( result );
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include "Platform.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class Renderer;
+
+struct SubmitBenchmarkSettings
+{
+	// Per measurement, after warm_up discarded runs
+	uint32_t samples = 1000;
+	uint32_t warm_up = 50;
+
+	// Submit infos per vkQueueSubmit and semaphore chain lengths double from 1 up to these
+	uint32_t max_batch = 32;
+	uint32_t max_chain = 16;
+
+	uint32_t barriers_per_buffer = 256;
+};
+
+struct SubmitBenchmarkResult
+{
+	std::string name;
+	uint32_t samples;
+
+	// Nanoseconds
+	double min;
+	double p50;
+	double p90;
+	double p99;
+	double max;
+	double mean;
+};
+
+// Microbenchmarks of the submission path, built from the command pool tests in main.cpp. Every measurement repeats
+// one primitive and reports the distribution of its cost:
+//
+//   command_pool_create/destroy/reset    with one recorded command buffer for the reset
+//   command_buffer_begin/end, cmd_set_viewport
+//   queue_submit_xN                      one vkQueueSubmit of N submit infos, the queue drained in between
+//   fence_submit_to_wake                 submitting an empty command buffer until vkWaitForFences returns
+//   fence_signal_to_wake                 from a second thread polling the fence seeing it signaled until the waiter
+//                                        wakes, the part of the round trip spent getting the waiter running again
+//   semaphore_chain_N                    N submit infos each waiting on the previous one's semaphore, to the fence
+//   barrier_record                       CPU cost of recording one full pipeline barrier
+//   barrier_gpu                          GPU cost of one, from timestamps around barriers_per_buffer of them
+//
+// Nothing here needs a window, so it runs headless, on software implementations too. Calls go straight to the
+// driver, not through CommandCapture, with the queue taken from the renderer's submission queue during Run().
+class SubmitBenchmark
+{
+public:
+	SubmitBenchmark( Renderer* r, const SubmitBenchmarkSettings& settings = SubmitBenchmarkSettings() );
+	~SubmitBenchmark();
+
+	void Run();
+
+	const std::vector<SubmitBenchmarkResult>& getResults() const;
+
+	void PrintResults() const;
+	bool WriteCsv( const std::string& path ) const;
+
+	// Reads a CSV written by WriteCsv() and prints every result whose p50 is more than tolerance times the
+	// baseline's. Returns the number of those, -1 if the baseline can't be read
+	int CompareWithBaseline( const std::string& path, double tolerance ) const;
+
+private:
+	void _MeasureCommandPools();
+	void _MeasureRecording();
+	void _MeasureSubmits();
+	void _MeasureFenceWake();
+	void _MeasureSemaphoreChains();
+	void _MeasureBarriers();
+
+	// Begin, one viewport, end, like the tests' command buffers
+	void _RecordMinimal( VkCommandBuffer command_buffer );
+	void _Submit( uint32_t count, const VkSubmitInfo* submit_infos, VkFence fence );
+	void _WaitAndResetFence();
+
+	// Sorts samples
+	void _AddResult( const std::string& name, std::vector<double>& samples );
+
+	Renderer* _renderer = nullptr;
+	SubmitBenchmarkSettings _settings;
+	VkQueue _queue = VK_NULL_HANDLE;		// acquired during Run()
+
+	VkCommandPool _command_pool = VK_NULL_HANDLE;
+	std::vector<VkCommandBuffer> _command_buffers;		// recorded with _RecordMinimal()
+	std::vector<VkSemaphore> _semaphores;
+	VkFence _fence = VK_NULL_HANDLE;
+
+	std::vector<SubmitBenchmarkResult> _results;
+};
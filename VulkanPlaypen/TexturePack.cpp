@@ -0,0 +1,208 @@
+#include "TexturePack.h"
+
+#include <algorithm>
+#include <cstring>
+
+static uint64_t AlignTexturePackOffset( uint64_t offset )
+{
+	return ( offset + TEXTURE_PACK_DATA_ALIGNMENT - 1 ) & ~uint64_t( TEXTURE_PACK_DATA_ALIGNMENT - 1 );
+}
+
+TexturePack::TexturePack()
+{
+}
+
+
+TexturePack::~TexturePack()
+{
+	Close();
+}
+
+bool TexturePack::Open( const std::string& path )
+{
+	Close();
+
+	if( !_file.OpenRead( path ) || _file.getSize() < sizeof( TexturePackHeader ) ) {
+		Close();
+		return false;
+	}
+
+	const uint8_t* base = _file.getData();
+	_header = reinterpret_cast<const TexturePackHeader*>( base );
+
+	// Sizes come from the file, so every check below is written to not overflow on corrupt values
+	uint64_t file_size = _file.getSize();
+	uint64_t tables_size = sizeof( TexturePackHeader ) + uint64_t( _header->texture_count ) * sizeof( TexturePackTexture ) + uint64_t( _header->mip_count ) * sizeof( TexturePackMip );
+
+	if( _header->magic != TEXTURE_PACK_MAGIC || _header->version != TEXTURE_PACK_VERSION ||
+		tables_size > _header->data_offset || _header->data_size > file_size || _header->data_offset > file_size - _header->data_size ) {
+		Close();
+		return false;
+	}
+
+	_textures = reinterpret_cast<const TexturePackTexture*>( base + sizeof( TexturePackHeader ) );
+	_mips = reinterpret_cast<const TexturePackMip*>( _textures + _header->texture_count );
+	_data = base + _header->data_offset;
+
+	// Users index mips and mip data without further checks
+	for( uint32_t i = 0; i < _header->texture_count; i++ ) {
+		const TexturePackTexture& texture = _textures[i];
+		if( texture.mip_count == 0 || uint64_t( texture.first_mip ) + texture.mip_count > _header->mip_count ) {
+			Close();
+			return false;
+		}
+
+		for( uint32_t mip = 0; mip < texture.mip_count; mip++ ) {
+			const TexturePackMip& pack_mip = _mips[texture.first_mip + mip];
+			if( pack_mip.size > _header->data_size || pack_mip.offset > _header->data_size - pack_mip.size ) {
+				Close();
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+void TexturePack::Close()
+{
+	_file.Close();
+	_header = nullptr;
+	_textures = nullptr;
+	_mips = nullptr;
+	_data = nullptr;
+}
+
+uint32_t TexturePack::getTextureCount() const
+{
+	return _header != nullptr ? _header->texture_count : 0;
+}
+
+const TexturePackTexture& TexturePack::getTexture( uint32_t texture ) const
+{
+	return _textures[texture];
+}
+
+const TexturePackMip& TexturePack::getMip( uint32_t texture, uint32_t mip ) const
+{
+	return _mips[_textures[texture].first_mip + mip];
+}
+
+const uint8_t* TexturePack::getMipData( uint32_t texture, uint32_t mip ) const
+{
+	return _data + getMip( texture, mip ).offset;
+}
+
+uint32_t TexturePack::FindTexture( const std::string& name ) const
+{
+	for( uint32_t i = 0; i < getTextureCount(); i++ ) {
+		if( std::strncmp( _textures[i].name, name.c_str(), TEXTURE_PACK_NAME_LENGTH ) == 0 ) {
+			return i;
+		}
+	}
+
+	return UINT32_MAX;
+}
+
+void TexturePackWriter::AddTexture( const std::string& name, VkFormat format, uint32_t width, uint32_t height, const std::vector<std::vector<uint8_t>>& mips )
+{
+	PendingTexture pending {};
+	std::strncpy( pending.texture.name, name.c_str(), TEXTURE_PACK_NAME_LENGTH - 1 );
+	pending.texture.format = format;
+	pending.texture.width = width;
+	pending.texture.height = height;
+	pending.texture.mip_count = uint32_t( mips.size() );
+	pending.mips = mips;
+
+	_textures.push_back( pending );
+}
+
+bool TexturePackWriter::Write( const std::string& path ) const
+{
+	TexturePackHeader header {};
+	header.magic = TEXTURE_PACK_MAGIC;
+	header.version = TEXTURE_PACK_VERSION;
+	header.texture_count = uint32_t( _textures.size() );
+
+	std::vector<TexturePackTexture> textures;
+	std::vector<TexturePackMip> mips;
+
+	uint64_t data_size = 0;
+	for( auto &i : _textures ) {
+		TexturePackTexture texture = i.texture;
+		texture.first_mip = uint32_t( mips.size() );
+
+		for( uint32_t level = 0; level < texture.mip_count; level++ ) {
+			TexturePackMip mip {};
+			mip.offset = data_size;
+			mip.size = i.mips[level].size();
+			mip.width = std::max( 1u, texture.width >> level );
+			mip.height = std::max( 1u, texture.height >> level );
+			mips.push_back( mip );
+
+			data_size = AlignTexturePackOffset( data_size + mip.size );
+		}
+
+		textures.push_back( texture );
+	}
+
+	header.mip_count = uint32_t( mips.size() );
+	header.data_offset = AlignTexturePackOffset( sizeof( TexturePackHeader ) + textures.size() * sizeof( TexturePackTexture ) + mips.size() * sizeof( TexturePackMip ) );
+	header.data_size = data_size;
+
+	MappedFile file;
+	if( !file.OpenWrite( path, header.data_offset + header.data_size ) ) {
+		return false;
+	}
+
+	uint8_t* base = file.getData();
+	std::memset( base, 0, size_t( header.data_offset ) );
+	std::memcpy( base, &header, sizeof( header ) );
+	std::memcpy( base + sizeof( header ), textures.data(), textures.size() * sizeof( TexturePackTexture ) );
+	std::memcpy( base + sizeof( header ) + textures.size() * sizeof( TexturePackTexture ), mips.data(), mips.size() * sizeof( TexturePackMip ) );
+
+	for( size_t t = 0; t < _textures.size(); t++ ) {
+		for( uint32_t level = 0; level < textures[t].mip_count; level++ ) {
+			const TexturePackMip& mip = mips[textures[t].first_mip + level];
+			std::memcpy( base + header.data_offset + mip.offset, _textures[t].mips[level].data(), size_t( mip.size ) );
+		}
+	}
+
+	file.Close();
+	return true;
+}
+
+std::vector<std::vector<uint8_t>> GenerateMipChainRGBA8( uint32_t width, uint32_t height, const std::vector<uint8_t>& pixels )
+{
+	std::vector<std::vector<uint8_t>> mips;
+	mips.push_back( pixels );
+
+	while( width > 1 || height > 1 ) {
+		uint32_t mip_width = std::max( 1u, width / 2 );
+		uint32_t mip_height = std::max( 1u, height / 2 );
+
+		const std::vector<uint8_t>& src = mips.back();
+		std::vector<uint8_t> dst( size_t( mip_width ) * mip_height * 4 );
+
+		for( uint32_t y = 0; y < mip_height; y++ ) {
+			for( uint32_t x = 0; x < mip_width; x++ ) {
+				uint32_t x0 = std::min( x * 2, width - 1 );
+				uint32_t x1 = std::min( x * 2 + 1, width - 1 );
+				uint32_t y0 = std::min( y * 2, height - 1 );
+				uint32_t y1 = std::min( y * 2 + 1, height - 1 );
+
+				for( uint32_t c = 0; c < 4; c++ ) {
+					uint32_t sum = src[( size_t( y0 ) * width + x0 ) * 4 + c] + src[( size_t( y0 ) * width + x1 ) * 4 + c] +
+						src[( size_t( y1 ) * width + x0 ) * 4 + c] + src[( size_t( y1 ) * width + x1 ) * 4 + c];
+					dst[( size_t( y ) * mip_width + x ) * 4 + c] = uint8_t( ( sum + 2 ) / 4 );
+				}
+			}
+		}
+
+		mips.push_back( std::move( dst ) );
+		width = mip_width;
+		height = mip_height;
+	}
+
+	return mips;
+}
\ No newline at end of file
@@ -0,0 +1,96 @@
+#pragma once
+
+#include "Platform.h"
+#include "MappedFile.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Packed mip-chain asset format
+//
+// A pack is a TexturePackHeader, followed by texture_count TexturePackTexture entries, followed by the
+// TexturePackMip table, followed by the texel data. Mip data is stored largest first, and every mip starts on a
+// TEXTURE_PACK_DATA_ALIGNMENT boundary so it can be copied straight out of the mapped file into a staging buffer.
+
+#define TEXTURE_PACK_MAGIC           0x4B504D54 // "TMPK"
+#define TEXTURE_PACK_VERSION         1
+#define TEXTURE_PACK_NAME_LENGTH     64
+#define TEXTURE_PACK_DATA_ALIGNMENT  256
+
+struct TexturePackHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t texture_count;
+	uint32_t mip_count;
+	uint64_t data_offset;
+	uint64_t data_size;
+};
+
+struct TexturePackTexture
+{
+	char name[TEXTURE_PACK_NAME_LENGTH];
+	uint32_t format;
+	uint32_t width;
+	uint32_t height;
+	uint32_t mip_count;
+	uint32_t first_mip;		// index into the mip table
+	uint32_t reserved;
+};
+
+struct TexturePackMip
+{
+	uint64_t offset;		// relative to data_offset
+	uint64_t size;
+	uint32_t width;
+	uint32_t height;
+};
+
+class TexturePack
+{
+public:
+	TexturePack();
+	~TexturePack();
+
+	bool Open( const std::string& path );
+	void Close();
+
+	uint32_t getTextureCount() const;
+	const TexturePackTexture& getTexture( uint32_t texture ) const;
+	const TexturePackMip& getMip( uint32_t texture, uint32_t mip ) const;
+	const uint8_t* getMipData( uint32_t texture, uint32_t mip ) const;
+
+	// Returns UINT32_MAX if there's no texture with that name
+	uint32_t FindTexture( const std::string& name ) const;
+
+private:
+	MappedFile _file;
+
+	const TexturePackHeader* _header = nullptr;
+	const TexturePackTexture* _textures = nullptr;
+	const TexturePackMip* _mips = nullptr;
+	const uint8_t* _data = nullptr;
+};
+
+// Offline side of the format, used by tools to assemble packs
+class TexturePackWriter
+{
+public:
+	// mips holds the texel data for every level, largest first
+	void AddTexture( const std::string& name, VkFormat format, uint32_t width, uint32_t height, const std::vector<std::vector<uint8_t>>& mips );
+
+	bool Write( const std::string& path ) const;
+
+private:
+	struct PendingTexture
+	{
+		TexturePackTexture texture;
+		std::vector<std::vector<uint8_t>> mips;
+	};
+
+	std::vector<PendingTexture> _textures;
+};
+
+// Box filters an RGBA8 image down to 1x1, returning every level including the source
+std::vector<std::vector<uint8_t>> GenerateMipChainRGBA8( uint32_t width, uint32_t height, const std::vector<uint8_t>& pixels );
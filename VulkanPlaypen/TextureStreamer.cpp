@@ -0,0 +1,631 @@
+#include "TextureStreamer.h"
+#include "Renderer.h"
+#include "RendererUtils.h"
+#include "DeletionQueue.h"
+#include "SubmissionQueue.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+
+TextureStreamer::TextureStreamer( Renderer* r, const TextureStreamerSettings& settings )
+{
+	_renderer = r;
+	_settings = settings;
+
+	_InitStaging();
+}
+
+
+TextureStreamer::~TextureStreamer()
+{
+	Unload();
+	_DeInitStaging();
+}
+
+bool TextureStreamer::Load( const std::string& pack_path )
+{
+	Unload();
+
+	if( !_pack.Open( pack_path ) ) {
+		std::cout << "Failed to open texture pack " << pack_path << std::endl;
+		return false;
+	}
+
+	// Budget against the heap device local images come from
+	{
+		const VkPhysicalDeviceMemoryProperties& memory_properties = _renderer->getPhysicalDeviceMemoryProperties();
+		uint32_t memory_type_index = FindMemoryTypeIndex( memory_properties, UINT32_MAX, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT );
+		_heap_index = memory_type_index != UINT32_MAX ? memory_properties.memoryTypes[memory_type_index].heapIndex : 0;
+	}
+
+	_textures.resize( _pack.getTextureCount() );
+
+	for( uint32_t i = 0; i < _pack.getTextureCount(); i++ ) {
+		const TexturePackTexture& pack_texture = _pack.getTexture( i );
+		StreamedTexture& texture = _textures[i];
+
+		texture.floor_mip = pack_texture.mip_count - 1;
+		for( uint32_t mip = 0; mip < pack_texture.mip_count; mip++ ) {
+			const TexturePackMip& pack_mip = _pack.getMip( i, mip );
+			if( std::max( pack_mip.width, pack_mip.height ) <= _settings.resident_mip_size ) {
+				texture.floor_mip = mip;
+				break;
+			}
+		}
+
+		// Nothing is resident yet
+		texture.resident_mip = pack_texture.mip_count;
+		texture.requested_mip = pack_texture.mip_count;
+	}
+
+	// Upload the always resident mips, in as many batches as the staging buffer needs
+	for( uint32_t i = 0; i < _pack.getTextureCount(); i++ ) {
+		if( _QueueReallocation( i, _textures[i].floor_mip ) ) {
+			continue;
+		}
+
+		if( _batch.empty() ) {
+			std::cout << "Texture " << _pack.getTexture( i ).name << " resident mips don't fit in the staging buffer" << std::endl;
+			Unload();
+			return false;
+		}
+
+		_SubmitBatch();
+		_RetireBatch( true );
+		i--;
+	}
+
+	_SubmitBatch();
+	_RetireBatch( true );
+
+	// The always resident set isn't streaming traffic
+	_stats = TextureStreamerStats();
+	for( auto &i : _textures ) {
+		_stats.resident_bytes += i.memory_size;
+	}
+
+	return true;
+}
+
+void TextureStreamer::Unload()
+{
+	_RetireBatch( true );
+
+	// Frames still in flight may sample these
+	DeletionQueue* deletion_queue = _renderer->getDeletionQueue();
+	for( auto &i : _textures ) {
+		deletion_queue->DestroyImageView( i.view );
+		deletion_queue->DestroyImage( i.image );
+		deletion_queue->FreeMemory( i.memory );
+	}
+	_textures.clear();
+
+	_pack.Close();
+	_stats = TextureStreamerStats();
+}
+
+void TextureStreamer::RequestMip( uint32_t texture, uint32_t mip )
+{
+	StreamedTexture& t = _textures[texture];
+	t.requested_mip = std::min( t.requested_mip, mip );
+	t.last_used_frame = _frame;
+}
+
+void TextureStreamer::ReportScreenCoverage( uint32_t texture, float screen_width, float screen_height )
+{
+	const TexturePackTexture& pack_texture = _pack.getTexture( texture );
+
+	// Pick the mip whose texel density is closest to one texel per covered pixel
+	float ratio = std::max( pack_texture.width / std::max( screen_width, 1.0f ), pack_texture.height / std::max( screen_height, 1.0f ) );
+	float mip = ratio > 1.0f ? std::floor( std::log2( ratio ) ) : 0.0f;
+
+	RequestMip( texture, std::min( uint32_t( mip ), pack_texture.mip_count - 1 ) );
+}
+
+void TextureStreamer::Update()
+{
+	_stats.evictions_last_frame = 0;
+
+	auto now = std::chrono::high_resolution_clock::now();
+
+	for( auto &i : _textures ) {
+		if( i.requested_mip < i.resident_mip && !i.request_timed ) {
+			i.request_timed = true;
+			i.request_time = now;
+		}
+	}
+
+	_RetireBatch( false );
+
+	if( !_batch_in_flight ) {
+		_UpdateBudget();
+
+		std::vector<uint32_t> candidates;
+		for( uint32_t i = 0; i < _textures.size(); i++ ) {
+			if( _textures[i].requested_mip < _textures[i].resident_mip && !_textures[i].pending ) {
+				candidates.push_back( i );
+			}
+		}
+
+		// Biggest quality deficit first
+		std::sort( candidates.begin(), candidates.end(), [this]( uint32_t a, uint32_t b ) {
+			return _textures[a].resident_mip - _textures[a].requested_mip > _textures[b].resident_mip - _textures[b].requested_mip;
+		} );
+
+		VkDeviceSize projected_bytes = _stats.resident_bytes;
+
+		for( auto i : candidates ) {
+			StreamedTexture& texture = _textures[i];
+			VkDeviceSize growth = _EstimateBytes( i, texture.requested_mip ) - _EstimateBytes( i, texture.resident_mip );
+
+			while( !_Fits( projected_bytes + growth ) ) {
+				uint32_t victim = _FindEvictionCandidate( i );
+				if( victim == UINT32_MAX ) {
+					break;
+				}
+
+				StreamedTexture& victim_texture = _textures[victim];
+				uint32_t victim_mip = victim_texture.last_used_frame == _frame ? victim_texture.requested_mip : victim_texture.floor_mip;
+				VkDeviceSize freed = _EstimateBytes( victim, victim_texture.resident_mip ) - _EstimateBytes( victim, victim_mip );
+
+				if( !_QueueReallocation( victim, victim_mip ) ) {
+					break;
+				}
+
+				projected_bytes -= std::min( projected_bytes, freed );
+				_stats.evicted_bytes += freed;
+				_stats.eviction_count++;
+				_stats.evictions_last_frame++;
+			}
+
+			if( !_Fits( projected_bytes + growth ) ) {
+				continue;
+			}
+
+			// Out of staging space, the rest waits for the next batch
+			if( !_QueueReallocation( i, texture.requested_mip ) ) {
+				break;
+			}
+
+			projected_bytes += growth;
+		}
+
+		_SubmitBatch();
+	}
+
+	for( uint32_t i = 0; i < _textures.size(); i++ ) {
+		_textures[i].requested_mip = _pack.getTexture( i ).mip_count;
+	}
+
+	// Only now, the checks above treat last_used_frame == _frame as used this frame
+	_frame++;
+}
+
+VkImageView TextureStreamer::getImageView( uint32_t texture ) const
+{
+	return _textures[texture].view;
+}
+
+uint32_t TextureStreamer::getResidentMip( uint32_t texture ) const
+{
+	return _textures[texture].resident_mip;
+}
+
+const TexturePack& TextureStreamer::getPack() const
+{
+	return _pack;
+}
+
+const TextureStreamerStats& TextureStreamer::getStats() const
+{
+	return _stats;
+}
+
+void TextureStreamer::PrintStats() const
+{
+	const double mb = 1024.0 * 1024.0;
+	double latency_avg = _stats.stream_in_count > 0 ? _stats.stream_in_latency_total_ms / _stats.stream_in_count : 0.0;
+
+	std::cout << std::fixed << std::setprecision( 2 )
+		<< "Texture streaming: resident " << _stats.resident_bytes / mb << " MB of " << _stats.budget_bytes / mb << " MB budget"
+		<< ( _stats.budget_from_extension ? " (VK_EXT_memory_budget)" : " (heap size)" ) << std::endl
+		<< "  stream-ins " << _stats.stream_in_count << " (" << _stats.streamed_in_bytes / mb << " MB), latency avg " << latency_avg << " ms, max " << _stats.stream_in_latency_max_ms << " ms" << std::endl
+		<< "  evictions  " << _stats.eviction_count << " (" << _stats.evicted_bytes / mb << " MB), " << _stats.evictions_last_frame << " last frame" << std::endl;
+}
+
+void TextureStreamer::_InitStaging()
+{
+	VkDevice device = _renderer->getDevice();
+
+	_staging_alignment = std::max<VkDeviceSize>( 16, _renderer->getPhysicalDeviceProperties().limits.optimalBufferCopyOffsetAlignment );
+
+	VkBufferCreateInfo buffer_info {};
+	buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	buffer_info.size = _settings.staging_size;
+	buffer_info.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+	buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	vkResultErrorCheck( vkCreateBuffer( device, &buffer_info, _renderer->getAllocationCallbacks(), &_staging_buffer ) );
+	vkResultErrorCheck( AllocateBufferMemory( device, _renderer->getAllocationCallbacks(), _renderer->getPhysicalDeviceMemoryProperties(), _staging_buffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &_staging_memory ) );
+
+	// Staging stays mapped for the lifetime of the streamer
+	void* mapped = nullptr;
+	vkResultErrorCheck( vkMapMemory( device, _staging_memory, 0, VK_WHOLE_SIZE, 0, &mapped ) );
+	_staging_data = reinterpret_cast<uint8_t*>( mapped );
+
+	VkCommandPoolCreateInfo pool_info {};
+	pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	pool_info.queueFamilyIndex = _renderer->getGraphicsFamilyIndex();
+	pool_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT | VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+	vkResultErrorCheck( vkCreateCommandPool( device, &pool_info, _renderer->getAllocationCallbacks(), &_command_pool ) );
+
+	VkCommandBufferAllocateInfo command_buffer_info {};
+	command_buffer_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	command_buffer_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	command_buffer_info.commandPool = _command_pool;
+	command_buffer_info.commandBufferCount = 1;
+	vkResultErrorCheck( vkAllocateCommandBuffers( device, &command_buffer_info, &_command_buffer ) );
+
+	VkFenceCreateInfo fence_info {};
+	fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	vkResultErrorCheck( vkCreateFence( device, &fence_info, _renderer->getAllocationCallbacks(), &_fence ) );
+}
+
+void TextureStreamer::_DeInitStaging()
+{
+	VkDevice device = _renderer->getDevice();
+
+	vkDestroyFence( device, _fence, _renderer->getAllocationCallbacks() );
+	vkDestroyCommandPool( device, _command_pool, _renderer->getAllocationCallbacks() );
+
+	vkUnmapMemory( device, _staging_memory );
+	vkDestroyBuffer( device, _staging_buffer, _renderer->getAllocationCallbacks() );
+	vkFreeMemory( device, _staging_memory, _renderer->getAllocationCallbacks() );
+
+	_fence = VK_NULL_HANDLE;
+	_command_pool = VK_NULL_HANDLE;
+	_command_buffer = VK_NULL_HANDLE;
+	_staging_buffer = VK_NULL_HANDLE;
+	_staging_memory = VK_NULL_HANDLE;
+	_staging_data = nullptr;
+}
+
+void TextureStreamer::_UpdateBudget()
+{
+	VkDeviceSize heap_budgets[VK_MAX_MEMORY_HEAPS];
+	VkDeviceSize heap_usages[VK_MAX_MEMORY_HEAPS];
+	_stats.budget_from_extension = _renderer->QueryMemoryBudget( heap_budgets, heap_usages );
+
+	// Heap usage includes our own textures, which are exactly what the budget is meant to cover
+	VkDeviceSize other_usage = heap_usages[_heap_index] > _stats.resident_bytes ? heap_usages[_heap_index] - _stats.resident_bytes : 0;
+	VkDeviceSize available = heap_budgets[_heap_index] > other_usage ? heap_budgets[_heap_index] - other_usage : 0;
+
+	_stats.budget_bytes = VkDeviceSize( double( available ) * _settings.budget_fraction );
+	if( _settings.budget_limit != 0 ) {
+		_stats.budget_bytes = std::min( _stats.budget_bytes, _settings.budget_limit );
+	}
+}
+
+bool TextureStreamer::_Fits( VkDeviceSize projected_bytes ) const
+{
+	return projected_bytes <= _stats.budget_bytes;
+}
+
+uint32_t TextureStreamer::_FindEvictionCandidate( uint32_t requester ) const
+{
+	// Least recently used texture holding mips above its floor. Textures used this frame only qualify if they hold
+	// finer mips than were asked for, and then only give up those
+	uint32_t candidate = UINT32_MAX;
+	uint64_t candidate_frame = UINT64_MAX;
+
+	for( uint32_t i = 0; i < _textures.size(); i++ ) {
+		const StreamedTexture& texture = _textures[i];
+		if( i == requester || texture.pending || texture.resident_mip >= texture.floor_mip ) {
+			continue;
+		}
+
+		if( texture.last_used_frame == _frame && texture.requested_mip <= texture.resident_mip ) {
+			continue;
+		}
+
+		if( texture.last_used_frame < candidate_frame ) {
+			candidate = i;
+			candidate_frame = texture.last_used_frame;
+		}
+	}
+
+	return candidate;
+}
+
+VkDeviceSize TextureStreamer::_EstimateBytes( uint32_t texture, uint32_t first_mip ) const
+{
+	VkDeviceSize bytes = 0;
+	for( uint32_t mip = first_mip; mip < _pack.getTexture( texture ).mip_count; mip++ ) {
+		bytes += _pack.getMip( texture, mip ).size;
+	}
+	return bytes;
+}
+
+VkDeviceSize TextureStreamer::_StagingBytes( uint32_t texture, uint32_t first_mip, uint32_t end_mip ) const
+{
+	VkDeviceSize bytes = 0;
+	for( uint32_t mip = first_mip; mip < end_mip; mip++ ) {
+		bytes = ( bytes + _staging_alignment - 1 ) & ~( _staging_alignment - 1 );
+		bytes += _pack.getMip( texture, mip ).size;
+	}
+	return bytes;
+}
+
+bool TextureStreamer::_QueueReallocation( uint32_t texture, uint32_t new_mip )
+{
+	VkDevice device = _renderer->getDevice();
+	StreamedTexture& t = _textures[texture];
+	const TexturePackTexture& pack_texture = _pack.getTexture( texture );
+
+	// Only the mips that aren't already resident come from the pack
+	uint32_t upload_end = std::min( t.resident_mip, pack_texture.mip_count );
+	VkDeviceSize staging_offset = ( _staging_used + _staging_alignment - 1 ) & ~( _staging_alignment - 1 );
+	VkDeviceSize staging_bytes = new_mip < upload_end ? _StagingBytes( texture, new_mip, upload_end ) : 0;
+
+	if( staging_offset + staging_bytes > _settings.staging_size ) {
+		return false;
+	}
+
+	const TexturePackMip& base_mip = _pack.getMip( texture, new_mip );
+
+	Reallocation realloc {};
+	realloc.texture = texture;
+	realloc.new_mip = new_mip;
+	realloc.staging_offset = staging_offset;
+
+	VkImageCreateInfo image_info {};
+	image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	image_info.imageType = VK_IMAGE_TYPE_2D;
+	image_info.format = VkFormat( pack_texture.format );
+	image_info.extent.width = base_mip.width;
+	image_info.extent.height = base_mip.height;
+	image_info.extent.depth = 1;
+	image_info.mipLevels = pack_texture.mip_count - new_mip;
+	image_info.arrayLayers = 1;
+	image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+	image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+	image_info.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+	image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+	if( vkCreateImage( device, &image_info, _renderer->getAllocationCallbacks(), &realloc.image ) != VK_SUCCESS ) {
+		return false;
+	}
+
+	if( AllocateImageMemory( device, _renderer->getAllocationCallbacks(), _renderer->getPhysicalDeviceMemoryProperties(), realloc.image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &realloc.memory, &realloc.memory_size ) != VK_SUCCESS ) {
+		vkDestroyImage( device, realloc.image, _renderer->getAllocationCallbacks() );
+		return false;
+	}
+
+	VkImageViewCreateInfo view_info {};
+	view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	view_info.image = realloc.image;
+	view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	view_info.format = image_info.format;
+	view_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	view_info.subresourceRange.levelCount = image_info.mipLevels;
+	view_info.subresourceRange.layerCount = 1;
+	vkResultErrorCheck( vkCreateImageView( device, &view_info, _renderer->getAllocationCallbacks(), &realloc.view ) );
+
+	// Copy the new mips out of the mapped pack
+	VkDeviceSize offset = staging_offset;
+	for( uint32_t mip = new_mip; mip < upload_end; mip++ ) {
+		offset = ( offset + _staging_alignment - 1 ) & ~( _staging_alignment - 1 );
+		const TexturePackMip& pack_mip = _pack.getMip( texture, mip );
+		std::memcpy( _staging_data + offset, _pack.getMipData( texture, mip ), size_t( pack_mip.size ) );
+		offset += pack_mip.size;
+	}
+
+	_staging_used = staging_offset + staging_bytes;
+
+	t.pending = true;
+	_batch.push_back( realloc );
+	return true;
+}
+
+void TextureStreamer::_SubmitBatch()
+{
+	if( _batch.empty() ) {
+		return;
+	}
+
+	std::vector<VkImageMemoryBarrier> barriers;
+	std::vector<VkImageCopy> image_copies;
+	std::vector<VkBufferImageCopy> buffer_copies;
+
+	VkCommandBufferBeginInfo begin_info {};
+	begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	vkBeginCommandBuffer( _command_buffer, &begin_info );
+
+	// New images become copy destinations, the images they replace copy sources
+	for( auto &i : _batch ) {
+		const StreamedTexture& t = _textures[i.texture];
+
+		VkImageMemoryBarrier barrier {};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		barrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+		barrier.subresourceRange.layerCount = 1;
+
+		barrier.image = i.image;
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barriers.push_back( barrier );
+
+		if( t.image != VK_NULL_HANDLE ) {
+			barrier.image = t.image;
+			barrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+			barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+			barrier.oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+			barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+			barriers.push_back( barrier );
+		}
+	}
+
+	vkCmdPipelineBarrier( _command_buffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, uint32_t( barriers.size() ), barriers.data() );
+
+	for( auto &i : _batch ) {
+		const StreamedTexture& t = _textures[i.texture];
+		uint32_t mip_count = _pack.getTexture( i.texture ).mip_count;
+
+		// Mips that are already resident are copied on the GPU
+		image_copies.clear();
+		for( uint32_t mip = std::max( i.new_mip, t.resident_mip ); mip < mip_count && t.image != VK_NULL_HANDLE; mip++ ) {
+			const TexturePackMip& pack_mip = _pack.getMip( i.texture, mip );
+
+			VkImageCopy region {};
+			region.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			region.srcSubresource.mipLevel = mip - t.resident_mip;
+			region.srcSubresource.layerCount = 1;
+			region.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			region.dstSubresource.mipLevel = mip - i.new_mip;
+			region.dstSubresource.layerCount = 1;
+			region.extent.width = pack_mip.width;
+			region.extent.height = pack_mip.height;
+			region.extent.depth = 1;
+			image_copies.push_back( region );
+		}
+
+		if( !image_copies.empty() ) {
+			vkCmdCopyImage( _command_buffer, t.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, i.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, uint32_t( image_copies.size() ), image_copies.data() );
+		}
+
+		// The rest comes from staging
+		buffer_copies.clear();
+		VkDeviceSize offset = i.staging_offset;
+		for( uint32_t mip = i.new_mip; mip < std::min( t.resident_mip, mip_count ); mip++ ) {
+			const TexturePackMip& pack_mip = _pack.getMip( i.texture, mip );
+			offset = ( offset + _staging_alignment - 1 ) & ~( _staging_alignment - 1 );
+
+			VkBufferImageCopy region {};
+			region.bufferOffset = offset;
+			region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			region.imageSubresource.mipLevel = mip - i.new_mip;
+			region.imageSubresource.layerCount = 1;
+			region.imageExtent.width = pack_mip.width;
+			region.imageExtent.height = pack_mip.height;
+			region.imageExtent.depth = 1;
+			buffer_copies.push_back( region );
+
+			offset += pack_mip.size;
+		}
+
+		if( !buffer_copies.empty() ) {
+			vkCmdCopyBufferToImage( _command_buffer, _staging_buffer, i.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, uint32_t( buffer_copies.size() ), buffer_copies.data() );
+		}
+	}
+
+	// New images are ready for sampling. The images they replace go back too, frames recorded before the batch retires
+	// still sample them through getImageView()
+	barriers.clear();
+	for( auto &i : _batch ) {
+		const StreamedTexture& t = _textures[i.texture];
+
+		VkImageMemoryBarrier barrier {};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		barrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+		barrier.subresourceRange.layerCount = 1;
+		barrier.image = i.image;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		barriers.push_back( barrier );
+
+		if( t.image != VK_NULL_HANDLE ) {
+			barrier.image = t.image;
+			barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+			barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+			barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+			barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+			barriers.push_back( barrier );
+		}
+	}
+
+	vkCmdPipelineBarrier( _command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 0, nullptr, uint32_t( barriers.size() ), barriers.data() );
+
+	vkEndCommandBuffer( _command_buffer );
+
+	VkSubmitInfo submit_info {};
+	submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submit_info.commandBufferCount = 1;
+	submit_info.pCommandBuffers = &_command_buffer;
+	_renderer->getSubmissionQueue()->Submit( 1, &submit_info, _fence );
+
+	_batch_in_flight = true;
+}
+
+bool TextureStreamer::_RetireBatch( bool wait )
+{
+	if( !_batch_in_flight ) {
+		return true;
+	}
+
+	VkDevice device = _renderer->getDevice();
+
+	if( wait ) {
+		vkWaitForFences( device, 1, &_fence, VK_TRUE, UINT64_MAX );
+	}
+	else if( vkGetFenceStatus( device, _fence ) != VK_SUCCESS ) {
+		return false;
+	}
+
+	auto now = std::chrono::high_resolution_clock::now();
+
+	for( auto &i : _batch ) {
+		StreamedTexture& t = _textures[i.texture];
+
+		if( i.new_mip < t.resident_mip && t.image != VK_NULL_HANDLE ) {
+			_stats.stream_in_count++;
+			_stats.streamed_in_bytes += i.memory_size - std::min( i.memory_size, t.memory_size );
+
+			if( t.request_timed ) {
+				double latency = std::chrono::duration<double, std::milli>( now - t.request_time ).count();
+				_stats.stream_in_latency_total_ms += latency;
+				_stats.stream_in_latency_max_ms = std::max( _stats.stream_in_latency_max_ms, latency );
+			}
+		}
+
+		if( i.new_mip < t.resident_mip || t.image == VK_NULL_HANDLE ) {
+			t.request_timed = false;
+		}
+
+		// The copy is done with the old image, but frames still in flight may sample it
+		_renderer->getDeletionQueue()->DestroyImageView( t.view );
+		_renderer->getDeletionQueue()->DestroyImage( t.image );
+		_renderer->getDeletionQueue()->FreeMemory( t.memory );
+
+		_stats.resident_bytes = _stats.resident_bytes - t.memory_size + i.memory_size;
+
+		t.image = i.image;
+		t.memory = i.memory;
+		t.view = i.view;
+		t.memory_size = i.memory_size;
+		t.resident_mip = i.new_mip;
+		t.pending = false;
+	}
+
+	_batch.clear();
+	_staging_used = 0;
+	_batch_in_flight = false;
+
+	vkResetFences( device, 1, &_fence );
+	vkResetCommandBuffer( _command_buffer, 0 );
+
+	return true;
+}
\ No newline at end of file
@@ -0,0 +1,146 @@
+#pragma once
+
+#include "Platform.h"
+#include "TexturePack.h"
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+class Renderer;
+
+struct TextureStreamerSettings
+{
+	// Share of the device local heap budget (after other users of the heap) that streamed textures may occupy
+	float budget_fraction = 0.8f;
+
+	// Hard cap on streamed texture memory, 0 for no cap
+	VkDeviceSize budget_limit = 0;
+
+	// Host visible staging memory for uploads, which also limits how much is streamed in per batch
+	VkDeviceSize staging_size = 32 * 1024 * 1024;
+
+	// Mips whose largest dimension is at or below this size are always resident
+	uint32_t resident_mip_size = 64;
+};
+
+struct TextureStreamerStats
+{
+	VkDeviceSize resident_bytes = 0;
+	VkDeviceSize budget_bytes = 0;
+	bool budget_from_extension = false;
+
+	uint64_t streamed_in_bytes = 0;
+	uint64_t evicted_bytes = 0;
+	uint32_t stream_in_count = 0;
+	uint32_t eviction_count = 0;
+	uint32_t evictions_last_frame = 0;
+
+	double stream_in_latency_total_ms = 0.0;
+	double stream_in_latency_max_ms = 0.0;
+};
+
+// Streams the mip chains of a memory mapped TexturePack into device local images.
+//
+// Each texture keeps its low mips resident at all times. Higher mips are streamed in when usage feedback asks for
+// them and dropped again, least recently used first, when the streamed set would exceed the memory budget. The
+// resident mip range of a texture lives in a single VkImage, so changing it reallocates the image: retained mips are
+// copied over on the GPU and new mips are uploaded from the pack. All reallocations of a frame go into one batch,
+// and only one batch is in flight at a time.
+//
+// Image views change when a texture is reallocated, so fetch them with getImageView() every frame.
+class TextureStreamer
+{
+public:
+	TextureStreamer( Renderer* r, const TextureStreamerSettings& settings = TextureStreamerSettings() );
+	~TextureStreamer();
+
+	// Maps the pack and uploads the always-resident mips of every texture (blocking)
+	bool Load( const std::string& pack_path );
+	void Unload();
+
+	// Usage feedback, reset every Update(). The finest mip requested during the frame wins
+	void RequestMip( uint32_t texture, uint32_t mip );
+	void ReportScreenCoverage( uint32_t texture, float screen_width, float screen_height );
+
+	// Call once per frame: retires finished batches, applies the budget and kicks off new stream-ins
+	void Update();
+
+	VkImageView getImageView( uint32_t texture ) const;
+	// Views start at the resident mip, so they only cover mip_count - resident_mip levels
+	uint32_t getResidentMip( uint32_t texture ) const;
+	const TexturePack& getPack() const;
+
+	const TextureStreamerStats& getStats() const;
+	void PrintStats() const;
+
+private:
+	struct StreamedTexture
+	{
+		VkImage image = VK_NULL_HANDLE;
+		VkDeviceMemory memory = VK_NULL_HANDLE;
+		VkImageView view = VK_NULL_HANDLE;
+		VkDeviceSize memory_size = 0;
+
+		uint32_t resident_mip = 0;
+		uint32_t floor_mip = 0;				// first of the always resident mips
+		uint32_t requested_mip = 0;
+		uint64_t last_used_frame = 0;
+
+		bool pending = false;
+		bool request_timed = false;
+		std::chrono::high_resolution_clock::time_point request_time;
+	};
+
+	struct Reallocation
+	{
+		uint32_t texture;
+		uint32_t new_mip;
+
+		VkImage image;
+		VkDeviceMemory memory;
+		VkImageView view;
+		VkDeviceSize memory_size;
+
+		VkDeviceSize staging_offset;
+	};
+
+	void _InitStaging();
+	void _DeInitStaging();
+
+	void _UpdateBudget();
+
+	bool _Fits( VkDeviceSize projected_bytes ) const;
+	// Never returns requester, the texture the space is being made for
+	uint32_t _FindEvictionCandidate( uint32_t requester ) const;
+	VkDeviceSize _EstimateBytes( uint32_t texture, uint32_t first_mip ) const;
+	VkDeviceSize _StagingBytes( uint32_t texture, uint32_t first_mip, uint32_t end_mip ) const;
+
+	bool _QueueReallocation( uint32_t texture, uint32_t new_mip );
+	void _SubmitBatch();
+	bool _RetireBatch( bool wait );
+
+	Renderer* _renderer = nullptr;
+	TextureStreamerSettings _settings;
+
+	TexturePack _pack;
+	std::vector<StreamedTexture> _textures;
+
+	uint32_t _heap_index = 0;
+	uint64_t _frame = 1;					// textures never used have last_used_frame 0
+
+	VkBuffer _staging_buffer = VK_NULL_HANDLE;
+	VkDeviceMemory _staging_memory = VK_NULL_HANDLE;
+	uint8_t* _staging_data = nullptr;
+	VkDeviceSize _staging_used = 0;
+	VkDeviceSize _staging_alignment = 16;
+
+	VkCommandPool _command_pool = VK_NULL_HANDLE;
+	VkCommandBuffer _command_buffer = VK_NULL_HANDLE;
+	VkFence _fence = VK_NULL_HANDLE;
+
+	std::vector<Reallocation> _batch;
+	bool _batch_in_flight = false;
+
+	TextureStreamerStats _stats;
+};
@@ -0,0 +1,81 @@
+#include "ThreadPool.h"
+
+ThreadPool::ThreadPool( uint32_t thread_count )
+{
+	for( uint32_t i = 0; i < thread_count; i++ ) {
+		_threads.push_back( std::thread( &ThreadPool::_WorkerLoop, this ) );
+	}
+}
+
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock( _mutex );
+		_stopping = true;
+	}
+	_job_available.notify_all();
+
+	for( auto &i : _threads ) {
+		i.join();
+	}
+}
+
+void ThreadPool::Enqueue( std::function<void()> job )
+{
+	// Without workers jobs run inline
+	if( _threads.empty() ) {
+		job();
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock( _mutex );
+		_jobs.push_back( std::move( job ) );
+	}
+	_job_available.notify_one();
+}
+
+void ThreadPool::WaitIdle()
+{
+	std::unique_lock<std::mutex> lock( _mutex );
+	_idle.wait( lock, [this]() { return _jobs.empty() && _running_jobs == 0; } );
+}
+
+uint32_t ThreadPool::getThreadCount() const
+{
+	return uint32_t( _threads.size() );
+}
+
+uint32_t ThreadPool::getPendingJobCount() const
+{
+	std::lock_guard<std::mutex> lock( _mutex );
+	return uint32_t( _jobs.size() ) + _running_jobs;
+}
+
+void ThreadPool::_WorkerLoop()
+{
+	std::unique_lock<std::mutex> lock( _mutex );
+
+	for( ;; ) {
+		_job_available.wait( lock, [this]() { return _stopping || !_jobs.empty(); } );
+
+		// Queued jobs still run when stopping
+		if( _jobs.empty() ) {
+			return;
+		}
+
+		std::function<void()> job = std::move( _jobs.front() );
+		_jobs.pop_front();
+		_running_jobs++;
+
+		lock.unlock();
+		job();
+		lock.lock();
+
+		_running_jobs--;
+		if( _jobs.empty() && _running_jobs == 0 ) {
+			_idle.notify_all();
+		}
+	}
+}
\ No newline at end of file
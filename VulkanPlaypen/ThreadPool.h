@@ -0,0 +1,37 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads running jobs in submission order
+class ThreadPool
+{
+public:
+	ThreadPool( uint32_t thread_count );
+	~ThreadPool();
+
+	void Enqueue( std::function<void()> job );
+
+	// Blocks until every job queued so far has finished
+	void WaitIdle();
+
+	uint32_t getThreadCount() const;
+	uint32_t getPendingJobCount() const;
+
+private:
+	void _WorkerLoop();
+
+	std::vector<std::thread> _threads;
+
+	mutable std::mutex _mutex;
+	std::condition_variable _job_available;
+	std::condition_variable _idle;
+	std::deque<std::function<void()>> _jobs;
+	uint32_t _running_jobs = 0;
+	bool _stopping = false;
+};
\ No newline at end of file
@@ -0,0 +1,115 @@
+#include "VulkanDispatch.h"
+
+#if defined( _WIN32 )
+static const char* VULKAN_LIBRARY_NAME = "vulkan-1.dll";
+#else
+// dlopen() lives in libdl on older glibc, link with -ldl
+#include <dlfcn.h>
+static const char* VULKAN_LIBRARY_NAME = "libvulkan.so.1";
+#endif
+
+#define VULKAN_DISPATCH_DEFINE( name ) PFN_##name name = nullptr;
+
+PFN_vkGetInstanceProcAddr vkGetInstanceProcAddr = nullptr;
+VULKAN_GLOBAL_FUNCTIONS( VULKAN_DISPATCH_DEFINE )
+VULKAN_INSTANCE_FUNCTIONS( VULKAN_DISPATCH_DEFINE )
+VULKAN_DEVICE_FUNCTIONS( VULKAN_DISPATCH_DEFINE )
+
+#if defined( _WIN32 )
+static HMODULE vulkan_library = nullptr;
+#else
+static void* vulkan_library = nullptr;
+#endif
+
+bool LoadVulkanLibrary()
+{
+	if( vulkan_library != nullptr ) {
+		return true;
+	}
+
+#if defined( _WIN32 )
+	vulkan_library = LoadLibraryA( VULKAN_LIBRARY_NAME );
+	if( vulkan_library == nullptr ) {
+		return false;
+	}
+	vkGetInstanceProcAddr = (PFN_vkGetInstanceProcAddr)GetProcAddress( vulkan_library, "vkGetInstanceProcAddr" );
+#else
+	vulkan_library = dlopen( VULKAN_LIBRARY_NAME, RTLD_NOW | RTLD_LOCAL );
+	if( vulkan_library == nullptr ) {
+		return false;
+	}
+	vkGetInstanceProcAddr = (PFN_vkGetInstanceProcAddr)dlsym( vulkan_library, "vkGetInstanceProcAddr" );
+#endif
+
+	if( vkGetInstanceProcAddr == nullptr ) {
+		UnloadVulkanLibrary();
+		return false;
+	}
+
+#define VULKAN_DISPATCH_LOAD_GLOBAL( name ) name = (PFN_##name)vkGetInstanceProcAddr( VK_NULL_HANDLE, #name );
+	VULKAN_GLOBAL_FUNCTIONS( VULKAN_DISPATCH_LOAD_GLOBAL )
+#undef VULKAN_DISPATCH_LOAD_GLOBAL
+
+	return vkCreateInstance != nullptr;
+}
+
+void UnloadVulkanLibrary()
+{
+	if( vulkan_library == nullptr ) {
+		return;
+	}
+
+#if defined( _WIN32 )
+	FreeLibrary( vulkan_library );
+#else
+	dlclose( vulkan_library );
+#endif
+	vulkan_library = nullptr;
+
+	// Nothing may call into the unloaded library
+	vkGetInstanceProcAddr = nullptr;
+	SetVulkanInstanceDispatch( VulkanInstanceDispatch() );
+	SetVulkanDeviceDispatch( VulkanDeviceDispatch() );
+#define VULKAN_DISPATCH_CLEAR( name ) name = nullptr;
+	VULKAN_GLOBAL_FUNCTIONS( VULKAN_DISPATCH_CLEAR )
+#undef VULKAN_DISPATCH_CLEAR
+}
+
+void LoadVulkanInstanceDispatch( VkInstance instance, VulkanInstanceDispatch* dispatch )
+{
+#define VULKAN_DISPATCH_LOAD_INSTANCE( name ) dispatch->name = (PFN_##name)vkGetInstanceProcAddr( instance, #name );
+	VULKAN_INSTANCE_FUNCTIONS( VULKAN_DISPATCH_LOAD_INSTANCE )
+#undef VULKAN_DISPATCH_LOAD_INSTANCE
+}
+
+void LoadVulkanDeviceDispatch( VkInstance instance, VkDevice device, VulkanDeviceDispatch* dispatch )
+{
+	PFN_vkGetDeviceProcAddr get_device_proc_addr = (PFN_vkGetDeviceProcAddr)vkGetInstanceProcAddr( instance, "vkGetDeviceProcAddr" );
+
+#define VULKAN_DISPATCH_LOAD_DEVICE( name ) dispatch->name = (PFN_##name)get_device_proc_addr( device, #name );
+	VULKAN_DEVICE_FUNCTIONS( VULKAN_DISPATCH_LOAD_DEVICE )
+#undef VULKAN_DISPATCH_LOAD_DEVICE
+}
+
+void LoadVulkanDeviceTrampolines( VkInstance instance, VulkanDeviceDispatch* dispatch )
+{
+	// Device functions fetched from the instance are the loader's trampolines, which look up the device's table on
+	// every call
+#define VULKAN_DISPATCH_LOAD_TRAMPOLINE( name ) dispatch->name = (PFN_##name)vkGetInstanceProcAddr( instance, #name );
+	VULKAN_DEVICE_FUNCTIONS( VULKAN_DISPATCH_LOAD_TRAMPOLINE )
+#undef VULKAN_DISPATCH_LOAD_TRAMPOLINE
+}
+
+void SetVulkanInstanceDispatch( const VulkanInstanceDispatch& dispatch )
+{
+#define VULKAN_DISPATCH_SET( name ) name = dispatch.name;
+	VULKAN_INSTANCE_FUNCTIONS( VULKAN_DISPATCH_SET )
+#undef VULKAN_DISPATCH_SET
+}
+
+void SetVulkanDeviceDispatch( const VulkanDeviceDispatch& dispatch )
+{
+#define VULKAN_DISPATCH_SET( name ) name = dispatch.name;
+	VULKAN_DEVICE_FUNCTIONS( VULKAN_DISPATCH_SET )
+#undef VULKAN_DISPATCH_SET
+}
\ No newline at end of file
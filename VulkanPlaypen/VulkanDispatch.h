@@ -0,0 +1,210 @@
+#pragma once
+
+#include "Platform.h"
+
+// Vulkan entry points loaded at runtime.
+//
+// Platform.h defines VK_NO_PROTOTYPES, so the vk* names used throughout the code are the global function pointers
+// declared here rather than loader exports, and the loader library is opened at runtime instead of being linked.
+// Device functions loaded with vkGetDeviceProcAddr skip the loader's trampoline and dispatch straight into the
+// driver, or the first enabled layer.
+//
+// The global pointers follow the last tables passed to SetVulkanInstanceDispatch() and SetVulkanDeviceDispatch(),
+// which the renderer does for its own instance and device. Code working with another instance or device calls through
+// its own tables.
+
+#if defined( VK_USE_PLATFORM_WIN32_KHR )
+#define VULKAN_PLATFORM_INSTANCE_FUNCTIONS( X ) \
+	X( vkCreateWin32SurfaceKHR ) \
+	X( vkGetPhysicalDeviceWin32PresentationSupportKHR )
+#elif defined( VK_USE_PLATFORM_XCB_KHR )
+#define VULKAN_PLATFORM_INSTANCE_FUNCTIONS( X ) \
+	X( vkCreateXcbSurfaceKHR ) \
+	X( vkGetPhysicalDeviceXcbPresentationSupportKHR )
+#endif
+
+// Resolved with a null instance
+#define VULKAN_GLOBAL_FUNCTIONS( X ) \
+	X( vkCreateInstance ) \
+	X( vkEnumerateInstanceExtensionProperties ) \
+	X( vkEnumerateInstanceLayerProperties )
+
+#define VULKAN_INSTANCE_FUNCTIONS( X ) \
+	X( vkDestroyInstance ) \
+	X( vkEnumeratePhysicalDevices ) \
+	X( vkGetPhysicalDeviceFeatures ) \
+	X( vkGetPhysicalDeviceFormatProperties ) \
+	X( vkGetPhysicalDeviceImageFormatProperties ) \
+	X( vkGetPhysicalDeviceProperties ) \
+	X( vkGetPhysicalDeviceQueueFamilyProperties ) \
+	X( vkGetPhysicalDeviceMemoryProperties ) \
+	X( vkGetPhysicalDeviceSparseImageFormatProperties ) \
+	X( vkGetDeviceProcAddr ) \
+	X( vkCreateDevice ) \
+	X( vkEnumerateDeviceExtensionProperties ) \
+	X( vkEnumerateDeviceLayerProperties ) \
+	X( vkDestroySurfaceKHR ) \
+	X( vkGetPhysicalDeviceSurfaceSupportKHR ) \
+	X( vkGetPhysicalDeviceSurfaceCapabilitiesKHR ) \
+	X( vkGetPhysicalDeviceSurfaceFormatsKHR ) \
+	X( vkGetPhysicalDeviceSurfacePresentModesKHR ) \
+	VULKAN_PLATFORM_INSTANCE_FUNCTIONS( X )
+
+#define VULKAN_DEVICE_FUNCTIONS( X ) \
+	X( vkDestroyDevice ) \
+	X( vkGetDeviceQueue ) \
+	X( vkQueueSubmit ) \
+	X( vkQueueWaitIdle ) \
+	X( vkDeviceWaitIdle ) \
+	X( vkAllocateMemory ) \
+	X( vkFreeMemory ) \
+	X( vkMapMemory ) \
+	X( vkUnmapMemory ) \
+	X( vkFlushMappedMemoryRanges ) \
+	X( vkInvalidateMappedMemoryRanges ) \
+	X( vkGetDeviceMemoryCommitment ) \
+	X( vkBindBufferMemory ) \
+	X( vkBindImageMemory ) \
+	X( vkGetBufferMemoryRequirements ) \
+	X( vkGetImageMemoryRequirements ) \
+	X( vkGetImageSparseMemoryRequirements ) \
+	X( vkQueueBindSparse ) \
+	X( vkCreateFence ) \
+	X( vkDestroyFence ) \
+	X( vkResetFences ) \
+	X( vkGetFenceStatus ) \
+	X( vkWaitForFences ) \
+	X( vkCreateSemaphore ) \
+	X( vkDestroySemaphore ) \
+	X( vkCreateEvent ) \
+	X( vkDestroyEvent ) \
+	X( vkGetEventStatus ) \
+	X( vkSetEvent ) \
+	X( vkResetEvent ) \
+	X( vkCreateQueryPool ) \
+	X( vkDestroyQueryPool ) \
+	X( vkGetQueryPoolResults ) \
+	X( vkCreateBuffer ) \
+	X( vkDestroyBuffer ) \
+	X( vkCreateBufferView ) \
+	X( vkDestroyBufferView ) \
+	X( vkCreateImage ) \
+	X( vkDestroyImage ) \
+	X( vkGetImageSubresourceLayout ) \
+	X( vkCreateImageView ) \
+	X( vkDestroyImageView ) \
+	X( vkCreateShaderModule ) \
+	X( vkDestroyShaderModule ) \
+	X( vkCreatePipelineCache ) \
+	X( vkDestroyPipelineCache ) \
+	X( vkGetPipelineCacheData ) \
+	X( vkMergePipelineCaches ) \
+	X( vkCreateGraphicsPipelines ) \
+	X( vkCreateComputePipelines ) \
+	X( vkDestroyPipeline ) \
+	X( vkCreatePipelineLayout ) \
+	X( vkDestroyPipelineLayout ) \
+	X( vkCreateSampler ) \
+	X( vkDestroySampler ) \
+	X( vkCreateDescriptorSetLayout ) \
+	X( vkDestroyDescriptorSetLayout ) \
+	X( vkCreateDescriptorPool ) \
+	X( vkDestroyDescriptorPool ) \
+	X( vkResetDescriptorPool ) \
+	X( vkAllocateDescriptorSets ) \
+	X( vkFreeDescriptorSets ) \
+	X( vkUpdateDescriptorSets ) \
+	X( vkCreateFramebuffer ) \
+	X( vkDestroyFramebuffer ) \
+	X( vkCreateRenderPass ) \
+	X( vkDestroyRenderPass ) \
+	X( vkGetRenderAreaGranularity ) \
+	X( vkCreateCommandPool ) \
+	X( vkDestroyCommandPool ) \
+	X( vkResetCommandPool ) \
+	X( vkAllocateCommandBuffers ) \
+	X( vkFreeCommandBuffers ) \
+	X( vkBeginCommandBuffer ) \
+	X( vkEndCommandBuffer ) \
+	X( vkResetCommandBuffer ) \
+	X( vkCmdBindPipeline ) \
+	X( vkCmdSetViewport ) \
+	X( vkCmdSetScissor ) \
+	X( vkCmdSetLineWidth ) \
+	X( vkCmdSetDepthBias ) \
+	X( vkCmdSetBlendConstants ) \
+	X( vkCmdSetDepthBounds ) \
+	X( vkCmdSetStencilCompareMask ) \
+	X( vkCmdSetStencilWriteMask ) \
+	X( vkCmdSetStencilReference ) \
+	X( vkCmdBindDescriptorSets ) \
+	X( vkCmdBindIndexBuffer ) \
+	X( vkCmdBindVertexBuffers ) \
+	X( vkCmdDraw ) \
+	X( vkCmdDrawIndexed ) \
+	X( vkCmdDrawIndirect ) \
+	X( vkCmdDrawIndexedIndirect ) \
+	X( vkCmdDispatch ) \
+	X( vkCmdDispatchIndirect ) \
+	X( vkCmdCopyBuffer ) \
+	X( vkCmdCopyImage ) \
+	X( vkCmdBlitImage ) \
+	X( vkCmdCopyBufferToImage ) \
+	X( vkCmdCopyImageToBuffer ) \
+	X( vkCmdUpdateBuffer ) \
+	X( vkCmdFillBuffer ) \
+	X( vkCmdClearColorImage ) \
+	X( vkCmdClearDepthStencilImage ) \
+	X( vkCmdClearAttachments ) \
+	X( vkCmdResolveImage ) \
+	X( vkCmdSetEvent ) \
+	X( vkCmdResetEvent ) \
+	X( vkCmdWaitEvents ) \
+	X( vkCmdPipelineBarrier ) \
+	X( vkCmdBeginQuery ) \
+	X( vkCmdEndQuery ) \
+	X( vkCmdResetQueryPool ) \
+	X( vkCmdWriteTimestamp ) \
+	X( vkCmdCopyQueryPoolResults ) \
+	X( vkCmdPushConstants ) \
+	X( vkCmdBeginRenderPass ) \
+	X( vkCmdNextSubpass ) \
+	X( vkCmdEndRenderPass ) \
+	X( vkCmdExecuteCommands ) \
+	X( vkCreateSwapchainKHR ) \
+	X( vkDestroySwapchainKHR ) \
+	X( vkGetSwapchainImagesKHR ) \
+	X( vkAcquireNextImageKHR ) \
+	X( vkQueuePresentKHR )
+
+#define VULKAN_DISPATCH_MEMBER( name ) PFN_##name name = nullptr;
+#define VULKAN_DISPATCH_DECLARE( name ) extern PFN_##name name;
+
+struct VulkanInstanceDispatch
+{
+	VULKAN_INSTANCE_FUNCTIONS( VULKAN_DISPATCH_MEMBER )
+};
+
+struct VulkanDeviceDispatch
+{
+	VULKAN_DEVICE_FUNCTIONS( VULKAN_DISPATCH_MEMBER )
+};
+
+extern PFN_vkGetInstanceProcAddr vkGetInstanceProcAddr;
+VULKAN_GLOBAL_FUNCTIONS( VULKAN_DISPATCH_DECLARE )
+VULKAN_INSTANCE_FUNCTIONS( VULKAN_DISPATCH_DECLARE )
+VULKAN_DEVICE_FUNCTIONS( VULKAN_DISPATCH_DECLARE )
+
+// Opens the Vulkan loader library and loads vkGetInstanceProcAddr and the global functions
+bool LoadVulkanLibrary();
+void UnloadVulkanLibrary();
+
+void LoadVulkanInstanceDispatch( VkInstance instance, VulkanInstanceDispatch* dispatch );
+
+// Straight to the driver, through vkGetDeviceProcAddr
+void LoadVulkanDeviceDispatch( VkInstance instance, VkDevice device, VulkanDeviceDispatch* dispatch );
+// Through the loader's trampolines, which is what calling the loader's exports amounts to. For comparison
+void LoadVulkanDeviceTrampolines( VkInstance instance, VulkanDeviceDispatch* dispatch );
+
+void SetVulkanInstanceDispatch( const VulkanInstanceDispatch& dispatch );
+void SetVulkanDeviceDispatch( const VulkanDeviceDispatch& dispatch );
\ No newline at end of file
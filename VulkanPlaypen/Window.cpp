@@ -1,9 +1,15 @@
+#include <algorithm>
 #include <assert.h>
+#include <cmath>
 #include <cstdlib>
+#include <functional>
 
 #include "Window.h"
 #include "Renderer.h"
 #include "RendererUtils.h"
+#include "DeletionQueue.h"
+#include "DynamicResolution.h"
+#include "ObjectCache.h"
 
 Window::Window( Renderer* r, uint32_t size_x, uint32_t size_y, std::string name )
 {
@@ -15,11 +21,16 @@ Window::Window( Renderer* r, uint32_t size_x, uint32_t size_y, std::string name
 	_InitOSWindow();
 	_InitSurface();
 	_InitSwapchain();
+	_InitSync();
 }
 
 
 Window::~Window()
 {
+	delete _dynamic_resolution;
+	_dynamic_resolution = nullptr;
+
+	_DeInitSync();
 	_DeInitSwapchain();
 	_DeInitSurface();
 	_DeInitOSWindow();
@@ -36,6 +47,196 @@ bool Window::Update()
 	return _window_should_run;
 }
 
+bool Window::AcquireImage( uint32_t frame_slot )
+{
+	if( _swapchain_out_of_date && !_RecreateSwapchain() ) {
+		_frame_timing.skipped_frames++;
+		return false;
+	}
+
+	auto acquire_start = std::chrono::high_resolution_clock::now();
+	VkResult result = vkAcquireNextImageKHR( _renderer->getDevice(), _swapchain, UINT64_MAX, _image_available[frame_slot], VK_NULL_HANDLE, &_image_index );
+	double acquire_ms = std::chrono::duration<double, std::milli>( std::chrono::high_resolution_clock::now() - acquire_start ).count();
+
+	if( result == VK_ERROR_OUT_OF_DATE_KHR ) {
+		_swapchain_out_of_date = true;
+	}
+
+	if( result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR ) {
+		_frame_timing.skipped_frames++;
+		return false;
+	}
+
+	// A suboptimal image can still be presented, the swapchain is rebuilt next frame
+	if( result == VK_SUBOPTIMAL_KHR ) {
+		_swapchain_out_of_date = true;
+	}
+
+	_frame_timing.acquire_total_ms += acquire_ms;
+	_frame_timing.acquire_max_ms = std::max( _frame_timing.acquire_max_ms, acquire_ms );
+	return true;
+}
+
+void Window::RecordFrame( VkCommandBuffer command_buffer, uint32_t frame_slot, uint64_t frame_index )
+{
+	if( _timestamp_query_pool != VK_NULL_HANDLE ) {
+		vkCmdResetQueryPool( command_buffer, _timestamp_query_pool, frame_slot * 2, 2 );
+	}
+
+	VkImageMemoryBarrier barrier {};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.image = _swapchain_images[_image_index];
+	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	barrier.subresourceRange.levelCount = 1;
+	barrier.subresourceRange.layerCount = 1;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+	// The acquire semaphore is waited on at the transfer stage, so the first barrier chains off that
+	if( _clear_supported ) {
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		vkCmdPipelineBarrier( command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier );
+		_WriteBeginTimestamp( command_buffer, frame_slot );
+
+		// Every window pulses in its own colour
+		float phase = float( frame_index ) * 0.02f + float( std::hash<std::string>()( _window_name ) % 628 ) * 0.01f;
+		VkClearColorValue clear_color {};
+		clear_color.float32[0] = 0.5f + 0.5f * std::sin( phase );
+		clear_color.float32[1] = 0.5f + 0.5f * std::sin( phase + 2.094f );
+		clear_color.float32[2] = 0.5f + 0.5f * std::sin( phase + 4.189f );
+		clear_color.float32[3] = 1.0f;
+
+		if( _dynamic_resolution != nullptr ) {
+			_dynamic_resolution->RecordFrame( command_buffer, frame_slot, frame_index, clear_color, barrier.image );
+		}
+		else {
+			vkCmdClearColorImage( command_buffer, barrier.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &clear_color, 1, &barrier.subresourceRange );
+		}
+
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	}
+	else {
+		_WriteBeginTimestamp( command_buffer, frame_slot );
+	}
+
+	barrier.dstAccessMask = 0;
+	barrier.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+	vkCmdPipelineBarrier( command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier );
+
+	if( _timestamp_query_pool != VK_NULL_HANDLE ) {
+		vkCmdWriteTimestamp( command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, _timestamp_query_pool, frame_slot * 2 + 1 );
+		_timestamps_written[frame_slot] = true;
+	}
+}
+
+void Window::_WriteBeginTimestamp( VkCommandBuffer command_buffer, uint32_t frame_slot )
+{
+	// At the transfer stage, where the acquire semaphore is waited on, so the wait for the presentation engine to
+	// release the image is not counted. It also waits for earlier windows' transfers, which end their frames
+	if( _timestamp_query_pool != VK_NULL_HANDLE ) {
+		vkCmdWriteTimestamp( command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, _timestamp_query_pool, frame_slot * 2 );
+	}
+}
+
+void Window::OnPresented( VkResult result )
+{
+	if( result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR ) {
+		_swapchain_out_of_date = true;
+	}
+
+	if( result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR ) {
+		_frame_timing.skipped_frames++;
+		return;
+	}
+
+	auto now = std::chrono::high_resolution_clock::now();
+	if( _presented_before ) {
+		double interval_ms = std::chrono::duration<double, std::milli>( now - _last_present_time ).count();
+		_frame_timing.present_interval_total_ms += interval_ms;
+		_frame_timing.present_interval_max_ms = std::max( _frame_timing.present_interval_max_ms, interval_ms );
+	}
+
+	_presented_before = true;
+	_last_present_time = now;
+	_frame_timing.presented_frames++;
+}
+
+void Window::CollectTiming( uint32_t frame_slot )
+{
+	if( !_timestamps_written[frame_slot] ) {
+		return;
+	}
+	_timestamps_written[frame_slot] = false;
+
+	uint64_t timestamps[2] {};
+	if( vkGetQueryPoolResults( _renderer->getDevice(), _timestamp_query_pool, frame_slot * 2, 2, sizeof( timestamps ), timestamps, sizeof( uint64_t ), VK_QUERY_RESULT_64_BIT ) != VK_SUCCESS ) {
+		return;
+	}
+
+	double gpu_ms = double( timestamps[1] - timestamps[0] ) * _renderer->getPhysicalDeviceProperties().limits.timestampPeriod / 1000000.0;
+	_frame_timing.gpu_samples++;
+	_frame_timing.gpu_total_ms += gpu_ms;
+	_frame_timing.gpu_max_ms = std::max( _frame_timing.gpu_max_ms, gpu_ms );
+
+	if( _dynamic_resolution != nullptr ) {
+		_dynamic_resolution->OnGpuTime( frame_slot, gpu_ms );
+	}
+}
+
+VkSwapchainKHR Window::getSwapchain() const
+{
+	return _swapchain;
+}
+
+uint32_t Window::getImageIndex() const
+{
+	return _image_index;
+}
+
+VkImageView Window::getImageView() const
+{
+	return _swapchain_image_views[_image_index];
+}
+
+VkSemaphore Window::getImageAvailableSemaphore( uint32_t frame_slot ) const
+{
+	return _image_available[frame_slot];
+}
+
+const std::string& Window::getName() const
+{
+	return _window_name;
+}
+
+const WindowFrameTiming& Window::getFrameTiming() const
+{
+	return _frame_timing;
+}
+
+void Window::ResetFrameTiming()
+{
+	_frame_timing = WindowFrameTiming();
+}
+
+bool Window::EnableDynamicResolution( const DynamicResolutionSettings& settings )
+{
+	if( _timestamp_query_pool == VK_NULL_HANDLE || !_clear_supported || !DynamicResolution::IsSupported( _renderer, _surface_format.format ) ) {
+		return false;
+	}
+
+	delete _dynamic_resolution;
+	_dynamic_resolution = new DynamicResolution( _renderer, _surface_format.format, _surface_size_x, _surface_size_y, settings );
+	return true;
+}
+
+DynamicResolution* Window::getDynamicResolution() const
+{
+	return _dynamic_resolution;
+}
+
 void Window::_InitSurface()
 {
 	_InitOSSurface();
@@ -78,12 +279,14 @@ void Window::_InitSurface()
 
 void Window::_DeInitSurface()
 {
-	vkDestroySurfaceKHR( _renderer->getInstance(), _surface, nullptr );
+	// Queued after the swapchain, which has to go first
+	_renderer->getDeletionQueue()->DestroySurface( _surface );
+	_surface = VK_NULL_HANDLE;
 }
 
 void Window::_InitSwapchain()
 {
-	if( _swapchain_image_count > _surface_capabilities.maxImageCount ) {
+	if( _surface_capabilities.maxImageCount > 0 && _swapchain_image_count > _surface_capabilities.maxImageCount ) {
 		_swapchain_image_count = _surface_capabilities.maxImageCount;
 	}
 
@@ -124,16 +327,122 @@ void Window::_InitSwapchain()
 	create_info.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
 	create_info.presentMode = present_mode;
 	create_info.clipped = VK_TRUE;
-	create_info.oldSwapchain = VK_NULL_HANDLE;
+	create_info.oldSwapchain = _swapchain;
+
+	// Frames are cleared with transfer commands where the surface allows it
+	_clear_supported = ( _surface_capabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_DST_BIT ) != 0;
+	if( _clear_supported ) {
+		create_info.imageUsage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+	}
 	
+	// The old views go first, they have to be destroyed before their swapchain
+	_DeInitSwapchainImageViews();
+
 	// Create the swapchain
-	vkResultErrorCheck( vkCreateSwapchainKHR( _renderer->getDevice(), &create_info, nullptr, &_swapchain ) );
+	VkSwapchainKHR old_swapchain = _swapchain;
+	vkResultErrorCheck( vkCreateSwapchainKHR( _renderer->getDevice(), &create_info, _renderer->getAllocationCallbacks(), &_swapchain ) );
+
+	// A replaced swapchain may still have presents in flight
+	if( old_swapchain != VK_NULL_HANDLE ) {
+		_renderer->getDeletionQueue()->DestroySwapchain( old_swapchain );
+	}
 
 	// Ensure we've create a swapchain with a valid number of items (& store back to _swapchain_image_count)
 	vkResultErrorCheck( vkGetSwapchainImagesKHR( _renderer->getDevice(), _swapchain, &_swapchain_image_count, nullptr ) );
+
+	_swapchain_images.resize( _swapchain_image_count );
+	vkResultErrorCheck( vkGetSwapchainImagesKHR( _renderer->getDevice(), _swapchain, &_swapchain_image_count, _swapchain_images.data() ) );
+
+	_swapchain_image_views.resize( _swapchain_image_count );
+	for( uint32_t i = 0; i < _swapchain_image_count; i++ ) {
+		VkImageViewCreateInfo view_info {};
+		view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		view_info.image = _swapchain_images[i];
+		view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		view_info.format = _surface_format.format;
+		view_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		view_info.subresourceRange.levelCount = 1;
+		view_info.subresourceRange.layerCount = 1;
+		vkResultErrorCheck( vkCreateImageView( _renderer->getDevice(), &view_info, _renderer->getAllocationCallbacks(), &_swapchain_image_views[i] ) );
+	}
 }
 
 void Window::_DeInitSwapchain()
 {
-	vkDestroySwapchainKHR( _renderer->getDevice(), _swapchain, nullptr );
+	_DeInitSwapchainImageViews();
+	_renderer->getDeletionQueue()->DestroySwapchain( _swapchain );
+	_swapchain = VK_NULL_HANDLE;
+	_swapchain_images.clear();
+}
+
+bool Window::_RecreateSwapchain()
+{
+	vkGetPhysicalDeviceSurfaceCapabilitiesKHR( _renderer->getPhysicalDevice(), _surface, &_surface_capabilities );
+
+	// Minimized, nothing to present into
+	if( _surface_capabilities.currentExtent.width == 0 || _surface_capabilities.currentExtent.height == 0 ) {
+		return false;
+	}
+
+	if( _surface_capabilities.currentExtent.width < UINT32_MAX ) {
+		_surface_size_x = _surface_capabilities.currentExtent.width;
+		_surface_size_y = _surface_capabilities.currentExtent.height;
+	}
+
+	_InitSwapchain();
+	_swapchain_out_of_date = false;
+
+	if( _dynamic_resolution != nullptr ) {
+		_dynamic_resolution->SetOutputSize( _surface_size_x, _surface_size_y );
+	}
+	return true;
+}
+
+void Window::_DeInitSwapchainImageViews()
+{
+	// Framebuffers made from the views are cached, they are retired along with them
+	for( auto i : _swapchain_image_views ) {
+		_renderer->getObjectCache()->InvalidateImageView( i );
+		_renderer->getDeletionQueue()->DestroyImageView( i );
+	}
+	_swapchain_image_views.clear();
+}
+
+void Window::_InitSync()
+{
+	VkDevice device = _renderer->getDevice();
+
+	_image_available.resize( Renderer::FRAMES_IN_FLIGHT );
+	for( auto &i : _image_available ) {
+		VkSemaphoreCreateInfo semaphore_info {};
+		semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+		vkResultErrorCheck( vkCreateSemaphore( device, &semaphore_info, _renderer->getAllocationCallbacks(), &i ) );
+	}
+
+	_timestamps_written.assign( Renderer::FRAMES_IN_FLIGHT, false );
+
+	// GPU frame timing needs timestamp support on the graphics queue
+	uint32_t family_count = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties( _renderer->getPhysicalDevice(), &family_count, nullptr );
+	std::vector<VkQueueFamilyProperties> family_properties( family_count );
+	vkGetPhysicalDeviceQueueFamilyProperties( _renderer->getPhysicalDevice(), &family_count, family_properties.data() );
+
+	if( family_properties[_renderer->getGraphicsFamilyIndex()].timestampValidBits > 0 ) {
+		VkQueryPoolCreateInfo query_pool_info {};
+		query_pool_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		query_pool_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+		query_pool_info.queryCount = Renderer::FRAMES_IN_FLIGHT * 2;
+		vkResultErrorCheck( vkCreateQueryPool( device, &query_pool_info, _renderer->getAllocationCallbacks(), &_timestamp_query_pool ) );
+	}
+}
+
+void Window::_DeInitSync()
+{
+	for( auto i : _image_available ) {
+		_renderer->getDeletionQueue()->DestroySemaphore( i );
+	}
+	_image_available.clear();
+
+	_renderer->getDeletionQueue()->DestroyQueryPool( _timestamp_query_pool );
+	_timestamp_query_pool = VK_NULL_HANDLE;
 }
@@ -1,10 +1,30 @@
 #pragma once
 
+#include <chrono>
 #include <string>
+#include <vector>
 
 #include "Platform.h"
 
+class DynamicResolution;
 class Renderer;
+struct DynamicResolutionSettings;
+
+// Frame statistics of one window since the last ResetFrameTiming()
+struct WindowFrameTiming
+{
+	uint32_t presented_frames = 0;
+	uint32_t skipped_frames = 0;			// no image acquired: minimized, out of date or timed out
+
+	double present_interval_total_ms = 0.0;
+	double present_interval_max_ms = 0.0;
+	double acquire_total_ms = 0.0;
+	double acquire_max_ms = 0.0;
+
+	uint32_t gpu_samples = 0;
+	double gpu_total_ms = 0.0;
+	double gpu_max_ms = 0.0;
+};
 
 class Window
 {
@@ -16,6 +36,32 @@ public:
 	void Close();
 	bool Update();
 
+	// Frame interface driven by Renderer::Run(). frame_slot picks the per frame-in-flight resources, which the
+	// renderer only reuses after the GPU is done with them
+
+	// Acquires the next swapchain image. Returns false if the window has nothing to show this frame
+	bool AcquireImage( uint32_t frame_slot );
+	void RecordFrame( VkCommandBuffer command_buffer, uint32_t frame_slot, uint64_t frame_index );
+	void OnPresented( VkResult result );
+	// Reads back the GPU timestamps of frame_slot, once its fence has signaled
+	void CollectTiming( uint32_t frame_slot );
+
+	VkSwapchainKHR getSwapchain() const;
+	uint32_t getImageIndex() const;
+	// View of the acquired image. Cached framebuffers made from it are invalidated when the swapchain is rebuilt
+	VkImageView getImageView() const;
+	VkSemaphore getImageAvailableSemaphore( uint32_t frame_slot ) const;
+	const std::string& getName() const;
+
+	const WindowFrameTiming& getFrameTiming() const;
+	void ResetFrameTiming();
+
+	// Renders at a scale picked from the measured GPU frame time and blits up to the swapchain image. Needs GPU
+	// timestamps and a swapchain format that can be rendered to and blitted, returns false without them
+	bool EnableDynamicResolution( const DynamicResolutionSettings& settings );
+	// nullptr unless enabled
+	DynamicResolution* getDynamicResolution() const;
+
 private:
 	bool _window_should_run = true;
 
@@ -33,6 +79,22 @@ private:
 	VkSurfaceKHR _surface = VK_NULL_HANDLE;
 
 	VkSwapchainKHR _swapchain = VK_NULL_HANDLE;
+	std::vector<VkImage> _swapchain_images;
+	std::vector<VkImageView> _swapchain_image_views;
+	bool _swapchain_out_of_date = false;
+	bool _clear_supported = false;
+
+	uint32_t _image_index = 0;
+	std::vector<VkSemaphore> _image_available;
+
+	VkQueryPool _timestamp_query_pool = VK_NULL_HANDLE;
+	std::vector<bool> _timestamps_written;
+
+	WindowFrameTiming _frame_timing;
+	bool _presented_before = false;
+	std::chrono::high_resolution_clock::time_point _last_present_time;
+
+	DynamicResolution* _dynamic_resolution = nullptr;
 
 #if VK_USE_PLATFORM_WIN32_KHR
 	HINSTANCE _win32_instance = NULL;
@@ -51,6 +113,13 @@ private:
 
 	void _InitSwapchain();
 	void _DeInitSwapchain();
+	bool _RecreateSwapchain();
+	void _DeInitSwapchainImageViews();
+
+	void _InitSync();
+	void _DeInitSync();
+
+	void _WriteBeginTimestamp( VkCommandBuffer command_buffer, uint32_t frame_slot );
 
 };
 
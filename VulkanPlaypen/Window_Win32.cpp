@@ -2,6 +2,7 @@
 #include "Platform.h"
 #include "Window.h"
 #include "Renderer.h"
+#include "DeletionQueue.h"
 
 #include <assert.h>
 
@@ -13,7 +14,10 @@ LRESULT CALLBACK WindowsEventHandler( HWND hWnd, UINT uMsg, WPARAM wParam, LPARA
 
 	switch( uMsg ) {
 		case WM_CLOSE:
-			window->Close();
+			// The Window is gone while its native window waits on the deletion queue
+			if( window != nullptr ) {
+				window->Close();
+			}
 			return 0;
 
 		case WM_SIZE:
@@ -30,6 +34,20 @@ LRESULT CALLBACK WindowsEventHandler( HWND hWnd, UINT uMsg, WPARAM wParam, LPARA
 
 uint64_t Window::_win32_class_id_counter = 0;
 
+struct Win32WindowDeletion
+{
+	HINSTANCE instance;
+	std::string class_name;
+};
+
+static void DeferredDestroyWin32Window( void* user_data, uint64_t handle )
+{
+	Win32WindowDeletion* deletion = static_cast<Win32WindowDeletion*>( user_data );
+	DestroyWindow( (HWND)handle );
+	UnregisterClass( deletion->class_name.c_str(), deletion->instance );
+	delete deletion;
+}
+
 void Window::_InitOSWindow()
 {
 	WNDCLASSEX win_class {};
@@ -83,8 +101,15 @@ void Window::_InitOSWindow()
 
 void Window::_DeInitOSWindow()
 {
-	DestroyWindow( _win32_window );
-	UnregisterClass( _win32_class_name.c_str(), _win32_instance );
+	// Queued after the surface, which has to go before the native window it was created on
+	SetWindowLongPtr( _win32_window, GWLP_USERDATA, ( LONG_PTR )nullptr );
+
+	Win32WindowDeletion* deletion = new Win32WindowDeletion();
+	deletion->instance = _win32_instance;
+	deletion->class_name = _win32_class_name;
+	_renderer->getDeletionQueue()->Defer( DeferredDestroyWin32Window, deletion, (uint64_t)_win32_window );
+
+	_win32_window = NULL;
 }
 
 void Window::_UpdateOSWindow()
@@ -103,7 +128,7 @@ void Window::_InitOSSurface()
 	surface_info.hinstance = _win32_instance;
 	surface_info.hwnd = _win32_window;
 
-	vkCreateWin32SurfaceKHR( _renderer->getInstance(), &surface_info, nullptr, &_surface );
+	vkCreateWin32SurfaceKHR( _renderer->getInstance(), &surface_info, _renderer->getAllocationCallbacks(), &_surface );
 }
 
 #endif
\ No newline at end of file
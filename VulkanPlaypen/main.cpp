@@ -1,9 +1,70 @@
+#include "BUILD_OPTIONS.h"
 #include "Platform.h"
 #include "Renderer.h"
+#include "CommandCapture.h"
+#include "CommandReplay.h"
+#include "CompletionReactor.h"
+#include "DeletionQueue.h"
+#include "DynamicResolution.h"
+#include "HostAllocator.h"
+#include "ImageEncoding.h"
+#include "MeshBuffers.h"
+#include "MeshPack.h"
+#include "MeshProcessing.h"
+#include "ObjectCache.h"
+#include "ReadbackQueue.h"
+#include "RendererUtils.h"
+#include "FrameUploadBuffer.h"
+#include "SceneTransforms.h"
+#include "SubmissionQueue.h"
+#include "SubmitBenchmark.h"
+#include "TexturePack.h"
+#include "TextureStreamer.h"
+#include "ThreadPool.h"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
 
-void TestCommandPoolWithFence( Renderer &r )
+// Test objects whose GPU work has finished. Reactor callbacks only queue them here, they are destroyed through the
+// capture on the main thread, which is the only thread writing the trace
+struct FinishedTestObjects
 {
+	std::mutex mutex;
+	std::vector<VkCommandPool> command_pools;
+	std::vector<VkFence> fences;
+};
+
+void DestroyFinishedTestObjects( CommandCapture& c, FinishedTestObjects& finished )
+{
+	std::vector<VkCommandPool> command_pools;
+	std::vector<VkFence> fences;
+	{
+		std::lock_guard<std::mutex> lock( finished.mutex );
+		command_pools.swap( finished.command_pools );
+		fences.swap( finished.fences );
+	}
+
+	for( auto i : command_pools ) {
+		c.DestroyCommandPool( i );
+	}
+	for( auto i : fences ) {
+		c.DestroyFence( i );
+	}
+}
+
+void TestCommandPoolWithFence( Renderer &r, CompletionReactor& reactor, FinishedTestObjects& finished )
+{
+	CommandCapture& c = *r.getCapture();
+
 	// Create the VkCommandPool
 	VkCommandPool command_pool;
 	VkCommandPoolCreateInfo pool_info {};
@@ -11,7 +72,7 @@ void TestCommandPoolWithFence( Renderer &r )
 	pool_info.queueFamilyIndex = r.getGraphicsFamilyIndex();
 	pool_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
 
-	vkCreateCommandPool( r.getDevice(), &pool_info, nullptr, &command_pool );
+	c.CreateCommandPool( &pool_info, &command_pool );
 
 	// Allocate a VkCommandBuffer, assigned to the pool
 	VkCommandBuffer command_buffer;
@@ -21,14 +82,14 @@ void TestCommandPoolWithFence( Renderer &r )
 	command_buffer_info.commandPool = command_pool;
 	command_buffer_info.commandBufferCount = 1;
 
-	vkAllocateCommandBuffers( r.getDevice(), &command_buffer_info, &command_buffer );
+	c.AllocateCommandBuffers( &command_buffer_info, &command_buffer );
 
 
 	// Begin a command buffer
 	VkCommandBufferBeginInfo begin_command_buffer_info {};
 	begin_command_buffer_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
 
-	vkBeginCommandBuffer( command_buffer, &begin_command_buffer_info );
+	c.BeginCommandBuffer( command_buffer, &begin_command_buffer_info );
 
 
 	// Add a command to the command buffer
@@ -39,18 +100,18 @@ void TestCommandPoolWithFence( Renderer &r )
 	viewport.y = 0;
 	viewport.minDepth = 0.0f;
 	viewport.maxDepth = 1.0f;
-	vkCmdSetViewport( command_buffer, 0, 1, &viewport );
+	c.CmdSetViewport( command_buffer, 0, 1, &viewport );
 
 
 	// End a command buffer
-	vkEndCommandBuffer( command_buffer );
+	c.EndCommandBuffer( command_buffer );
 
 
 	// Create VkFence to synchronise the submit queue below
 	VkFence fence;
 	VkFenceCreateInfo fence_info {};
 	fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-	vkCreateFence( r.getDevice(), &fence_info, nullptr, &fence );
+	c.CreateFence( &fence_info, &fence );
 
 
 	// Submit the command buffer to the device queue
@@ -59,28 +120,27 @@ void TestCommandPoolWithFence( Renderer &r )
 	submit_info.commandBufferCount = 1;
 	submit_info.pCommandBuffers = &command_buffer;
 
-	vkQueueSubmit( r.getQueue(), 1, &submit_info, fence );
-
-
-	// Wait for the fence given to the submit queue to expire
-	vkWaitForFences( r.getDevice(), 1, &fence, VK_TRUE, UINT64_MAX );
-
+	c.QueueSubmit( 1, &submit_info, fence );
 
-	// Wait for device idle - not needed because the fence above does this instead
-	// vkQueueWaitIdle( r.getQueue() );
 
-	// Detroy created Vulkan objects
-	vkDestroyCommandPool( r.getDevice(), command_pool, nullptr );
-	vkDestroyFence( r.getDevice(), fence, nullptr );
+	// Have the reactor report when the fence given to the submit queue expires, instead of blocking on it here.
+	// The created Vulkan objects are destroyed once it has
+	reactor.WatchQueued( fence, [&finished, command_pool, fence]() {
+		std::lock_guard<std::mutex> lock( finished.mutex );
+		finished.command_pools.push_back( command_pool );
+		finished.fences.push_back( fence );
+	} );
 }
 
 void TestCommandPoolWithSemaphore( Renderer &r )
 {
+	CommandCapture& c = *r.getCapture();
+
 	// Create a VkSemaphore for use to sync
 	VkSemaphore semaphore;
 	VkSemaphoreCreateInfo semaphore_info {};
 	semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
-	vkCreateSemaphore( r.getDevice(), &semaphore_info, nullptr, &semaphore );
+	c.CreateSemaphore( &semaphore_info, &semaphore );
 	
 
 	// Create the VkCommandPool
@@ -90,7 +150,7 @@ void TestCommandPoolWithSemaphore( Renderer &r )
 	pool_info.queueFamilyIndex = r.getGraphicsFamilyIndex();
 	pool_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
 
-	vkCreateCommandPool( r.getDevice(), &pool_info, nullptr, &command_pool );
+	c.CreateCommandPool( &pool_info, &command_pool );
 
 	// Allocate a VkCommandBuffer, assigned to the pool
 	VkCommandBuffer command_buffer[2];
@@ -100,7 +160,7 @@ void TestCommandPoolWithSemaphore( Renderer &r )
 	command_buffer_info.commandPool = command_pool;
 	command_buffer_info.commandBufferCount = 2;
 
-	vkAllocateCommandBuffers( r.getDevice(), &command_buffer_info, command_buffer );
+	c.AllocateCommandBuffers( &command_buffer_info, command_buffer );
 	
 	// Command buffer 1
 	{
@@ -108,10 +168,10 @@ void TestCommandPoolWithSemaphore( Renderer &r )
 		VkCommandBufferBeginInfo begin_command_buffer_info {};
 		begin_command_buffer_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
 
-		vkBeginCommandBuffer( command_buffer[0], &begin_command_buffer_info );
+		c.BeginCommandBuffer( command_buffer[0], &begin_command_buffer_info );
 
 		// Create a pipeline barrier for later
-		vkCmdPipelineBarrier( command_buffer[0], VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 0, nullptr, 0, nullptr );
+		c.CmdPipelineBarrier( command_buffer[0], VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 0, nullptr, 0, nullptr );
 
 		// Add a command to the command buffer
 		VkViewport viewport;
@@ -121,11 +181,11 @@ void TestCommandPoolWithSemaphore( Renderer &r )
 		viewport.y = 0;
 		viewport.minDepth = 0.0f;
 		viewport.maxDepth = 1.0f;
-		vkCmdSetViewport( command_buffer[0], 0, 1, &viewport );
+		c.CmdSetViewport( command_buffer[0], 0, 1, &viewport );
 
 
 		// End a command buffer
-		vkEndCommandBuffer( command_buffer[0] );
+		c.EndCommandBuffer( command_buffer[0] );
 	}
 
 	// Command buffer 2
@@ -134,7 +194,7 @@ void TestCommandPoolWithSemaphore( Renderer &r )
 		VkCommandBufferBeginInfo begin_command_buffer_info {};
 		begin_command_buffer_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
 
-		vkBeginCommandBuffer( command_buffer[1], &begin_command_buffer_info );
+		c.BeginCommandBuffer( command_buffer[1], &begin_command_buffer_info );
 
 
 		// Add a command to the command buffer
@@ -145,63 +205,1442 @@ void TestCommandPoolWithSemaphore( Renderer &r )
 		viewport.y = 0;
 		viewport.minDepth = 0.0f;
 		viewport.maxDepth = 1.0f;
-		vkCmdSetViewport( command_buffer[1], 0, 1, &viewport );
+		c.CmdSetViewport( command_buffer[1], 0, 1, &viewport );
 
 
 		// End a command buffer
-		vkEndCommandBuffer( command_buffer[1] );
+		c.EndCommandBuffer( command_buffer[1] );
 	}
 	
-	// Submit the command buffer(s) to the device queue
+	// Submit the command buffer(s) to the device queue, in one call. Batches are submitted in order, so the second can
+	// wait on the semaphore the first signals
 	{
+		VkPipelineStageFlags flags[] { VK_PIPELINE_STAGE_ALL_COMMANDS_BIT };
+		VkSubmitInfo submit_info[2] {};
+		submit_info[0].sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submit_info[0].commandBufferCount = 1;
+		submit_info[0].pCommandBuffers = &command_buffer[0];
+		submit_info[0].signalSemaphoreCount = 1;
+		submit_info[0].pSignalSemaphores = &semaphore;
+
+		submit_info[1].sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submit_info[1].commandBufferCount = 1;
+		submit_info[1].pCommandBuffers = &command_buffer[1];
+		submit_info[1].waitSemaphoreCount = 1;
+		submit_info[1].pWaitSemaphores = &semaphore;
+		submit_info[1].pWaitDstStageMask = flags;
+
+		c.QueueSubmit( 2, submit_info, VK_NULL_HANDLE );
+	}
+
+
+	// Detroy created Vulkan objects once the GPU is done with them, no need to idle the queue
+	c.DeferDestroyCommandPool( command_pool );
+	c.DeferDestroySemaphore( semaphore );
+	
+	
+}
+
+void TestBufferUpload( Renderer &r )
+{
+	CommandCapture& c = *r.getCapture();
+
+	const VkDeviceSize buffer_size = 64 * 1024;
+
+	// Create a host visible staging buffer and a device local destination buffer
+	VkBuffer staging_buffer;
+	VkBufferCreateInfo staging_info {};
+	staging_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	staging_info.size = buffer_size;
+	staging_info.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+	staging_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	c.CreateBuffer( &staging_info, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &staging_buffer );
+
+	VkBuffer device_buffer;
+	VkBufferCreateInfo device_info {};
+	device_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	device_info.size = buffer_size;
+	device_info.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+	device_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	c.CreateBuffer( &device_info, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &device_buffer );
+
+
+	// Upload some data into the staging buffer
+	std::vector<uint32_t> data( size_t( buffer_size / sizeof( uint32_t ) ) );
+	for( size_t i = 0; i < data.size(); i++ ) {
+		data[i] = uint32_t( i );
+	}
+	c.UploadBuffer( staging_buffer, 0, buffer_size, data.data() );
+
+
+	// Record the copy to the device local buffer
+	VkCommandPool command_pool;
+	VkCommandPoolCreateInfo pool_info {};
+	pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	pool_info.queueFamilyIndex = r.getGraphicsFamilyIndex();
+	pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+	c.CreateCommandPool( &pool_info, &command_pool );
+
+	VkCommandBuffer command_buffer;
+	VkCommandBufferAllocateInfo command_buffer_info {};
+	command_buffer_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	command_buffer_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	command_buffer_info.commandPool = command_pool;
+	command_buffer_info.commandBufferCount = 1;
+	c.AllocateCommandBuffers( &command_buffer_info, &command_buffer );
+
+	VkCommandBufferBeginInfo begin_command_buffer_info {};
+	begin_command_buffer_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	begin_command_buffer_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	c.BeginCommandBuffer( command_buffer, &begin_command_buffer_info );
+
+	VkBufferCopy region {};
+	region.size = buffer_size;
+	c.CmdCopyBuffer( command_buffer, staging_buffer, device_buffer, 1, &region );
+
+	// Overwrite the second half on the GPU, after the copy has landed
+	VkBufferMemoryBarrier barrier {};
+	barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.buffer = device_buffer;
+	barrier.offset = 0;
+	barrier.size = VK_WHOLE_SIZE;
+	c.CmdPipelineBarrier( command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr );
+
+	c.CmdFillBuffer( command_buffer, device_buffer, buffer_size / 2, buffer_size / 2, 0xFFFFFFFF );
+
+	c.EndCommandBuffer( command_buffer );
+
+
+	// Submit without waiting for the upload to finish
+	VkSubmitInfo submit_info {};
+	submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submit_info.commandBufferCount = 1;
+	submit_info.pCommandBuffers = &command_buffer;
+	c.QueueSubmit( 1, &submit_info, VK_NULL_HANDLE );
+
+	// Detroy created Vulkan objects once the GPU is done with them
+	c.DeferDestroyCommandPool( command_pool );
+	c.DeferDestroyBuffer( device_buffer );
+	c.DeferDestroyBuffer( staging_buffer );
+}
+
+// Plays back a trace captured with --capture, headless, and reports per-frame timings
+int ReplayTrace( Renderer &r, const std::string& trace_path, uint32_t loop_count, const std::string& csv_path )
+{
+	CommandReplay replay( &r );
+	if( !replay.Load( trace_path ) ) {
+		return -1;
+	}
+
+	bool success = replay.Run( loop_count );
+	replay.PrintReport();
+
+	if( !csv_path.empty() && !replay.WriteCsv( csv_path ) ) {
+		std::cout << "Failed to write " << csv_path << std::endl;
+	}
+
+	return success ? 0 : -1;
+}
+
+// Builds a pack of procedural RGBA8 textures for the streaming test
+bool WriteTestTexturePack( const std::string& pack_path, uint32_t texture_count, uint32_t size )
+{
+	TexturePackWriter writer;
+
+	for( uint32_t t = 0; t < texture_count; t++ ) {
+		std::vector<uint8_t> pixels( size_t( size ) * size * 4 );
+		for( uint32_t y = 0; y < size; y++ ) {
+			for( uint32_t x = 0; x < size; x++ ) {
+				uint8_t* texel = &pixels[( size_t( y ) * size + x ) * 4];
+				texel[0] = uint8_t( x * 255 / size );
+				texel[1] = uint8_t( y * 255 / size );
+				texel[2] = uint8_t( ( ( x / 32 + y / 32 + t ) & 1 ) * 255 );
+				texel[3] = 255;
+			}
+		}
+
+		writer.AddTexture( "texture" + std::to_string( t ), VK_FORMAT_R8G8B8A8_UNORM, size, size, GenerateMipChainRGBA8( size, size, pixels ) );
+	}
+
+	return writer.Write( pack_path );
+}
+
+// Streams the full chain of texture 0 in, then keeps asking for it along with texture 1 under a budget that only
+// has room for one of them. Texture 0 is in use every frame, so texture 1 must not evict it
+bool TestTextureStreamerEviction( Renderer &r, const std::string& pack_path )
+{
+	TexturePack pack;
+	if( !pack.Open( pack_path ) || pack.getTextureCount() < 2 ) {
+		return true;
+	}
+
+	VkDeviceSize chain_bytes = 0;
+	for( uint32_t mip = 0; mip < pack.getTexture( 0 ).mip_count; mip++ ) {
+		chain_bytes += pack.getMip( 0, mip ).size;
+	}
+	pack.Close();
+
+	TextureStreamerSettings settings;
+	settings.budget_limit = chain_bytes * 3 / 2;
+
+	TextureStreamer streamer( &r, settings );
+	if( !streamer.Load( pack_path ) ) {
+		return false;
+	}
+
+	for( uint32_t frame = 0; frame < 1000 && streamer.getResidentMip( 0 ) != 0; frame++ ) {
+		streamer.RequestMip( 0, 0 );
+		streamer.Update();
+		r.getDeletionQueue()->EndFrame();
+	}
+
+	if( streamer.getResidentMip( 0 ) != 0 ) {
+		std::cout << "Texture streamer eviction test failed: texture 0 was never streamed in" << std::endl;
+		return false;
+	}
+
+	bool passed = true;
+	for( uint32_t frame = 0; frame < 100 && passed; frame++ ) {
+		streamer.RequestMip( 0, 0 );
+		streamer.RequestMip( 1, 0 );
+		streamer.Update();
+		r.getDeletionQueue()->EndFrame();
+
+		passed = streamer.getResidentMip( 0 ) == 0;
+	}
+
+	std::cout << "Texture streamer eviction test " << ( passed ? "passed" : "failed: a texture in use was evicted" ) << std::endl;
+	return passed;
+}
+
+// Streams a pack under a tight budget while a simulated camera sweeps across the textures
+int StreamTextures( Renderer &r, const std::string& pack_path, uint32_t frame_count )
+{
+	const uint32_t texture_count = 16;
+
+	TexturePack existing;
+	if( !existing.Open( pack_path ) ) {
+		std::cout << "Writing test texture pack " << pack_path << std::endl;
+		if( !WriteTestTexturePack( pack_path, texture_count, 1024 ) ) {
+			std::cout << "Failed to write " << pack_path << std::endl;
+			return -1;
+		}
+	}
+	existing.Close();
+
+	if( !TestTextureStreamerEviction( r, pack_path ) ) {
+		return -1;
+	}
+
+	TextureStreamerSettings settings;
+	settings.budget_limit = 32 * 1024 * 1024;
+
+	TextureStreamer streamer( &r, settings );
+	if( !streamer.Load( pack_path ) ) {
+		return -1;
+	}
+
+	uint32_t count = streamer.getPack().getTextureCount();
+
+	for( uint32_t frame = 0; frame < frame_count; frame++ ) {
+		// A quarter of the textures are on screen at a time, the closer to the centre of view the larger
+		float center = float( frame ) * 0.05f;
+		for( uint32_t i = 0; i < count; i++ ) {
+			float distance = std::fabs( std::fmod( float( i ) - center + count * 1000.0f, float( count ) ) - count * 0.5f );
+			if( distance < count * 0.125f ) {
+				float coverage = 1024.0f / ( 1.0f + distance * 4.0f );
+				streamer.ReportScreenCoverage( i, coverage, coverage );
+			}
+		}
+
+		streamer.Update();
+		r.getDeletionQueue()->EndFrame();
+
+		if( frame % 100 == 99 ) {
+			streamer.PrintStats();
+			r.getDeletionQueue()->PrintStats();
+		}
+	}
+
+	streamer.PrintStats();
+
+	return 0;
+}
+
+// Renders into an offscreen image and buffer every frame and reads both back without stalling. Image readbacks are
+// hashed on the worker threads and every 60th frame is written out as a PNG when a prefix is given
+int ReadbackFrames( Renderer &r, uint32_t frame_count, const std::string& png_prefix )
+{
+	const uint32_t image_size = 512;
+	const VkDeviceSize buffer_size = 64 * 1024;
+
+	VkDevice device = r.getDevice();
+	const VkAllocationCallbacks* allocator = r.getAllocationCallbacks();
+
+	VkImage image;
+	VkImageCreateInfo image_info {};
+	image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	image_info.imageType = VK_IMAGE_TYPE_2D;
+	image_info.format = VK_FORMAT_R8G8B8A8_UNORM;
+	image_info.extent.width = image_size;
+	image_info.extent.height = image_size;
+	image_info.extent.depth = 1;
+	image_info.mipLevels = 1;
+	image_info.arrayLayers = 1;
+	image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+	image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+	image_info.usage = VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+	image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	vkResultErrorCheck( vkCreateImage( device, &image_info, allocator, &image ) );
+
+	VkDeviceMemory image_memory;
+	vkResultErrorCheck( AllocateImageMemory( device, allocator, r.getPhysicalDeviceMemoryProperties(), image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &image_memory ) );
+
+	VkBuffer buffer;
+	VkBufferCreateInfo buffer_info {};
+	buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	buffer_info.size = buffer_size;
+	buffer_info.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+	buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	vkResultErrorCheck( vkCreateBuffer( device, &buffer_info, allocator, &buffer ) );
+
+	VkDeviceMemory buffer_memory;
+	vkResultErrorCheck( AllocateBufferMemory( device, allocator, r.getPhysicalDeviceMemoryProperties(), buffer, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &buffer_memory ) );
+
+	// One command buffer per frame in flight, reused once its fence has signaled
+	VkCommandPool command_pool;
+	VkCommandPoolCreateInfo pool_info {};
+	pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	pool_info.queueFamilyIndex = r.getGraphicsFamilyIndex();
+	pool_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+	vkResultErrorCheck( vkCreateCommandPool( device, &pool_info, allocator, &command_pool ) );
+
+	VkCommandBuffer command_buffers[Renderer::FRAMES_IN_FLIGHT];
+	VkCommandBufferAllocateInfo command_buffer_info {};
+	command_buffer_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	command_buffer_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	command_buffer_info.commandPool = command_pool;
+	command_buffer_info.commandBufferCount = Renderer::FRAMES_IN_FLIGHT;
+	vkResultErrorCheck( vkAllocateCommandBuffers( device, &command_buffer_info, command_buffers ) );
+
+	VkFence fences[Renderer::FRAMES_IN_FLIGHT];
+	for( auto &i : fences ) {
+		VkFenceCreateInfo fence_info {};
+		fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+		fence_info.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+		vkResultErrorCheck( vkCreateFence( device, &fence_info, allocator, &i ) );
+	}
+
+	ReadbackQueue readback( &r );
+
+	std::atomic<uint32_t> mismatches( 0 );
+	std::atomic<uint32_t> pngs_written( 0 );
+	std::atomic<uint64_t> last_hash( 0 );
+
+	double cpu_time_total_ms = 0.0;
+	double cpu_time_max_ms = 0.0;
+
+	for( uint32_t frame = 0; frame < frame_count; frame++ ) {
+		auto frame_start = std::chrono::high_resolution_clock::now();
+
+		uint32_t index = frame % Renderer::FRAMES_IN_FLIGHT;
+		vkResultErrorCheck( vkWaitForFences( device, 1, &fences[index], VK_TRUE, UINT64_MAX ) );
+		vkResultErrorCheck( vkResetFences( device, 1, &fences[index] ) );
+
+		VkCommandBuffer command_buffer = command_buffers[index];
+
+		VkCommandBufferBeginInfo begin_info {};
+		begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		vkResultErrorCheck( vkBeginCommandBuffer( command_buffer, &begin_info ) );
+
+		// The readback copies of the previous frame have to finish before the image and buffer are overwritten
+		VkImageMemoryBarrier barrier {};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.oldLayout = frame == 0 ? VK_IMAGE_LAYOUT_UNDEFINED : VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = image;
+		barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		barrier.subresourceRange.levelCount = 1;
+		barrier.subresourceRange.layerCount = 1;
+		vkCmdPipelineBarrier( command_buffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier );
+
+		uint8_t shade = uint8_t( frame % 256 );
+
+		VkClearColorValue clear_color {};
+		clear_color.float32[0] = shade / 255.0f;
+		clear_color.float32[1] = 1.0f - shade / 255.0f;
+		clear_color.float32[2] = 0.5f;
+		clear_color.float32[3] = 1.0f;
+		vkCmdClearColorImage( command_buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &clear_color, 1, &barrier.subresourceRange );
+
+		vkCmdFillBuffer( command_buffer, buffer, 0, buffer_size, frame );
+
+		vkResultErrorCheck( vkEndCommandBuffer( command_buffer ) );
+
 		VkSubmitInfo submit_info {};
 		submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 		submit_info.commandBufferCount = 1;
-		submit_info.pCommandBuffers = &command_buffer[0];
-		submit_info.signalSemaphoreCount = 1;
-		submit_info.pSignalSemaphores = &semaphore;
+		submit_info.pCommandBuffers = &command_buffer;
+		r.getSubmissionQueue()->Submit( 1, &submit_info, fences[index] );
+
+		bool write_png = !png_prefix.empty() && frame % 60 == 0;
+		readback.ReadImage( image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_FORMAT_R8G8B8A8_UNORM, image_size, image_size,
+			[&mismatches, &pngs_written, &last_hash, shade, write_png, png_prefix, frame]( const ReadbackData& data ) {
+			const uint8_t* texel = static_cast<const uint8_t*>( data.data );
+			if( texel[0] != shade ) {
+				mismatches++;
+			}
+
+			last_hash = HashBytes( data.data, size_t( data.size ) );
+
+			if( write_png && WritePng( png_prefix + std::to_string( frame ) + ".png", data.width, data.height, data.format, data.data ) ) {
+				pngs_written++;
+			}
+		} );
+
+		readback.ReadBuffer( buffer, 0, buffer_size, [&mismatches, frame]( const ReadbackData& data ) {
+			const uint32_t* values = static_cast<const uint32_t*>( data.data );
+			for( size_t i = 0; i < data.size / sizeof( uint32_t ); i++ ) {
+				if( values[i] != frame ) {
+					mismatches++;
+					return;
+				}
+			}
+		} );
+
+		readback.EndFrame();
+		r.getDeletionQueue()->EndFrame();
+
+		double cpu_time_ms = std::chrono::duration<double, std::milli>( std::chrono::high_resolution_clock::now() - frame_start ).count();
+		cpu_time_total_ms += cpu_time_ms;
+		cpu_time_max_ms = std::max( cpu_time_max_ms, cpu_time_ms );
+
+		if( frame % 100 == 99 ) {
+			readback.PrintStats();
+		}
+	}
+
+	readback.Flush();
+
+	std::cout << std::fixed << std::setprecision( 3 )
+		<< "CPU frame time avg " << ( frame_count > 0 ? cpu_time_total_ms / frame_count : 0.0 ) << " ms, max " << cpu_time_max_ms << " ms" << std::endl
+		<< "Last image hash " << std::hex << last_hash.load() << std::dec << ", " << pngs_written.load() << " PNGs written, " << mismatches.load() << " mismatches" << std::endl;
+	readback.PrintStats();
+
+	vkResultErrorCheck( vkWaitForFences( device, Renderer::FRAMES_IN_FLIGHT, fences, VK_TRUE, UINT64_MAX ) );
+	for( auto i : fences ) {
+		vkDestroyFence( device, i, allocator );
+	}
+	vkDestroyCommandPool( device, command_pool, allocator );
+	vkDestroyBuffer( device, buffer, allocator );
+	vkFreeMemory( device, buffer_memory, allocator );
+	vkDestroyImage( device, image, allocator );
+	vkFreeMemory( device, image_memory, allocator );
+
+	return mismatches == 0 ? 0 : -1;
+}
+
+// Measures transform propagation and upload throughput over an 8-ary hierarchy, for every SIMD level the CPU supports
+// and for different shares of animated nodes. A node_count of 0 runs 100k and 1M nodes
+int BenchmarkTransforms( Renderer &r, uint32_t node_count, uint32_t frame_count )
+{
+	std::vector<uint32_t> node_counts;
+	if( node_count > 0 ) {
+		node_counts.push_back( node_count );
+	}
+	else {
+		node_counts.push_back( 100000 );
+		node_counts.push_back( 1000000 );
+	}
+
+	const float animated_shares[] = { 1.0f, 0.1f, 0.01f };
+	int result = 0;
+
+	for( auto count : node_counts ) {
+		SceneTransforms scene;
+		scene.Reserve( count );
+
+		for( uint32_t i = 0; i < count; i++ ) {
+			SceneNode node = scene.CreateNode( i == 0 ? SCENE_NODE_NONE : ( i - 1 ) / 8 );
+
+			float angle = float( i ) * 0.01f;
+			const float translation[3] = { float( i % 8 ), 1.0f, 0.0f };
+			const float rotation[4] = { 0.0f, std::sin( angle ), 0.0f, std::cos( angle ) };
+			const float scale[3] = { 0.9f, 0.9f, 0.9f };
+			scene.SetLocalTransform( node, translation, rotation, scale );
+		}
+
+		r.getFrameUpload()->Reserve( VkDeviceSize( count ) * SCENE_WORLD_ELEMENT_COUNT * sizeof( float ) );
+
+		// Reference result for checking the SIMD kernels
+		scene.setSimdLevel( SCENE_SIMD_SCALAR );
+		scene.Update();
+		std::vector<float> reference( size_t( count ) * SCENE_WORLD_ELEMENT_COUNT );
+		for( uint32_t i = 0; i < count; i++ ) {
+			scene.getWorldMatrix( i, &reference[size_t( i ) * SCENE_WORLD_ELEMENT_COUNT] );
+		}
+
+		std::cout << count << " nodes, " << scene.getStats().level_count << " levels" << std::endl;
+
+		for( uint32_t level = SCENE_SIMD_SCALAR; level <= uint32_t( SceneTransforms::getSupportedSimdLevel() ); level++ ) {
+			scene.setSimdLevel( SceneSimdLevel( level ) );
+
+			scene.Invalidate();
+			scene.Update();
+
+			float max_error = 0.0f;
+			for( uint32_t i = 0; i < count; i++ ) {
+				float matrix[SCENE_WORLD_ELEMENT_COUNT];
+				scene.getWorldMatrix( i, matrix );
+				for( uint32_t e = 0; e < SCENE_WORLD_ELEMENT_COUNT; e++ ) {
+					max_error = std::max( max_error, std::fabs( matrix[e] - reference[size_t( i ) * SCENE_WORLD_ELEMENT_COUNT + e] ) );
+				}
+			}
+			if( max_error > 1e-3f ) {
+				result = -1;
+			}
+
+			for( auto share : animated_shares ) {
+				uint32_t animated = std::max( 1u, uint32_t( count * share ) );
+				uint32_t stride = count / animated;
+
+				double update_total_ms = 0.0;
+				double write_total_ms = 0.0;
+				uint64_t computed_total = 0;
+				uint64_t written_total = 0;
+
+				for( uint32_t frame = 0; frame < frame_count; frame++ ) {
+					float angle = float( frame ) * 0.02f;
+					const float rotation[4] = { 0.0f, std::sin( angle ), 0.0f, std::cos( angle ) };
+					for( uint32_t j = 0; j < animated; j++ ) {
+						scene.SetRotation( ( j * stride + frame ) % count, rotation );
+					}
+
+					scene.Update();
+					scene.WriteWorldMatrices( r.getFrameUpload() );
+
+					r.getFrameUpload()->EndFrame();
+					r.getDeletionQueue()->EndFrame();
+
+					const SceneTransformStats& stats = scene.getStats();
+					update_total_ms += stats.update_ms;
+					write_total_ms += stats.write_ms;
+					computed_total += stats.computed_nodes;
+					written_total += stats.written_nodes;
+				}
+
+				double update_avg = update_total_ms / std::max( 1u, frame_count );
+				double write_avg = write_total_ms / std::max( 1u, frame_count );
+
+				std::cout << std::fixed << std::setprecision( 3 ) << "  " << std::setw( 6 ) << SceneTransforms::getSimdLevelName( SceneSimdLevel( level ) )
+					<< " " << std::setw( 5 ) << share * 100.0f << "% animated: update " << update_avg << " ms ("
+					<< ( update_avg > 0.0 ? count / update_avg / 1000.0 : 0.0 ) << " Mnodes/s, " << computed_total / std::max( 1u, frame_count ) << " computed), write "
+					<< write_avg << " ms (" << written_total / std::max( 1u, frame_count ) << " written), max error " << max_error << std::endl;
+			}
+		}
+	}
+
+	return result;
+}
+
+// Records the same commands through the loader's trampolines and through the device dispatch table and compares the
+// cost per command. Dynamic state and small fills stand in for per-draw calls, nothing is submitted
+int BenchmarkDispatch( Renderer &r, uint32_t command_count, uint32_t iteration_count )
+{
+	VkDevice device = r.getDevice();
+	const VkAllocationCallbacks* allocator = r.getAllocationCallbacks();
+
+	VulkanDeviceDispatch trampolines;
+	LoadVulkanDeviceTrampolines( r.getInstance(), &trampolines );
+
+	const VulkanDeviceDispatch* tables[] = { &trampolines, &r.getDeviceDispatch() };
+	const char* table_names[] = { "loader trampolines", "device dispatch" };
+
+	VkBuffer buffer;
+	VkBufferCreateInfo buffer_info {};
+	buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	buffer_info.size = 64 * 1024;
+	buffer_info.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+	buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	vkResultErrorCheck( vkCreateBuffer( device, &buffer_info, allocator, &buffer ) );
+
+	VkDeviceMemory buffer_memory;
+	vkResultErrorCheck( AllocateBufferMemory( device, allocator, r.getPhysicalDeviceMemoryProperties(), buffer, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &buffer_memory ) );
+
+	VkCommandPool command_pool;
+	VkCommandPoolCreateInfo pool_info {};
+	pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	pool_info.queueFamilyIndex = r.getGraphicsFamilyIndex();
+	pool_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+	vkResultErrorCheck( vkCreateCommandPool( device, &pool_info, allocator, &command_pool ) );
+
+	VkCommandBuffer command_buffer;
+	VkCommandBufferAllocateInfo command_buffer_info {};
+	command_buffer_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	command_buffer_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	command_buffer_info.commandPool = command_pool;
+	command_buffer_info.commandBufferCount = 1;
+	vkResultErrorCheck( vkAllocateCommandBuffers( device, &command_buffer_info, &command_buffer ) );
+
+	VkViewport viewport {};
+	viewport.width = 800.0f;
+	viewport.height = 600.0f;
+	viewport.maxDepth = 1.0f;
+
+	VkRect2D scissor {};
+	scissor.extent.width = 800;
+	scissor.extent.height = 600;
+
+	// Three commands per iteration of the recording loop
+	uint32_t draw_count = std::max( 1u, command_count / 3 );
+	std::vector<double> ns_per_command[2];
+
+	// Interleaved so both tables see the same cache and clock conditions
+	for( uint32_t iteration = 0; iteration < iteration_count; iteration++ ) {
+		for( uint32_t t = 0; t < 2; t++ ) {
+			const VulkanDeviceDispatch& d = *tables[( iteration + t ) % 2];
+
+			vkResultErrorCheck( d.vkResetCommandBuffer( command_buffer, 0 ) );
+
+			VkCommandBufferBeginInfo begin_info {};
+			begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+			begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+			vkResultErrorCheck( d.vkBeginCommandBuffer( command_buffer, &begin_info ) );
+
+			auto start = std::chrono::high_resolution_clock::now();
+			for( uint32_t i = 0; i < draw_count; i++ ) {
+				d.vkCmdSetViewport( command_buffer, 0, 1, &viewport );
+				d.vkCmdSetScissor( command_buffer, 0, 1, &scissor );
+				d.vkCmdFillBuffer( command_buffer, buffer, ( i % 1024 ) * 64, 64, i );
+			}
+			auto end = std::chrono::high_resolution_clock::now();
+
+			vkResultErrorCheck( d.vkEndCommandBuffer( command_buffer ) );
 
-		vkQueueSubmit( r.getQueue(), 1, &submit_info, VK_NULL_HANDLE );
+			double ns = std::chrono::duration<double, std::nano>( end - start ).count();
+			ns_per_command[( iteration + t ) % 2].push_back( ns / ( draw_count * 3.0 ) );
+		}
 	}
 
+	std::cout << draw_count * 3 << " commands recorded " << iteration_count << " times per path" << std::endl;
+#if BUILD_ENABLE_VULKAN_DEBUG
+	std::cout << "  validation layers are enabled and sit behind both paths, build with BUILD_ENABLE_VULKAN_DEBUG 0 for driver numbers" << std::endl;
+#endif
+
+	double medians[2] = {};
+	for( uint32_t t = 0; t < 2; t++ ) {
+		std::vector<double>& samples = ns_per_command[t];
+		std::sort( samples.begin(), samples.end() );
+		medians[t] = samples.empty() ? 0.0 : samples[samples.size() / 2];
+
+		std::cout << std::fixed << std::setprecision( 2 ) << "  " << std::setw( 18 ) << table_names[t] << ": min " << ( samples.empty() ? 0.0 : samples.front() )
+			<< " ns, median " << medians[t] << " ns per command (" << ( medians[t] > 0.0 ? 1000.0 / medians[t] : 0.0 ) << " M commands/s)" << std::endl;
+	}
+	std::cout << "  device dispatch speedup " << ( medians[1] > 0.0 ? medians[0] / medians[1] : 0.0 ) << "x" << std::endl;
+
+	vkDestroyCommandPool( device, command_pool, allocator );
+	vkDestroyBuffer( device, buffer, allocator );
+	vkFreeMemory( device, buffer_memory, allocator );
+
+	return 0;
+}
+
+// Runs the same stream of small submissions twice, first waiting on a fence after each, then keeping up to in_flight
+// of them outstanding and letting a CompletionReactor report when they finish
+int BenchmarkReactor( Renderer &r, uint32_t submission_count, uint32_t in_flight )
+{
+	VkDevice device = r.getDevice();
+	SubmissionQueue* submission_queue = r.getSubmissionQueue();
+	const VkAllocationCallbacks* allocator = r.getAllocationCallbacks();
+
+	VkBuffer buffer;
+	VkBufferCreateInfo buffer_info {};
+	buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	buffer_info.size = 1024 * 1024;
+	buffer_info.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+	buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	vkResultErrorCheck( vkCreateBuffer( device, &buffer_info, allocator, &buffer ) );
+
+	VkDeviceMemory buffer_memory;
+	vkResultErrorCheck( AllocateBufferMemory( device, allocator, r.getPhysicalDeviceMemoryProperties(), buffer, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &buffer_memory ) );
+
+	VkCommandPool command_pool;
+	VkCommandPoolCreateInfo pool_info {};
+	pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	pool_info.queueFamilyIndex = r.getGraphicsFamilyIndex();
+	vkResultErrorCheck( vkCreateCommandPool( device, &pool_info, allocator, &command_pool ) );
+
+	// Recorded once, every submission uses it
+	VkCommandBuffer command_buffer;
+	VkCommandBufferAllocateInfo command_buffer_info {};
+	command_buffer_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	command_buffer_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	command_buffer_info.commandPool = command_pool;
+	command_buffer_info.commandBufferCount = 1;
+	vkResultErrorCheck( vkAllocateCommandBuffers( device, &command_buffer_info, &command_buffer ) );
+
+	VkCommandBufferBeginInfo begin_info {};
+	begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	begin_info.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
+	vkResultErrorCheck( vkBeginCommandBuffer( command_buffer, &begin_info ) );
+	vkCmdFillBuffer( command_buffer, buffer, 0, VK_WHOLE_SIZE, 0 );
+	vkResultErrorCheck( vkEndCommandBuffer( command_buffer ) );
+
+	VkSubmitInfo submit_info {};
+	submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submit_info.commandBufferCount = 1;
+	submit_info.pCommandBuffers = &command_buffer;
+
+	in_flight = std::max( in_flight, 1u );
+	std::cout << submission_count << " submissions" << std::endl;
+
+	// Blocking, the submitting thread is parked in every wait
 	{
-		VkPipelineStageFlags flags[] { VK_PIPELINE_STAGE_ALL_COMMANDS_BIT };
-		VkSubmitInfo submit_info {};
-		submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-		submit_info.commandBufferCount = 1;
-		submit_info.pCommandBuffers = &command_buffer[1];
-		submit_info.waitSemaphoreCount = 1;
-		submit_info.pWaitSemaphores = &semaphore;
-		submit_info.pWaitDstStageMask = flags;
+		VkFence fence;
+		VkFenceCreateInfo fence_info {};
+		fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+		vkResultErrorCheck( vkCreateFence( device, &fence_info, allocator, &fence ) );
+
+		double blocked_ms = 0.0;
+		auto start = std::chrono::high_resolution_clock::now();
+
+		for( uint32_t i = 0; i < submission_count; i++ ) {
+			submission_queue->Submit( 1, &submit_info, fence );
+
+			auto wait_start = std::chrono::high_resolution_clock::now();
+			vkResultErrorCheck( vkWaitForFences( device, 1, &fence, VK_TRUE, UINT64_MAX ) );
+			blocked_ms += std::chrono::duration<double, std::milli>( std::chrono::high_resolution_clock::now() - wait_start ).count();
+
+			vkResultErrorCheck( vkResetFences( device, 1, &fence ) );
+		}
+
+		double total_ms = std::chrono::duration<double, std::milli>( std::chrono::high_resolution_clock::now() - start ).count();
+		std::cout << std::fixed << std::setprecision( 2 ) << "  blocking waits: " << total_ms << " ms, submitting thread blocked for "
+			<< blocked_ms << " ms (" << ( total_ms > 0.0 ? 100.0 * blocked_ms / total_ms : 0.0 ) << "%)" << std::endl;
 
-		vkQueueSubmit( r.getQueue(), 1, &submit_info, VK_NULL_HANDLE );
+		vkDestroyFence( device, fence, allocator );
 	}
 
+	// Reactor, the submitting thread only submits and is free whenever in_flight submissions are outstanding
+	{
+		CompletionReactor reactor( &r );
+		std::atomic<uint32_t> completed( 0 );
 
-	// Wait for device idle
-	vkQueueWaitIdle( r.getQueue() );
+		uint32_t submitted = 0;
+		uint64_t free_polls = 0;
+		double submit_ms = 0.0;
+		auto start = std::chrono::high_resolution_clock::now();
 
-	// Detroy created Vulkan objects
-	
-	vkDestroyCommandPool( r.getDevice(), command_pool, nullptr );
-	vkDestroySemaphore( r.getDevice(), semaphore, nullptr );
-	
-	
+		while( submitted < submission_count ) {
+			if( submitted - completed.load() >= in_flight ) {
+				// Where other work would go
+				free_polls++;
+				std::this_thread::yield();
+				continue;
+			}
+
+			auto submit_start = std::chrono::high_resolution_clock::now();
+			reactor.Submit( 1, &submit_info, [&completed]() { completed++; } );
+			submit_ms += std::chrono::duration<double, std::milli>( std::chrono::high_resolution_clock::now() - submit_start ).count();
+			submitted++;
+		}
+
+		reactor.Flush();
+
+		double total_ms = std::chrono::duration<double, std::milli>( std::chrono::high_resolution_clock::now() - start ).count();
+		std::cout << std::fixed << std::setprecision( 2 ) << "  reactor, " << in_flight << " in flight: " << total_ms << " ms, submitting thread spent "
+			<< submit_ms << " ms in submits and polled " << free_polls << " times while free" << std::endl;
+		reactor.PrintStats();
+	}
+
+	vkDestroyCommandPool( device, command_pool, allocator );
+	vkDestroyBuffer( device, buffer, allocator );
+	vkFreeMemory( device, buffer_memory, allocator );
+
+	return 0;
 }
 
-int main()
+// Recording threads each submit packets_per_thread semaphore linked pairs of command buffers per frame, first straight
+// to the queue under a lock, then through the renderer's SubmissionQueue, and compare the submit calls and time spent
+// submitting
+int BenchmarkSubmissionQueue( Renderer &r, uint32_t thread_count, uint32_t frame_count )
 {
+	const uint32_t packets_per_thread = 16;
+
+	VkDevice device = r.getDevice();
+	SubmissionQueue* submission_queue = r.getSubmissionQueue();
+	const VkAllocationCallbacks* allocator = r.getAllocationCallbacks();
+
+	thread_count = std::max( thread_count, 1u );
+	uint32_t packet_count = thread_count * packets_per_thread;
+
+	VkCommandPool command_pool;
+	VkCommandPoolCreateInfo pool_info {};
+	pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	pool_info.queueFamilyIndex = r.getGraphicsFamilyIndex();
+	vkResultErrorCheck( vkCreateCommandPool( device, &pool_info, allocator, &command_pool ) );
+
+	// Recorded once, like the semaphore test, and submitted every frame
+	std::vector<VkCommandBuffer> command_buffers( packet_count * 2 );
+	VkCommandBufferAllocateInfo command_buffer_info {};
+	command_buffer_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	command_buffer_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	command_buffer_info.commandPool = command_pool;
+	command_buffer_info.commandBufferCount = uint32_t( command_buffers.size() );
+	vkResultErrorCheck( vkAllocateCommandBuffers( device, &command_buffer_info, command_buffers.data() ) );
+
+	for( auto command_buffer : command_buffers ) {
+		VkCommandBufferBeginInfo begin_info {};
+		begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		vkResultErrorCheck( vkBeginCommandBuffer( command_buffer, &begin_info ) );
+		vkCmdPipelineBarrier( command_buffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 0, nullptr, 0, nullptr );
+		vkResultErrorCheck( vkEndCommandBuffer( command_buffer ) );
+	}
+
+	std::vector<VkSemaphore> semaphores( packet_count );
+	for( auto &i : semaphores ) {
+		VkSemaphoreCreateInfo semaphore_info {};
+		semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+		vkResultErrorCheck( vkCreateSemaphore( device, &semaphore_info, allocator, &i ) );
+	}
+
+	VkFence fence;
+	VkFenceCreateInfo fence_info {};
+	fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	vkResultErrorCheck( vkCreateFence( device, &fence_info, allocator, &fence ) );
+
+	VkPipelineStageFlags wait_stage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+	auto make_packet = [&]( uint32_t packet, VkSubmitInfo* submit_info ) {
+		submit_info[0] = {};
+		submit_info[0].sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submit_info[0].commandBufferCount = 1;
+		submit_info[0].pCommandBuffers = &command_buffers[packet * 2];
+		submit_info[0].signalSemaphoreCount = 1;
+		submit_info[0].pSignalSemaphores = &semaphores[packet];
+
+		submit_info[1] = {};
+		submit_info[1].sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submit_info[1].commandBufferCount = 1;
+		submit_info[1].pCommandBuffers = &command_buffers[packet * 2 + 1];
+		submit_info[1].waitSemaphoreCount = 1;
+		submit_info[1].pWaitSemaphores = &semaphores[packet];
+		submit_info[1].pWaitDstStageMask = &wait_stage;
+	};
+
+	ThreadPool workers( thread_count );
+	std::cout << thread_count << " recording threads, " << packets_per_thread << " packets each per frame, " << frame_count << " frames" << std::endl;
+
+	for( uint32_t pass = 0; pass < 2; pass++ ) {
+		bool use_service = pass == 1;
+
+		// The direct pass takes the queue from the submission queue for its duration
+		VkQueue queue = VK_NULL_HANDLE;
+		if( use_service ) {
+			submission_queue->ResetStats();
+		}
+		else {
+			queue = submission_queue->AcquireQueue();
+		}
+
+		std::mutex queue_mutex;
+		std::atomic<uint64_t> direct_submits( 0 );
+		std::atomic<uint64_t> submit_ns( 0 );
+
+		auto start = std::chrono::high_resolution_clock::now();
+
+		for( uint32_t frame = 0; frame < frame_count; frame++ ) {
+			for( uint32_t t = 0; t < thread_count; t++ ) {
+				workers.Enqueue( [&, t]() {
+					uint64_t thread_submit_ns = 0;
+
+					for( uint32_t p = 0; p < packets_per_thread; p++ ) {
+						VkSubmitInfo submit_info[2];
+						make_packet( t * packets_per_thread + p, submit_info );
+
+						auto submit_start = std::chrono::high_resolution_clock::now();
+						if( use_service ) {
+							submission_queue->Submit( 2, submit_info );
+						}
+						else {
+							std::lock_guard<std::mutex> lock( queue_mutex );
+							vkResultErrorCheck( vkQueueSubmit( queue, 2, submit_info, VK_NULL_HANDLE ) );
+							direct_submits++;
+						}
+						thread_submit_ns += uint64_t( std::chrono::duration<double, std::nano>( std::chrono::high_resolution_clock::now() - submit_start ).count() );
+					}
+
+					submit_ns += thread_submit_ns;
+				} );
+			}
+			workers.WaitIdle();
+
+			// One frame in flight, so the semaphores can be reused
+			if( use_service ) {
+				submission_queue->Submit( 0, nullptr, fence );
+				submission_queue->EndFrame();
+			}
+			else {
+				vkResultErrorCheck( vkQueueSubmit( queue, 0, nullptr, fence ) );
+				direct_submits++;
+			}
+			vkResultErrorCheck( vkWaitForFences( device, 1, &fence, VK_TRUE, UINT64_MAX ) );
+			vkResultErrorCheck( vkResetFences( device, 1, &fence ) );
+		}
+
+		double total_ms = std::chrono::duration<double, std::milli>( std::chrono::high_resolution_clock::now() - start ).count();
+		double submit_us_per_packet = double( submit_ns.load() ) / 1000.0 / ( double( packet_count ) * std::max( frame_count, 1u ) );
+
+		std::cout << std::fixed << std::setprecision( 2 ) << "  " << ( use_service ? "submission queue" : "direct, locked  " ) << ": " << total_ms << " ms, "
+			<< submit_us_per_packet << " us per packet on the recording threads";
+		if( !use_service ) {
+			std::cout << ", " << double( direct_submits.load() ) / std::max( frame_count, 1u ) << " vkQueueSubmit calls per frame";
+		}
+		std::cout << std::endl;
+
+		if( use_service ) {
+			submission_queue->PrintStats();
+		}
+		else {
+			submission_queue->ReleaseQueue();
+		}
+	}
+
+	vkDestroyFence( device, fence, allocator );
+	for( auto i : semaphores ) {
+		vkDestroySemaphore( device, i, allocator );
+	}
+	vkDestroyCommandPool( device, command_pool, allocator );
+
+	return 0;
+}
+
+static void PrintMeshConvertStats( const MeshConvertStats& stats )
+{
+	std::cout << std::fixed << std::setprecision( 3 ) << "  " << stats.vertex_count << " vertices, " << stats.triangle_count << " triangles" << std::endl
+		<< "  ACMR " << stats.cache_before.acmr << " -> " << stats.cache_after.acmr << ", ATVR " << stats.cache_before.atvr << " -> " << stats.cache_after.atvr
+		<< " (16 entry FIFO), " << stats.overdraw_clusters << " overdraw clusters" << std::endl
+		<< std::setprecision( 6 ) << "  quantization error: position " << stats.quantization.position << ", normal " << stats.quantization.normal_degrees
+		<< " degrees, uv " << stats.quantization.uv << std::endl;
+}
+
+// Offline conversion, no device needed
+int ConvertMeshFile( const std::string& obj_path, const std::string& pack_path )
+{
+	SourceMesh mesh;
+	if( !LoadObjMesh( obj_path, &mesh ) ) {
+		std::cout << "Failed to load " << obj_path << std::endl;
+		return -1;
+	}
+
+	std::string name = obj_path.substr( obj_path.find_last_of( "/\\" ) + 1 );
+	name = name.substr( 0, name.find_last_of( '.' ) );
+
+	MeshPackWriter writer;
+	MeshConvertStats stats;
+	ConvertMesh( name, std::move( mesh ), writer, MeshConvertSettings(), &stats );
+
+	if( !writer.Write( pack_path ) ) {
+		std::cout << "Failed to write " << pack_path << std::endl;
+		return -1;
+	}
+
+	std::cout << "Converted " << obj_path << " to " << pack_path << std::endl;
+	PrintMeshConvertStats( stats );
+	return 0;
+}
+
+// Loads the same mesh from OBJ text and from a mesh pack and compares load time, upload rate and the vertex fetch
+// traffic of the original and optimized index orders. Writes a procedural OBJ first if none is given
+int BenchmarkMeshes( Renderer &r, std::string obj_path )
+{
+	if( obj_path.empty() ) {
+		obj_path = "mesh_benchmark.obj";
+		std::ifstream existing( obj_path );
+		if( !existing ) {
+			std::cout << "Writing test mesh " << obj_path << std::endl;
+			if( !WriteObjMesh( obj_path, GenerateTorusMesh( 768, 384 ) ) ) {
+				std::cout << "Failed to write " << obj_path << std::endl;
+				return -1;
+			}
+		}
+	}
+	std::string pack_path = obj_path + ".mpk";
+
+	auto start = std::chrono::high_resolution_clock::now();
+	SourceMesh mesh;
+	if( !LoadObjMesh( obj_path, &mesh ) ) {
+		std::cout << "Failed to load " << obj_path << std::endl;
+		return -1;
+	}
+	double obj_ms = std::chrono::duration<double, std::milli>( std::chrono::high_resolution_clock::now() - start ).count();
+
+	uint32_t vertex_count = mesh.getVertexCount();
+	uint64_t triangle_count = mesh.indices.size() / 3;
+	VertexCacheStats source_cache = AnalyzeVertexCache( mesh.indices, vertex_count );
+
+	start = std::chrono::high_resolution_clock::now();
+	MeshPackWriter writer;
+	MeshConvertStats stats;
+	ConvertMesh( "benchmark", mesh, writer, MeshConvertSettings(), &stats );
+	if( !writer.Write( pack_path ) ) {
+		std::cout << "Failed to write " << pack_path << std::endl;
+		return -1;
+	}
+	double convert_ms = std::chrono::duration<double, std::milli>( std::chrono::high_resolution_clock::now() - start ).count();
+
+	std::cout << std::fixed << std::setprecision( 2 ) << "OBJ parse: " << obj_ms << " ms, converted in " << convert_ms << " ms" << std::endl;
+	PrintMeshConvertStats( stats );
+
+	MeshBuffers buffers( &r );
+
+	// The first load reads the pack's pages in, later ones come from the page cache
+	for( uint32_t i = 0; i < 3; i++ ) {
+		start = std::chrono::high_resolution_clock::now();
+		MeshPack pack;
+		if( !pack.Open( pack_path ) ) {
+			std::cout << "Failed to open " << pack_path << std::endl;
+			return -1;
+		}
+		double open_ms = std::chrono::duration<double, std::milli>( std::chrono::high_resolution_clock::now() - start ).count();
+
+		buffers.Load( pack );
+		const MeshBufferStats& upload = buffers.getStats();
+		double total_ms = std::chrono::duration<double, std::milli>( std::chrono::high_resolution_clock::now() - start ).count();
+
+		std::cout << std::setprecision( 2 ) << "Pack load " << i << ": open " << open_ms << " ms, upload " << upload.upload_ms << " ms ("
+			<< upload.uploaded_bytes / ( 1024.0 * 1024.0 ) << " MB in " << upload.chunk_count << " chunks, " << upload.staging_copy_ms << " ms copying out of the mapping, "
+			<< ( upload.upload_ms > 0.0 ? upload.uploaded_bytes / ( upload.upload_ms * 1e6 ) : 0.0 ) << " GB/s), " << total_ms << " ms total" << std::endl;
+
+		if( i == 0 ) {
+			const MeshPackMesh& m = pack.getMesh( 0 );
+			for( uint32_t lod = 0; lod < m.lod_count; lod++ ) {
+				const MeshPackLod& l = pack.getLod( 0, lod );
+				std::cout << std::setprecision( 5 ) << "  LOD " << lod << ": " << l.index_count / 3 << " triangles, " << l.meshlet_count << " meshlets, error " << l.error << std::endl;
+			}
+		}
+	}
+	buffers.Unload();
+	r.getDeletionQueue()->Flush();
+
+	// Vertex fetch per draw is roughly one vertex per cache miss plus the indices
+	uint32_t pack_index_size = vertex_count <= 0xFFFF ? 2 : 4;
+	double float_mb = ( triangle_count * source_cache.acmr * 32.0 + triangle_count * 12.0 ) / ( 1024.0 * 1024.0 );
+	double pack_mb = ( triangle_count * stats.cache_after.acmr * sizeof( MeshPackVertex ) + triangle_count * 3.0 * pack_index_size ) / ( 1024.0 * 1024.0 );
+
+	std::cout << std::setprecision( 2 ) << "Vertex data: " << vertex_count * 32.0 / ( 1024.0 * 1024.0 ) << " MB as floats, " << vertex_count * double( sizeof( MeshPackVertex ) ) / ( 1024.0 * 1024.0 )
+		<< " MB quantized" << std::endl
+		<< "Estimated fetch per draw: " << float_mb << " MB for the source order and floats, " << pack_mb << " MB for the pack" << std::endl;
+
+	return 0;
+}
+
+// Compares creating samplers, render passes and framebuffers whenever they are needed with looking them up in an
+// object cache, from one thread and from several, then invalidates the framebuffers of one image view
+int BenchmarkObjectCache( Renderer &r, uint32_t thread_count, uint32_t lookup_count )
+{
+	const uint32_t sampler_count = 32;
+	const uint32_t render_pass_count = 8;
+	const uint32_t view_count = 4;
+
+	VkDevice device = r.getDevice();
+	const VkAllocationCallbacks* allocator = r.getAllocationCallbacks();
+	thread_count = std::max( thread_count, 1u );
+	lookup_count = std::max( lookup_count, 1u );
+
+	std::vector<VkSamplerCreateInfo> sampler_infos( sampler_count );
+	for( uint32_t i = 0; i < sampler_count; i++ ) {
+		VkSamplerCreateInfo& info = sampler_infos[i];
+		info = {};
+		info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+		info.magFilter = ( i & 1 ) ? VK_FILTER_LINEAR : VK_FILTER_NEAREST;
+		info.minFilter = info.magFilter;
+		info.mipmapMode = ( i & 2 ) ? VK_SAMPLER_MIPMAP_MODE_LINEAR : VK_SAMPLER_MIPMAP_MODE_NEAREST;
+		info.addressModeU = ( i & 4 ) ? VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE : VK_SAMPLER_ADDRESS_MODE_REPEAT;
+		info.addressModeV = info.addressModeU;
+		info.addressModeW = info.addressModeU;
+		info.maxLod = float( i >> 3 ) * 4.0f;
+		info.borderColor = VK_BORDER_COLOR_FLOAT_TRANSPARENT_BLACK;
+	}
+
+	// Half of the render passes are compatible with the test views' format
+	std::vector<VkAttachmentDescription> attachments( render_pass_count );
+	for( uint32_t i = 0; i < render_pass_count; i++ ) {
+		VkAttachmentDescription& attachment = attachments[i];
+		attachment = {};
+		attachment.format = ( i & 1 ) ? VK_FORMAT_B8G8R8A8_UNORM : VK_FORMAT_R8G8B8A8_UNORM;
+		attachment.samples = VK_SAMPLE_COUNT_1_BIT;
+		attachment.loadOp = ( i & 2 ) ? VK_ATTACHMENT_LOAD_OP_DONT_CARE : VK_ATTACHMENT_LOAD_OP_CLEAR;
+		attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+		attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+		attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		attachment.finalLayout = ( i & 4 ) ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	}
+
+	VkAttachmentReference color_reference {};
+	color_reference.attachment = 0;
+	color_reference.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+	VkSubpassDescription subpass {};
+	subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+	subpass.colorAttachmentCount = 1;
+	subpass.pColorAttachments = &color_reference;
+
+	std::vector<VkRenderPassCreateInfo> render_pass_infos( render_pass_count );
+	for( uint32_t i = 0; i < render_pass_count; i++ ) {
+		VkRenderPassCreateInfo& info = render_pass_infos[i];
+		info = {};
+		info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+		info.attachmentCount = 1;
+		info.pAttachments = &attachments[i];
+		info.subpassCount = 1;
+		info.pSubpasses = &subpass;
+	}
+
+	std::vector<VkImage> images( view_count );
+	std::vector<VkDeviceMemory> memories( view_count );
+	std::vector<VkImageView> views( view_count );
+	for( uint32_t i = 0; i < view_count; i++ ) {
+		VkImageCreateInfo image_info {};
+		image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		image_info.imageType = VK_IMAGE_TYPE_2D;
+		image_info.format = VK_FORMAT_R8G8B8A8_UNORM;
+		image_info.extent.width = 256;
+		image_info.extent.height = 256;
+		image_info.extent.depth = 1;
+		image_info.mipLevels = 1;
+		image_info.arrayLayers = 1;
+		image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+		image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+		image_info.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+		image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		vkResultErrorCheck( vkCreateImage( device, &image_info, allocator, &images[i] ) );
+		vkResultErrorCheck( AllocateImageMemory( device, allocator, r.getPhysicalDeviceMemoryProperties(), images[i], VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &memories[i] ) );
+
+		VkImageViewCreateInfo view_info {};
+		view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		view_info.image = images[i];
+		view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		view_info.format = image_info.format;
+		view_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		view_info.subresourceRange.levelCount = 1;
+		view_info.subresourceRange.layerCount = 1;
+		vkResultErrorCheck( vkCreateImageView( device, &view_info, allocator, &views[i] ) );
+	}
+
+	{
+		ObjectCache cache( &r );
+
+		// Framebuffers need real render passes, the cache's do
+		std::vector<VkFramebufferCreateInfo> framebuffer_infos;
+		for( uint32_t i = 0; i < render_pass_count; i++ ) {
+			if( attachments[i].format != VK_FORMAT_R8G8B8A8_UNORM ) {
+				continue;
+			}
+			for( uint32_t v = 0; v < view_count; v++ ) {
+				VkFramebufferCreateInfo info {};
+				info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+				info.renderPass = cache.GetRenderPass( render_pass_infos[i] );
+				info.attachmentCount = 1;
+				info.pAttachments = &views[v];
+				info.width = 256;
+				info.height = 256;
+				info.layers = 1;
+				framebuffer_infos.push_back( info );
+			}
+		}
+
+		// Every third request is a sampler, a render pass or a framebuffer, spread over the descriptions
+		auto direct = [&]( uint32_t i ) {
+			uint32_t d = i * 7919u;
+			switch( i % 3 ) {
+			case 0: {
+				VkSampler sampler = VK_NULL_HANDLE;
+				vkResultErrorCheck( vkCreateSampler( device, &sampler_infos[d % sampler_count], allocator, &sampler ) );
+				vkDestroySampler( device, sampler, allocator );
+				break;
+			}
+			case 1: {
+				VkRenderPass render_pass = VK_NULL_HANDLE;
+				vkResultErrorCheck( vkCreateRenderPass( device, &render_pass_infos[d % render_pass_count], allocator, &render_pass ) );
+				vkDestroyRenderPass( device, render_pass, allocator );
+				break;
+			}
+			default: {
+				VkFramebuffer framebuffer = VK_NULL_HANDLE;
+				vkResultErrorCheck( vkCreateFramebuffer( device, &framebuffer_infos[d % framebuffer_infos.size()], allocator, &framebuffer ) );
+				vkDestroyFramebuffer( device, framebuffer, allocator );
+				break;
+			}
+			}
+		};
+
+		auto cached = [&]( uint32_t i ) {
+			uint32_t d = i * 7919u;
+			switch( i % 3 ) {
+			case 0:		return (uint64_t)cache.GetSampler( sampler_infos[d % sampler_count] );
+			case 1:		return (uint64_t)cache.GetRenderPass( render_pass_infos[d % render_pass_count] );
+			default:	return (uint64_t)cache.GetFramebuffer( framebuffer_infos[d % framebuffer_infos.size()] );
+			}
+		};
+
+		// Creating is slow enough that fewer requests give a stable number
+		uint32_t direct_count = std::min( lookup_count, 30000u );
+		auto start = std::chrono::high_resolution_clock::now();
+		for( uint32_t i = 0; i < direct_count; i++ ) {
+			direct( i );
+		}
+		double direct_ns = std::chrono::duration<double, std::nano>( std::chrono::high_resolution_clock::now() - start ).count() / direct_count;
+
+		uint64_t checksum = 0;
+		start = std::chrono::high_resolution_clock::now();
+		for( uint32_t i = 0; i < lookup_count; i++ ) {
+			checksum ^= cached( i );
+		}
+		double cached_ns = std::chrono::duration<double, std::nano>( std::chrono::high_resolution_clock::now() - start ).count() / lookup_count;
+
+		ThreadPool workers( thread_count );
+		std::atomic<uint64_t> thread_checksum( 0 );
+		start = std::chrono::high_resolution_clock::now();
+		for( uint32_t t = 0; t < thread_count; t++ ) {
+			workers.Enqueue( [&, t]() {
+				uint64_t local = 0;
+				for( uint32_t i = t; i < lookup_count; i += thread_count ) {
+					local ^= cached( i );
+				}
+				thread_checksum.fetch_xor( local );
+			} );
+		}
+		workers.WaitIdle();
+		double threaded_ms = std::chrono::duration<double, std::milli>( std::chrono::high_resolution_clock::now() - start ).count();
+
+		std::cout << std::fixed << std::setprecision( 1 ) << sampler_count << " samplers, " << render_pass_count << " render passes and "
+			<< framebuffer_infos.size() << " framebuffers requested in turn" << std::endl
+			<< "  create and destroy: " << direct_ns << " ns per request (" << direct_count << " requests)" << std::endl
+			<< "  cache, 1 thread: " << cached_ns << " ns per lookup (" << lookup_count << " lookups)" << std::endl
+			<< "  cache, " << thread_count << " threads: " << std::setprecision( 2 ) << lookup_count / ( threaded_ms * 1000.0 )
+			<< " M lookups/s, " << threaded_ms << " ms" << ( checksum == thread_checksum.load() ? "" : ", handles differ between runs" ) << std::endl;
+
+		// The framebuffers of the first view have to be created again after it is invalidated
+		cache.InvalidateImageView( views[0] );
+		for( uint32_t i = 0; i < framebuffer_infos.size(); i++ ) {
+			cache.GetFramebuffer( framebuffer_infos[i] );
+		}
+
+		cache.PrintStats();
+	}
+
+	// The cache queued its objects on destruction, the views they use go after them
+	for( uint32_t i = 0; i < view_count; i++ ) {
+		r.getDeletionQueue()->DestroyImageView( views[i] );
+		r.getDeletionQueue()->DestroyImage( images[i] );
+		r.getDeletionQueue()->FreeMemory( memories[i] );
+	}
+	r.getDeletionQueue()->Flush();
+
+	return 0;
+}
+
+int RunSubmitBenchmark( Renderer &r, uint32_t sample_count, const std::string& csv_path, const std::string& baseline_path )
+{
+	SubmitBenchmarkSettings settings;
+	settings.samples = sample_count;
+
+	SubmitBenchmark benchmark( &r, settings );
+	benchmark.Run();
+	benchmark.PrintResults();
+
+	if( !benchmark.WriteCsv( csv_path ) ) {
+		std::cout << "Could not write " << csv_path << std::endl;
+		return 1;
+	}
+	std::cout << "Results written to " << csv_path << std::endl;
+
+	if( baseline_path.empty() ) {
+		return 0;
+	}
+
+	// Timing noise on shared machines is well over 10%, only flag clear slowdowns
+	int regressions = benchmark.CompareWithBaseline( baseline_path, 1.25 );
+	if( regressions < 0 ) {
+		std::cout << "Could not read baseline " << baseline_path << std::endl;
+		return 1;
+	}
+	std::cout << regressions << " regressions against " << baseline_path << std::endl;
+
+	return regressions > 0 ? 1 : 0;
+}
+
+// Usage:
+//   VulkanPlaypen                                        run the tests, then open a window
+//   VulkanPlaypen --capture <trace> [frames]             capture the test workload for a number of frames
+//   VulkanPlaypen --replay <trace> [loops] [timings.csv] replay a trace headless and report timings
+//   VulkanPlaypen --stream-textures <pack> [frames]      stream a texture pack under a memory budget, writing a test pack if missing
+//   VulkanPlaypen --windows <count>                      run the tests, then open several windows presented together
+//   VulkanPlaypen --readback [frames] [png_prefix]       read back an offscreen target every frame, hashing it and writing PNGs
+//   VulkanPlaypen --transforms [nodes] [frames]          benchmark transform hierarchy updates, 100k and 1M nodes by default
+//   VulkanPlaypen --dispatch [commands] [iterations]     compare command recording through loader trampolines and the device table
+//   VulkanPlaypen --reactor [submissions] [in_flight]    compare blocking fence waits with the completion reactor
+//   VulkanPlaypen --submit-thread [threads] [frames]     compare locked submits from recording threads with the submission queue
+//   VulkanPlaypen --convert-mesh <input.obj> <output>    convert an OBJ into a mesh pack
+//   VulkanPlaypen --mesh-benchmark [input.obj]           compare OBJ loading with mesh pack loading and upload
+//   VulkanPlaypen --object-cache [threads] [lookups]     compare creating objects on demand with object cache lookups
+//   VulkanPlaypen --submit-benchmark [samples] [results.csv] [baseline.csv]
+//                                                        measure the submission path, exits with 1 on regressions against the baseline
+//   VulkanPlaypen --dynamic-resolution [target_ms] [fill_passes] [log.csv]
+//                                                        open a window that scales its render resolution to the target GPU time
+int main( int argc, char** argv )
+{
+	std::string mode = argc > 1 ? argv[1] : "";
+
+	if( mode == "--convert-mesh" && argc > 3 ) {
+		return ConvertMeshFile( argv[2], argv[3] );
+	}
+
 	Renderer r;
 
-	TestCommandPoolWithFence( r );
+	if( mode == "--replay" && argc > 2 ) {
+		uint32_t loop_count = argc > 3 ? uint32_t( std::strtoul( argv[3], nullptr, 10 ) ) : 1;
+		return ReplayTrace( r, argv[2], loop_count, argc > 4 ? argv[4] : "" );
+	}
+
+	if( mode == "--stream-textures" && argc > 2 ) {
+		uint32_t stream_frames = argc > 3 ? uint32_t( std::strtoul( argv[3], nullptr, 10 ) ) : 1000;
+		return StreamTextures( r, argv[2], stream_frames );
+	}
+
+	if( mode == "--readback" ) {
+		uint32_t readback_frames = argc > 2 ? uint32_t( std::strtoul( argv[2], nullptr, 10 ) ) : 600;
+		return ReadbackFrames( r, readback_frames, argc > 3 ? argv[3] : "" );
+	}
+
+	if( mode == "--transforms" ) {
+		uint32_t node_count = argc > 2 ? uint32_t( std::strtoul( argv[2], nullptr, 10 ) ) : 0;
+		uint32_t transform_frames = argc > 3 ? uint32_t( std::strtoul( argv[3], nullptr, 10 ) ) : 100;
+		return BenchmarkTransforms( r, node_count, transform_frames );
+	}
+
+	if( mode == "--dispatch" ) {
+		uint32_t command_count = argc > 2 ? uint32_t( std::strtoul( argv[2], nullptr, 10 ) ) : 300000;
+		uint32_t dispatch_iterations = argc > 3 ? uint32_t( std::strtoul( argv[3], nullptr, 10 ) ) : 50;
+		return BenchmarkDispatch( r, command_count, dispatch_iterations );
+	}
+
+	if( mode == "--reactor" ) {
+		uint32_t submission_count = argc > 2 ? uint32_t( std::strtoul( argv[2], nullptr, 10 ) ) : 10000;
+		uint32_t in_flight = argc > 3 ? uint32_t( std::strtoul( argv[3], nullptr, 10 ) ) : 2000;
+		return BenchmarkReactor( r, submission_count, in_flight );
+	}
+
+	if( mode == "--submit-thread" ) {
+		uint32_t thread_count = argc > 2 ? uint32_t( std::strtoul( argv[2], nullptr, 10 ) ) : 4;
+		uint32_t submit_frames = argc > 3 ? uint32_t( std::strtoul( argv[3], nullptr, 10 ) ) : 1000;
+		return BenchmarkSubmissionQueue( r, thread_count, submit_frames );
+	}
+
+	if( mode == "--mesh-benchmark" ) {
+		return BenchmarkMeshes( r, argc > 2 ? argv[2] : "" );
+	}
+
+	if( mode == "--object-cache" ) {
+		uint32_t thread_count = argc > 2 ? uint32_t( std::strtoul( argv[2], nullptr, 10 ) ) : 4;
+		uint32_t lookup_count = argc > 3 ? uint32_t( std::strtoul( argv[3], nullptr, 10 ) ) : 1000000;
+		return BenchmarkObjectCache( r, thread_count, lookup_count );
+	}
+
+	if( mode == "--submit-benchmark" ) {
+		uint32_t sample_count = argc > 2 ? uint32_t( std::strtoul( argv[2], nullptr, 10 ) ) : 1000;
+		return RunSubmitBenchmark( r, sample_count, argc > 3 ? argv[3] : "submit_benchmark.csv", argc > 4 ? argv[4] : "" );
+	}
+
+	uint32_t frame_count = 1;
+	uint32_t window_count = 1;
+	bool dynamic_resolution = false;
+	DynamicResolutionSettings dynamic_resolution_settings;
+	if( mode == "--windows" && argc > 2 ) {
+		window_count = std::max( 1u, uint32_t( std::strtoul( argv[2], nullptr, 10 ) ) );
+	}
+	else if( mode == "--dynamic-resolution" ) {
+		dynamic_resolution = true;
+		if( argc > 2 ) {
+			dynamic_resolution_settings.target_gpu_ms = std::strtod( argv[2], nullptr );
+		}
+		dynamic_resolution_settings.fill_passes = argc > 3 ? uint32_t( std::strtoul( argv[3], nullptr, 10 ) ) : 0;
+		dynamic_resolution_settings.log_path = argc > 4 ? argv[4] : "dynamic_resolution.csv";
+	}
+	else if( mode == "--capture" && argc > 2 ) {
+		if( !r.getCapture()->BeginCapture( argv[2] ) ) {
+			return -1;
+		}
+		frame_count = argc > 3 ? uint32_t( std::strtoul( argv[3], nullptr, 10 ) ) : 60;
+	}
+
+	CompletionReactor test_reactor( &r );
+	FinishedTestObjects finished_test_objects;
 
-	TestCommandPoolWithSemaphore( r );
+	for( uint32_t i = 0; i < frame_count; i++ ) {
+		TestCommandPoolWithFence( r, test_reactor, finished_test_objects );
 
-	r.OpenWindow( 800, 600, "Vulkan Playpen" );
+		TestCommandPoolWithSemaphore( r );
+
+		TestBufferUpload( r );
+
+		DestroyFinishedTestObjects( *r.getCapture(), finished_test_objects );
+
+		r.getCapture()->EndFrame();
+		r.getDeletionQueue()->EndFrame();
+		r.getHostAllocator()->EndFrame();
+	}
+
+	test_reactor.Flush();
+	DestroyFinishedTestObjects( *r.getCapture(), finished_test_objects );
+
+	r.getCapture()->EndCapture();
+
+	r.getDeletionQueue()->PrintStats();
+
+	std::cout << "Driver host allocations, last test frame:" << std::endl;
+	HostAllocator::PrintStats( r.getHostAllocator()->getFrameStats() );
+
+	for( uint32_t i = 0; i < window_count; i++ ) {
+		Window* window = r.OpenWindow( 800, 600, window_count > 1 ? "Vulkan Playpen " + std::to_string( i + 1 ) : "Vulkan Playpen" );
+
+		if( dynamic_resolution && !window->EnableDynamicResolution( dynamic_resolution_settings ) ) {
+			std::cout << "Dynamic resolution needs GPU timestamps and a swapchain format that can be blitted, rendering at full size" << std::endl;
+		}
+	}
+	r.getHostAllocator()->EndFrame();
+
+	// Once warmed up, the frame loop must not allocate host memory through the driver at all
+	const uint32_t warm_up_frames = 3;
+	uint64_t frame = 0;
 
 	while( r.Run() ) {
+		uint64_t allocation_count = r.getHostAllocator()->EndFrame();
+		if( ++frame > warm_up_frames && allocation_count > 0 ) {
+			std::cout << "Frame " << frame << " made " << allocation_count << " driver host allocations" << std::endl;
+			HostAllocator::PrintStats( r.getHostAllocator()->getFrameStats() );
+		}
 
+		if( frame % 300 == 0 ) {
+			r.PrintWindowTimings();
+			r.getSubmissionQueue()->PrintStats();
+		}
 	}
 
+	std::cout << "Driver host allocations, whole run:" << std::endl;
+	r.getHostAllocator()->PrintStats();
+
 	return 0;
 }
\ No newline at end of file